@@ -0,0 +1,16 @@
+#include "bench.h"
+
+#include <stdio.h>
+
+const char *bench_filter = NULL;
+
+int main(int argc, char **argv) {
+  if (argc > 1) {
+    bench_filter = argv[1];
+  }
+  int result = common_benches();
+
+  printf("All benchmarks completed.\n");
+
+  return result;
+}
@@ -0,0 +1,6 @@
+#ifndef BENCH_BENCH_H__
+#define BENCH_BENCH_H__
+
+#include "common/common_benches.h"
+
+#endif // BENCH_BENCH_H__
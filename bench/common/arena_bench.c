@@ -0,0 +1,80 @@
+#include "arena_bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../../common/public/list.h"
+#include "../../common/public/map.h"
+#include "../../common/public/set.h"
+
+#define PHASE_COUNT 20
+#define PHASE_LISTS 2000
+#define PHASE_LIST_LENGTH 50
+#define PHASE_MAP_SIZE 20000
+
+// Everything one "compilation phase" builds.
+struct Phase {
+  List *lists[PHASE_LISTS];
+  Map *map;
+  Set *set;
+};
+
+void _phase_build(struct Phase *phase, Arena *arena) {
+  for (int i = 0; i < PHASE_LISTS; i++) {
+    phase->lists[i] = List_alloc_ext(sizeof(long), arena);
+    for (long j = 0; j < PHASE_LIST_LENGTH; j++) {
+      List_append(phase->lists[i], &j);
+    }
+  }
+  phase->map = Map_alloc_ext(&IntKeyInfo, sizeof(long), arena);
+  phase->set = Set_alloc_ext(&IntKeyInfo, arena);
+  for (int i = 0; i < PHASE_MAP_SIZE; i++) {
+    long value = i;
+    Map_add(phase->map, &i, &value);
+    Set_add(phase->set, &i);
+  }
+}
+
+void _phase_free(struct Phase *phase) {
+  for (int i = 0; i < PHASE_LISTS; i++) {
+    List_free(phase->lists[i]);
+  }
+  Map_free(phase->map);
+  Set_free(phase->set);
+}
+
+// Builds and throws away PHASE_COUNT phases' worth of containers, either
+// freeing each container or resetting one arena per phase.
+void _phases(const char *label, bool use_arena) {
+  static struct Phase phase;
+  Arena *arena = use_arena ? Arena_alloc(0) : NULL;
+  long long build = 0, teardown = 0;
+  for (int p = 0; p < PHASE_COUNT; p++) {
+    long long start = bench_now_ns();
+    _phase_build(&phase, arena);
+    long long built = bench_now_ns();
+    if (use_arena) {
+      Arena_reset(arena);
+    } else {
+      _phase_free(&phase);
+    }
+    build += built - start;
+    teardown += bench_now_ns() - built;
+  }
+  size_t objects = (size_t)PHASE_COUNT *
+                   (PHASE_LISTS * (PHASE_LIST_LENGTH + 1) + 2 * PHASE_MAP_SIZE);
+  printf("%-8s build %8.2f ms/phase  teardown %8.3f ms/phase  (%.1f ns/object "
+         "overall)\n",
+         label, build / 1e6 / PHASE_COUNT, teardown / 1e6 / PHASE_COUNT,
+         (double)(build + teardown) / objects);
+  if (arena) {
+    Arena_free(arena);
+  }
+}
+
+BENCH(arena_phases) {
+  _phases("malloc", false);
+  _phases("arena", true);
+}
+
+int arena_benches(void) { return bench_arena_phases(); }
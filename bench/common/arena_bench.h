@@ -0,0 +1,9 @@
+#ifndef BENCH_COMMON_ARENA_BENCH_H__
+#define BENCH_COMMON_ARENA_BENCH_H__
+
+#include "../../common/public/arena.h"
+#include "../macros.h"
+
+int arena_benches(void);
+
+#endif // BENCH_COMMON_ARENA_BENCH_H__
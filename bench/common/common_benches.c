@@ -0,0 +1,10 @@
+#include "common_benches.h"
+
+#include "../macros.h"
+
+int common_benches(void) {
+  return hash_benches() || map_benches() || arena_benches() || list_benches() ||
+         concurrency_benches() || priority_queue_benches() ||
+         sort_benches() || vector_benches() || logging_benches() ||
+         rope_benches();
+}
@@ -0,0 +1,17 @@
+#ifndef BENCH_COMMON_COMMON_BENCHES_H__
+#define BENCH_COMMON_COMMON_BENCHES_H__
+
+#include "arena_bench.h"
+#include "concurrency_bench.h"
+#include "hash_bench.h"
+#include "list_bench.h"
+#include "logging_bench.h"
+#include "map_bench.h"
+#include "priority_queue_bench.h"
+#include "rope_bench.h"
+#include "sort_bench.h"
+#include "vector_bench.h"
+
+int common_benches(void);
+
+#endif // BENCH_COMMON_COMMON_BENCHES_H__
@@ -0,0 +1,398 @@
+#define _GNU_SOURCE // For pthread_setaffinity_np.
+#include "concurrency_bench.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SPSC_ITEMS 10000000
+#define SPSC_CAPACITY 1024
+#define SPSC_BATCH 64
+#define PING_PONGS 100000
+
+// Pins the calling thread to the `index'th CPU we may run on, so that the two
+// ends of a queue really are on different cores. Does nothing if there aren't
+// that many.
+void _bench_pin_thread(int index) {
+#ifdef __linux__
+  cpu_set_t allowed;
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0 ||
+      CPU_COUNT(&allowed) < 2) {
+    return;
+  }
+  int seen = 0;
+  for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    if (CPU_ISSET(cpu, &allowed) && seen++ == index % CPU_COUNT(&allowed)) {
+      cpu_set_t one;
+      CPU_ZERO(&one);
+      CPU_SET(cpu, &one);
+      pthread_setaffinity_np(pthread_self(), sizeof(one), &one);
+      return;
+    }
+  }
+#endif
+}
+
+// The obvious alternative: a ring guarded by a mutex, with condition variables
+// to wait on.
+typedef struct {
+  pthread_mutex_t lock;
+  pthread_cond_t not_empty;
+  pthread_cond_t not_full;
+  long data[SPSC_CAPACITY];
+  size_t head, tail;
+  bool closed;
+} _LockedRing;
+
+_LockedRing *_locked_ring_alloc(void) {
+  _LockedRing *ring = malloc(sizeof(_LockedRing));
+  pthread_mutex_init(&ring->lock, NULL);
+  pthread_cond_init(&ring->not_empty, NULL);
+  pthread_cond_init(&ring->not_full, NULL);
+  ring->head = ring->tail = 0;
+  ring->closed = false;
+  return ring;
+}
+
+void _locked_ring_free(_LockedRing *ring) {
+  pthread_mutex_destroy(&ring->lock);
+  pthread_cond_destroy(&ring->not_empty);
+  pthread_cond_destroy(&ring->not_full);
+  free(ring);
+}
+
+void _locked_ring_enqueue(_LockedRing *ring, long value) {
+  pthread_mutex_lock(&ring->lock);
+  while (ring->tail - ring->head == SPSC_CAPACITY) {
+    pthread_cond_wait(&ring->not_full, &ring->lock);
+  }
+  ring->data[ring->tail++ % SPSC_CAPACITY] = value;
+  pthread_cond_signal(&ring->not_empty);
+  pthread_mutex_unlock(&ring->lock);
+}
+
+// Returns false once the ring is closed and empty.
+bool _locked_ring_dequeue(_LockedRing *ring, long *value) {
+  pthread_mutex_lock(&ring->lock);
+  while (ring->tail == ring->head && !ring->closed) {
+    pthread_cond_wait(&ring->not_empty, &ring->lock);
+  }
+  bool found = ring->tail != ring->head;
+  if (found) {
+    *value = ring->data[ring->head++ % SPSC_CAPACITY];
+    pthread_cond_signal(&ring->not_full);
+  }
+  pthread_mutex_unlock(&ring->lock);
+  return found;
+}
+
+void _locked_ring_close(_LockedRing *ring) {
+  pthread_mutex_lock(&ring->lock);
+  ring->closed = true;
+  pthread_cond_broadcast(&ring->not_empty);
+  pthread_mutex_unlock(&ring->lock);
+}
+
+void *_locked_ring_producer(void *arg) {
+  _bench_pin_thread(1);
+  for (long i = 0; i < SPSC_ITEMS; i++) {
+    _locked_ring_enqueue(arg, i);
+  }
+  _locked_ring_close(arg);
+  return NULL;
+}
+
+void _locked_ring_throughput(void) {
+  _LockedRing *ring = _locked_ring_alloc();
+  long long start = bench_now_ns();
+  pthread_t producer;
+  pthread_create(&producer, NULL, _locked_ring_producer, ring);
+  long sum = 0, value;
+  while (_locked_ring_dequeue(ring, &value)) {
+    sum += value;
+  }
+  pthread_join(producer, NULL);
+  bench_report_throughput("mutex ring", SPSC_ITEMS, bench_now_ns() - start);
+  _locked_ring_free(ring);
+}
+
+typedef struct {
+  SpscQueue *queue;
+  size_t batch;
+} _SpscRun;
+
+void *_spsc_producer(void *arg) {
+  _SpscRun *run = arg;
+  _bench_pin_thread(1);
+  long batch[SPSC_BATCH];
+  for (long i = 0; i < SPSC_ITEMS; i += run->batch) {
+    for (size_t j = 0; j < run->batch; j++) {
+      batch[j] = i + j;
+    }
+    SpscQueue_enqueue_n_wait(run->queue, batch, run->batch);
+  }
+  SpscQueue_close(run->queue);
+  return NULL;
+}
+
+void _spsc_throughput(const char *label, WaitPolicy wait, size_t batch) {
+  _SpscRun run = {SpscQueue_alloc_ext(sizeof(long), SPSC_CAPACITY, wait),
+                  batch};
+  long long start = bench_now_ns();
+  pthread_t producer;
+  pthread_create(&producer, NULL, _spsc_producer, &run);
+  long values[SPSC_BATCH];
+  long sum = 0;
+  size_t count;
+  while ((count = SpscQueue_dequeue_n_wait(run.queue, values, batch)) > 0) {
+    for (size_t i = 0; i < count; i++) {
+      sum += values[i];
+    }
+  }
+  pthread_join(producer, NULL);
+  bench_report_throughput(label, SPSC_ITEMS, bench_now_ns() - start);
+  SpscQueue_free(run.queue);
+}
+
+BENCH(spsc_queue_throughput) {
+  _bench_pin_thread(0);
+  _locked_ring_throughput();
+  _spsc_throughput("spsc, spin, 1 at a time", WAIT_SPIN, 1);
+  _spsc_throughput("spsc, block, 1 at a time", WAIT_BLOCK, 1);
+  _spsc_throughput("spsc, spin, batches of 64", WAIT_SPIN, SPSC_BATCH);
+  _spsc_throughput("spsc, block, batches of 64", WAIT_BLOCK, SPSC_BATCH);
+}
+
+typedef struct {
+  SpscQueue *ping;
+  SpscQueue *pong;
+} _PingPong;
+
+void *_spsc_echo(void *arg) {
+  _PingPong *pp = arg;
+  _bench_pin_thread(1);
+  long long value;
+  while (SpscQueue_dequeue_wait(pp->ping, &value)) {
+    SpscQueue_enqueue_wait(pp->pong, &value);
+  }
+  return NULL;
+}
+
+// Times a round trip through a pair of queues: one hop there, one hop back.
+void _spsc_latency(const char *label, WaitPolicy wait) {
+  _PingPong pp = {SpscQueue_alloc_ext(sizeof(long long), 64, wait),
+                  SpscQueue_alloc_ext(sizeof(long long), 64, wait)};
+  long long *samples = malloc(PING_PONGS * sizeof(long long));
+  pthread_t echo;
+  pthread_create(&echo, NULL, _spsc_echo, &pp);
+  for (int i = 0; i < PING_PONGS; i++) {
+    long long sent = bench_now_ns(), received;
+    SpscQueue_enqueue_wait(pp.ping, &sent);
+    SpscQueue_dequeue_wait(pp.pong, &received);
+    samples[i] = bench_now_ns() - received;
+  }
+  SpscQueue_close(pp.ping);
+  pthread_join(echo, NULL);
+  bench_report_latency(label, samples, PING_PONGS);
+  free(samples);
+  SpscQueue_free(pp.ping);
+  SpscQueue_free(pp.pong);
+}
+
+BENCH(spsc_queue_latency) {
+  _bench_pin_thread(0);
+  _spsc_latency("spsc round trip, spin", WAIT_SPIN);
+  _spsc_latency("spsc round trip, block", WAIT_BLOCK);
+}
+
+#define MPMC_ITEMS 2000000
+#define MPMC_MAX_THREADS 16
+
+// One side of the contention bench: either an MpmcQueue or a _LockedRing.
+typedef struct {
+  MpmcQueue *queue;
+  _LockedRing *ring;
+  int index;
+  long items; // Producers: how many to add.
+  long sum;   // Consumers: what they removed, summed.
+} _MpmcWorker;
+
+void *_mpmc_producer(void *arg) {
+  _MpmcWorker *worker = arg;
+  _bench_pin_thread(worker->index);
+  for (long i = 0; i < worker->items; i++) {
+    if (worker->queue) {
+      MpmcQueue_enqueue_wait(worker->queue, &i);
+    } else {
+      _locked_ring_enqueue(worker->ring, i);
+    }
+  }
+  return NULL;
+}
+
+void *_mpmc_consumer(void *arg) {
+  _MpmcWorker *worker = arg;
+  _bench_pin_thread(worker->index);
+  long value;
+  if (worker->queue) {
+    while (MpmcQueue_dequeue_wait(worker->queue, &value)) {
+      worker->sum += value;
+    }
+  } else {
+    while (_locked_ring_dequeue(worker->ring, &value)) {
+      worker->sum += value;
+    }
+  }
+  return NULL;
+}
+
+// Runs `threads' producers against `threads' consumers, passing MPMC_ITEMS
+// between them in all, and reports the time per item.
+void _mpmc_contention(int threads, WaitPolicy wait, bool locked) {
+  MpmcQueue *queue =
+      locked ? NULL : MpmcQueue_alloc_ext(sizeof(long), SPSC_CAPACITY, wait);
+  _LockedRing *ring = locked ? _locked_ring_alloc() : NULL;
+  _MpmcWorker producers[MPMC_MAX_THREADS], consumers[MPMC_MAX_THREADS];
+  pthread_t producer_threads[MPMC_MAX_THREADS];
+  pthread_t consumer_threads[MPMC_MAX_THREADS];
+  long long start = bench_now_ns();
+  for (int i = 0; i < threads; i++) {
+    producers[i] = (_MpmcWorker){queue, ring, 2 * i, MPMC_ITEMS / threads, 0};
+    consumers[i] = (_MpmcWorker){queue, ring, 2 * i + 1, 0, 0};
+    pthread_create(&consumer_threads[i], NULL, _mpmc_consumer, &consumers[i]);
+    pthread_create(&producer_threads[i], NULL, _mpmc_producer, &producers[i]);
+  }
+  for (int i = 0; i < threads; i++) {
+    pthread_join(producer_threads[i], NULL);
+  }
+  if (queue) {
+    MpmcQueue_close(queue);
+  } else {
+    _locked_ring_close(ring);
+  }
+  for (int i = 0; i < threads; i++) {
+    pthread_join(consumer_threads[i], NULL);
+  }
+  char label[64];
+  snprintf(label, sizeof(label), "%s, %2d+%-2d threads",
+           locked ? "mutex ring" : wait == WAIT_SPIN ? "mpmc, spin"
+                                                     : "mpmc, block",
+           threads, threads);
+  bench_report_throughput(label, MPMC_ITEMS / threads * threads,
+                          bench_now_ns() - start);
+  if (queue) {
+    MpmcQueue_free(queue);
+  } else {
+    _locked_ring_free(ring);
+  }
+}
+
+BENCH(mpmc_queue_contention) {
+  for (int threads = 1; threads <= MPMC_MAX_THREADS; threads *= 2) {
+    _mpmc_contention(threads, WAIT_SPIN, true);
+    _mpmc_contention(threads, WAIT_SPIN, false);
+    _mpmc_contention(threads, WAIT_BLOCK, false);
+  }
+}
+
+#define STACK_OPS 2000000
+#define STACK_BURST 8
+#define STACK_MAX_THREADS 8
+
+// A Stack behind a mutex, the baseline for AtomicStack.
+typedef struct {
+  pthread_mutex_t lock;
+  Stack *stack;
+} _LockedStack;
+
+typedef struct {
+  AtomicStack *atomic;
+  _LockedStack *locked;
+  int index;
+  long ops; // Push/pop pairs to do.
+} _StackWorker;
+
+// Pushes a burst, then pops a burst, like a shared free list would see.
+void *_stack_worker(void *arg) {
+  _StackWorker *worker = arg;
+  _bench_pin_thread(worker->index);
+  long value = 0;
+  for (long done = 0; done < worker->ops; done += STACK_BURST) {
+    for (int i = 0; i < STACK_BURST; i++, value++) {
+      if (worker->atomic) {
+        AtomicStack_push(worker->atomic, &value);
+      } else {
+        pthread_mutex_lock(&worker->locked->lock);
+        Stack_push(worker->locked->stack, &value);
+        pthread_mutex_unlock(&worker->locked->lock);
+      }
+    }
+    for (int i = 0; i < STACK_BURST; i++) {
+      if (worker->atomic) {
+        AtomicStack_pop(worker->atomic, &value);
+      } else {
+        pthread_mutex_lock(&worker->locked->lock);
+        Stack_pop(worker->locked->stack, &value);
+        pthread_mutex_unlock(&worker->locked->lock);
+      }
+    }
+  }
+  return NULL;
+}
+
+// Runs `threads' threads doing STACK_OPS push/pop pairs between them, and
+// reports the time per pair.
+void _stack_contention(int threads, bool locked) {
+  AtomicStack *atomic = NULL;
+  _LockedStack ls;
+  size_t depth = STACK_BURST * STACK_MAX_THREADS;
+  long value = 0;
+  if (locked) {
+    pthread_mutex_init(&ls.lock, NULL);
+    ls.stack = Stack_alloc(sizeof(long));
+    // Grow it up front, so the timed pushes don't go through Vector_add.
+    for (size_t i = 0; i < depth; i++) {
+      Stack_push(ls.stack, &value);
+    }
+    while (Stack_pop(ls.stack, &value)) {
+    }
+  } else {
+    atomic = AtomicStack_alloc(sizeof(long));
+    AtomicStack_reserve(atomic, depth + STACK_MAX_THREADS);
+  }
+  _StackWorker workers[STACK_MAX_THREADS];
+  pthread_t worker_threads[STACK_MAX_THREADS];
+  long long start = bench_now_ns();
+  for (int i = 0; i < threads; i++) {
+    workers[i] = (_StackWorker){atomic, &ls, i, STACK_OPS / threads};
+    pthread_create(&worker_threads[i], NULL, _stack_worker, &workers[i]);
+  }
+  for (int i = 0; i < threads; i++) {
+    pthread_join(worker_threads[i], NULL);
+  }
+  char label[64];
+  snprintf(label, sizeof(label), "%s, %d threads",
+           locked ? "mutex stack" : "atomic stack", threads);
+  bench_report_throughput(label, STACK_OPS / threads * threads,
+                          bench_now_ns() - start);
+  if (locked) {
+    Stack_free(ls.stack);
+    pthread_mutex_destroy(&ls.lock);
+  } else {
+    AtomicStack_free(atomic);
+  }
+}
+
+BENCH(atomic_stack_contention) {
+  for (int threads = 1; threads <= STACK_MAX_THREADS; threads *= 2) {
+    _stack_contention(threads, true);
+    _stack_contention(threads, false);
+  }
+}
+
+int concurrency_benches(void) {
+  return bench_spsc_queue_throughput() || bench_spsc_queue_latency() ||
+         bench_mpmc_queue_contention() || bench_atomic_stack_contention();
+}
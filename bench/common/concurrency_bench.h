@@ -0,0 +1,12 @@
+#ifndef BENCH_COMMON_CONCURRENCY_BENCH_H__
+#define BENCH_COMMON_CONCURRENCY_BENCH_H__
+
+#include "../../common/public/atomic_stack.h"
+#include "../../common/public/mpmc_queue.h"
+#include "../../common/public/spsc_queue.h"
+#include "../../common/public/stack.h"
+#include "../macros.h"
+
+int concurrency_benches(void);
+
+#endif // BENCH_COMMON_CONCURRENCY_BENCH_H__
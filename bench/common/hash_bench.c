@@ -0,0 +1,135 @@
+#include "hash_bench.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../common/public/iterator.h"
+
+#define DISTRIBUTION_KEY_COUNT (1 << 16)
+#define THROUGHPUT_BYTES (64 << 20)
+
+// The string hashes the CString KeyInfo used before the Hash family, kept here
+// for comparison. The Map took abs() of the result.
+static int _legacy_cstring_hash(const void *key) {
+  int hash = 13;
+  for (char *c = *(char *const *)key; *c; c++) {
+    hash = hash * 7 + 17 * *c;
+  }
+  return hash;
+}
+
+static int _legacy_cstring_case_hash(const void *key) {
+  int hash = 13;
+  for (char *c = *(char *const *)key; *c; c++) {
+    hash = hash * 7 + 17 * toupper(*c);
+  }
+  return hash;
+}
+
+// Distributes `count' keys into as many power-of-two buckets using the low
+// bits of the hash, and reports how far the bucket loads are from uniform.
+static void _distribution(const char *label, char **keys, size_t count,
+                          int (*hash_fn)(const void *)) {
+  size_t *buckets = calloc(count, sizeof(size_t));
+  for (size_t i = 0; i < count; i++) {
+    unsigned int h = (unsigned int)abs(hash_fn(&keys[i]));
+    buckets[h & (count - 1)]++;
+  }
+  // For a uniform hash the chi-square statistic is close to the bucket count,
+  // so the ratio should be near 1.
+  double chi = 0;
+  size_t max = 0, empty = 0;
+  for (size_t i = 0; i < count; i++) {
+    double d = (double)buckets[i] - 1.0;
+    chi += d * d;
+    if (buckets[i] > max) {
+      max = buckets[i];
+    }
+    if (buckets[i] == 0) {
+      empty++;
+    }
+  }
+  printf("%-36s chi2/n %8.3f  max bucket %6zu  empty %5.1f%%\n", label,
+         chi / count, max, 100.0 * empty / count);
+  free(buckets);
+}
+
+static char **_keys(const char *format, size_t count) {
+  char **keys = malloc(count * sizeof(char *));
+  for (size_t i = 0; i < count; i++) {
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), format, i);
+    keys[i] = strdup(buffer);
+  }
+  return keys;
+}
+
+static void _free_keys(char **keys, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    free(keys[i]);
+  }
+  free(keys);
+}
+
+BENCH(hash_distribution) {
+  const char *formats[] = {"%zu", "key_%zu", "/usr/lib/module_%06zu.so"};
+  for (int f = 0; f < 3; f++) {
+    char **keys = _keys(formats[f], DISTRIBUTION_KEY_COUNT);
+    char label[64];
+    printf("keys like \"%s\":\n", formats[f]);
+    snprintf(label, sizeof(label), "  legacy CString_hash");
+    _distribution(label, keys, DISTRIBUTION_KEY_COUNT, _legacy_cstring_hash);
+    snprintf(label, sizeof(label), "  CString_hash");
+    _distribution(label, keys, DISTRIBUTION_KEY_COUNT, CString_hash);
+    snprintf(label, sizeof(label), "  CStringCase_hash");
+    _distribution(label, keys, DISTRIBUTION_KEY_COUNT, CStringCase_hash);
+    _free_keys(keys, DISTRIBUTION_KEY_COUNT);
+  }
+}
+
+// Hashes THROUGHPUT_BYTES worth of `len'-byte strings and reports GB/s.
+static void _throughput(const char *label, size_t len,
+                        int (*hash_fn)(const void *)) {
+  size_t count = THROUGHPUT_BYTES / (len + 1);
+  if (count > (1 << 20)) {
+    count = 1 << 20;
+  }
+  // A few distinct strings, cycled, so the data stays in cache and the bench
+  // measures the hash rather than memory bandwidth.
+  char *strings[16];
+  for (int i = 0; i < 16; i++) {
+    strings[i] = malloc(len + 1);
+    for (size_t j = 0; j < len; j++) {
+      strings[i][j] = "abcdefghijKLMNOPQRST0123456789_-"[(i + j * 7) % 32];
+    }
+    strings[i][len] = '\0';
+  }
+  volatile int sink = 0;
+  long long start = bench_now_ns();
+  for (size_t i = 0; i < count; i++) {
+    sink += hash_fn(&strings[i & 15]);
+  }
+  long long elapsed = bench_now_ns() - start;
+  printf("%-24s len %5zu  %7.2f ns/hash  %6.2f GB/s\n", label, len,
+         (double)elapsed / count, (double)count * len / elapsed);
+  for (int i = 0; i < 16; i++) {
+    free(strings[i]);
+  }
+}
+
+BENCH(hash_throughput) {
+  size_t lengths[] = {4, 8, 16, 32, 64, 256, 4096};
+  for (int i = 0; i < 7; i++) {
+    _throughput("legacy CString_hash", lengths[i], _legacy_cstring_hash);
+    _throughput("CString_hash", lengths[i], CString_hash);
+    _throughput("legacy CStringCase_hash", lengths[i],
+                _legacy_cstring_case_hash);
+    _throughput("CStringCase_hash", lengths[i], CStringCase_hash);
+  }
+}
+
+int hash_benches(void) {
+  return bench_hash_distribution() || bench_hash_throughput();
+}
@@ -0,0 +1,9 @@
+#ifndef BENCH_COMMON_HASH_BENCH_H__
+#define BENCH_COMMON_HASH_BENCH_H__
+
+#include "../../common/public/hash.h"
+#include "../macros.h"
+
+int hash_benches(void);
+
+#endif // BENCH_COMMON_HASH_BENCH_H__
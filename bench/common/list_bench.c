@@ -0,0 +1,266 @@
+#include "list_bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LIST_LENGTH 1000000
+
+// Another allocation made alongside every append, the way a real program
+// interleaves its allocations. Malloc'd nodes end up scattered between these;
+// pooled nodes stay together in their slabs.
+#define NOISE_SIZE 48
+
+void _list_workload(const char *label, List *list) {
+  void **noise = malloc(LIST_LENGTH * sizeof(void *));
+  long long start = bench_now_ns();
+  for (long i = 0; i < LIST_LENGTH; i++) {
+    List_append(list, &i);
+    noise[i] = malloc(NOISE_SIZE);
+  }
+  long long appended = bench_now_ns();
+  long sum = 0;
+  for (int pass = 0; pass < 10; pass++) {
+    for (ListNode *node = List_get_first_node(list); node;
+         node = List_get_next_node(node)) {
+      sum += *(const long *)List_get(node);
+    }
+  }
+  long long iterated = bench_now_ns();
+  // Remove every other node, then refill, so the recycled nodes get reused.
+  ListNode *node = List_get_first_node(list);
+  while (node) {
+    ListNode *next = List_get_next_node(node);
+    List_remove(list, node);
+    node = next ? List_get_next_node(next) : NULL;
+  }
+  for (long i = 0; i < LIST_LENGTH / 2; i++) {
+    List_append(list, &i);
+  }
+  long long churned = bench_now_ns();
+  while (!List_empty(list)) {
+    List_remove_first(list);
+  }
+  long long removed = bench_now_ns();
+
+  printf("%-22s append %6.1f  iterate %5.2f  remove/refill %6.1f  "
+         "remove %6.1f ns/op  (sum %ld)\n",
+         label, (double)(appended - start) / LIST_LENGTH,
+         (double)(iterated - appended) / (10.0 * LIST_LENGTH),
+         (double)(churned - iterated) / LIST_LENGTH,
+         (double)(removed - churned) / LIST_LENGTH, sum);
+  for (long i = 0; i < LIST_LENGTH; i++) {
+    free(noise[i]);
+  }
+  free(noise);
+}
+
+void _forward_list_workload(const char *label, ForwardList *list) {
+  void **noise = malloc(LIST_LENGTH * sizeof(void *));
+  long long start = bench_now_ns();
+  for (long i = 0; i < LIST_LENGTH; i++) {
+    ForwardList_append(list, &i);
+    noise[i] = malloc(NOISE_SIZE);
+  }
+  long long appended = bench_now_ns();
+  long sum = 0;
+  for (int pass = 0; pass < 10; pass++) {
+    for (ForwardListNode *node = ForwardList_get_first_node(list); node;
+         node = ForwardList_get_next_node(node)) {
+      sum += *(const long *)ForwardList_get(node);
+    }
+  }
+  long long iterated = bench_now_ns();
+  while (!ForwardList_empty(list)) {
+    ForwardList_remove_first(list);
+  }
+  long long removed = bench_now_ns();
+
+  printf("%-22s append %6.1f  iterate %5.2f  remove %6.1f ns/op  (sum %ld)\n",
+         label, (double)(appended - start) / LIST_LENGTH,
+         (double)(iterated - appended) / (10.0 * LIST_LENGTH),
+         (double)(removed - iterated) / LIST_LENGTH, sum);
+  for (long i = 0; i < LIST_LENGTH; i++) {
+    free(noise[i]);
+  }
+  free(noise);
+}
+
+BENCH(list_node_pool) {
+  List *list = List_alloc(sizeof(long));
+  _list_workload("List (malloc)", list);
+  List_free(list);
+  list = List_alloc_pooled(sizeof(long), NULL);
+  _list_workload("List (pooled)", list);
+  List_free(list);
+
+  ForwardList *flist = ForwardList_alloc(sizeof(long));
+  _forward_list_workload("ForwardList (malloc)", flist);
+  ForwardList_free(flist);
+  flist = ForwardList_alloc_pooled(sizeof(long), NULL);
+  _forward_list_workload("ForwardList (pooled)", flist);
+  ForwardList_free(flist);
+}
+
+// The mixed workload: passes over a list of MIXED_LENGTH elements that insert
+// a new element after every MIXED_STRIDE-th one and remove one midway between,
+// the way an editor or a lexer's buffer gets patched while it is being read.
+#define MIXED_LENGTH 20000
+#define MIXED_PASSES 20
+#define MIXED_STRIDE 8
+#define SCAN_PASSES 10
+
+void _report_mixed(const char *label, long long start, long long scanned,
+                   long long mixed, long sum) {
+  printf("%-22s scan %5.2f  mixed insert/remove/scan %6.2f ns/elem  "
+         "(sum %ld)\n",
+         label, (double)(scanned - start) / (SCAN_PASSES * LIST_LENGTH),
+         (double)(mixed - scanned) / ((double)MIXED_PASSES * MIXED_LENGTH),
+         sum);
+}
+
+void _list_mixed(void) {
+  List *list = List_alloc_pooled(sizeof(long), NULL);
+  for (long i = 0; i < LIST_LENGTH; i++) {
+    List_append(list, &i);
+  }
+  long sum = 0;
+  long long start = bench_now_ns();
+  for (int pass = 0; pass < SCAN_PASSES; pass++) {
+    for (ListNode *node = List_get_first_node(list); node;
+         node = List_get_next_node(node)) {
+      sum += *(const long *)List_get(node);
+    }
+  }
+  long long scanned = bench_now_ns();
+  List_clear(list);
+  for (long i = 0; i < MIXED_LENGTH; i++) {
+    List_append(list, &i);
+  }
+  for (int pass = 0; pass < MIXED_PASSES; pass++) {
+    long step = 0;
+    ListNode *node = List_get_first_node(list);
+    while (node) {
+      sum += *(const long *)List_get(node);
+      ListNode *next = List_get_next_node(node);
+      if (step % MIXED_STRIDE == 0) {
+        next = List_get_next_node(List_insert_after(list, node, &step));
+      } else if (step % MIXED_STRIDE == MIXED_STRIDE / 2) {
+        List_remove(list, node);
+      }
+      node = next;
+      step++;
+    }
+  }
+  long long mixed = bench_now_ns();
+  _report_mixed("List (pooled)", start, scanned, mixed, sum);
+  List_free(list);
+}
+
+// Vector's mutators currently log the whole vector on every call, which would
+// swamp what is being measured, so the Vector is filled in one call and the
+// mixed phase shifts its elements with memmove directly: the least an insert
+// can cost.
+void _vector_mixed(void) {
+  Vector *vector = Vector_alloc(sizeof(long));
+  long *values = malloc(LIST_LENGTH * sizeof(long));
+  for (long i = 0; i < LIST_LENGTH; i++) {
+    values[i] = i;
+  }
+  Vector_add_range(vector, values, LIST_LENGTH);
+  free(values);
+  long sum = 0;
+  long long start = bench_now_ns();
+  for (int pass = 0; pass < SCAN_PASSES; pass++) {
+    const long *data = Vector_get_data(vector);
+    size_t count = Vector_count(vector);
+    for (size_t i = 0; i < count; i++) {
+      sum += data[i];
+    }
+  }
+  long long scanned = bench_now_ns();
+  // Never more than one element over MIXED_LENGTH, so this never grows.
+  long *data = Vector_get_data(vector);
+  size_t count = MIXED_LENGTH;
+  for (long i = 0; i < MIXED_LENGTH; i++) {
+    data[i] = i;
+  }
+  for (int pass = 0; pass < MIXED_PASSES; pass++) {
+    long step = 0;
+    size_t i = 0;
+    while (i < count) {
+      sum += data[i];
+      if (step % MIXED_STRIDE == 0) {
+        memmove(&data[i + 2], &data[i + 1], (count - i - 1) * sizeof(long));
+        data[i + 1] = step;
+        count++;
+        i += 2;
+      } else if (step % MIXED_STRIDE == MIXED_STRIDE / 2) {
+        memmove(&data[i], &data[i + 1], (count - i - 1) * sizeof(long));
+        count--;
+      } else {
+        i++;
+      }
+      step++;
+    }
+  }
+  long long mixed = bench_now_ns();
+  _report_mixed("Vector (memmove)", start, scanned, mixed, sum);
+  Vector_free(vector);
+}
+
+void _unrolled_list_mixed(void) {
+  UnrolledList *list = UnrolledList_alloc_pooled(sizeof(long), NULL);
+  for (long i = 0; i < LIST_LENGTH; i++) {
+    UnrolledList_append(list, &i);
+  }
+  long sum = 0;
+  UnrolledListCursor cursor;
+  long long start = bench_now_ns();
+  for (int pass = 0; pass < SCAN_PASSES; pass++) {
+    UnrolledList_get_first_cursor(list, &cursor);
+    while (cursor.node) {
+      size_t count;
+      const long *span = UnrolledList_get_span(list, &cursor, &count);
+      for (size_t i = 0; i < count; i++) {
+        sum += span[i];
+      }
+      cursor.index += count - 1;
+      UnrolledList_move_next(&cursor);
+    }
+  }
+  long long scanned = bench_now_ns();
+  UnrolledList_clear(list);
+  for (long i = 0; i < MIXED_LENGTH; i++) {
+    UnrolledList_append(list, &i);
+  }
+  for (int pass = 0; pass < MIXED_PASSES; pass++) {
+    long step = 0;
+    UnrolledList_get_first_cursor(list, &cursor);
+    while (cursor.node) {
+      sum += *(const long *)UnrolledList_get(list, &cursor);
+      if (step % MIXED_STRIDE == 0) {
+        UnrolledList_insert_after(list, &cursor, &step);
+        UnrolledList_move_next(&cursor);
+      } else if (step % MIXED_STRIDE == MIXED_STRIDE / 2) {
+        UnrolledList_remove(list, &cursor);
+      } else {
+        UnrolledList_move_next(&cursor);
+      }
+      step++;
+    }
+  }
+  long long mixed = bench_now_ns();
+  _report_mixed("UnrolledList (pooled)", start, scanned, mixed, sum);
+  UnrolledList_free(list);
+}
+
+BENCH(unrolled_list) {
+  _list_mixed();
+  _vector_mixed();
+  _unrolled_list_mixed();
+}
+
+int list_benches(void) {
+  return bench_list_node_pool() || bench_unrolled_list();
+}
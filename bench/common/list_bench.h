@@ -0,0 +1,12 @@
+#ifndef BENCH_COMMON_LIST_BENCH_H__
+#define BENCH_COMMON_LIST_BENCH_H__
+
+#include "../../common/public/forward_list.h"
+#include "../../common/public/list.h"
+#include "../../common/public/unrolled_list.h"
+#include "../../common/public/vector.h"
+#include "../macros.h"
+
+int list_benches(void);
+
+#endif // BENCH_COMMON_LIST_BENCH_H__
@@ -0,0 +1,107 @@
+#include "logging_bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define LOGGING_VECTOR_OPS 20000000
+#define LOGGING_MAP_OPS 1000000
+#define LOGGING_RECORDS 2000000
+
+#define _LOGGING_STR(x) #x
+#define _LOGGING_XSTR(x) _LOGGING_STR(x)
+#if defined(RELEASE)
+#define LOGGING_BUILD "release"
+#elif defined(LOGLEVEL)
+#define LOGGING_BUILD "LOGLEVEL=" _LOGGING_XSTR(LOGLEVEL)
+#else
+#define LOGGING_BUILD "default"
+#endif
+
+// What logging costs the operations that log on every call, with nothing
+// printed at the build's level. Run the bench_logging script to compare a
+// build with DEBUG logging compiled in against a release build.
+BENCH(logging) {
+  Vector *vector = Vector_alloc(sizeof(int));
+  long long start = bench_now_ns();
+  for (int i = 0; i < LOGGING_VECTOR_OPS; i++) {
+    Vector_add(vector, &i);
+  }
+  long long add = bench_now_ns() - start;
+  long empty = 0;
+  start = bench_now_ns();
+  for (int i = 0; i < LOGGING_VECTOR_OPS; i++) {
+    empty += Vector_empty(vector);
+  }
+  long long is_empty = bench_now_ns() - start;
+  Vector_free(vector);
+
+  Map *map = Map_alloc(&IntKeyInfo, sizeof(long));
+  start = bench_now_ns();
+  for (int i = 0; i < LOGGING_MAP_OPS; i++) {
+    long value = i;
+    Map_add(map, &i, &value);
+  }
+  long long map_add = bench_now_ns() - start;
+  long sum = 0;
+  start = bench_now_ns();
+  for (int i = 0; i < LOGGING_MAP_OPS; i++) {
+    long value;
+    if (Map_get(map, &i, &value)) {
+      sum += value;
+    }
+  }
+  long long map_get = bench_now_ns() - start;
+  Map_free(map);
+
+  printf("%-14s Vector_add %6.2f  Vector_empty %5.2f  Map_add %7.2f  "
+         "Map_get %6.2f ns/op  (%ld, %ld)\n",
+         LOGGING_BUILD, (double)add / LOGGING_VECTOR_OPS,
+         (double)is_empty / LOGGING_VECTOR_OPS,
+         (double)map_add / LOGGING_MAP_OPS, (double)map_get / LOGGING_MAP_OPS,
+         empty, sum);
+}
+
+// A DEBUG line formatted by the caller, as LOG_FORMAT does when the logger
+// isn't running, against the same line copied onto the asynchronous logger's
+// ring. Records go out in bursts of half a ring, so none are dropped; the
+// caller's time leaves out waiting for the drain.
+BENCH(logging_async) {
+  static LogSite site = LOG_SITE_INIT("key %d -> %s (%zu of %zu)");
+  FILE *null = fopen("/dev/null", "w");
+  long long start = bench_now_ns();
+  for (int i = 0; i < LOGGING_RECORDS; i++) {
+    fprintf(null, "%-5s %40s:%-5d: %s"
+                  "key %d -> %s (%zu of %zu)\n",
+            "DEBUG", __FILE__, __LINE__, "", i, "value", (size_t)i,
+            (size_t)LOGGING_RECORDS);
+  }
+  long long formatted = bench_now_ns() - start;
+  fclose(null);
+
+  char path[] = "/tmp/logging_bench_XXXXXX";
+  close(mkstemp(path));
+  Log_start(path);
+  long long caller = 0;
+  start = bench_now_ns();
+  for (int i = 0; i < LOGGING_RECORDS;) {
+    long long burst = bench_now_ns();
+    for (int end = i + LOG_RING_CAPACITY / 2; i < end; i++) {
+      Log_write(&site, DEBUG, 0, i, "value", (size_t)i,
+                (size_t)LOGGING_RECORDS);
+    }
+    caller += bench_now_ns() - burst;
+    Log_flush();
+  }
+  long long drained = bench_now_ns() - start;
+  size_t dropped = Log_dropped();
+  Log_stop();
+  unlink(path);
+
+  printf("fprintf %6.2f  Log_write %6.2f  with drain %6.2f ns/record  "
+         "(%zu dropped)\n",
+         (double)formatted / LOGGING_RECORDS, (double)caller / LOGGING_RECORDS,
+         (double)drained / LOGGING_RECORDS, dropped);
+}
+
+int logging_benches(void) { return bench_logging() || bench_logging_async(); }
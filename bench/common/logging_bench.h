@@ -0,0 +1,11 @@
+#ifndef BENCH_COMMON_LOGGING_BENCH_H__
+#define BENCH_COMMON_LOGGING_BENCH_H__
+
+#include "../../common/public/log.h"
+#include "../../common/public/map.h"
+#include "../../common/public/vector.h"
+#include "../macros.h"
+
+int logging_benches(void);
+
+#endif // BENCH_COMMON_LOGGING_BENCH_H__
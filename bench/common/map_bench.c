@@ -0,0 +1,137 @@
+#include "map_bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INSERT_COUNT (1 << 20)
+#define STRING_KEY_COUNT 200000
+#define STRING_KEY_LENGTH 256
+
+// Times every Map_add while the map grows from empty past INSERT_COUNT.
+void _map_insert_latency(const char *label, bool incremental) {
+  long long *samples = malloc(INSERT_COUNT * sizeof(long long));
+  Map *m = Map_alloc(&IntKeyInfo, sizeof(long));
+  Map_incremental_rehash(m, incremental);
+  long long start = bench_now_ns();
+  for (int i = 0; i < INSERT_COUNT; i++) {
+    long value = i;
+    long long t = bench_now_ns();
+    Map_add(m, &i, &value);
+    samples[i] = bench_now_ns() - t;
+  }
+  long long elapsed = bench_now_ns() - start;
+  bench_report_latency(label, samples, INSERT_COUNT);
+  bench_report_throughput(label, INSERT_COUNT, elapsed);
+  Map_free(m);
+  free(samples);
+}
+
+// Times every Set_add while the set grows from empty past INSERT_COUNT.
+void _set_insert_latency(const char *label, bool incremental) {
+  long long *samples = malloc(INSERT_COUNT * sizeof(long long));
+  Set *s = Set_alloc(&IntKeyInfo);
+  Set_incremental_rehash(s, incremental);
+  long long start = bench_now_ns();
+  for (int i = 0; i < INSERT_COUNT; i++) {
+    long long t = bench_now_ns();
+    Set_add(s, &i);
+    samples[i] = bench_now_ns() - t;
+  }
+  long long elapsed = bench_now_ns() - start;
+  bench_report_latency(label, samples, INSERT_COUNT);
+  bench_report_throughput(label, INSERT_COUNT, elapsed);
+  Set_free(s);
+  free(samples);
+}
+
+// The worst-case insert should drop from a full O(n) rehash to a bounded
+// number of slot (or bucket) moves when rehashing incrementally.
+BENCH(map_insert_latency) {
+  _map_insert_latency("Map_add (rehash all at once)", false);
+  _map_insert_latency("Map_add (incremental rehash)", true);
+  _set_insert_latency("Set_add (rehash all at once)", false);
+  _set_insert_latency("Set_add (incremental rehash)", true);
+}
+
+// Builds `count' distinct keys of STRING_KEY_LENGTH characters that share a
+// long common prefix, so every hash and every full comparison walks the
+// whole string.
+char **_long_string_keys(const char *tag, int count) {
+  char **keys = malloc(count * sizeof(char *));
+  char *data = malloc((size_t)count * (STRING_KEY_LENGTH + 1));
+  for (int i = 0; i < count; i++) {
+    keys[i] = data + (size_t)i * (STRING_KEY_LENGTH + 1);
+    memset(keys[i], 'k', STRING_KEY_LENGTH);
+    snprintf(keys[i] + STRING_KEY_LENGTH - 16, 17, "%6s%010d", tag, i);
+  }
+  return keys;
+}
+
+void _free_long_string_keys(char **keys) {
+  free(keys[0]);
+  free(keys);
+}
+
+BENCH(map_long_string_keys) {
+  char **keys = _long_string_keys("hit", STRING_KEY_COUNT);
+  char **misses = _long_string_keys("miss", STRING_KEY_COUNT);
+  long long start;
+  size_t found = 0;
+
+  Map *m = Map_alloc(&CStringKeyInfo, sizeof(int));
+  start = bench_now_ns();
+  for (int i = 0; i < STRING_KEY_COUNT; i++) {
+    Map_add(m, &keys[i], &i);
+  }
+  bench_report_throughput("Map_add (256-char keys)", STRING_KEY_COUNT,
+                          bench_now_ns() - start);
+  start = bench_now_ns();
+  for (int i = 0; i < STRING_KEY_COUNT; i++) {
+    found += Map_contains_key(m, &keys[i]);
+  }
+  bench_report_throughput("Map_contains_key (hit)", STRING_KEY_COUNT,
+                          bench_now_ns() - start);
+  start = bench_now_ns();
+  for (int i = 0; i < STRING_KEY_COUNT; i++) {
+    found += Map_contains_key(m, &misses[i]);
+  }
+  bench_report_throughput("Map_contains_key (miss)", STRING_KEY_COUNT,
+                          bench_now_ns() - start);
+  start = bench_now_ns();
+  for (int i = 0; i < STRING_KEY_COUNT; i++) {
+    Map_delete(m, &keys[i]);
+  }
+  bench_report_throughput("Map_delete", STRING_KEY_COUNT,
+                          bench_now_ns() - start);
+  Map_free(m);
+
+  Set *s = Set_alloc(&CStringKeyInfo);
+  start = bench_now_ns();
+  for (int i = 0; i < STRING_KEY_COUNT; i++) {
+    Set_add(s, &keys[i]);
+  }
+  bench_report_throughput("Set_add (256-char keys)", STRING_KEY_COUNT,
+                          bench_now_ns() - start);
+  start = bench_now_ns();
+  for (int i = 0; i < STRING_KEY_COUNT; i++) {
+    found += Set_contains(s, &keys[i]);
+  }
+  bench_report_throughput("Set_contains (hit)", STRING_KEY_COUNT,
+                          bench_now_ns() - start);
+  start = bench_now_ns();
+  for (int i = 0; i < STRING_KEY_COUNT; i++) {
+    found += Set_contains(s, &misses[i]);
+  }
+  bench_report_throughput("Set_contains (miss)", STRING_KEY_COUNT,
+                          bench_now_ns() - start);
+  Set_free(s);
+
+  printf("(%zu keys found)\n", found);
+  _free_long_string_keys(keys);
+  _free_long_string_keys(misses);
+}
+
+int map_benches(void) {
+  return bench_map_insert_latency() || bench_map_long_string_keys();
+}
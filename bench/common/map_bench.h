@@ -0,0 +1,10 @@
+#ifndef BENCH_COMMON_MAP_BENCH_H__
+#define BENCH_COMMON_MAP_BENCH_H__
+
+#include "../../common/public/map.h"
+#include "../../common/public/set.h"
+#include "../macros.h"
+
+int map_benches(void);
+
+#endif // BENCH_COMMON_MAP_BENCH_H__
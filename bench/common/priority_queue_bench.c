@@ -0,0 +1,116 @@
+#include "priority_queue_bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define PQ_MIN_SIZE 1000
+#define PQ_MAX_SIZE 10000000
+#define PQ_MIXED_OPS 1000000
+
+static unsigned int _pq_seed = 1;
+
+static int _pq_random_key(void) {
+  _pq_seed = _pq_seed * 1103515245 + 12345;
+  return (int)(_pq_seed >> 1);
+}
+
+// Fills a heap of `size' int keys and values, runs PQ_MIXED_OPS
+// dequeue/enqueue pairs on it at that size, as Dijkstra or a list scheduler
+// would, then drains it.
+void _pq_workload(size_t size, size_t arity) {
+  PriorityQueue *queue = PriorityQueue_alloc_ext(
+      &IntRelationalKeyInfo, sizeof(int), PQ_MODE_SMALLEST_FIRST, arity);
+  _pq_seed = 1;
+  long long start = bench_now_ns();
+  for (size_t i = 0; i < size; i++) {
+    int key = _pq_random_key(), value = (int)i;
+    PriorityQueue_enqueue(queue, &key, &value);
+  }
+  long long filled = bench_now_ns();
+  long sum = 0;
+  for (int i = 0; i < PQ_MIXED_OPS; i++) {
+    int key, value;
+    PriorityQueue_dequeue(queue, &key, &value);
+    sum += value;
+    // Later keys are mostly larger, the way priorities tend to grow.
+    key += _pq_random_key() >> 8;
+    PriorityQueue_enqueue(queue, &key, &value);
+  }
+  long long mixed = bench_now_ns();
+  int key, value;
+  while (PriorityQueue_dequeue(queue, &key, &value)) {
+    sum += value;
+  }
+  long long drained = bench_now_ns();
+  printf("%9zu %d-ary  enqueue %6.1f  dequeue+enqueue %6.1f  "
+         "dequeue %6.1f ns/op  (sum %ld)\n",
+         size, (int)arity, (double)(filled - start) / size,
+         (double)(mixed - filled) / PQ_MIXED_OPS,
+         (double)(drained - mixed) / size, sum);
+  PriorityQueue_free(queue);
+}
+
+BENCH(priority_queue_arity) {
+  for (size_t size = PQ_MIN_SIZE; size <= PQ_MAX_SIZE; size *= 10) {
+    _pq_workload(size, 2);
+    _pq_workload(size, 4);
+    _pq_workload(size, 8);
+  }
+}
+
+#define PQ_BULK_SIZE 1000000
+
+// Iterates an array of KeyValuePair, without going through a Vector.
+static void *_pq_kvp_current(const Iterator *iter) {
+  return (KeyValuePair *)iter->collection + iter->impl_data1;
+}
+
+static bool _pq_kvp_eof(const Iterator *iter) {
+  return iter->impl_data1 >= iter->impl_data2;
+}
+
+static bool _pq_kvp_move_next(Iterator *iter) {
+  iter->impl_data1++;
+  return !_pq_kvp_eof(iter);
+}
+
+// Loads PQ_BULK_SIZE items one enqueue at a time, then all at once.
+BENCH(priority_queue_bulk) {
+  int *keys = malloc(PQ_BULK_SIZE * sizeof(int));
+  KeyValuePair *items = malloc(PQ_BULK_SIZE * sizeof(KeyValuePair));
+  _pq_seed = 1;
+  for (int i = 0; i < PQ_BULK_SIZE; i++) {
+    keys[i] = _pq_random_key();
+    items[i] = (KeyValuePair){&keys[i], &keys[i]};
+  }
+  for (size_t arity = 2; arity <= 8; arity *= 2) {
+    PriorityQueue *queue = PriorityQueue_alloc_ext(
+        &IntRelationalKeyInfo, sizeof(int), PQ_MODE_SMALLEST_FIRST, arity);
+    long long start = bench_now_ns();
+    for (int i = 0; i < PQ_BULK_SIZE; i++) {
+      PriorityQueue_enqueue(queue, &keys[i], &keys[i]);
+    }
+    long long one_by_one = bench_now_ns() - start;
+    PriorityQueue_clear(queue);
+    Iterator iter = {.collection = items,
+                     .elem_size = sizeof(KeyValuePair),
+                     .current = _pq_kvp_current,
+                     .move_next = _pq_kvp_move_next,
+                     .eof = _pq_kvp_eof,
+                     .impl_data1 = -1,
+                     .impl_data2 = PQ_BULK_SIZE};
+    start = bench_now_ns();
+    PriorityQueue_from_iterator(queue, &iter);
+    long long bulk = bench_now_ns() - start;
+    printf("%d-ary  enqueue each %6.1f  from_iterator %6.1f ns/item\n",
+           (int)arity, (double)one_by_one / PQ_BULK_SIZE,
+           (double)bulk / PQ_BULK_SIZE);
+    PriorityQueue_free(queue);
+  }
+  free(items);
+  free(keys);
+}
+
+int priority_queue_benches(void) {
+  return bench_priority_queue_arity() || bench_priority_queue_bulk();
+}
@@ -0,0 +1,9 @@
+#ifndef BENCH_COMMON_PRIORITY_QUEUE_BENCH_H__
+#define BENCH_COMMON_PRIORITY_QUEUE_BENCH_H__
+
+#include "../../common/public/priority_queue.h"
+#include "../macros.h"
+
+int priority_queue_benches(void);
+
+#endif // BENCH_COMMON_PRIORITY_QUEUE_BENCH_H__
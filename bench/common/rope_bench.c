@@ -0,0 +1,87 @@
+#include "rope_bench.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define ROPE_BENCH_LINES 2000000
+
+// Appends a line the way String_cat_c_str does: find the end with strlen,
+// realloc to fit, then strcat, which finds the end again.
+static char *_rope_bench_strcat(char *str, const char *line) {
+  size_t length = str ? strlen(str) : 0;
+  str = realloc(str, length + strlen(line) + 1);
+  str[length] = '\0';
+  strcat(str, line);
+  return str;
+}
+
+// Emits `lines' lines of assembly by strcat, then into a Rope.
+static void _rope_bench_build(size_t lines, bool with_strcat) {
+  char line[64];
+  long long strcat_ns = 0;
+  if (with_strcat) {
+    char *str = NULL;
+    long long start = bench_now_ns();
+    for (size_t i = 0; i < lines; i++) {
+      snprintf(line, sizeof(line), "\tmovq %%rax, %zu(%%rbp)\n", i);
+      str = _rope_bench_strcat(str, line);
+    }
+    strcat_ns = bench_now_ns() - start;
+    free(str);
+  }
+
+  Rope *rope = Rope_alloc();
+  long long start = bench_now_ns();
+  for (size_t i = 0; i < lines; i++) {
+    Rope_append_format(rope, "\tmovq %%rax, %zu(%%rbp)\n", i);
+  }
+  long long rope_ns = bench_now_ns() - start;
+  if (with_strcat) {
+    printf("%8zu lines  strcat %10.2f ms  Rope_append_format %8.2f ms\n",
+           lines, strcat_ns / 1e6, rope_ns / 1e6);
+  } else {
+    printf("%8zu lines  %20s  Rope_append_format %8.2f ms\n", lines, "",
+           rope_ns / 1e6);
+  }
+  Rope_free(rope);
+}
+
+// Building: realloc-and-strcat is quadratic, appending to a Rope linear.
+BENCH(rope_build) {
+  for (size_t lines = 12500; lines <= 50000; lines *= 2) {
+    _rope_bench_build(lines, true);
+  }
+  _rope_bench_build(ROPE_BENCH_LINES, false);
+}
+
+// Writing a big Rope out: flattened and written at once, or handed to writev
+// a chunk at a time without copying.
+BENCH(rope_write) {
+  Rope *rope = Rope_alloc();
+  for (size_t i = 0; i < ROPE_BENCH_LINES; i++) {
+    Rope_append_format(rope, "\tmovq %%rax, %zu(%%rbp)\n", i);
+  }
+  RopeView all = Rope_view(rope, 0, Rope_length(rope));
+  int fd = open("/dev/null", O_WRONLY);
+
+  long long start = bench_now_ns();
+  char *flat = Rope_flatten(rope);
+  ssize_t written = write(fd, flat, all.length);
+  long long flatten_ns = bench_now_ns() - start;
+  free(flat);
+
+  start = bench_now_ns();
+  bool ok = RopeView_write(all, fd);
+  long long writev_ns = bench_now_ns() - start;
+
+  printf("%zu bytes  flatten + write %.2f ms  RopeView_write %.2f ms  "
+         "(%zd, %d)\n",
+         all.length, flatten_ns / 1e6, writev_ns / 1e6, written, ok);
+  close(fd);
+  Rope_free(rope);
+}
+
+int rope_benches(void) { return bench_rope_build() || bench_rope_write(); }
@@ -0,0 +1,9 @@
+#ifndef BENCH_COMMON_ROPE_BENCH_H__
+#define BENCH_COMMON_ROPE_BENCH_H__
+
+#include "../../common/public/rope.h"
+#include "../macros.h"
+
+int rope_benches(void);
+
+#endif // BENCH_COMMON_ROPE_BENCH_H__
@@ -0,0 +1,147 @@
+#include "sort_bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SORT_MIN_SIZE 10000
+#define SORT_MAX_SIZE 10000000
+#define SORT_STRING_SIZE 1000000
+
+static unsigned long long _sort_seed = 1;
+
+static unsigned long long _sort_random(void) {
+  _sort_seed = _sort_seed * 6364136223846793005ull + 1442695040888963407ull;
+  return _sort_seed >> 11;
+}
+
+// Times qsort against Indexer_sort on an Array holding copies of `source',
+// which picks the kernel for `compare_fn' on its own.
+static void _sort_compare(const char *label, const void *source, size_t count,
+                          size_t elem_size,
+                          int (*compare_fn)(const void *a, const void *b)) {
+  Array *array = Array_alloc(count, elem_size);
+  Indexer indexer;
+  Array_get_indexer(array, &indexer);
+
+  memcpy(Array_get_data(array), source, count * elem_size);
+  long long start = bench_now_ns();
+  qsort(Array_get_data(array), count, elem_size, compare_fn);
+  long long with_qsort = bench_now_ns() - start;
+
+  memcpy(Array_get_data(array), source, count * elem_size);
+  start = bench_now_ns();
+  Indexer_sort(&indexer, compare_fn);
+  long long with_kernel = bench_now_ns() - start;
+
+  printf("%9zu %-22s qsort %7.1f  Indexer_sort %7.1f ns/elem  (%.1fx)\n",
+         count, label, (double)with_qsort / count,
+         (double)with_kernel / count, (double)with_qsort / with_kernel);
+  Array_free(array);
+}
+
+BENCH(sort_kernels) {
+  int *ints = malloc(SORT_MAX_SIZE * sizeof(int));
+  int *small = malloc(SORT_MAX_SIZE * sizeof(int));
+  unsigned long *longs = malloc(SORT_MAX_SIZE * sizeof(unsigned long));
+  double *doubles = malloc(SORT_MAX_SIZE * sizeof(double));
+  for (size_t i = 0; i < SORT_MAX_SIZE; i++) {
+    unsigned long long r = _sort_random();
+    ints[i] = (int)r;
+    small[i] = (int)(r % 1000) - 500;
+    longs[i] = (unsigned long)r;
+    doubles[i] = ((double)(r >> 11) - (double)(1ull << 52)) / 1e6;
+  }
+  for (size_t size = SORT_MIN_SIZE; size <= SORT_MAX_SIZE; size *= 10) {
+    _sort_compare("int", ints, size, sizeof(int), Int_compare);
+    _sort_compare("int in [-500, 500)", small, size, sizeof(int), Int_compare);
+    _sort_compare("unsigned long", longs, size, sizeof(unsigned long),
+                  UnsignedLong_compare);
+    _sort_compare("double", doubles, size, sizeof(double), Double_compare);
+  }
+  free(doubles);
+  free(longs);
+  free(small);
+  free(ints);
+}
+
+// Strings go through the introsort kernel, which only saves the indirect
+// calls; strcmp itself still dominates.
+BENCH(sort_strings) {
+  char *text = malloc(SORT_STRING_SIZE * 16);
+  char **strings = malloc(SORT_STRING_SIZE * sizeof(char *));
+  for (size_t i = 0; i < SORT_STRING_SIZE; i++) {
+    strings[i] = text + i * 16;
+    snprintf(strings[i], 16, "key%012llu", _sort_random() % 1000000000000ull);
+  }
+  _sort_compare("char *", strings, SORT_STRING_SIZE, sizeof(char *),
+                CString_compare);
+  free(strings);
+  free(text);
+}
+
+#define SORT_SYMBOL_SIZE 2000000
+
+// Shaped like a linker's symbol table: sorted by address, through a compare
+// function that has no kernel.
+struct _SortSymbol {
+  unsigned long address;
+  unsigned int name;
+  unsigned int section;
+};
+
+static int _sort_symbol_compare(const void *a, const void *b) {
+  unsigned long x = ((const struct _SortSymbol *)a)->address;
+  unsigned long y = ((const struct _SortSymbol *)b)->address;
+  return (x > y) - (x < y);
+}
+
+static void _sort_parallel(const char *label, const void *source, size_t count,
+                           size_t elem_size, ThreadPool *pool,
+                           int (*compare_fn)(const void *a, const void *b)) {
+  Array *array = Array_alloc(count, elem_size);
+  Indexer indexer;
+  Array_get_indexer(array, &indexer);
+
+  memcpy(Array_get_data(array), source, count * elem_size);
+  long long start = bench_now_ns();
+  Indexer_sort(&indexer, compare_fn);
+  long long sequential = bench_now_ns() - start;
+
+  memcpy(Array_get_data(array), source, count * elem_size);
+  start = bench_now_ns();
+  Indexer_parallel_sort(&indexer, compare_fn, pool);
+  long long parallel = bench_now_ns() - start;
+
+  printf("%9zu %-10s %2zu threads  Indexer_sort %6.1f  "
+         "Indexer_parallel_sort %6.1f ns/elem  (%.1fx)\n",
+         count, label, ThreadPool_thread_count(pool) + 1,
+         (double)sequential / count, (double)parallel / count,
+         (double)sequential / parallel);
+  Array_free(array);
+}
+
+BENCH(sort_parallel) {
+  ThreadPool *pool = ThreadPool_alloc(0, 64);
+  int *ints = malloc(SORT_MAX_SIZE * sizeof(int));
+  struct _SortSymbol *symbols =
+      malloc(SORT_SYMBOL_SIZE * sizeof(struct _SortSymbol));
+  for (size_t i = 0; i < SORT_MAX_SIZE; i++) {
+    ints[i] = (int)_sort_random();
+  }
+  for (size_t i = 0; i < SORT_SYMBOL_SIZE; i++) {
+    symbols[i].address = _sort_random() & ~15ul;
+    symbols[i].name = (unsigned int)i;
+    symbols[i].section = (unsigned int)(i % 7);
+  }
+  _sort_parallel("int", ints, SORT_MAX_SIZE, sizeof(int), pool, Int_compare);
+  _sort_parallel("symbol", symbols, SORT_SYMBOL_SIZE,
+                 sizeof(struct _SortSymbol), pool, _sort_symbol_compare);
+  free(symbols);
+  free(ints);
+  ThreadPool_free(pool);
+}
+
+int sort_benches(void) {
+  return bench_sort_kernels() || bench_sort_strings() || bench_sort_parallel();
+}
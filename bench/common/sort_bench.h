@@ -0,0 +1,10 @@
+#ifndef BENCH_COMMON_SORT_BENCH_H__
+#define BENCH_COMMON_SORT_BENCH_H__
+
+#include "../../common/public/array.h"
+#include "../../common/public/sort.h"
+#include "../macros.h"
+
+int sort_benches(void);
+
+#endif // BENCH_COMMON_SORT_BENCH_H__
@@ -0,0 +1,259 @@
+#include "vector_bench.h"
+
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define VECTOR_APPENDS 100000000
+
+// Gets the resident set size, in KiB.
+static long _vector_rss_kib(void) {
+  long pages = 0;
+  FILE *statm = fopen("/proc/self/statm", "r");
+  if (statm) {
+    if (fscanf(statm, "%*ld %ld", &pages) != 1) {
+      pages = 0;
+    }
+    fclose(statm);
+  }
+  return pages * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+// Appends VECTOR_APPENDS ints under `growth' in a child process, so that its
+// peak RSS is its own. A busy heap keeps malloc from using mmap, and puts a
+// block after the vector's each time it grows, so realloc can't extend it in
+// place, as in a long-running process with a fragmented heap. The blocks are
+// too big for the holes older buffers left, and never touched, so they add
+// no RSS themselves.
+static void _vector_growth_workload(const char *label, VectorGrowth growth,
+                                    bool busy) {
+  fflush(stdout);
+  pid_t child = fork();
+  if (child == 0) {
+    if (busy) {
+      mallopt(M_MMAP_MAX, 0);
+    }
+    long rss_before = _vector_rss_kib();
+    Vector *vector = Vector_alloc(sizeof(int));
+    Vector_set_growth(vector, growth);
+    size_t capacity = 0;
+    long long start = bench_now_ns();
+    for (int i = 0; i < VECTOR_APPENDS; i++) {
+      Vector_add(vector, &i);
+      if (busy && Vector_capacity(vector) != capacity) {
+        capacity = Vector_capacity(vector);
+        // Leaked; the child exits soon.
+        if (!malloc(2 * capacity * sizeof(int))) {
+          break;
+        }
+      }
+    }
+    long long elapsed = bench_now_ns() - start;
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    printf("%-8s %-10s %5.2f ns/append  peak RSS %5ld MiB for %ld MiB of data  "
+           "capacity %zu\n",
+           label, busy ? "busy heap" : "fresh heap", (double)elapsed / VECTOR_APPENDS,
+           (usage.ru_maxrss - rss_before) / 1024,
+           (long)(VECTOR_APPENDS * sizeof(int) >> 20),
+           Vector_capacity(vector));
+    Vector_free(vector);
+    fflush(stdout);
+    _exit(0);
+  }
+  if (child > 0) {
+    waitpid(child, NULL, 0);
+  }
+}
+
+BENCH(vector_growth) {
+  for (int busy = 0; busy < 2; busy++) {
+    _vector_growth_workload("double", VECTOR_GROW_DOUBLE, busy);
+    _vector_growth_workload("by half", VECTOR_GROW_BY_HALF, busy);
+    _vector_growth_workload("pages", VECTOR_GROW_PAGES, busy);
+    _vector_growth_workload("mapped", VECTOR_GROW_MAPPED, busy);
+  }
+}
+
+#define VECTOR_SMALL_ROUNDS 1000000
+#define VECTOR_SMALL_ITEMS 6
+
+DECLARE_SMALL_VECTOR(Int, int, 8)
+DEFINE_SMALL_VECTOR(Int, int, 8)
+
+// Short-lived vectors of a few elements, like a lexeme buffer.
+BENCH(vector_small) {
+  long sum = 0;
+  long long start = bench_now_ns();
+  for (int round = 0; round < VECTOR_SMALL_ROUNDS; round++) {
+    Vector *vector = Vector_alloc(sizeof(int));
+    for (int i = 0; i < VECTOR_SMALL_ITEMS; i++) {
+      Vector_add(vector, &i);
+    }
+    sum += *(int *)Vector_get(vector, round % VECTOR_SMALL_ITEMS);
+    Vector_free(vector);
+  }
+  long long heap = bench_now_ns() - start;
+
+  start = bench_now_ns();
+  for (int round = 0; round < VECTOR_SMALL_ROUNDS; round++) {
+    Vector *vector = (Vector *)IntSmallVector_alloc();
+    for (int i = 0; i < VECTOR_SMALL_ITEMS; i++) {
+      Vector_add(vector, &i);
+    }
+    sum += *(int *)Vector_get(vector, round % VECTOR_SMALL_ITEMS);
+    Vector_free(vector);
+  }
+  long long allocated = bench_now_ns() - start;
+
+  start = bench_now_ns();
+  for (int round = 0; round < VECTOR_SMALL_ROUNDS; round++) {
+    IntSmallVector small;
+    Vector *vector = (Vector *)IntSmallVector_init(&small);
+    for (int i = 0; i < VECTOR_SMALL_ITEMS; i++) {
+      Vector_add(vector, &i);
+    }
+    sum += *(int *)Vector_get(vector, round % VECTOR_SMALL_ITEMS);
+    IntSmallVector_cleanup(&small);
+  }
+  long long on_stack = bench_now_ns() - start;
+
+  printf("%d ints per vector: Vector_alloc %6.1f  IntSmallVector_alloc %6.1f  "
+         "on the stack %6.1f ns/vector  (sum %ld)\n",
+         VECTOR_SMALL_ITEMS, (double)heap / VECTOR_SMALL_ROUNDS,
+         (double)allocated / VECTOR_SMALL_ROUNDS,
+         (double)on_stack / VECTOR_SMALL_ROUNDS, sum);
+}
+
+#define VECTOR_TYPED_ELEMENTS 100000000
+
+// Appending and reading back ints through IntVector, whose accessors are
+// inline, and through the generic functions it used to wrap.
+BENCH(vector_typed) {
+  long sum = 0;
+  Vector *vector = Vector_alloc(sizeof(int));
+  long long start = bench_now_ns();
+  for (int i = 0; i < VECTOR_TYPED_ELEMENTS; i++) {
+    Vector_add(vector, &i);
+  }
+  long long generic_add = bench_now_ns() - start;
+  start = bench_now_ns();
+  for (size_t i = 0; i < VECTOR_TYPED_ELEMENTS; i++) {
+    sum += *(int *)Vector_get(vector, i);
+  }
+  long long generic_get = bench_now_ns() - start;
+  Vector_free(vector);
+
+  IntVector *ints = IntVector_alloc();
+  start = bench_now_ns();
+  for (int i = 0; i < VECTOR_TYPED_ELEMENTS; i++) {
+    IntVector_add(ints, i);
+  }
+  long long typed_add = bench_now_ns() - start;
+  start = bench_now_ns();
+  for (size_t i = 0; i < VECTOR_TYPED_ELEMENTS; i++) {
+    sum += IntVector_get(ints, i);
+  }
+  long long typed_get = bench_now_ns() - start;
+  Vector_free((Vector *)ints);
+
+  printf("%d ints: Vector_add %5.2f  IntVector_add %5.2f  Vector_get %5.2f  "
+         "IntVector_get %5.2f ns/element  (sum %ld)\n",
+         VECTOR_TYPED_ELEMENTS, (double)generic_add / VECTOR_TYPED_ELEMENTS,
+         (double)typed_add / VECTOR_TYPED_ELEMENTS,
+         (double)generic_get / VECTOR_TYPED_ELEMENTS,
+         (double)typed_get / VECTOR_TYPED_ELEMENTS, sum);
+}
+
+#define VECTOR_FILE_SYMBOLS 20000000
+
+struct _vector_symbol {
+  unsigned long address;
+  unsigned long name_hash;
+};
+
+// Makes a symbol table the way a process would at startup.
+static Vector *_vector_build_symbols(Vector *vector) {
+  struct _vector_symbol symbol = {0, 14695981039346656037ul};
+  for (unsigned long i = 0; i < VECTOR_FILE_SYMBOLS; i++) {
+    symbol.address += 16 + (i & 63);
+    symbol.name_hash = (symbol.name_hash ^ i) * 1099511628211ul;
+    Vector_add(vector, &symbol);
+  }
+  return vector;
+}
+
+static unsigned long _vector_sum_symbols(Vector *vector) {
+  unsigned long sum = 0;
+  Indexer indexer;
+  Vector_get_indexer(vector, &indexer);
+  for (size_t i = 0; i < indexer.size(&indexer); i += 64) {
+    sum += ((struct _vector_symbol *)indexer.get(&indexer, i))->name_hash;
+  }
+  return sum;
+}
+
+// Getting a symbol table at startup: rebuilding it, reading it back from a
+// file, or mapping a file-backed Vector. The file is in the page cache, as it
+// is when a process restarts.
+BENCH(vector_file) {
+  char path[] = "/tmp/vector_bench_XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    return;
+  }
+  close(fd);
+  Vector *vector = _vector_build_symbols(
+      Vector_open_file(path, sizeof(struct _vector_symbol)));
+  Vector_free(vector);
+  unsigned long sum = 0;
+
+  long long start = bench_now_ns();
+  vector = _vector_build_symbols(Vector_alloc(sizeof(struct _vector_symbol)));
+  sum += _vector_sum_symbols(vector);
+  long long rebuild = bench_now_ns() - start;
+  Vector_free(vector);
+
+  start = bench_now_ns();
+  FILE *file = fopen(path, "rb");
+  vector = Vector_alloc(sizeof(struct _vector_symbol));
+  struct _vector_symbol *buffer = malloc(65536 * sizeof(struct _vector_symbol));
+  fseek(file, VECTOR_FILE_HEADER_SIZE, SEEK_SET);
+  for (size_t remaining = VECTOR_FILE_SYMBOLS, read; remaining > 0;
+       remaining -= read) {
+    read = fread(buffer, sizeof(struct _vector_symbol),
+                 remaining < 65536 ? remaining : 65536, file);
+    if (read == 0) {
+      break;
+    }
+    Vector_add_range(vector, buffer, read);
+  }
+  free(buffer);
+  fclose(file);
+  sum += _vector_sum_symbols(vector);
+  long long read_back = bench_now_ns() - start;
+  Vector_free(vector);
+
+  start = bench_now_ns();
+  vector = Vector_open_file(path, sizeof(struct _vector_symbol));
+  long long open = bench_now_ns() - start;
+  sum += _vector_sum_symbols(vector);
+  long long open_scan = bench_now_ns() - start;
+  Vector_free(vector);
+  unlink(path);
+
+  printf("%d symbols (%d MiB): rebuild %8.2f  fread %8.2f  Vector_open_file "
+         "%8.3f ms, %8.2f ms with a scan  (sum %lu)\n",
+         VECTOR_FILE_SYMBOLS,
+         (int)(VECTOR_FILE_SYMBOLS * sizeof(struct _vector_symbol) >> 20),
+         rebuild / 1e6, read_back / 1e6, open / 1e6, open_scan / 1e6, sum);
+}
+
+int vector_benches(void) {
+  return bench_vector_growth() || bench_vector_small() || bench_vector_typed() ||
+         bench_vector_file();
+}
@@ -0,0 +1,10 @@
+#ifndef BENCH_COMMON_VECTOR_BENCH_H__
+#define BENCH_COMMON_VECTOR_BENCH_H__
+
+#include "../../common/public/collections.h"
+#include "../../common/public/vector.h"
+#include "../macros.h"
+
+int vector_benches(void);
+
+#endif // BENCH_COMMON_VECTOR_BENCH_H__
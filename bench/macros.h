@@ -0,0 +1,31 @@
+#ifndef BENCH_MACROS_H__
+#define BENCH_MACROS_H__
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "timing.h"
+
+// Only benchmarks whose names contain this run, if it isn't NULL. Set from
+// the first command-line argument.
+extern const char *bench_filter;
+
+#define BENCH(name)                                                            \
+  void _bench_##name(void);                                                    \
+  int bench_##name(void) {                                                     \
+    if (bench_filter && !strstr("bench_" #name, bench_filter)) {               \
+      return 0;                                                                \
+    }                                                                          \
+    printf("=================================================================" \
+           "===============\n");                                               \
+    printf("== Bench: %-67s ==\n", "bench_" #name);                            \
+    printf("=================================================================" \
+           "===============\n");                                               \
+    _bench_##name();                                                           \
+    printf("\n%s completed.\n\n", "bench_" #name);                             \
+    return 0;                                                                  \
+  }                                                                            \
+  void _bench_##name(void)
+
+#endif // BENCH_MACROS_H__
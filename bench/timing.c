@@ -0,0 +1,38 @@
+#include "timing.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+long long bench_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+int _bench_compare_ns(const void *a, const void *b) {
+  long long x = *(const long long *)a, y = *(const long long *)b;
+  return (x > y) - (x < y);
+}
+
+void bench_report_latency(const char *label, long long *samples, size_t count) {
+  if (count == 0) {
+    return;
+  }
+  long long total = 0;
+  for (size_t i = 0; i < count; i++) {
+    total += samples[i];
+  }
+  qsort(samples, count, sizeof(long long), _bench_compare_ns);
+  printf("%-36s mean %8.1f ns  p50 %7lld  p99 %7lld  p99.9 %8lld  "
+         "p99.99 %9lld  max %10lld\n",
+         label, (double)total / count, samples[count / 2],
+         samples[count * 99 / 100], samples[count * 999 / 1000],
+         samples[count * 9999 / 10000], samples[count - 1]);
+}
+
+void bench_report_throughput(const char *label, size_t count,
+                             long long elapsed_ns) {
+  printf("%-36s %10zu ops in %8.2f ms  (%7.1f ns/op)\n", label, count,
+         elapsed_ns / 1e6, (double)elapsed_ns / count);
+}
@@ -0,0 +1,18 @@
+#ifndef BENCH_TIMING_H__
+#define BENCH_TIMING_H__
+
+#include <stddef.h>
+
+// Gets a monotonic timestamp in nanoseconds.
+long long bench_now_ns(void);
+
+// Prints the mean, percentiles and maximum of `count' per-operation
+// latencies, in nanoseconds. Sorts `samples' in place. The maximum includes
+// scheduler preemption, so compare the high percentiles as well.
+void bench_report_latency(const char *label, long long *samples, size_t count);
+
+// Prints the throughput of `count' operations that took `elapsed_ns' overall.
+void bench_report_throughput(const char *label, size_t count,
+                             long long elapsed_ns);
+
+#endif // BENCH_TIMING_H__
@@ -0,0 +1,181 @@
+#include "protected/arena.h"
+
+#include <string.h>
+
+#include "../test/stubs.h"
+#include "public/assert.h"
+
+// Rounds `size' up to a multiple of ARENA_ALIGN.
+size_t _Arena_align(size_t size) {
+  return (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+}
+
+struct ArenaBlock *_Arena_alloc_block(size_t size) {
+  struct ArenaBlock *block;
+  if (NULL == (block = malloc(sizeof(struct ArenaBlock) + size))) {
+    return NULL;
+  }
+  block->next = NULL;
+  block->size = size;
+  block->used = 0;
+  return block;
+}
+
+// Initializes a pre-allocated Arena object
+bool Arena_init(Arena *arena, size_t block_size) {
+  ASSERT(arena != NULL);
+
+  arena->head = NULL;
+  arena->block_size =
+      _Arena_align(block_size ? block_size : ARENA_DEFAULT_BLOCK_SIZE);
+  arena->bytes_used = 0;
+  arena->last = NULL;
+  return true;
+}
+
+// Creates a new Arena object.
+Arena *Arena_alloc(size_t block_size) {
+  Arena *arena;
+  if (NULL == (arena = malloc(sizeof(Arena)))) {
+    return NULL;
+  }
+  if (!Arena_init(arena, block_size)) {
+    free(arena);
+    return NULL;
+  }
+  return arena;
+}
+
+// Frees every block, but not the Arena object.
+void Arena_cleanup(Arena *arena) {
+  ASSERT(arena != NULL);
+
+  struct ArenaBlock *block = arena->head;
+  while (block) {
+    struct ArenaBlock *next = block->next;
+    free(block);
+    block = next;
+  }
+  arena->head = NULL;
+  arena->bytes_used = 0;
+  arena->last = NULL;
+}
+
+// Frees up the Arena object and everything allocated from it.
+void Arena_free(Arena *arena) {
+  ASSERT(arena != NULL);
+
+  Arena_cleanup(arena);
+  free(arena);
+}
+
+void Arena_reset(Arena *arena) {
+  ASSERT(arena != NULL);
+
+  if (!arena->head) {
+    return;
+  }
+  struct ArenaBlock *block = arena->head->next;
+  while (block) {
+    struct ArenaBlock *next = block->next;
+    free(block);
+    block = next;
+  }
+  arena->head->next = NULL;
+  arena->head->used = 0;
+  arena->bytes_used = 0;
+  arena->last = NULL;
+}
+
+size_t Arena_bytes_used(const Arena *arena) {
+  ASSERT(arena != NULL);
+
+  return arena->bytes_used;
+}
+
+void *(Arena_malloc)(Arena *arena, size_t size) {
+  if (!arena) {
+    return malloc(size);
+  }
+  size = _Arena_align(size ? size : 1);
+  struct ArenaBlock *head = arena->head;
+  if (head && head->size - head->used >= size) {
+    void *ptr = head->data + head->used;
+    head->used += size;
+    arena->bytes_used += size;
+    arena->last = ptr;
+    return ptr;
+  }
+  struct ArenaBlock *block;
+  if (size > arena->block_size / 4) {
+    // Oversized: give it a block of its own, and keep allocating from the
+    // current one.
+    if (NULL == (block = _Arena_alloc_block(size))) {
+      return NULL;
+    }
+    block->used = size;
+    if (head) {
+      block->next = head->next;
+      head->next = block;
+    } else {
+      arena->head = block;
+      arena->last = NULL;
+    }
+    arena->bytes_used += size;
+    return block->data;
+  }
+  if (NULL == (block = _Arena_alloc_block(arena->block_size))) {
+    return NULL;
+  }
+  block->next = head;
+  block->used = size;
+  arena->head = block;
+  arena->bytes_used += size;
+  arena->last = block->data;
+  return block->data;
+}
+
+void *(Arena_calloc)(Arena *arena, size_t count, size_t size) {
+  if (!arena) {
+    return calloc(count, size);
+  }
+  if (size && count > (size_t)-1 / size) {
+    return NULL;
+  }
+  void *ptr;
+  if ((ptr = Arena_malloc(arena, count * size))) {
+    memset(ptr, 0, count * size);
+  }
+  return ptr;
+}
+
+void *(Arena_realloc)(Arena *arena, void *ptr, size_t old_size, size_t size) {
+  if (!arena) {
+    return realloc(ptr, size);
+  }
+  if (!ptr) {
+    return Arena_malloc(arena, size);
+  }
+  old_size = _Arena_align(old_size ? old_size : 1);
+  size_t new_size = _Arena_align(size ? size : 1);
+  if (new_size <= old_size) {
+    return ptr; // Shrinking never moves.
+  }
+  struct ArenaBlock *head = arena->head;
+  if (ptr == arena->last && head->size - head->used >= new_size - old_size) {
+    head->used += new_size - old_size;
+    arena->bytes_used += new_size - old_size;
+    return ptr;
+  }
+  void *new_ptr;
+  if ((new_ptr = Arena_malloc(arena, size))) {
+    memcpy(new_ptr, ptr, old_size);
+  }
+  return new_ptr;
+}
+
+void Arena_release(Arena *arena, void *ptr) {
+  if (!arena) {
+    free(ptr);
+  }
+}
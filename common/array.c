@@ -1,6 +1,7 @@
 #include "protected/array.h"
 
 #include <string.h>
+#include <sys/stat.h>
 
 #include "../test/stubs.h"
 #include "public/collections.h"
@@ -23,6 +24,7 @@ bool Array_init(Array *array, size_t count, size_t elem_size)
     ASSERT(elem_size > 0);
     array->count = count;
     array->elem_size = elem_size;
+    array->file = NULL;
     Array_clear(array);
     return true;
 }
@@ -39,6 +41,78 @@ Array *Array_alloc(size_t count, size_t elem_size)
     return array;
 }
 
+// A file-backed array's elements start this far into its file, with the
+// magic number at the start and the rest of the Array just before them.
+#define _ARRAY_FILE_DATA_OFFSET 64
+
+_Static_assert(offsetof(Array, data) + 8 <= _ARRAY_FILE_DATA_OFFSET,
+               "_ARRAY_FILE_DATA_OFFSET is too small for an Array");
+
+static const char _ARRAY_FILE_MAGIC[8] = "ccARRAY1";
+
+static Array *_Array_in_file(MappedFile *file)
+{
+    return (Array *)((unsigned char *)MappedFile_data(file) +
+                     _ARRAY_FILE_DATA_OFFSET - offsetof(Array, data));
+}
+
+Array *Array_open_file(const char *path, size_t count, size_t elem_size)
+{
+    ASSERT(path != NULL);
+    ASSERT(elem_size > 0);
+    MappedFile *file;
+    struct stat st;
+    // With no count there's nothing to create, so don't leave an empty file.
+    if (count == 0 && stat(path, &st) != 0) {
+        return NULL;
+    }
+    if (NULL == (file = MappedFile_open(path))) {
+        return NULL;
+    }
+    Array *array;
+    size_t size = MappedFile_size(file);
+    if (size == 0) {
+        // A new file, zeroed as it grows.
+        if (count == 0 ||
+            !MappedFile_resize(file, _ARRAY_FILE_DATA_OFFSET + count * elem_size)) {
+            goto out_close;
+        }
+        memcpy(MappedFile_data(file), _ARRAY_FILE_MAGIC, sizeof(_ARRAY_FILE_MAGIC));
+        array = _Array_in_file(file);
+        array->count = count;
+        array->elem_size = elem_size;
+    } else {
+        array = _Array_in_file(file);
+        if (size < _ARRAY_FILE_DATA_OFFSET ||
+            memcmp(MappedFile_data(file), _ARRAY_FILE_MAGIC,
+                   sizeof(_ARRAY_FILE_MAGIC)) != 0 ||
+            array->elem_size != elem_size ||
+            array->count > (size - _ARRAY_FILE_DATA_OFFSET) / elem_size) {
+            goto out_close;
+        }
+    }
+    array->file = file;
+    if (count > 0 && count != array->count) {
+        Array *resized;
+        if (NULL == (resized = Array_realloc(array, count))) {
+            goto out_close;
+        }
+        array = resized;
+    }
+    return array;
+
+out_close:
+    MappedFile_close(file);
+    return NULL;
+}
+
+bool Array_sync(Array *array)
+{
+    ASSERT(array != NULL);
+    ASSERT(array->file != NULL);
+    return MappedFile_sync(array->file);
+}
+
 void Array_clear(Array *array)
 {
     ASSERT(array != NULL);
@@ -49,15 +123,26 @@ Array *Array_realloc(Array *array, size_t count)
 {
     ASSERT(array != NULL);
     Array *new_array = NULL;
+    if (array->file) {
+        // The file grows with zeroes, and the pages are only touched as
+        // they're used.
+        MappedFile *file = array->file;
+        if (!MappedFile_resize(file, _ARRAY_FILE_DATA_OFFSET + count * array->elem_size)) {
+            return NULL;
+        }
+        new_array = _Array_in_file(file);
+        new_array->count = count;
+        return new_array;
+    }
     if (NULL ==
         (new_array = realloc(array, sizeof(Array) + count * array->elem_size))) {
         return NULL;
     }
-    if (count > array->count) {
-        memset(new_array->data + array->count * array->elem_size, 0,
-            (count - array->count) * array->elem_size);
+    if (count > new_array->count) {
+        memset(new_array->data + new_array->count * new_array->elem_size, 0,
+            (count - new_array->count) * new_array->elem_size);
     }
-    array->count = count;
+    new_array->count = count;
     return new_array;
 }
 
@@ -70,6 +155,10 @@ size_t Array_count(const Array *array)
 void Array_free(Array *array)
 {
     ASSERT(array != NULL);
+    if (array->file) {
+        MappedFile_close(array->file);
+        return;
+    }
     free(array);
 }
 
@@ -123,7 +212,7 @@ void Array_copy(Array *dest_array, const Array *array)
     ASSERT(array != NULL);
     ASSERT(dest_array->count == array->count);
     ASSERT(dest_array->elem_size == array->elem_size);
-    memcpy(dest_array, array, sizeof(Array) + array->count * array->elem_size);
+    memcpy(dest_array->data, array->data, array->count * array->elem_size);
 }
 
 void *Array_iter_current_(const Iterator *iter);
@@ -0,0 +1,229 @@
+#include "protected/atomic_stack.h"
+
+#include <string.h>
+
+#include "../test/stubs.h"
+#include "public/assert.h"
+
+// Initializes a pre-allocated AtomicStack object
+bool AtomicStack_init(AtomicStack *stack, size_t elem_size) {
+  ASSERT(stack != NULL);
+  ASSERT(elem_size > 0);
+
+  size_t align = _Alignof(max_align_t);
+  stack->elem_size = elem_size;
+  stack->elem_offset =
+      (sizeof(struct AtomicStackNode) + align - 1) & ~(align - 1);
+  stack->node_size =
+      (stack->elem_offset + elem_size + align - 1) & ~(align - 1);
+  atomic_init(&stack->top, ATOMIC_STACK_EMPTY);
+  atomic_init(&stack->free_top, ATOMIC_STACK_EMPTY);
+  atomic_init(&stack->fresh, 0);
+  for (int i = 0; i < ATOMIC_STACK_MAX_SLABS; i++) {
+    atomic_init(&stack->slabs[i], NULL);
+  }
+  pthread_mutex_init(&stack->grow_lock, NULL);
+  return true;
+}
+
+void AtomicStack_cleanup(AtomicStack *stack) {
+  ASSERT(stack != NULL);
+  for (int i = 0; i < ATOMIC_STACK_MAX_SLABS; i++) {
+    free(atomic_load_explicit(&stack->slabs[i], memory_order_relaxed));
+    atomic_store_explicit(&stack->slabs[i], NULL, memory_order_relaxed);
+  }
+  pthread_mutex_destroy(&stack->grow_lock);
+}
+
+AtomicStack *AtomicStack_alloc(size_t elem_size) {
+  AtomicStack *stack;
+  if (NULL == (stack = CacheLine_alloc(sizeof(AtomicStack)))) {
+    return NULL;
+  }
+  if (!AtomicStack_init(stack, elem_size)) {
+    CacheLine_free(stack);
+    return NULL;
+  }
+  return stack;
+}
+
+void AtomicStack_free(AtomicStack *stack) {
+  ASSERT(stack != NULL);
+  AtomicStack_cleanup(stack);
+  CacheLine_free(stack);
+}
+
+bool AtomicStack_empty(const AtomicStack *stack) {
+  ASSERT(stack != NULL);
+  return (uint32_t)atomic_load_explicit(&stack->top, memory_order_relaxed) ==
+         ATOMIC_STACK_EMPTY;
+}
+
+size_t AtomicStack_element_size(const AtomicStack *stack) {
+  ASSERT(stack != NULL);
+  return stack->elem_size;
+}
+
+// Finds which slab node `index' lives in, and where.
+static inline int _AtomicStack_slab_of(uint32_t index, size_t *offset_out) {
+  uint64_t j = (uint64_t)index + ATOMIC_STACK_FIRST_SLAB;
+  int slab = 63 - __builtin_clzll(j) - ATOMIC_STACK_FIRST_SLAB_LOG2;
+  *offset_out = j - ((uint64_t)ATOMIC_STACK_FIRST_SLAB << slab);
+  return slab;
+}
+
+// Gets node `ref' (index + 1). Its slab must already exist.
+static inline struct AtomicStackNode *
+_AtomicStack_node(const AtomicStack *stack, uint32_t ref) {
+  size_t offset;
+  int slab = _AtomicStack_slab_of(ref - 1, &offset);
+  unsigned char *nodes =
+      atomic_load_explicit(&stack->slabs[slab], memory_order_acquire);
+  return (struct AtomicStackNode *)(nodes + offset * stack->node_size);
+}
+
+static inline void *_AtomicStack_elem(const AtomicStack *stack,
+                                      struct AtomicStackNode *node) {
+  return (unsigned char *)node + stack->elem_offset;
+}
+
+// Makes sure slab `slab' exists. Only the first thread to need it allocates.
+static bool _AtomicStack_ensure_slab(AtomicStack *stack, int slab) {
+  if (atomic_load_explicit(&stack->slabs[slab], memory_order_acquire)) {
+    return true;
+  }
+  bool success = true;
+  pthread_mutex_lock(&stack->grow_lock);
+  if (!atomic_load_explicit(&stack->slabs[slab], memory_order_relaxed)) {
+    size_t nodes = (size_t)ATOMIC_STACK_FIRST_SLAB << slab;
+    unsigned char *data = malloc(nodes * stack->node_size);
+    if (data == NULL) {
+      success = false;
+    } else {
+      atomic_store_explicit(&stack->slabs[slab], data, memory_order_release);
+    }
+  }
+  pthread_mutex_unlock(&stack->grow_lock);
+  return success;
+}
+
+// Pushes node `ref' onto the stack whose top is `top'.
+static inline void _AtomicStack_push_node(AtomicStack *stack,
+                                          _Atomic uint64_t *top, uint32_t ref) {
+  struct AtomicStackNode *node = _AtomicStack_node(stack, ref);
+  uint64_t old = atomic_load_explicit(top, memory_order_relaxed);
+  uint64_t new;
+  do {
+    atomic_store_explicit(&node->next, (uint32_t)old, memory_order_relaxed);
+    new = ((old >> 32) + 1) << 32 | ref;
+  } while (!atomic_compare_exchange_weak_explicit(
+      top, &old, new, memory_order_release, memory_order_relaxed));
+}
+
+// Pops the node on top of the stack whose top is `top'. Returns its ref, or 0
+// if the stack is empty. `next' may be stale if another thread got the node
+// first, but then the tag has moved on and the CAS fails.
+static inline uint32_t _AtomicStack_pop_node(const AtomicStack *stack,
+                                             _Atomic uint64_t *top) {
+  uint64_t old = atomic_load_explicit(top, memory_order_acquire);
+  uint64_t new;
+  uint32_t ref;
+  do {
+    if ((ref = (uint32_t)old) == ATOMIC_STACK_EMPTY) {
+      return ATOMIC_STACK_EMPTY;
+    }
+    struct AtomicStackNode *node = _AtomicStack_node(stack, ref);
+    uint32_t next = atomic_load_explicit(&node->next, memory_order_relaxed);
+    new = ((old >> 32) + 1) << 32 | next;
+  } while (!atomic_compare_exchange_weak_explicit(
+      top, &old, new, memory_order_acquire, memory_order_acquire));
+  return ref;
+}
+
+// Gets a node to hold a new element: a recycled one if there is one, otherwise
+// the next one never used. Returns 0 if memory ran out.
+static uint32_t _AtomicStack_take_node(AtomicStack *stack) {
+  uint32_t ref = _AtomicStack_pop_node(stack, &stack->free_top);
+  if (ref != ATOMIC_STACK_EMPTY) {
+    return ref;
+  }
+  // The index is only claimed once its slab exists, so a failed push doesn't
+  // use one up, and a full stack never counts on past the last slab.
+  uint32_t index = atomic_load_explicit(&stack->fresh, memory_order_relaxed);
+  do {
+    size_t offset;
+    int slab = _AtomicStack_slab_of(index, &offset);
+    if (slab >= ATOMIC_STACK_MAX_SLABS ||
+        !_AtomicStack_ensure_slab(stack, slab)) {
+      return ATOMIC_STACK_EMPTY;
+    }
+  } while (!atomic_compare_exchange_weak_explicit(
+      &stack->fresh, &index, index + 1, memory_order_relaxed,
+      memory_order_relaxed));
+  return index + 1;
+}
+
+bool AtomicStack_reserve(AtomicStack *stack, size_t num_elems) {
+  ASSERT(stack != NULL);
+  ASSERT(num_elems);
+  if (num_elems > UINT32_MAX - ATOMIC_STACK_FIRST_SLAB) {
+    return false;
+  }
+  size_t offset;
+  int last = _AtomicStack_slab_of((uint32_t)(num_elems - 1), &offset);
+  for (int slab = 0; slab <= last; slab++) {
+    if (!_AtomicStack_ensure_slab(stack, slab)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool AtomicStack_push(AtomicStack *stack, const void *data) {
+  ASSERT(stack != NULL);
+  ASSERT(data != NULL);
+  uint32_t ref = _AtomicStack_take_node(stack);
+  if (ref == ATOMIC_STACK_EMPTY) {
+    return false;
+  }
+  struct AtomicStackNode *node = _AtomicStack_node(stack, ref);
+  memcpy(_AtomicStack_elem(stack, node), data, stack->elem_size);
+  _AtomicStack_push_node(stack, &stack->top, ref);
+  return true;
+}
+
+bool AtomicStack_pop(AtomicStack *stack, void *data_out) {
+  ASSERT(stack != NULL);
+  ASSERT(data_out != NULL);
+  uint32_t ref = _AtomicStack_pop_node(stack, &stack->top);
+  if (ref == ATOMIC_STACK_EMPTY) {
+    return false;
+  }
+  struct AtomicStackNode *node = _AtomicStack_node(stack, ref);
+  memcpy(data_out, _AtomicStack_elem(stack, node), stack->elem_size);
+  _AtomicStack_push_node(stack, &stack->free_top, ref);
+  return true;
+}
+
+bool AtomicStack_peek(const AtomicStack *stack, void *data_out) {
+  ASSERT(stack != NULL);
+  ASSERT(data_out != NULL);
+  _Atomic uint64_t *top = (_Atomic uint64_t *)&stack->top;
+  uint64_t old = atomic_load_explicit(top, memory_order_acquire);
+  for (;;) {
+    uint32_t ref = (uint32_t)old;
+    if (ref == ATOMIC_STACK_EMPTY) {
+      return false;
+    }
+    struct AtomicStackNode *node = _AtomicStack_node(stack, ref);
+    memcpy(data_out, _AtomicStack_elem(stack, node), stack->elem_size);
+    // If the top is unchanged (tag and all), nobody reused the node while we
+    // copied it.
+    atomic_thread_fence(memory_order_acquire);
+    uint64_t now = atomic_load_explicit(top, memory_order_relaxed);
+    if (now == old) {
+      return true;
+    }
+    old = now;
+  }
+}
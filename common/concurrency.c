@@ -0,0 +1,24 @@
+#include "public/concurrency.h"
+
+#include <stdint.h>
+
+#include "../test/stubs.h"
+#include "public/assert.h"
+
+// The block malloc returned is kept just before the aligned pointer.
+void *(CacheLine_alloc)(size_t size) {
+  unsigned char *block = malloc(size + CACHE_LINE_SIZE + sizeof(void *));
+  if (block == NULL) {
+    return NULL;
+  }
+  uintptr_t aligned = ((uintptr_t)block + sizeof(void *) + CACHE_LINE_SIZE - 1) &
+                      ~(uintptr_t)(CACHE_LINE_SIZE - 1);
+  ((void **)aligned)[-1] = block;
+  return (void *)aligned;
+}
+
+void CacheLine_free(void *ptr) {
+  if (ptr) {
+    free(((void **)ptr)[-1]);
+  }
+}
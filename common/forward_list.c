@@ -21,9 +21,17 @@ DEFINE_FORWARD_LIST(UnsignedChar, unsigned char)
 DEFINE_FORWARD_LIST(CString, char *)
 
 bool ForwardList_init(ForwardList *list, size_t elem_size)
+{
+    return ForwardList_init_ext(list, elem_size, NULL);
+}
+
+bool ForwardList_init_ext(ForwardList *list, size_t elem_size, Arena *arena)
 {
     ASSERT(list);
     ASSERT(elem_size);
+    list->arena = arena;
+    list->pool = NULL;
+    list->owns_pool = false;
     list->elem_size = elem_size;
     list->count = 0;
     list->head = NULL;
@@ -32,13 +40,36 @@ bool ForwardList_init(ForwardList *list, size_t elem_size)
     return true;
 }
 
+// Gets memory for a node from the list's pool, or its arena.
+ForwardListNode *_ForwardList_alloc_node(ForwardList *list)
+{
+    if (list->pool) {
+        return Pool_acquire(list->pool);
+    }
+    return Arena_malloc(list->arena, ForwardList_node_size(list));
+}
+
+void _ForwardList_free_node(ForwardList *list, ForwardListNode *node)
+{
+    if (list->pool) {
+        Pool_release(list->pool, node);
+    } else {
+        Arena_release(list->arena, node);
+    }
+}
+
 void ForwardList_cleanup(ForwardList *list)
 {
-    ForwardListNode *current = list->head;
-    while (current) {
-        ForwardListNode *next = current->next;
-        free(current);
-        current = next;
+    if (list->owns_pool) {
+        // Nobody else has nodes in it, so drop them all at once.
+        Pool_clear(list->pool);
+    } else {
+        ForwardListNode *current = list->head;
+        while (current) {
+            ForwardListNode *next = current->next;
+            _ForwardList_free_node(list, current);
+            current = next;
+        }
     }
     list->head = NULL;
     list->tail = NULL;
@@ -46,15 +77,50 @@ void ForwardList_cleanup(ForwardList *list)
 }
 
 ForwardList *ForwardList_alloc(size_t elem_size)
+{
+    return ForwardList_alloc_ext(elem_size, NULL);
+}
+
+ForwardList *ForwardList_alloc_ext(size_t elem_size, Arena *arena)
+{
+    ASSERT(elem_size);
+    ForwardList *list = NULL;
+    if ((list = Arena_malloc(arena, sizeof(ForwardList))) == NULL) {
+        return NULL;
+    }
+    if (!ForwardList_init_ext(list, elem_size, arena)) {
+        Arena_release(arena, list);
+        return NULL;
+    }
+    return list;
+}
+
+ForwardList *ForwardList_alloc_pooled(size_t elem_size, Pool *pool)
 {
     ASSERT(elem_size);
+    ASSERT(!pool ||
+           Pool_object_size(pool) >= sizeof(ForwardListNode) + elem_size);
     ForwardList *list = NULL;
-    if ((list = malloc(sizeof(list))) == NULL || !ForwardList_init(list, elem_size)) {
+    if ((list = ForwardList_alloc(elem_size)) == NULL) {
         return NULL;
     }
+    if (!pool) {
+        if ((pool = ForwardList_node_pool_alloc(elem_size)) == NULL) {
+            ForwardList_free(list);
+            return NULL;
+        }
+        list->owns_pool = true;
+    }
+    list->pool = pool;
     return list;
 }
 
+Pool *ForwardList_node_pool_alloc(size_t elem_size)
+{
+    ASSERT(elem_size);
+    return Pool_alloc(sizeof(ForwardListNode) + elem_size);
+}
+
 size_t ForwardList_count(const ForwardList *list)
 {
     ASSERT(list);
@@ -71,7 +137,10 @@ void ForwardList_free(ForwardList *list)
 {
     ASSERT(list);
     ForwardList_cleanup(list);
-    free(list);
+    if (list->owns_pool) {
+        Pool_free(list->pool);
+    }
+    Arena_release(list->arena, list);
 }
 
 size_t ForwardList_element_size(const ForwardList *list)
@@ -138,7 +207,7 @@ ForwardListNode *ForwardList_insert_before(ForwardList *list,
     ASSERT(node);
     ASSERT(elem);
     size_t node_size = ForwardList_node_size(list);
-    ForwardListNode *new_node = malloc(node_size);
+    ForwardListNode *new_node = _ForwardList_alloc_node(list);
     if (!new_node) return NULL;
     memcpy(new_node, node, node_size); // copy previous to new node
     memcpy(node->data, elem, list->elem_size);
@@ -156,8 +225,7 @@ ForwardListNode *ForwardList_insert_after(ForwardList *list, ForwardListNode *no
     ASSERT(list);
     ASSERT(node);
     ASSERT(elem);
-    size_t node_size = ForwardList_node_size(list);
-    ForwardListNode *new_node = malloc(node_size);
+    ForwardListNode *new_node = _ForwardList_alloc_node(list);
     if (!new_node) return NULL;
     memcpy(new_node->data, elem, list->elem_size);
     new_node->next = node->next;
@@ -177,10 +245,10 @@ ForwardListNode *ForwardList_append(ForwardList *list, const void *elem)
         return ForwardList_insert_after(list, list->tail, elem);
     }
     // Singleton list case:
-    size_t node_size = ForwardList_node_size(list);
-    ForwardListNode *node = malloc(node_size);
+    ForwardListNode *node = _ForwardList_alloc_node(list);
     if (!node) return NULL;
     memcpy(node->data, elem, list->elem_size);
+    node->next = NULL;
     list->head = node;
     list->tail = node;
     list->count++;
@@ -195,10 +263,10 @@ ForwardListNode *ForwardList_prepend(ForwardList *list, const void *elem)
         return ForwardList_insert_before(list, list->head, elem);
     }
     // Singleton list case:
-    size_t node_size = ForwardList_node_size(list);
-    ForwardListNode *node = malloc(node_size);
+    ForwardListNode *node = _ForwardList_alloc_node(list);
     if (!node) return NULL;
     memcpy(node->data, elem, list->elem_size);
+    node->next = NULL;
     list->head = node;
     list->tail = node;
     list->count++;
@@ -209,27 +277,29 @@ void ForwardList_remove(ForwardList *list, ForwardListNode *node)
 {
     ASSERT(list);
     ASSERT(node);
-    if (node == list->head) {
-        list->head = node->next;
-    }
     if (node->next) {
-        if (node->next == list->tail) {
+        // Pull the next node's contents into this one and free the next node,
+        // so `node' stays valid and points at the following element.
+        ForwardListNode *next = node->next;
+        if (next == list->tail) {
             list->tail = node;
         }
-        memcpy(node, node->next, ForwardList_node_size(list));
-        free(node->next);
+        memcpy(node, next, ForwardList_node_size(list));
+        _ForwardList_free_node(list, next);
     } else {
         ForwardListNode *new_tail = NULL;
-        ForwardListNode *current = list->head;
         // This is unfortunately O(N) because we don't have a prev ptr.
-        while (current) {
-            if (current != node) {
-                new_tail = current;
-            }
-            current = current->next;
+        for (ForwardListNode *current = list->head; current != node;
+             current = current->next) {
+            new_tail = current;
+        }
+        if (new_tail) {
+            new_tail->next = NULL;
+        } else {
+            list->head = NULL;
         }
         list->tail = new_tail;
-        free(node);
+        _ForwardList_free_node(list, node);
     }
     list->count--;
 }
@@ -262,9 +332,10 @@ void ForwardList_remove_range(ForwardList *list, ForwardListNode *node,
     ASSERT(node);
     ASSERT(count >= 0);
 
-    while (count--) {
+    while (count > 0) {
         ForwardListNode *next = node->next;
         ForwardList_remove(list, node); // Replaces current with next
+        count--;
         if (!next) break;
     }
     ASSERT(count == 0 && "Tried to remove too many nodes");
@@ -0,0 +1,170 @@
+#include "public/hash.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "public/assert.h"
+
+#if defined(__SSE2__) && defined(__x86_64__)
+#include <emmintrin.h>
+#endif
+
+// A wyhash-style hash: the input is consumed 16 bytes at a time (48 in the bulk
+// loop, as three independent lanes) and mixed with a 64x64->128 multiply,
+// folding the high half back into the low half.
+
+static const uint64_t _Hash_secret[4] = {
+    0xA0761D6478BD642Full, 0xE7037ED1A0B428DBull, 0x8EBC6AF09C88C6E3ull,
+    0x589965CC75374CC3ull};
+
+// Multiplies a and b, leaving the low 64 bits in a and the high 64 in b.
+static inline void _Hash_mum128(uint64_t *a, uint64_t *b) {
+#ifdef __SIZEOF_INT128__
+  unsigned __int128 r = (unsigned __int128)*a * *b;
+  *a = (uint64_t)r;
+  *b = (uint64_t)(r >> 64);
+#else
+  uint64_t ha = *a >> 32, hb = *b >> 32, la = (uint32_t)*a, lb = (uint32_t)*b;
+  uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+  uint64_t t = rl + (rm0 << 32);
+  uint64_t c = t < rl;
+  uint64_t lo = t + (rm1 << 32);
+  c += lo < t;
+  *a = lo;
+  *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static inline uint64_t _Hash_mum(uint64_t a, uint64_t b) {
+  _Hash_mum128(&a, &b);
+  return a ^ b;
+}
+
+// Upper-cases the ASCII letters among the bytes of `v', eight at a time: a byte
+// gets its 0x20 bit cleared iff it lies in 'a'..'z'. Bytes >= 0x80 are left
+// alone, so UTF-8 passes through unchanged.
+static inline uint64_t _Hash_fold(uint64_t v) {
+  uint64_t low7 = v & 0x7F7F7F7F7F7F7F7Full;
+  uint64_t ge_a = low7 + 0x1F1F1F1F1F1F1F1Full;   // High bit set iff >= 'a'.
+  uint64_t gt_z = low7 + 0x0505050505050505ull;   // High bit set iff > 'z'.
+  uint64_t lower = ge_a & ~gt_z & ~v & 0x8080808080808080ull;
+  return v & ~(lower >> 2);
+}
+
+static inline uint64_t _Hash_read64(const unsigned char *p, bool fold) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return fold ? _Hash_fold(v) : v;
+}
+
+// Reads 16 bytes as two words. With SSE2 the case fold is done on all 16 bytes
+// at once, which keeps the case-insensitive bulk loop close to the plain one.
+static inline void _Hash_read128(const unsigned char *p, bool fold,
+                                 uint64_t *lo, uint64_t *hi) {
+#if defined(__SSE2__) && defined(__x86_64__)
+  if (fold) {
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    // Signed compares: bytes >= 0x80 are negative and never in 'a'..'z'.
+    __m128i lower = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('a' - 1)),
+                                  _mm_cmplt_epi8(v, _mm_set1_epi8('z' + 1)));
+    v = _mm_andnot_si128(_mm_and_si128(lower, _mm_set1_epi8(0x20)), v);
+    *lo = (uint64_t)_mm_cvtsi128_si64(v);
+    *hi = (uint64_t)_mm_cvtsi128_si64(_mm_unpackhi_epi64(v, v));
+    return;
+  }
+#endif
+  *lo = _Hash_read64(p, fold);
+  *hi = _Hash_read64(p + 8, fold);
+}
+
+static inline uint64_t _Hash_read32(const unsigned char *p, bool fold) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return fold ? _Hash_fold(v) : v;
+}
+
+static inline uint64_t _Hash_read3(const unsigned char *p, size_t len,
+                                   bool fold) {
+  uint64_t v = ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) |
+               p[len - 1];
+  return fold ? _Hash_fold(v) : v;
+}
+
+// Folding is applied to every load, so overlapping reads of the same bytes
+// always agree. Inlined into each caller with `fold' as a constant.
+static inline uint64_t _Hash_bytes(const unsigned char *p, size_t len,
+                                   uint64_t seed, bool fold) {
+  const uint64_t *s = _Hash_secret;
+  uint64_t a, b;
+  seed ^= _Hash_mum(seed ^ s[0], s[1]);
+  if (len <= 16) {
+    if (len >= 4) {
+      size_t mid = (len >> 3) << 2;
+      a = (_Hash_read32(p, fold) << 32) | _Hash_read32(p + mid, fold);
+      b = (_Hash_read32(p + len - 4, fold) << 32) |
+          _Hash_read32(p + len - 4 - mid, fold);
+    } else if (len > 0) {
+      a = _Hash_read3(p, len, fold);
+      b = 0;
+    } else {
+      a = b = 0;
+    }
+  } else {
+    size_t i = len;
+    if (i > 48) {
+      uint64_t seed1 = seed, seed2 = seed;
+      do {
+        uint64_t w0, w1, w2, w3, w4, w5;
+        _Hash_read128(p, fold, &w0, &w1);
+        _Hash_read128(p + 16, fold, &w2, &w3);
+        _Hash_read128(p + 32, fold, &w4, &w5);
+        seed = _Hash_mum(w0 ^ s[1], w1 ^ seed);
+        seed1 = _Hash_mum(w2 ^ s[2], w3 ^ seed1);
+        seed2 = _Hash_mum(w4 ^ s[3], w5 ^ seed2);
+        p += 48;
+        i -= 48;
+      } while (i > 48);
+      seed ^= seed1 ^ seed2;
+    }
+    while (i > 16) {
+      uint64_t w0, w1;
+      _Hash_read128(p, fold, &w0, &w1);
+      seed = _Hash_mum(w0 ^ s[1], w1 ^ seed);
+      p += 16;
+      i -= 16;
+    }
+    // The last 16 bytes, overlapping what was already mixed if need be.
+    a = _Hash_read64(p + i - 16, fold);
+    b = _Hash_read64(p + i - 8, fold);
+  }
+  a ^= s[1];
+  b ^= seed;
+  _Hash_mum128(&a, &b);
+  return _Hash_mum(a ^ s[0] ^ len, b ^ s[1]);
+}
+
+uint64_t Hash_bytes(const void *data, size_t len, uint64_t seed) {
+  ASSERT(data != NULL || len == 0);
+  return _Hash_bytes(data, len, seed, false);
+}
+
+uint64_t Hash_bytes_case(const void *data, size_t len, uint64_t seed) {
+  ASSERT(data != NULL || len == 0);
+  return _Hash_bytes(data, len, seed, true);
+}
+
+// strlen is vectorized by the C library, so measuring first and then hashing
+// in 8-byte words beats scanning for the terminator a byte at a time.
+uint64_t Hash_cstring(const char *str, uint64_t seed) {
+  ASSERT(str != NULL);
+  return _Hash_bytes((const unsigned char *)str, strlen(str), seed, false);
+}
+
+uint64_t Hash_cstring_case(const char *str, uint64_t seed) {
+  ASSERT(str != NULL);
+  return _Hash_bytes((const unsigned char *)str, strlen(str), seed, true);
+}
+
+uint64_t Hash_u64(uint64_t value, uint64_t seed) {
+  return _Hash_mum(value ^ _Hash_secret[0], seed ^ _Hash_secret[1]);
+}
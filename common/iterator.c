@@ -1,17 +1,21 @@
 #include "public/iterator.h"
 
-#include <ctype.h>
+#include <float.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "public/array.h"
 #include "public/list.h"
 #include "public/forward_list.h"
+#include "public/hash.h"
 #include "public/map.h"
 #include "public/priority_queue.h"
 #include "public/queue.h"
 #include "public/set.h"
+#include "public/sort.h"
 #include "public/stack.h"
+#include "public/unrolled_list.h"
 #include "public/vector.h"
 
 void for_each(Iterator *iter, void (*action)(void *elem)) {
@@ -76,6 +80,9 @@ void sink_ensure_iterator_size_(const Sink *dest, Iterator *source) {
   case COLLECTION_MAP:
     size = Map_count((Map *)source->collection);
     break;
+  case COLLECTION_UNROLLED_LIST:
+    size = UnrolledList_count((UnrolledList *)source->collection);
+    break;
   default:
     return;
   }
@@ -98,7 +105,7 @@ bool Iterator_copy(Sink *dest, Iterator *iter) {
   return true;
 }
 
-void indexer_sort(const Indexer *indexer,
+void Indexer_sort(const Indexer *indexer,
                   int (*compare_fn)(const void *a, const void *b)) {
   ASSERT(indexer->collection_type & (COLLECTION_ARRAY | COLLECTION_VECTOR));
   void *data = NULL;
@@ -112,50 +119,55 @@ void indexer_sort(const Indexer *indexer,
   default:
     return; // not supported
   }
-  if (data) {
-    qsort(data, indexer->size(indexer), indexer->elem_size, compare_fn);
-  }
+  Sort_data(data, indexer->size(indexer), indexer->elem_size, compare_fn);
 }
 
 bool Iterator_sort(Sink *dest, Iterator *iter,
-               int (*compare_fn)(const void *a, const void *b)) {
+                   int (*compare_fn)(const void *a, const void *b)) {
   bool status = false;
-  Indexer indexer;
-  Sink interm_sink;
-  Vector *temp_list;
+  Vector *temp_list = NULL;
   Iterator list_iter;
-  Sink *interm_dest = dest;
-  if (dest->collection_type & (COLLECTION_ARRAY | COLLECTION_VECTOR)) {
-    // Write directly to the collection instead of using a temporary list
-    if (dest->collection_type == COLLECTION_VECTOR) {
-      Vector *dest_list = dest->collection;
-      Vector_clear(dest_list);
-      Vector_get_indexer(dest_list, &indexer);
-    } else {
-      Array *dest_array = dest->collection;
-      Array_get_indexer(dest_array, &indexer);
+  if (dest->collection_type == COLLECTION_VECTOR) {
+    // Sort directly in the collection instead of using a temporary list
+    Vector *dest_list = dest->collection;
+    Vector_clear(dest_list);
+    if (!Iterator_copy(dest, iter)) {
+      goto out;
+    }
+    Sort_data(Vector_get_data(dest_list), Vector_count(dest_list),
+              dest->elem_size, compare_fn);
+  } else if (dest->collection_type == COLLECTION_ARRAY) {
+    // Only the part of the array that was written gets sorted.
+    void *start = dest->state;
+    if (!Iterator_copy(dest, iter)) {
+      goto out;
     }
-    interm_dest = dest;
+    Sort_data(start,
+              (size_t)((char *)dest->state - (char *)start) / dest->elem_size,
+              dest->elem_size, compare_fn);
   } else {
     // Use a temporary list
     temp_list = Vector_alloc(iter->elem_size);
     if (!temp_list) {
       goto out;
     }
-    Vector_get_indexer(temp_list, &indexer);
+    Sink list_sink;
+    Vector_get_sink(temp_list, &list_sink);
+    if (!Iterator_copy(&list_sink, iter)) {
+      goto out_temp_list;
+    }
+    Sort_data(Vector_get_data(temp_list), Vector_count(temp_list),
+              iter->elem_size, compare_fn);
     Vector_get_iterator(temp_list, &list_iter);
-    Vector_get_sink(temp_list, &interm_sink);
-    interm_dest = &interm_sink;
+    if (!Iterator_copy(dest, &list_iter)) {
+      goto out_temp_list;
+    }
   }
-  // Copy the source and sort
-  Iterator_copy(interm_dest, iter);
-  indexer_sort(&indexer, compare_fn);
-  // Copy and free any temporary list.
+  status = true;
+out_temp_list:
   if (temp_list) {
-    Iterator_copy(dest, &list_iter);
+    Vector_free(temp_list);
   }
-out_temp_list:
-  Vector_free(temp_list);
 out:
   return status;
 }
@@ -172,28 +184,58 @@ void Iterator_filter(const Sink *dest, Iterator *iter,
 void Iterator_reduce(const void *dest, Iterator *iter,
                      void (*reduce_fn)(void *dest, const void *elem)) {}
 
+// The CString functions take pointers to the `char *' elements, like every
+// other KeyInfo function.
 int CString_compare(const void *a, const void *b) {
-  return strcmp((char *)a, (char *)b);
+  return strcmp(*(char *const *)a, *(char *const *)b);
 }
 
 int CStringCase_compare(const void *a, const void *b) {
-  return strcasecmp((char *)a, (char *)b);
+  return strcasecmp(*(char *const *)a, *(char *const *)b);
 }
 
-int CString_hash(const void *key) {
-  int hash = 13;
-  for (char *c = (char *)key; *c; c++) {
-    hash = hash * 7 + 17 * *c;
-  }
-  return hash;
+uint64_t CString_hash64(const void *key) {
+  return Hash_cstring(*(char *const *)key, HASH_DEFAULT_SEED);
 }
 
-int CStringCase_hash(const void *key) {
-  int hash = 13;
-  for (char *c = (char *)key; *c; c++) {
-    hash = hash * 7 + 17 * toupper(*c);
-  }
-  return hash;
+uint64_t CStringCase_hash64(const void *key) {
+  return Hash_cstring_case(*(char *const *)key, HASH_DEFAULT_SEED);
+}
+
+// The 32-bit string hashes keep the low half of the 64-bit ones, which are
+// mixed well enough that any subset of bits is usable.
+int CString_hash(const void *key) { return (int)CString_hash64(key); }
+
+int CStringCase_hash(const void *key) { return (int)CStringCase_hash64(key); }
+
+// Floating-point keys hash their bits, with -0.0 made 0.0 first since the two
+// compare equal. The bits are mixed so the low half used by the 32-bit hash
+// isn't mostly mantissa zeros.
+static uint64_t _Iterator_float_hash(float key) {
+  uint32_t bits;
+  key = key == 0 ? 0.0f : key;
+  memcpy(&bits, &key, sizeof(bits));
+  return Hash_u64(bits, HASH_DEFAULT_SEED);
+}
+
+static uint64_t _Iterator_double_hash(double key) {
+  uint64_t bits;
+  key = key == 0 ? 0.0 : key;
+  memcpy(&bits, &key, sizeof(bits));
+  return Hash_u64(bits, HASH_DEFAULT_SEED);
+}
+
+// Only the bytes that hold the value: x87's 80-bit format leaves the rest of
+// the 16 as padding, which may hold anything.
+#if LDBL_MANT_DIG == 64
+#define _ITERATOR_LONG_DOUBLE_BYTES 10
+#else
+#define _ITERATOR_LONG_DOUBLE_BYTES sizeof(long double)
+#endif
+
+static uint64_t _Iterator_long_double_hash(long double key) {
+  key = key == 0 ? 0.0L : key;
+  return Hash_bytes(&key, _ITERATOR_LONG_DOUBLE_BYTES, HASH_DEFAULT_SEED);
 }
 
 DEFINE_RELATIONAL_CONTAINER_BASIC(Int, int)
@@ -204,11 +246,13 @@ DEFINE_RELATIONAL_CONTAINER_BASIC(Short, short)
 
 DEFINE_RELATIONAL_CONTAINER_BASIC(Char, char)
 
-DEFINE_RELATIONAL_CONTAINER_BASIC(Float, float)
+DEFINE_RELATIONAL_CONTAINER_BASIC_EXT(Float, float, _Iterator_float_hash(key))
 
-DEFINE_RELATIONAL_CONTAINER_BASIC(Double, double)
+DEFINE_RELATIONAL_CONTAINER_BASIC_EXT(Double, double,
+                                      _Iterator_double_hash(key))
 
-DEFINE_RELATIONAL_CONTAINER_BASIC(LongDouble, long double)
+DEFINE_RELATIONAL_CONTAINER_BASIC_EXT(LongDouble, long double,
+                                      _Iterator_long_double_hash(key))
 
 DEFINE_RELATIONAL_CONTAINER_BASIC(UnsignedShort, unsigned short)
 
@@ -218,7 +262,8 @@ DEFINE_RELATIONAL_CONTAINER_BASIC(UnsignedLong, unsigned long)
 
 DEFINE_RELATIONAL_CONTAINER_BASIC(UnsignedChar, unsigned char)
 
-DEFINE_RELATIONAL_CONTAINER_FN(CString, char *, CString_hash, CString_compare)
+DEFINE_RELATIONAL_CONTAINER_FN_EXT(CString, char *, CString_hash,
+                                   CString_hash64, CString_compare)
 
-DEFINE_RELATIONAL_CONTAINER_FN(CStringCase, char *, CStringCase_hash,
-                               CString_compare)
+DEFINE_RELATIONAL_CONTAINER_FN_EXT(CStringCase, char *, CStringCase_hash,
+                                   CStringCase_hash64, CStringCase_compare)
@@ -21,9 +21,17 @@ DEFINE_LIST(UnsignedChar, unsigned char)
 DEFINE_LIST(CString, char *)
 
 bool List_init(List *list, size_t elem_size)
+{
+    return List_init_ext(list, elem_size, NULL);
+}
+
+bool List_init_ext(List *list, size_t elem_size, Arena *arena)
 {
     ASSERT(list);
     ASSERT(elem_size);
+    list->arena = arena;
+    list->pool = NULL;
+    list->owns_pool = false;
     list->elem_size = elem_size;
     list->count = 0;
     list->head = NULL;
@@ -32,13 +40,36 @@ bool List_init(List *list, size_t elem_size)
     return true;
 }
 
+// Gets memory for a node from the list's pool, or its arena.
+ListNode *_List_alloc_node(List *list)
+{
+    if (list->pool) {
+        return Pool_acquire(list->pool);
+    }
+    return Arena_malloc(list->arena, List_node_size(list));
+}
+
+void _List_free_node(List *list, ListNode *node)
+{
+    if (list->pool) {
+        Pool_release(list->pool, node);
+    } else {
+        Arena_release(list->arena, node);
+    }
+}
+
 void List_cleanup(List *list)
 {
-    ListNode *current = list->head;
-    while (current) {
-        ListNode *next = current->next;
-        free(current);
-        current = next;
+    if (list->owns_pool) {
+        // Nobody else has nodes in it, so drop them all at once.
+        Pool_clear(list->pool);
+    } else {
+        ListNode *current = list->head;
+        while (current) {
+            ListNode *next = current->next;
+            _List_free_node(list, current);
+            current = next;
+        }
     }
     list->head = NULL;
     list->tail = NULL;
@@ -46,15 +77,49 @@ void List_cleanup(List *list)
 }
 
 List *List_alloc(size_t elem_size)
+{
+    return List_alloc_ext(elem_size, NULL);
+}
+
+List *List_alloc_ext(size_t elem_size, Arena *arena)
+{
+    ASSERT(elem_size);
+    List *list = NULL;
+    if ((list = Arena_malloc(arena, sizeof(List))) == NULL) {
+        return NULL;
+    }
+    if (!List_init_ext(list, elem_size, arena)) {
+        Arena_release(arena, list);
+        return NULL;
+    }
+    return list;
+}
+
+List *List_alloc_pooled(size_t elem_size, Pool *pool)
 {
     ASSERT(elem_size);
+    ASSERT(!pool || Pool_object_size(pool) >= sizeof(ListNode) + elem_size);
     List *list = NULL;
-    if ((list = malloc(sizeof(list))) == NULL || !List_init(list, elem_size)) {
+    if ((list = List_alloc(elem_size)) == NULL) {
         return NULL;
     }
+    if (!pool) {
+        if ((pool = List_node_pool_alloc(elem_size)) == NULL) {
+            List_free(list);
+            return NULL;
+        }
+        list->owns_pool = true;
+    }
+    list->pool = pool;
     return list;
 }
 
+Pool *List_node_pool_alloc(size_t elem_size)
+{
+    ASSERT(elem_size);
+    return Pool_alloc(sizeof(ListNode) + elem_size);
+}
+
 size_t List_count(const List *list)
 {
     ASSERT(list);
@@ -71,7 +136,10 @@ void List_free(List *list)
 {
     ASSERT(list);
     List_cleanup(list);
-    free(list);
+    if (list->owns_pool) {
+        Pool_free(list->pool);
+    }
+    Arena_release(list->arena, list);
 }
 
 size_t List_element_size(const List *list)
@@ -143,17 +211,20 @@ ListNode *List_insert_before(List *list,
     ASSERT(list);
     ASSERT(node);
     ASSERT(elem);
-    size_t node_size = List_node_size(list);
-    ListNode *new_node = malloc(node_size);
+    ListNode *new_node = _List_alloc_node(list);
     if (!new_node) return NULL;
     memcpy(new_node->data, elem, list->elem_size);
+    new_node->prev = node->prev;
     new_node->next = node;
+    if (node->prev) {
+        node->prev->next = new_node;
+    }
     node->prev = new_node;
     if (node == list->head) {
         list->head = new_node;
     }
     list->count++;
-    return node;
+    return new_node;
 }
 
 ListNode *List_insert_after(List *list, ListNode *node,
@@ -162,11 +233,14 @@ ListNode *List_insert_after(List *list, ListNode *node,
     ASSERT(list);
     ASSERT(node);
     ASSERT(elem);
-    size_t node_size = List_node_size(list);
-    ListNode *new_node = malloc(node_size);
+    ListNode *new_node = _List_alloc_node(list);
     if (!new_node) return NULL;
     memcpy(new_node->data, elem, list->elem_size);
     new_node->prev = node;
+    new_node->next = node->next;
+    if (node->next) {
+        node->next->prev = new_node;
+    }
     node->next = new_node;
     if (node == list->tail) {
         list->tail = new_node;
@@ -183,10 +257,11 @@ ListNode *List_append(List *list, const void *elem)
         return List_insert_after(list, list->tail, elem);
     }
     // Singleton list case:
-    size_t node_size = List_node_size(list);
-    ListNode *node = malloc(node_size);
+    ListNode *node = _List_alloc_node(list);
     if (!node) return NULL;
     memcpy(node->data, elem, list->elem_size);
+    node->prev = NULL;
+    node->next = NULL;
     list->head = node;
     list->tail = node;
     list->count++;
@@ -201,10 +276,11 @@ ListNode *List_prepend(List *list, const void *elem)
         return List_insert_before(list, list->head, elem);
     }
     // Singleton list case:
-    size_t node_size = List_node_size(list);
-    ListNode *node = malloc(node_size);
+    ListNode *node = _List_alloc_node(list);
     if (!node) return NULL;
     memcpy(node->data, elem, list->elem_size);
+    node->prev = NULL;
+    node->next = NULL;
     list->head = node;
     list->tail = node;
     list->count++;
@@ -227,7 +303,7 @@ void List_remove(List *list, ListNode *node)
     if (node->next) {
         node->next->prev = node->prev;
     }
-    free(node);
+    _List_free_node(list, node);
     list->count--;
 }
 
@@ -259,10 +335,11 @@ void List_remove_range(List *list, ListNode *node,
     ASSERT(node);
     ASSERT(count >= 0);
 
-    while (count--) {
+    while (count > 0 && node) {
         ListNode *next = node->next;
-        List_remove(list, node); // Replaces current with next
-        if (!next) break;
+        List_remove(list, node);
+        node = next;
+        count--;
     }
     ASSERT(count == 0 && "Tried to remove too many nodes");
 }
@@ -0,0 +1,852 @@
+#include "protected/log.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "public/assert.h"
+#include "public/spsc_queue.h"
+
+// Nothing here logs, since logging would come straight back in, and nothing
+// includes test/stubs.h, so the tracker never sees the logger's own memory.
+
+_Static_assert(sizeof(LogRecord) == LOG_RECORD_SIZE,
+               "LOG_RECORD_SIZE doesn't match a LogRecord");
+
+static const char *const _LOG_LEVEL_NAMES[] = {"TRACE", "DEBUG", "INFO",
+                                               "WARN",  "ERROR", "FATAL"};
+
+// The signals that flush the rings before the process dies.
+static const int _LOG_CRASH_SIGNALS[] = {SIGSEGV, SIGBUS, SIGILL, SIGFPE,
+                                         SIGABRT};
+#define _LOG_CRASH_SIGNAL_COUNT                                                \
+  (sizeof(_LOG_CRASH_SIGNALS) / sizeof(_LOG_CRASH_SIGNALS[0]))
+
+// A thread's ring. Rings are only added to the list while the logger runs.
+// The background thread frees those whose threads have exited once it has
+// emptied them, and Log_stop frees the rest.
+struct _LogRing {
+  SpscQueue *queue;
+  uint32_t thread_id;
+  atomic_bool retired; // Set as the thread exits.
+  bool drained;        // Retired and emptied. Only the background thread uses it.
+  struct _LogRing *next;
+};
+
+// Taken to register a site or a thread, and to start and stop.
+static pthread_mutex_t _log_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static atomic_bool _log_running;
+static atomic_bool _log_stopping;
+// Bumped by every Log_start and Log_stop, so threads know their ring is gone.
+static atomic_uint _log_generation;
+static atomic_size_t _log_dropped;
+static atomic_uint _log_flush_requested;
+static atomic_uint _log_flush_done;
+// 1 once a crash asks for the rings to be flushed, 2 once they have been.
+static atomic_int _log_crash;
+
+static pthread_t _log_thread;
+static FILE *_log_file; // NULL to format records instead.
+static _Atomic(struct _LogRing *) _log_rings;
+static uint32_t _log_thread_count;
+static struct sigaction _log_old_actions[_LOG_CRASH_SIGNAL_COUNT];
+
+// Sites by id - 1. Sites keep their ids for good, so these outlive Log_stop.
+static LogSite **_log_sites;
+static uint32_t _log_site_count;
+static uint32_t _log_site_capacity;
+
+static _Thread_local struct _LogRing *_log_ring;
+static _Thread_local unsigned _log_ring_generation;
+// Holds each thread's ring, so it can be retired when the thread exits.
+static pthread_key_t _log_ring_key;
+static bool _log_ring_key_created;
+
+// A conversion in a format: `start' is its `%', and `end' is just past it.
+struct _LogSpec {
+  const char *start;
+  const char *end;
+  int stars; // Widths and precisions given as arguments.
+  int type;  // A LOG_ARG_*, or -1 for `%%' and conversions that print nothing.
+};
+
+// Parses the conversion at `p', which is a `%'. Returns false at the end of
+// the format.
+static bool _Log_parse_spec(const char *p, struct _LogSpec *spec) {
+  spec->start = p++;
+  spec->stars = 0;
+  spec->type = -1;
+  if (*p == '%') {
+    spec->end = p + 1;
+    return true;
+  }
+  while (*p && strchr("-+ #0'", *p)) {
+    p++;
+  }
+  for (int part = 0; part < 2; part++) {
+    if (*p == '*') {
+      spec->stars++;
+      p++;
+    }
+    while (*p >= '0' && *p <= '9') {
+      p++;
+    }
+    if (part == 0 && *p == '.') {
+      p++;
+    } else {
+      break;
+    }
+  }
+  int length = LOG_ARG_INT;
+  bool long_double = false;
+  switch (*p) {
+  case 'h':
+    p += p[1] == 'h' ? 2 : 1;
+    break;
+  case 'l':
+    length = p[1] == 'l' ? LOG_ARG_LONG_LONG : LOG_ARG_LONG;
+    p += p[1] == 'l' ? 2 : 1;
+    break;
+  case 'q':
+    length = LOG_ARG_LONG_LONG;
+    p++;
+    break;
+  case 'z':
+    length = LOG_ARG_SIZE;
+    p++;
+    break;
+  case 'j':
+    length = LOG_ARG_INTMAX;
+    p++;
+    break;
+  case 't':
+    length = LOG_ARG_PTRDIFF;
+    p++;
+    break;
+  case 'L':
+    long_double = true;
+    p++;
+    break;
+  }
+  if (!*p) {
+    return false;
+  }
+  switch (*p) {
+  case 'd': case 'i': case 'o': case 'u': case 'x': case 'X':
+    spec->type = length;
+    break;
+  case 'c':
+    spec->type = LOG_ARG_INT;
+    break;
+  case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a':
+  case 'A':
+    spec->type = long_double ? LOG_ARG_LONG_DOUBLE : LOG_ARG_DOUBLE;
+    break;
+  case 's':
+    spec->type = LOG_ARG_STRING;
+    break;
+  case 'p':
+    spec->type = LOG_ARG_POINTER;
+    break;
+  case 'n':
+    // Read as a pointer, but never written through.
+    spec->type = LOG_ARG_POINTER;
+    break;
+  }
+  spec->end = p + 1;
+  return true;
+}
+
+// Gives the site an id and works out its arguments, the first time it logs.
+static uint32_t _Log_register_site(LogSite *site) {
+  pthread_mutex_lock(&_log_lock);
+  uint32_t id = atomic_load_explicit(&site->id, memory_order_relaxed);
+  if (id != 0) {
+    goto out; // Another thread got here first.
+  }
+  if (_log_site_count == _log_site_capacity) {
+    uint32_t capacity = _log_site_capacity ? 2 * _log_site_capacity : 64;
+    LogSite **sites = realloc(_log_sites, capacity * sizeof(LogSite *));
+    if (!sites) {
+      goto out;
+    }
+    _log_sites = sites;
+    _log_site_capacity = capacity;
+  }
+  site->arg_count = 0;
+  const char *p = site->format;
+  struct _LogSpec spec;
+  while ((p = strchr(p, '%')) && _Log_parse_spec(p, &spec)) {
+    for (int i = 0; i < spec.stars && site->arg_count < LOG_MAX_ARGS; i++) {
+      site->arg_types[site->arg_count++] = LOG_ARG_INT;
+    }
+    if (spec.type >= 0 && site->arg_count < LOG_MAX_ARGS) {
+      site->arg_types[site->arg_count++] = (unsigned char)spec.type;
+    }
+    p = spec.end;
+  }
+  _log_sites[_log_site_count++] = site;
+  id = _log_site_count;
+  atomic_store_explicit(&site->id, id, memory_order_release);
+out:
+  pthread_mutex_unlock(&_log_lock);
+  return id;
+}
+
+// Runs as a thread exits. The ring is only still in the list if the logger
+// hasn't been stopped since the thread made it.
+// The thread forgets the ring, since the background thread may free it from
+// now on; anything it logs later, from another destructor say, goes to a
+// fresh ring, which is retired in turn.
+static void _Log_retire_ring(void *ring) {
+  pthread_mutex_lock(&_log_lock);
+  if (ring == _log_ring &&
+      _log_ring_generation == atomic_load(&_log_generation)) {
+    atomic_store_explicit(&((struct _LogRing *)ring)->retired, true,
+                          memory_order_release);
+  }
+  _log_ring = NULL;
+  pthread_mutex_unlock(&_log_lock);
+}
+
+// Gets the calling thread's ring, making it on the thread's first record.
+static struct _LogRing *_Log_thread_ring(void) {
+  unsigned generation =
+      atomic_load_explicit(&_log_generation, memory_order_acquire);
+  if (_log_ring && _log_ring_generation == generation) {
+    return _log_ring;
+  }
+  pthread_mutex_lock(&_log_lock);
+  struct _LogRing *ring = malloc(sizeof(struct _LogRing));
+  if (!ring) {
+    goto out;
+  }
+  if (!(ring->queue = SpscQueue_alloc(sizeof(LogRecord), LOG_RING_CAPACITY))) {
+    free(ring);
+    ring = NULL;
+    goto out;
+  }
+  ring->thread_id = ++_log_thread_count;
+  atomic_init(&ring->retired, false);
+  ring->drained = false;
+  if (_log_ring_key_created) {
+    pthread_setspecific(_log_ring_key, ring);
+  }
+  ring->next = atomic_load_explicit(&_log_rings, memory_order_relaxed);
+  atomic_store_explicit(&_log_rings, ring, memory_order_release);
+  _log_ring = ring;
+  _log_ring_generation = generation;
+out:
+  pthread_mutex_unlock(&_log_lock);
+  return ring;
+}
+
+static void _Log_put(unsigned char *payload, size_t *size, const void *value) {
+  memcpy(payload + *size, value, 8);
+  *size += 8;
+}
+
+// Copies the arguments into the payload, as far as they fit. Returns its size.
+static size_t _Log_pack(const LogSite *site, unsigned char *payload,
+                        va_list args) {
+  size_t size = 0;
+  size_t capacity = sizeof(((LogRecord *)0)->payload);
+  for (int i = 0; i < site->arg_count; i++) {
+    int64_t n;
+    double d;
+    int type = site->arg_types[i];
+    if (type == LOG_ARG_STRING) {
+      const char *s = va_arg(args, const char *);
+      if (!s) {
+        s = "(null)";
+      }
+      if (capacity - size < 2) {
+        break;
+      }
+      size_t length = strnlen(s, LOG_MAX_STRING);
+      if (length > capacity - size - 2) {
+        length = capacity - size - 2;
+      }
+      uint16_t length16 = (uint16_t)length;
+      memcpy(payload + size, &length16, 2);
+      memcpy(payload + size + 2, s, length);
+      size += 2 + length;
+      continue;
+    }
+    if (capacity - size < 8) {
+      break;
+    }
+    switch (type) {
+    case LOG_ARG_INT:
+      n = va_arg(args, int);
+      _Log_put(payload, &size, &n);
+      break;
+    case LOG_ARG_LONG:
+      n = va_arg(args, long);
+      _Log_put(payload, &size, &n);
+      break;
+    case LOG_ARG_LONG_LONG:
+      n = va_arg(args, long long);
+      _Log_put(payload, &size, &n);
+      break;
+    case LOG_ARG_SIZE:
+      n = (int64_t)va_arg(args, size_t);
+      _Log_put(payload, &size, &n);
+      break;
+    case LOG_ARG_INTMAX:
+      n = va_arg(args, intmax_t);
+      _Log_put(payload, &size, &n);
+      break;
+    case LOG_ARG_PTRDIFF:
+      n = va_arg(args, ptrdiff_t);
+      _Log_put(payload, &size, &n);
+      break;
+    case LOG_ARG_DOUBLE:
+      d = va_arg(args, double);
+      _Log_put(payload, &size, &d);
+      break;
+    case LOG_ARG_LONG_DOUBLE:
+      d = (double)va_arg(args, long double);
+      _Log_put(payload, &size, &d);
+      break;
+    case LOG_ARG_POINTER:
+      n = (int64_t)(uintptr_t)va_arg(args, void *);
+      _Log_put(payload, &size, &n);
+      break;
+    }
+  }
+  return size;
+}
+
+void Log_write(LogSite *site, int level, size_t indent, ...) {
+  ASSERT(site != NULL);
+  if (!atomic_load_explicit(&_log_running, memory_order_acquire)) {
+    return;
+  }
+  uint32_t id = atomic_load_explicit(&site->id, memory_order_acquire);
+  if (id == 0 && (id = _Log_register_site(site)) == 0) {
+    atomic_fetch_add_explicit(&_log_dropped, 1, memory_order_relaxed);
+    return;
+  }
+  struct _LogRing *ring = _Log_thread_ring();
+  if (!ring) {
+    atomic_fetch_add_explicit(&_log_dropped, 1, memory_order_relaxed);
+    return;
+  }
+  LogRecord record;
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  record.timestamp_ns = (uint64_t)now.tv_sec * 1000000000u + now.tv_nsec;
+  record.site_id = id;
+  record.thread_id = ring->thread_id;
+  record.level = (uint8_t)level;
+  record.indent = indent < 255 ? (uint8_t)indent : 255;
+  va_list args;
+  va_start(args, indent);
+  record.payload_size = (uint16_t)_Log_pack(site, record.payload, args);
+  va_end(args);
+  // Whatever the stack held before doesn't go to the file.
+  memset(record.payload + record.payload_size, 0,
+         sizeof(record.payload) - record.payload_size);
+  if (!SpscQueue_enqueue(ring->queue, &record)) {
+    atomic_fetch_add_explicit(&_log_dropped, 1, memory_order_relaxed);
+  }
+}
+
+// Reads the next 8-byte argument of a payload into `value'. Returns false if
+// there are no more.
+static bool _Log_take(const LogRecord *record, size_t *offset, void *value) {
+  if (record->payload_size - *offset < 8) {
+    return false;
+  }
+  memcpy(value, record->payload + *offset, 8);
+  *offset += 8;
+  return true;
+}
+
+// Formats the message of a record, the arguments taken from its payload in
+// place of the ones printf would have been given.
+static void _Log_format_message(FILE *out, const char *format,
+                                const LogRecord *record) {
+  size_t offset = 0;
+  const char *p = format;
+  struct _LogSpec spec;
+  char spec_text[64];
+  char string[LOG_MAX_STRING + 1];
+  for (;;) {
+    const char *next = strchr(p, '%');
+    if (!next || !_Log_parse_spec(next, &spec)) {
+      fputs(p, out);
+      return;
+    }
+    fwrite(p, 1, next - p, out);
+    p = spec.end;
+    if (spec.end - spec.start == 2 && spec.start[1] == '%') {
+      fputc('%', out);
+      continue;
+    }
+    // The spec with each `*' replaced by the number it stands for.
+    size_t length = 0;
+    bool missing = false;
+    for (const char *c = spec.start; c < spec.end && length < 40; c++) {
+      if (*c == '*') {
+        int64_t n;
+        missing |= !_Log_take(record, &offset, &n);
+        length += snprintf(spec_text + length, sizeof(spec_text) - length,
+                           "%d", (int)n);
+      } else {
+        spec_text[length++] = *c;
+      }
+    }
+    spec_text[length] = '\0';
+    int64_t n = 0;
+    if (spec.type < 0) {
+      continue;
+    }
+    if (spec.end[-1] == 'n') {
+      _Log_take(record, &offset, &n); // Nothing to print.
+      continue;
+    }
+    double d = 0;
+    if (spec.type == LOG_ARG_STRING) {
+      uint16_t string_length;
+      if (missing || record->payload_size - offset < 2) {
+        fputc('?', out);
+        continue;
+      }
+      memcpy(&string_length, record->payload + offset, 2);
+      if (string_length > record->payload_size - offset - 2 ||
+          string_length > LOG_MAX_STRING) {
+        fputc('?', out);
+        offset = record->payload_size;
+        continue;
+      }
+      memcpy(string, record->payload + offset + 2, string_length);
+      string[string_length] = '\0';
+      offset += 2 + string_length;
+      fprintf(out, spec_text, string);
+      continue;
+    }
+    if (missing || !_Log_take(record, &offset,
+                              spec.type == LOG_ARG_DOUBLE ||
+                                      spec.type == LOG_ARG_LONG_DOUBLE
+                                  ? (void *)&d
+                                  : (void *)&n)) {
+      fputc('?', out);
+      continue;
+    }
+    switch (spec.type) {
+    case LOG_ARG_INT:
+      fprintf(out, spec_text, (int)n);
+      break;
+    case LOG_ARG_LONG:
+      fprintf(out, spec_text, (long)n);
+      break;
+    case LOG_ARG_LONG_LONG:
+      fprintf(out, spec_text, (long long)n);
+      break;
+    case LOG_ARG_SIZE:
+      fprintf(out, spec_text, (size_t)n);
+      break;
+    case LOG_ARG_INTMAX:
+      fprintf(out, spec_text, (intmax_t)n);
+      break;
+    case LOG_ARG_PTRDIFF:
+      fprintf(out, spec_text, (ptrdiff_t)n);
+      break;
+    case LOG_ARG_DOUBLE:
+      fprintf(out, spec_text, d);
+      break;
+    case LOG_ARG_LONG_DOUBLE:
+      fprintf(out, spec_text, (long double)d);
+      break;
+    case LOG_ARG_POINTER:
+      fprintf(out, spec_text, (void *)(uintptr_t)n);
+      break;
+    }
+  }
+}
+
+// Formats a whole line the way the LOG_* macros print it.
+static void _Log_format_line(FILE *out, int level, const char *file, int line,
+                             const char *format, const LogRecord *record) {
+  const char *name = level >= 0 && level <= FATAL ? _LOG_LEVEL_NAMES[level]
+                                                   : "?";
+  fprintf(out, "%-5s %40s:%-5d: %*s", name, file, line, (int)record->indent,
+          "");
+  _Log_format_message(out, format, record);
+  fputc('\n', out);
+}
+
+// The background thread's view of the sites, copied from the shared table as
+// it meets new ones, so it needn't lock for each record.
+struct _LogDrain {
+  LogSite **sites;
+  uint32_t site_count;
+  uint32_t sites_written; // Site entries already in the file.
+  size_t dropped;         // Drops already reported.
+};
+
+static LogSite *_Log_drain_site(struct _LogDrain *drain, uint32_t id) {
+  if (id > drain->site_count) {
+    pthread_mutex_lock(&_log_lock);
+    LogSite **sites = realloc(drain->sites, _log_site_count * sizeof(LogSite *));
+    if (sites) {
+      memcpy(sites, _log_sites, _log_site_count * sizeof(LogSite *));
+      drain->sites = sites;
+      drain->site_count = _log_site_count;
+    }
+    pthread_mutex_unlock(&_log_lock);
+  }
+  return id <= drain->site_count ? drain->sites[id - 1] : NULL;
+}
+
+static void _Log_write_site(const LogSite *site, uint32_t id) {
+  int32_t header[2] = {(int32_t)id, site->line};
+  uint16_t lengths[2] = {(uint16_t)strlen(site->file),
+                         (uint16_t)strlen(site->format)};
+  fputc('S', _log_file);
+  fwrite(header, sizeof(header), 1, _log_file);
+  fwrite(lengths, sizeof(lengths), 1, _log_file);
+  fwrite(site->file, 1, lengths[0], _log_file);
+  fwrite(site->format, 1, lengths[1], _log_file);
+}
+
+static void _Log_emit(struct _LogDrain *drain, const LogRecord *record) {
+  LogSite *site = _Log_drain_site(drain, record->site_id);
+  if (!site) {
+    return;
+  }
+  if (_log_file) {
+    while (drain->sites_written < record->site_id) {
+      drain->sites_written++;
+      _Log_write_site(drain->sites[drain->sites_written - 1],
+                      drain->sites_written);
+    }
+    fputc('R', _log_file);
+    fwrite(record, sizeof(LogRecord), 1, _log_file);
+  } else {
+    _Log_format_line(record->level < WARN ? stdout : stderr, record->level,
+                     site->file, site->line, site->format, record);
+  }
+}
+
+// Unlinks and frees the drained rings. Threads only ever push onto the head
+// of the list, under the lock, so holding it keeps the list still.
+static void _Log_free_drained(void) {
+  pthread_mutex_lock(&_log_lock);
+  struct _LogRing *prev = NULL;
+  struct _LogRing *ring = atomic_load(&_log_rings);
+  while (ring) {
+    struct _LogRing *next = ring->next;
+    if (ring->drained) {
+      if (prev) {
+        prev->next = next;
+      } else {
+        atomic_store(&_log_rings, next);
+      }
+      SpscQueue_free(ring->queue);
+      free(ring);
+    } else {
+      prev = ring;
+    }
+    ring = next;
+  }
+  pthread_mutex_unlock(&_log_lock);
+}
+
+// Empties every ring, and frees those of threads that have exited. Returns
+// how many records it took.
+static size_t _Log_drain(struct _LogDrain *drain) {
+  LogRecord records[64];
+  size_t total = 0;
+  bool any_drained = false;
+  for (struct _LogRing *ring =
+           atomic_load_explicit(&_log_rings, memory_order_acquire);
+       ring; ring = ring->next) {
+    // A thread that has retired its ring won't write to it again, so once
+    // it's emptied it stays empty.
+    bool retired =
+        atomic_load_explicit(&ring->retired, memory_order_acquire);
+    size_t count;
+    while ((count = SpscQueue_dequeue_n(ring->queue, records, 64)) > 0) {
+      for (size_t i = 0; i < count; i++) {
+        _Log_emit(drain, &records[i]);
+      }
+      total += count;
+    }
+    ring->drained = retired;
+    any_drained |= retired;
+  }
+  if (any_drained) {
+    _Log_free_drained();
+  }
+  size_t dropped = atomic_load_explicit(&_log_dropped, memory_order_relaxed);
+  if (dropped != drain->dropped) {
+    drain->dropped = dropped;
+    if (_log_file) {
+      uint64_t dropped64 = dropped;
+      fputc('D', _log_file);
+      fwrite(&dropped64, sizeof(dropped64), 1, _log_file);
+    } else {
+      fprintf(stderr, "WARN  log: %zu records dropped so far\n", dropped);
+    }
+  }
+  return total;
+}
+
+static void _Log_flush_output(void) {
+  if (_log_file) {
+    fflush(_log_file);
+  } else {
+    fflush(stdout);
+    fflush(stderr);
+  }
+}
+
+static void *_Log_main(void *arg) {
+  struct _LogDrain drain = {NULL, 0, 0, 0};
+  for (;;) {
+    // Whatever was logged before these were set gets drained on this pass.
+    bool stopping = atomic_load(&_log_stopping);
+    int crash = atomic_load(&_log_crash);
+    unsigned flush = atomic_load(&_log_flush_requested);
+    size_t count = _Log_drain(&drain);
+    if (count > 0 || flush != atomic_load(&_log_flush_done) || crash == 1) {
+      _Log_flush_output();
+    }
+    atomic_store(&_log_flush_done, flush);
+    if (crash == 1) {
+      atomic_store(&_log_crash, 2);
+    }
+    if (stopping) {
+      break;
+    }
+    if (count == 0) {
+      struct timespec pause = {0, 1000000};
+      nanosleep(&pause, NULL);
+    }
+  }
+  free(drain.sites);
+  return NULL;
+}
+
+// Gives the background thread up to a second to write out the rings, then
+// lets the signal take its course.
+static void _Log_crash_handler(int signal) {
+  size_t index = 0;
+  while (_LOG_CRASH_SIGNALS[index] != signal) {
+    index++;
+  }
+  if (atomic_load(&_log_running) && !pthread_equal(pthread_self(), _log_thread)) {
+    int expected = 0;
+    atomic_compare_exchange_strong(&_log_crash, &expected, 1);
+    for (int i = 0; i < 1000 && atomic_load(&_log_crash) != 2; i++) {
+      struct timespec pause = {0, 1000000};
+      nanosleep(&pause, NULL);
+    }
+  }
+  sigaction(signal, &_log_old_actions[index], NULL);
+  raise(signal);
+}
+
+static void _Log_flush_at_exit(void) {
+  if (Log_running()) {
+    Log_flush();
+  }
+}
+
+bool Log_start(const char *path) {
+  static bool exit_handler = false;
+  pthread_mutex_lock(&_log_lock);
+  if (atomic_load(&_log_running)) {
+    goto out_false;
+  }
+  _log_file = NULL;
+  if (path) {
+    uint32_t record_size = sizeof(LogRecord);
+    if (!(_log_file = fopen(path, "wb"))) {
+      goto out_false;
+    }
+    fwrite(LOG_FILE_MAGIC, 1, 8, _log_file);
+    fwrite(&record_size, sizeof(record_size), 1, _log_file);
+  }
+  atomic_store(&_log_stopping, false);
+  atomic_store(&_log_crash, 0);
+  atomic_store(&_log_dropped, 0);
+  atomic_fetch_add(&_log_generation, 1);
+  _log_thread_count = 0;
+  if (pthread_create(&_log_thread, NULL, _Log_main, NULL) != 0) {
+    goto out_close;
+  }
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = _Log_crash_handler;
+  sigemptyset(&action.sa_mask);
+  for (size_t i = 0; i < _LOG_CRASH_SIGNAL_COUNT; i++) {
+    sigaction(_LOG_CRASH_SIGNALS[i], &action, &_log_old_actions[i]);
+  }
+  if (!exit_handler) {
+    exit_handler = atexit(_Log_flush_at_exit) == 0;
+  }
+  if (!_log_ring_key_created) {
+    _log_ring_key_created =
+        pthread_key_create(&_log_ring_key, _Log_retire_ring) == 0;
+  }
+  atomic_store(&_log_running, true);
+  pthread_mutex_unlock(&_log_lock);
+  return true;
+
+out_close:
+  if (_log_file) {
+    fclose(_log_file);
+    _log_file = NULL;
+  }
+out_false:
+  pthread_mutex_unlock(&_log_lock);
+  return false;
+}
+
+void Log_stop(void) {
+  pthread_mutex_lock(&_log_lock);
+  if (!atomic_load(&_log_running)) {
+    pthread_mutex_unlock(&_log_lock);
+    return;
+  }
+  atomic_store(&_log_running, false);
+  atomic_store(&_log_stopping, true);
+  // Threads exiting from here on leave their rings to the loop below.
+  atomic_fetch_add(&_log_generation, 1);
+  pthread_mutex_unlock(&_log_lock);
+  // The thread takes the lock to look up sites.
+  pthread_join(_log_thread, NULL);
+
+  pthread_mutex_lock(&_log_lock);
+  for (size_t i = 0; i < _LOG_CRASH_SIGNAL_COUNT; i++) {
+    sigaction(_LOG_CRASH_SIGNALS[i], &_log_old_actions[i], NULL);
+  }
+  if (_log_file) {
+    fclose(_log_file);
+    _log_file = NULL;
+  }
+  struct _LogRing *ring = atomic_exchange(&_log_rings, NULL);
+  while (ring) {
+    struct _LogRing *next = ring->next;
+    SpscQueue_free(ring->queue);
+    free(ring);
+    ring = next;
+  }
+  pthread_mutex_unlock(&_log_lock);
+}
+
+bool Log_running(void) {
+  return atomic_load_explicit(&_log_running, memory_order_relaxed);
+}
+
+void Log_flush(void) {
+  if (!Log_running()) {
+    return;
+  }
+  unsigned request = atomic_fetch_add(&_log_flush_requested, 1) + 1;
+  while ((int)(atomic_load(&_log_flush_done) - request) < 0 &&
+         Log_running()) {
+    struct timespec pause = {0, 100000};
+    nanosleep(&pause, NULL);
+  }
+}
+
+size_t Log_dropped(void) { return atomic_load(&_log_dropped); }
+
+bool Log_decode(FILE *in, FILE *out) {
+  ASSERT(in != NULL);
+  ASSERT(out != NULL);
+  char magic[8];
+  uint32_t record_size;
+  if (fread(magic, 1, 8, in) != 8 || memcmp(magic, LOG_FILE_MAGIC, 8) != 0 ||
+      fread(&record_size, sizeof(record_size), 1, in) != 1 ||
+      record_size != sizeof(LogRecord)) {
+    return false;
+  }
+  struct _LogSiteEntry {
+    int line;
+    char *file;
+    char *format;
+  } *sites = NULL;
+  uint32_t site_count = 0;
+  bool ok = false;
+  int tag;
+  while ((tag = fgetc(in)) != EOF) {
+    if (tag == 'S') {
+      int32_t header[2];
+      uint16_t lengths[2];
+      if (fread(header, sizeof(header), 1, in) != 1 ||
+          fread(lengths, sizeof(lengths), 1, in) != 1 || header[0] <= 0) {
+        goto out;
+      }
+      uint32_t id = (uint32_t)header[0];
+      if (id > site_count) {
+        struct _LogSiteEntry *grown = realloc(sites, id * sizeof(*sites));
+        if (!grown) {
+          goto out;
+        }
+        memset(grown + site_count, 0, (id - site_count) * sizeof(*sites));
+        sites = grown;
+        site_count = id;
+      }
+      struct _LogSiteEntry *site = &sites[id - 1];
+      free(site->file);
+      free(site->format);
+      site->line = header[1];
+      site->file = calloc(lengths[0] + 1, 1);
+      site->format = calloc(lengths[1] + 1, 1);
+      if (!site->file || !site->format ||
+          fread(site->file, 1, lengths[0], in) != lengths[0] ||
+          fread(site->format, 1, lengths[1], in) != lengths[1]) {
+        goto out;
+      }
+    } else if (tag == 'R') {
+      LogRecord record;
+      if (fread(&record, sizeof(record), 1, in) != 1 ||
+          record.payload_size > sizeof(record.payload)) {
+        goto out;
+      }
+      time_t seconds = (time_t)(record.timestamp_ns / 1000000000u);
+      struct tm tm;
+      char when[32];
+      gmtime_r(&seconds, &tm);
+      strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", &tm);
+      fprintf(out, "%s.%09u T%-3u ", when,
+              (unsigned)(record.timestamp_ns % 1000000000u),
+              (unsigned)record.thread_id);
+      if (record.site_id == 0 || record.site_id > site_count ||
+          !sites[record.site_id - 1].format) {
+        fprintf(out, "(unknown site %u)\n", (unsigned)record.site_id);
+        continue;
+      }
+      struct _LogSiteEntry *site = &sites[record.site_id - 1];
+      _Log_format_line(out, record.level, site->file, site->line,
+                       site->format, &record);
+    } else if (tag == 'D') {
+      uint64_t dropped;
+      if (fread(&dropped, sizeof(dropped), 1, in) != 1) {
+        goto out;
+      }
+      fprintf(out, "WARN  log: %llu records dropped so far\n",
+              (unsigned long long)dropped);
+    } else {
+      goto out;
+    }
+  }
+  ok = true;
+out:
+  for (uint32_t i = 0; i < site_count; i++) {
+    free(sites[i].file);
+    free(sites[i].format);
+  }
+  free(sites);
+  return ok;
+}
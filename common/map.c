@@ -1,12 +1,13 @@
 #include "protected/map.h"
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "../test/stubs.h"
 #include "public/assert.h"
+#include "public/hash.h"
 #include "public/iterator.h"
-#include "public/vector.h"
 
 // TODO:
 // - Version
@@ -22,29 +23,10 @@ void _Map_swap(Map *a, Map *b) {
   *b = tmp;
 }
 
-void _Vector_print_MapBucket(const Vector *self, char *str, struct MapBucket *bucket) {
-  char buffer[10000];
-  sprintf(str, " *(Vector<KeyValuePair>)(%p): {", bucket->key_value_pairs);
-  size_t len = Vector_count(bucket->key_value_pairs);
-  if (len) {
-    for (size_t i = 0; i < len; i++) {
-      KeyValuePair kvp = *(KeyValuePair*)Vector_get(bucket->key_value_pairs, i);
-      sprintf(str + strlen(str), " %zu { *key (%p): ", i, kvp.key);
-      bucket->map->print_key(bucket->map, buffer, kvp.key);
-      strcat(str, buffer);
-      sprintf(str + strlen(str), " , *value (%p): ", kvp.value);
-      bucket->map->print_value(bucket->map, buffer, kvp.value);
-      strcat(str, buffer);
-      strcat(str, " }");
-    }
-  }
-  strcat(str, " }");
-}
-
 void _Map_default_key_print_fn(const Map *self, char *str, const unsigned char *elem) {
   char byte[4];
   str[0] = '\0';
-  for (size_t i = 0; i < self->elem_size; i++) {
+  for (size_t i = 0; i < self->key_info.key_size; i++) {
     sprintf(byte, " %02x", elem[i]);
     strcat(str, byte);
   }
@@ -53,7 +35,7 @@ void _Map_default_key_print_fn(const Map *self, char *str, const unsigned char *
 void _Map_default_value_print_fn(const Map *self, char *str, const unsigned char *elem) {
   char byte[4];
   str[0] = '\0';
-  for (size_t i = 0; i < self->key_info.key_size; i++) {
+  for (size_t i = 0; i < self->elem_size; i++) {
     sprintf(byte, " %02x", elem[i]);
     strcat(str, byte);
   }
@@ -98,99 +80,179 @@ void Map_print(const Map *map, char *buffer)
 }
 
 void _Map_log_element(const Map *map, const char *message, const char *key) {
+  if (!LOG_ENABLED(TRACE)) {
+    return; // Don't look the key up again just to format it.
+  }
   char buffer[10000];
   Map_print_element(map, buffer, key);
   LOG_FORMAT(TRACE, "%s: %s", message, buffer);
 }
 
-const KeyValuePair *_Map_find_ext(const Map *map, const void *key, int hash);
-
-int _Map_hash(const Map *map, const void *key) {
+// Hashes a key and finalizes it, so the low bits pick the slot.
+uint64_t _Map_hash(const Map *map, const void *key) {
   ASSERT(map != NULL);
   ASSERT(key != NULL);
 
-  int hash = map->key_info.hash_fn(key);
-  return hash > 0 ? hash : -hash;
+  return Hash_fibonacci(KeyInfo_hash(&map->key_info, key));
+}
+
+// The 7 hash bits stored in the control byte of a full slot. Taken from the
+// top of the hash, so they're independent of the probe position.
+unsigned char _Map_hash_tag(uint64_t hash) {
+  return (unsigned char)(hash >> 57);
+}
+
+// Rounds `size' up to a multiple of `align' (a power of 2).
+size_t _Map_align_up(size_t size, size_t align) {
+  return (size + align - 1) & ~(align - 1);
+}
+
+// The alignment used for an inline key or value of the given size.
+size_t _Map_align_for(size_t size) {
+  size_t align = sizeof(void *);
+  while (align < 16 && size % (align << 1) == 0) {
+    align <<= 1;
+  }
+  return align;
+}
+
+unsigned char *_Map_slot(const Map *map, const struct MapTable *table,
+                         size_t index) {
+  return table->slots + map->slot_size * index;
+}
+
+KeyValuePair *_Map_slot_kvp(const Map *map, const struct MapTable *table,
+                            size_t index) {
+  return &((struct MapSlot *)_Map_slot(map, table, index))->kvp;
+}
+
+bool _Map_rehashing(const Map *map) {
+  return map->old_table.slots != NULL;
+}
+
+// Number of slots across both tables. Together with _Map_entry this lets
+// callers walk every entry without caring whether a rehash is in progress.
+size_t _Map_entry_count(const Map *map) {
+  return map->table.capacity + map->old_table.capacity;
+}
+
+// Gets the entry in slot `index' of the combined slot range, or NULL.
+KeyValuePair *_Map_entry(const Map *map, size_t index) {
+  const struct MapTable *table = &map->table;
+  if (index >= table->capacity) {
+    index -= table->capacity;
+    table = &map->old_table;
+  }
+  if (!MAP_CTRL_IS_FULL(table->ctrl[index])) {
+    return NULL;
+  }
+  return _Map_slot_kvp(map, table, index);
+}
+
+// Allocates the slab of slots and control bytes for `capacity' slots.
+bool _Map_alloc_table(Map *map, struct MapTable *table, size_t capacity) {
+  ASSERT((capacity & (capacity - 1)) == 0 && "capacity must be a power of 2");
+  unsigned char *slab;
+  if (NULL == (slab = Arena_malloc(map->arena,
+                                   map->slot_size * capacity + capacity))) {
+    return false;
+  }
+  table->slots = slab;
+  table->ctrl = slab + map->slot_size * capacity;
+  table->capacity = capacity;
+  table->tombstones = 0;
+  memset(table->ctrl, MAP_CTRL_EMPTY, capacity);
+  return true;
+}
+
+void _Map_free_table(Map *map, struct MapTable *table) {
+  if (table->slots != NULL) {
+    LOG_FORMAT(TRACE, "Freeing slab (%p)...", table->slots);
+    Arena_release(map->arena, table->slots);
+  }
+  table->slots = NULL;
+  table->ctrl = NULL;
+  table->capacity = 0;
+  table->tombstones = 0;
+}
+
+// Allocates an empty table of at least `capacity' slots for a map that has
+// none, as after Map_cleanup. The map's settings are left as they are.
+bool _Map_rebuild_table(Map *map, size_t capacity) {
+  size_t num_slots = 8;
+  while (num_slots < capacity) {
+    num_slots <<= 1;
+  }
+  LOG_FORMAT(TRACE, "Allocating slab for %zu slots...", num_slots);
+  if (!_Map_alloc_table(map, &map->table, num_slots)) {
+    map->table = (struct MapTable){NULL, NULL, 0, 0};
+    LOG(WARN, "Unable to allocate map slab.");
+    return false;
+  }
+  return true;
 }
 
 // Initializes a pre-allocated Map object with a custom capacity
 bool Map_init_ext(Map *map, KeyInfo *key_info, size_t elem_size,
-                  size_t capacity) {
+                  size_t capacity, Arena *arena) {
   LOG_FORMAT(TRACE,
              "Map_init_ext(*map: %p, *key_info: %p, elem_size: %zu, capacity: "
-             "%zu) called...",
-             map, key_info, elem_size, capacity);
+             "%zu, *arena: %p) called...",
+             map, key_info, elem_size, capacity, arena);
   LOG_INDENT();
-  struct MapBucket bucket;
-  LOG(TRACE, "Allocating vector...");
-  if (!(map->buckets = Vector_alloc(sizeof(struct MapBucket)))) {
-    goto error;
-  }
-  Vector_print_fn(map->buckets, (void(*)(const Vector*, char*, const void*))_Vector_print_MapBucket);
-  map->capacity = capacity;
-  map->count = 0;
+  map->arena = arena;
   map->key_info = *key_info;
   map->elem_size = elem_size;
+  map->count = 0;
   map->version = 0;
+  map->incremental = false;
+  map->rehash_index = 0;
+  map->old_table = (struct MapTable){NULL, NULL, 0, 0};
   map->print_key = (void (*)(const Map *, char *, const void*))_Map_default_key_print_fn;
   map->print_value = (void (*)(const Map *, char *, const void*))_Map_default_value_print_fn;
-  LOG(TRACE, "Reserving capacity for vector...");
-  if (!Vector_reserve(map->buckets, capacity)) {
-    goto error_buckets;
-  }
-  LOG(TRACE, "Adding bucket key/value pair vectors...");
-  LOG_INDENT();
-  for (size_t i = 0; i < capacity; i++) {
-    LOG(TRACE, "Allocating key/value pair vector...");
-    if (NULL == (bucket.key_value_pairs = Vector_alloc(sizeof(KeyValuePair)))) {
-      goto error_kvps;
-    }
-    bucket.map = map;
-    LOG(TRACE, "Adding key/value pair vector to bucket vector...");
-    if (!Vector_add(map->buckets, &bucket)) {
-      goto error_kvps;
-    }
-  }
+  size_t key_align = _Map_align_for(key_info->key_size);
+  size_t value_align = _Map_align_for(elem_size);
+  size_t slot_align = key_align > value_align ? key_align : value_align;
+  map->key_offset = _Map_align_up(sizeof(struct MapSlot), key_align);
+  map->value_offset = _Map_align_up(map->key_offset + key_info->key_size, value_align);
+  map->slot_size = _Map_align_up(map->value_offset + elem_size, slot_align);
+  LOG_FORMAT(TRACE, "Slot size = %zu (key at %zu, value at %zu)", map->slot_size,
+             map->key_offset, map->value_offset);
+  bool result = _Map_rebuild_table(map, capacity);
   LOG_DEINDENT();
-  LOG_DEINDENT();
-  return true;
-error_kvps:
-  LOG(WARN, "Error occurred. Freeing key value pairs...");
-  for (size_t i = 0; i < Vector_count(map->buckets); i++) {
-    Vector_free(((struct MapBucket *)Vector_get(map->buckets, i))->key_value_pairs);
-  }
-error_buckets:
-  LOG(WARN, "Error occurred. Freeing buckets vector...");
-  Vector_free(map->buckets);
-  map->buckets = NULL;
-  LOG_DEINDENT();
-error:
-  return false;
+  return result;
 }
 
 // Creates a new Map object.
 Map *Map_alloc(KeyInfo *key_info, size_t elem_size) {
-  LOG_FORMAT(TRACE, "Map_alloc(*key_info: %p, elem_size: %zu) called...",
-             key_info, elem_size);
+  return Map_alloc_ext(key_info, elem_size, NULL);
+}
+
+// Creates a new Map object whose memory comes from `arena'.
+Map *Map_alloc_ext(KeyInfo *key_info, size_t elem_size, Arena *arena) {
+  LOG_FORMAT(TRACE,
+             "Map_alloc_ext(*key_info: %p, elem_size: %zu, *arena: %p) "
+             "called...",
+             key_info, elem_size, arena);
   ASSERT(key_info != NULL);
   ASSERT(elem_size > 0);
   LOG_INDENT();
 
   Map *map;
   LOG(TRACE, "Allocating map...");
-  if ((map = malloc(sizeof(Map))) == NULL) {
+  if ((map = Arena_malloc(arena, sizeof(Map))) == NULL) {
     goto error;
   }
-  map->buckets = NULL;
+  map->table.slots = NULL;
   LOG(TRACE, "Initializing map...");
-  if (!Map_init(map, key_info, elem_size)) {
+  if (!Map_init_ext(map, key_info, elem_size, 8, arena)) {
     goto error_map;
   }
   LOG_DEINDENT();
   return map;
 error_map:
   LOG(WARN, "Error occurred. Freeing map...");
-  free(map);
+  Arena_release(arena, map);
 error:
   LOG_DEINDENT();
   return NULL;
@@ -202,7 +264,7 @@ bool Map_init(Map *map, KeyInfo *key_info, size_t elem_size) {
   ASSERT(key_info != NULL);
   ASSERT(elem_size > 0);
 
-  return Map_init_ext(map, key_info, elem_size, 4);
+  return Map_init_ext(map, key_info, elem_size, 8, NULL);
 }
 
 // Gets the number of elements in the Map
@@ -228,7 +290,7 @@ void Map_free(Map *map) {
   LOG(TRACE, "Cleaning up...");
   Map_cleanup(map);
   LOG(TRACE, "Freeing...");
-  free(map);
+  Arena_release(map->arena, map);
   LOG_DEINDENT();
 }
 
@@ -236,20 +298,11 @@ void Map_free(Map *map) {
 void Map_cleanup(Map *map) {
   ASSERT(map != NULL);
 
-  LOG(TRACE, "Clearing map...");
-  Map_clear(map);
-  if (map->buckets != NULL) {
-    for (int i = 0; i < Vector_count(map->buckets); i++) {
-      Vector *kvps = ((struct MapBucket *)Vector_get(map->buckets, i))->key_value_pairs;
-      LOG_FORMAT(TRACE, "Freeing key/value pair vector (%p)...", kvps);
-      Vector_free(kvps);
-    }
-      LOG_FORMAT(TRACE, "Freeing buckets vector (%p)...", map->buckets);
-    Vector_free(map->buckets);
-    map->buckets = NULL;
-  }
-  map->capacity = 0;
+  _Map_free_table(map, &map->table);
+  _Map_free_table(map, &map->old_table);
+  map->rehash_index = 0;
   map->count = 0;
+  map->version++;
 }
 
 // Removes all the items from the map.
@@ -257,28 +310,15 @@ void Map_cleanup(Map *map) {
 void Map_clear(Map *map) {
   LOG_FORMAT(TRACE, "Map_clear(*map: %p) called...", map);
   ASSERT(map != NULL);
-  LOG_INDENT();
 
-  struct MapBucket *bucket;
-  Vector *kvps;
-  KeyValuePair *kvp;
-  for (size_t i = 0; i < map->capacity; i++) {
-    bucket = Vector_get(map->buckets, i);
-    kvps = bucket->key_value_pairs;
-    size_t nkvps = Vector_count(kvps);
-    LOG_FORMAT(TRACE, "Freeing elements of key/value pair vector (%p)...", kvps);
-    LOG_INDENT();
-    for (size_t j = 0; j < nkvps; j++) {
-      kvp = Vector_get(kvps, j);
-      LOG_FORMAT(TRACE, "Freeing (*key: %p *value: %p)...", kvp->key, kvp->value);
-      free(kvp->key);
-      free(kvp->value);
-    }
-    LOG_DEINDENT();
-    LOG_FORMAT(TRACE, "Clearing key/value pair vector (%p)...", kvps);
-    Vector_clear(kvps);
+  _Map_free_table(map, &map->old_table);
+  map->rehash_index = 0;
+  if (map->table.ctrl) {
+    memset(map->table.ctrl, MAP_CTRL_EMPTY, map->table.capacity);
   }
-  LOG_DEINDENT();
+  map->table.tombstones = 0;
+  map->count = 0;
+  map->version++;
 }
 
 // Gets the size of a value element in the Map
@@ -295,149 +335,307 @@ const KeyInfo *Map_key_info(const Map *map) {
   return &map->key_info;
 }
 
-bool Map_resize(Map *map, size_t new_capacity) {
-  LOG_FORMAT(TRACE, "Map_resize(*map: %p, new_capacity: %zu) called...", map, new_capacity);
+// Finds the slot in `table' holding `key', or returns -1. If `insert_index' is
+// given, it receives the first free (empty or deleted) slot on the probe
+// sequence.
+long long _Map_probe(const Map *map, const struct MapTable *table,
+                     const void *key, uint64_t hash, long long *insert_index) {
   ASSERT(map != NULL);
-  LOG_INDENT();
-  if (map->capacity >= new_capacity) {
-    LOG_FORMAT(TRACE, "Nothing to do (capacity = %zu)", map->capacity);
-    goto out; // Nothing to do.
+  ASSERT(key != NULL);
+
+  size_t mask = table->capacity - 1;
+  unsigned char tag = _Map_hash_tag(hash);
+  long long first_free = -1;
+  size_t index = (size_t)hash & mask;
+  for (size_t probes = 0; probes < table->capacity; probes++) {
+    unsigned char ctrl = table->ctrl[index];
+    if (ctrl == MAP_CTRL_EMPTY) {
+      if (first_free == -1) {
+        first_free = index;
+      }
+      break;
+    }
+    if (ctrl == MAP_CTRL_DELETED) {
+      if (first_free == -1) {
+        first_free = index;
+      }
+    } else if (ctrl == tag) {
+      struct MapSlot *slot = (struct MapSlot *)_Map_slot(map, table, index);
+      if (slot->hash == hash && map->key_info.eq_fn(slot->kvp.key, key)) {
+        return index;
+      }
+    }
+    index = (index + 1) & mask;
   }
-  LOG(TRACE, "Allocating temporary map...");
-  Map *temp_map = NULL;
-  if ((temp_map = malloc(sizeof(Map))) == NULL) {
-    goto error;
+  if (insert_index) {
+    *insert_index = first_free;
   }
-  LOG_FORMAT(TRACE, "Temporary map address: %p", temp_map);
-  if (!Map_init_ext(temp_map, &map->key_info, map->elem_size, new_capacity)) {
-    free(temp_map);
-    goto error;
+  return -1;
+}
+
+// Claims slot `index' for a key with the given hash and points its
+// KeyValuePair at the inline key and value.
+KeyValuePair *_Map_occupy(Map *map, struct MapTable *table, size_t index,
+                          uint64_t hash) {
+  if (table->ctrl[index] == MAP_CTRL_DELETED) {
+    table->tombstones--;
   }
-  temp_map->print_key = map->print_key;
-  temp_map->print_value = map->print_value;
-  temp_map->version = map->version;
-  struct MapBucket *bucket;
-  KeyValuePair ikvp;
-  size_t nbuckets = Vector_count(map->buckets);
-  LOG(TRACE, "Adding elements into temporary map...");
-  for (size_t i = 0; i < nbuckets; i++) {
-    bucket = Vector_get(map->buckets, i);
-    size_t nitems = Vector_count(bucket->key_value_pairs);
-    for (size_t j = 0; j < nitems; j++) {
-      ikvp = *(KeyValuePair *)Vector_get(bucket->key_value_pairs, j);
-      if (Map_add(temp_map, ikvp.key, ikvp.value).key == NULL) {
-        goto error_temp_map;
-      }
+  table->ctrl[index] = _Map_hash_tag(hash);
+  unsigned char *data = _Map_slot(map, table, index);
+  struct MapSlot *slot = (struct MapSlot *)data;
+  slot->kvp.key = data + map->key_offset;
+  slot->kvp.value = data + map->value_offset;
+  slot->hash = hash;
+  return &slot->kvp;
+}
+
+// Copies an entry whose key is known not to be in `table' into its first free
+// slot, reusing the cached hash.
+void _Map_place(Map *map, struct MapTable *table, const unsigned char *slot) {
+  uint64_t hash = ((const struct MapSlot *)slot)->hash;
+  size_t mask = table->capacity - 1;
+  size_t index = (size_t)hash & mask;
+  while (MAP_CTRL_IS_FULL(table->ctrl[index])) {
+    index = (index + 1) & mask;
+  }
+  memcpy(_Map_slot(map, table, index), slot, map->slot_size);
+  _Map_occupy(map, table, index, hash);
+}
+
+// Empties slot `index' of `table'. A slot followed by an empty slot can't be in
+// the middle of any probe sequence, so it doesn't need a tombstone.
+void _Map_vacate(Map *map, struct MapTable *table, size_t index) {
+  if (table->ctrl[(index + 1) & (table->capacity - 1)] == MAP_CTRL_EMPTY) {
+    table->ctrl[index] = MAP_CTRL_EMPTY;
+  } else {
+    table->ctrl[index] = MAP_CTRL_DELETED;
+    table->tombstones++;
+  }
+  map->count--;
+  map->version++;
+}
+
+// Empties slot `index' of the combined slot range (see _Map_entry).
+void _Map_vacate_entry(Map *map, size_t index) {
+  if (index < map->table.capacity) {
+    _Map_vacate(map, &map->table, index);
+  } else {
+    _Map_vacate(map, &map->old_table, index - map->table.capacity);
+  }
+}
+
+// Migrates up to `max_slots' slots of the old table into the new one, and
+// frees the old table once it's been fully drained.
+void _Map_rehash_step(Map *map, size_t max_slots) {
+  ASSERT(map != NULL);
+
+  if (!_Map_rehashing(map)) {
+    return;
+  }
+  struct MapTable *old_table = &map->old_table;
+  for (; max_slots > 0 && map->rehash_index < old_table->capacity; max_slots--) {
+    size_t index = map->rehash_index++;
+    if (!MAP_CTRL_IS_FULL(old_table->ctrl[index])) {
+      continue;
     }
-    LOG_FORMAT(TRACE,
-               "Clearing bucket of temp map so key/value pairs are not deleted "
-               "(*bucket->key_value_pairs = %p)",
-               bucket->key_value_pairs);
-    // Clear the bucket so the values can be reused in the new map,
-    // and the old map can be cleaned up.
-    Vector_clear(bucket->key_value_pairs);
-  }
-  // Put the new map in place of the old map, and free the old one now stored in `temp_map'.
-  LOG(TRACE, "Swapping temp_map <-> map and freeing temp_map...");
-  _Map_swap(map, temp_map);
-  Map_free(temp_map);
-out:
+    _Map_place(map, &map->table, _Map_slot(map, old_table, index));
+    // Leave a tombstone so keys further along the old probe sequences are
+    // still found until they're migrated too.
+    old_table->ctrl[index] = MAP_CTRL_DELETED;
+  }
+  if (map->rehash_index == old_table->capacity) {
+    LOG(TRACE, "Rehash complete.");
+    _Map_free_table(map, old_table);
+    map->rehash_index = 0;
+  }
+  map->version++;
+}
+
+// Moves every entry into a fresh slab of `new_capacity' slots. Also used at the
+// same capacity to flush out tombstones. In incremental mode the entries are
+// migrated a few at a time by later operations; otherwise all at once.
+bool _Map_start_rehash(Map *map, size_t new_capacity) {
+  LOG_FORMAT(TRACE, "_Map_start_rehash(*map: %p, new_capacity: %zu) called...",
+             map, new_capacity);
+  ASSERT(map != NULL);
+  ASSERT(new_capacity >= map->count);
+  LOG_INDENT();
+
+  // Only one rehash can be in flight at a time.
+  _Map_rehash_step(map, SIZE_MAX);
+  struct MapTable table = map->table;
+  if (!_Map_alloc_table(map, &map->table, new_capacity)) {
+    map->table = table;
+    LOG_DEINDENT();
+    return false;
+  }
+  map->old_table = table;
+  map->rehash_index = 0;
+  if (!map->incremental) {
+    _Map_rehash_step(map, SIZE_MAX);
+  }
+  map->version++;
   LOG_DEINDENT();
   return true;
-error_temp_map:
-  LOG(WARN, "Error occurred. Freeing temp_map...");
-  Map_free(temp_map);
-error:
-  LOG_DEINDENT();
-  return false;
 }
 
+bool Map_resize(Map *map, size_t new_capacity) {
+  LOG_FORMAT(TRACE, "Map_resize(*map: %p, new_capacity: %zu) called...", map, new_capacity);
+  ASSERT(map != NULL);
+
+  if (!map->table.slots) {
+    return _Map_rebuild_table(map, new_capacity);
+  }
+  if (map->table.capacity >= new_capacity) {
+    LOG_FORMAT(TRACE, "Nothing to do (capacity = %zu)", map->table.capacity);
+    return true; // Nothing to do.
+  }
+  size_t num_slots = map->table.capacity;
+  while (num_slots < new_capacity) {
+    num_slots <<= 1;
+  }
+  // An explicit resize is never deferred.
+  if (!_Map_start_rehash(map, num_slots)) {
+    return false;
+  }
+  _Map_rehash_step(map, SIZE_MAX);
+  return true;
+}
+
+// Sets whether growing the map migrates its entries a few at a time on later
+// adds and deletes, instead of all at once. This bounds the worst-case cost of
+// a single operation at the price of lookups checking two tables meanwhile.
+void Map_incremental_rehash(Map *map, bool enable) {
+  ASSERT(map != NULL);
+
+  map->incremental = enable;
+  if (!enable) {
+    _Map_rehash_step(map, SIZE_MAX);
+  }
+}
+
+// Whether one more entry would push the table over 7/8 full (counting
+// tombstones, which lengthen probe sequences just like live entries).
+// Entries still waiting in the old table are counted too, since they're headed
+// for this one.
+bool _Map_needs_room(const Map *map) {
+  return (map->count + map->table.tombstones + 1) * 8 > map->table.capacity * 7;
+}
+
+// Makes room for one more entry.
+bool _Map_make_room(Map *map) {
+  // Grow if the live entries alone would be over half full, otherwise just
+  // rehash in place to reclaim the deleted slots.
+  size_t new_capacity = (map->count + 1) * 2 > map->table.capacity
+                            ? map->table.capacity << 1
+                            : map->table.capacity;
+  LOG_FORMAT(TRACE, "Map is getting too full. Rehashing to %zu slots...", new_capacity);
+  return _Map_start_rehash(map, new_capacity);
+}
+
+// Finds `key' in either table. Returns the slot index, or -1, and stores the
+// table it was found in.
+long long _Map_lookup(const Map *map, const void *key, uint64_t hash,
+                      const struct MapTable **table_out) {
+  long long index;
+  *table_out = &map->table;
+  if ((index = _Map_probe(map, &map->table, key, hash, NULL)) != -1 ||
+      !_Map_rehashing(map)) {
+    return index;
+  }
+  *table_out = &map->old_table;
+  return _Map_probe(map, &map->old_table, key, hash, NULL);
+}
+
+// Gets the hash `map' uses for an entry of `src', reusing the hash cached in
+// the entry's slot when both maps hash the same way.
+uint64_t _Map_entry_hash(const Map *map, const Map *src,
+                         const KeyValuePair *kvp) {
+  if (KeyInfo_same_hash(&map->key_info, &src->key_info)) {
+    return ((const struct MapSlot *)kvp)->hash;
+  }
+  return _Map_hash(map, kvp->key);
+}
+
+const KeyValuePair _Map_add_ext(Map *map, const void *key, const void *data,
+                                uint64_t hash);
+
 // Copies the key and value to the map and returns pointer to new key/value
 // pair. Returns NULL in the key if unsuccessful.
+// The pointers stay valid until the next call that adds to or deletes from
+// the map.
 const KeyValuePair Map_add(Map *map, const void *key, const void *data) {
   LOG_FORMAT(TRACE, "Map_add(*map: %p, *key: %p, *data: %p) called...", map, key, data);
+  ASSERT(map != NULL);
+  ASSERT(key != NULL);
+
+  return _Map_add_ext(map, key, data, _Map_hash(map, key));
+}
+
+const KeyValuePair _Map_add_ext(Map *map, const void *key, const void *data,
+                                uint64_t hash) {
   KeyValuePair null_kvp = {NULL, NULL};
-  KeyValuePair kvp;
+  KeyValuePair *kvp;
   ASSERT(map != NULL);
   ASSERT(key != NULL);
   ASSERT(data != NULL);
   LOG_INDENT();
 
-  if (!map->buckets) {
-    LOG(TRACE, "No buckets vector, re-initializing.");
-    // Map needs to be re-initialized.
-    if (!Map_init(map, &map->key_info, map->elem_size)) {
+  if (!map->table.slots) {
+    LOG(TRACE, "No slab, rebuilding the table.");
+    // Map was cleaned up; only its table needs to come back.
+    if (!_Map_rebuild_table(map, 8)) {
       goto error;
     }
   }
-  const KeyValuePair *pkvp;
-  int hash = _Map_hash(map, key);
-  LOG_FORMAT(TRACE, "Key hash = %d", hash);
-  if ((pkvp = _Map_find_ext(map, key, hash)) == NULL) {
+  _Map_rehash_step(map, MAP_REHASH_STEP);
+  LOG_FORMAT(TRACE, "Key hash = %llx", (unsigned long long)hash);
+  const struct MapTable *table;
+  long long index, insert_index = -1;
+  if ((index = _Map_lookup(map, key, hash, &table)) == -1) {
     LOG(TRACE, "Item doesn't already exist in the map. Adding...");
-    size_t ibucket = hash % Vector_count(map->buckets);
-    LOG_FORMAT(TRACE, "Bucket = %zu", ibucket);
-    struct MapBucket *bucket = Vector_get(map->buckets, ibucket);
-    LOG(TRACE, "Allocating space for key...");
-    if (!(kvp.key = malloc(map->key_info.key_size))) {
-      goto error;
-    }
-    LOG(TRACE, "Allocating space for value...");
-    if (!(kvp.value = malloc(map->elem_size))) {
-      goto error_key;
-    }
-    LOG_FORMAT(TRACE, "Adding key/value to the bucket (*key: %p, *value: %p)...",
-        kvp.key, kvp.value);
-    if (!Vector_add(bucket->key_value_pairs, &kvp)) {
-      goto error_value;
+    _Map_probe(map, &map->table, key, hash, &insert_index);
+    // Grow before inserting so the returned pointers stay valid.
+    if (insert_index == -1 || _Map_needs_room(map)) {
+      if (!_Map_make_room(map)) {
+        LOG_FORMAT(WARN, "Unable to expand capacity of map to %016llx",
+                   (unsigned long long)(map->table.capacity << 1));
+        goto error;
+      }
+      _Map_probe(map, &map->table, key, hash, &insert_index);
     }
+    LOG_FORMAT(TRACE, "Slot = %lld", insert_index);
+    kvp = _Map_occupy(map, &map->table, insert_index, hash);
     map->count++;
+    map->version++;
   } else {
     LOG(TRACE, "Item already exists in the map.");
+    kvp = _Map_slot_kvp(map, table, index);
   }
   LOG(TRACE, "Copying key and value...");
   // Overwrite any key and value for good measure.
-  memcpy(kvp.key, key, map->key_info.key_size);
-  memcpy(kvp.value, data, map->elem_size);
-
-  // Have we grown too big?
-  if (map->count > map->capacity) {
-    LOG(TRACE, "Map is getting too big. Resizing...");
-    if (!Map_resize(map, map->capacity << 1)) {
-      // Print an error and ignore
-      LOG_FORMAT(WARN, "Unable to expand capacity of map to %016llx",
-              (unsigned long long)(map->capacity << 1));
-    }
-  }
-  _Map_log_element(map, "Added item with", kvp.key);
+  memcpy(kvp->key, key, map->key_info.key_size);
+  memcpy(kvp->value, data, map->elem_size);
+
+  _Map_log_element(map, "Added item with", kvp->key);
   LOG_DEINDENT();
-  return kvp;
-error_value:
-  LOG_FORMAT(TRACE, "Error occurred. Freeing value pointer (%p)...", kvp.value);
-  free(kvp.value);
-error_key:
-  LOG_FORMAT(TRACE, "freeing key pointer (%p)...", kvp.value);
-  free(kvp.key);
+  return *kvp;
 error:
   LOG_DEINDENT();
   return null_kvp;
 }
 
-const KeyValuePair *_Map_find_ext(const Map *map, const void *key, int hash) {
+const KeyValuePair *_Map_find_ext(const Map *map, const void *key,
+                                  uint64_t hash) {
   ASSERT(map != NULL);
   ASSERT(key != NULL);
 
-  size_t ibucket = hash % map->capacity;
-  struct MapBucket *bucket = Vector_get(map->buckets, ibucket);
-  size_t nitems = Vector_count(bucket->key_value_pairs);
-  for (size_t i = 0; i < nitems; i++) {
-    KeyValuePair *kvp = Vector_get(bucket->key_value_pairs, i);
-    int ihash = _Map_hash(map, kvp->key);
-    if (ihash == hash && map->key_info.eq_fn(kvp->key, key)) {
-      return kvp;
-    }
+  if (!map->table.slots) {
+    return NULL;
   }
-  return NULL;
+  const struct MapTable *table;
+  long long index = _Map_lookup(map, key, hash, &table);
+  return index == -1 ? NULL : _Map_slot_kvp(map, table, index);
 }
 
 // Looks up the key in map and returns a key/value pair.
@@ -447,7 +645,7 @@ const KeyValuePair Map_find(const Map *map, const void *key) {
 
   KeyValuePair null_kvp = {NULL, NULL};
   const KeyValuePair *pkvp;
-  int hash = _Map_hash(map, key);
+  uint64_t hash = _Map_hash(map, key);
   if (!(pkvp = _Map_find_ext(map, key, hash))) {
     return null_kvp;
   }
@@ -484,29 +682,21 @@ void Map_delete(Map *map, const void *key) {
   ASSERT(map != NULL);
   ASSERT(key != NULL);
 
-  int hash = _Map_hash(map, key);
-  size_t ibucket = hash % map->capacity;
-  LOG_FORMAT(TRACE, "Key hash = %d", hash);
-  LOG_FORMAT(TRACE, "Bucket = %zu", ibucket);
-  struct MapBucket *bucket = Vector_get(map->buckets, ibucket);
-  size_t nitems = Vector_count(bucket->key_value_pairs);
-  LOG_FORMAT(TRACE, "Scanning %zu items in bucket...", nitems);
-  for (size_t i = 0; i < nitems; i++) {
-    KeyValuePair *kvp = Vector_get(bucket->key_value_pairs, i);
-    int ihash = _Map_hash(map, kvp->key);
-    if (ihash == hash && map->key_info.eq_fn(kvp->key, key)) {
-      LOG_FORMAT(TRACE, "Item found at index %zu in bucket. Freeing key (%p)...", i, kvp->key);
-      free(kvp->key);
-      LOG_FORMAT(TRACE, "Freeing value (%p)...", kvp->value);
-      free(kvp->value);
-      LOG_FORMAT(TRACE, "Removing item in bucket vector at index %zu...", i);
-      Vector_remove(bucket->key_value_pairs, i);
-      map->count--;
-      LOG_DEINDENT();
-      return;
-    }
+  if (!map->table.slots) {
+    LOG_DEINDENT();
+    return;
+  }
+  _Map_rehash_step(map, MAP_REHASH_STEP);
+  uint64_t hash = _Map_hash(map, key);
+  LOG_FORMAT(TRACE, "Key hash = %llx", (unsigned long long)hash);
+  const struct MapTable *table;
+  long long index = _Map_lookup(map, key, hash, &table);
+  if (index != -1) {
+    LOG_FORMAT(TRACE, "Item found in slot %lld. Vacating...", index);
+    _Map_vacate(map, (struct MapTable *)table, index);
+  } else {
+    LOG_FORMAT(TRACE, "Key not found to delete (%p).", key);
   }
-  LOG_FORMAT(TRACE, "Key not found to delete (%p).", key);
   LOG_DEINDENT();
 }
 
@@ -520,19 +710,18 @@ bool Map_copy(Map *dest_map, const Map *map) {
   LOG(TRACE, "Clearing destination map...");
   Map_clear(dest_map);
   LOG(TRACE, "Resizing destination map...");
-  if (!Map_resize(dest_map, map->capacity)) {
+  if (!Map_resize(dest_map, map->table.capacity)) {
     goto error;
   }
   LOG(TRACE, "Copying items...");
   KeyValuePair *kvp;
-  for (size_t i = 0; i < map->capacity; i++) {
-    struct MapBucket *bucket = Vector_get(map->buckets, i);
-    size_t nitems = Vector_count(bucket->key_value_pairs);
-    for (size_t j = 0; j < nitems; j++) {
-      kvp = Vector_get(bucket->key_value_pairs, j);
-      if (!Map_add(dest_map, kvp->key, kvp->value).key) {
-        goto error;
-      }
+  for (size_t i = 0; i < _Map_entry_count(map); i++) {
+    if (!(kvp = _Map_entry(map, i))) {
+      continue;
+    }
+    if (!_Map_add_ext(dest_map, kvp->key, kvp->value,
+                      _Map_entry_hash(dest_map, map, kvp)).key) {
+      goto error;
     }
   }
   LOG_DEINDENT();
@@ -549,24 +738,22 @@ bool Map_union(Map *dest_map, const Map *a, const Map *b) {
   ASSERT(b != NULL);
 
   KeyValuePair *kvp;
-  for (size_t i = 0; i < a->capacity; i++) {
-    struct MapBucket *bucket = Vector_get(a->buckets, i);
-    size_t nitems = Vector_count(bucket->key_value_pairs);
-    for (size_t j = 0; j < nitems; j++) {
-      kvp = Vector_get(bucket->key_value_pairs, j);
-      if (!Map_add(dest_map, kvp->key, kvp->value).key) {
-        return false;
-      }
+  for (size_t i = 0; i < _Map_entry_count(a); i++) {
+    if (!(kvp = _Map_entry(a, i))) {
+      continue;
+    }
+    if (!_Map_add_ext(dest_map, kvp->key, kvp->value,
+                      _Map_entry_hash(dest_map, a, kvp)).key) {
+      return false;
     }
   }
-  for (size_t i = 0; i < b->capacity; i++) {
-    struct MapBucket *bucket = Vector_get(b->buckets, i);
-    size_t nitems = Vector_count(bucket->key_value_pairs);
-    for (size_t j = 0; j < nitems; j++) {
-      kvp = Vector_get(bucket->key_value_pairs, j);
-      if (!Map_add(dest_map, kvp->key, kvp->value).key) {
-        return false;
-      }
+  for (size_t i = 0; i < _Map_entry_count(b); i++) {
+    if (!(kvp = _Map_entry(b, i))) {
+      continue;
+    }
+    if (!_Map_add_ext(dest_map, kvp->key, kvp->value,
+                      _Map_entry_hash(dest_map, b, kvp)).key) {
+      return false;
     }
   }
   return true;
@@ -579,16 +766,15 @@ bool Map_intersection(Map *dest_map, const Map *a, const Map *b) {
   ASSERT(b != NULL);
 
   KeyValuePair *kvp;
-  for (size_t i = 0; i < a->capacity; i++) {
-    struct MapBucket *bucket = Vector_get(a->buckets, i);
-    size_t nitems = Vector_count(bucket->key_value_pairs);
-    for (size_t j = 0; j < nitems; j++) {
-      kvp = Vector_get(bucket->key_value_pairs, j);
-      if (!Map_contains_key(b, kvp->key))
-        continue;
-      if (!Map_add(dest_map, kvp->key, kvp->value).key) {
-        return false;
-      }
+  for (size_t i = 0; i < _Map_entry_count(a); i++) {
+    if (!(kvp = _Map_entry(a, i))) {
+      continue;
+    }
+    if (!_Map_find_ext(b, kvp->key, _Map_entry_hash(b, a, kvp)))
+      continue;
+    if (!_Map_add_ext(dest_map, kvp->key, kvp->value,
+                      _Map_entry_hash(dest_map, a, kvp)).key) {
+      return false;
     }
   }
   return true;
@@ -601,16 +787,15 @@ bool Map_difference(Map *dest_map, const Map *a, const Map *b) {
   ASSERT(b != NULL);
 
   KeyValuePair *kvp;
-  for (size_t i = 0; i < a->capacity; i++) {
-    struct MapBucket *bucket = Vector_get(a->buckets, i);
-    size_t nitems = Vector_count(bucket->key_value_pairs);
-    for (size_t j = 0; j < nitems; j++) {
-      kvp = Vector_get(bucket->key_value_pairs, j);
-      if (Map_contains_key(b, kvp->key))
-        continue;
-      if (!Map_add(dest_map, kvp->key, kvp->value).key) {
-        return false;
-      }
+  for (size_t i = 0; i < _Map_entry_count(a); i++) {
+    if (!(kvp = _Map_entry(a, i))) {
+      continue;
+    }
+    if (_Map_find_ext(b, kvp->key, _Map_entry_hash(b, a, kvp)))
+      continue;
+    if (!_Map_add_ext(dest_map, kvp->key, kvp->value,
+                      _Map_entry_hash(dest_map, a, kvp)).key) {
+      return false;
     }
   }
   return true;
@@ -623,28 +808,26 @@ bool Map_symmetric_difference(Map *dest_map, const Map *a, const Map *b) {
   ASSERT(b != NULL);
 
   KeyValuePair *kvp;
-  for (size_t i = 0; i < a->capacity; i++) {
-    struct MapBucket *bucket = Vector_get(a->buckets, i);
-    size_t nitems = Vector_count(bucket->key_value_pairs);
-    for (size_t j = 0; j < nitems; j++) {
-      kvp = Vector_get(bucket->key_value_pairs, j);
-      if (Map_contains_key(b, kvp->key))
-        continue;
-      if (!Map_add(dest_map, kvp->key, kvp->value).key) {
-        return false;
-      }
+  for (size_t i = 0; i < _Map_entry_count(a); i++) {
+    if (!(kvp = _Map_entry(a, i))) {
+      continue;
+    }
+    if (_Map_find_ext(b, kvp->key, _Map_entry_hash(b, a, kvp)))
+      continue;
+    if (!_Map_add_ext(dest_map, kvp->key, kvp->value,
+                      _Map_entry_hash(dest_map, a, kvp)).key) {
+      return false;
     }
   }
-  for (size_t i = 0; i < b->capacity; i++) {
-    struct MapBucket *bucket = Vector_get(b->buckets, i);
-    size_t nitems = Vector_count(bucket->key_value_pairs);
-    for (size_t j = 0; j < nitems; j++) {
-      kvp = Vector_get(bucket->key_value_pairs, j);
-      if (Map_contains_key(a, kvp->key))
-        continue;
-      if (!Map_add(dest_map, kvp->key, kvp->value).key) {
-        return false;
-      }
+  for (size_t i = 0; i < _Map_entry_count(b); i++) {
+    if (!(kvp = _Map_entry(b, i))) {
+      continue;
+    }
+    if (_Map_find_ext(a, kvp->key, _Map_entry_hash(a, b, kvp)))
+      continue;
+    if (!_Map_add_ext(dest_map, kvp->key, kvp->value,
+                      _Map_entry_hash(dest_map, b, kvp)).key) {
+      return false;
     }
   }
   return true;
@@ -656,14 +839,13 @@ bool Map_union_with(Map *dest_map, const Map *map) {
   ASSERT(map != NULL);
 
   KeyValuePair *kvp;
-  for (size_t i = 0; i < map->capacity; i++) {
-    struct MapBucket *bucket = Vector_get(map->buckets, i);
-    size_t nitems = Vector_count(bucket->key_value_pairs);
-    for (size_t j = 0; j < nitems; j++) {
-      kvp = Vector_get(bucket->key_value_pairs, j);
-      if (!Map_add(dest_map, kvp->key, kvp->value).key) {
-        return false;
-      }
+  for (size_t i = 0; i < _Map_entry_count(map); i++) {
+    if (!(kvp = _Map_entry(map, i))) {
+      continue;
+    }
+    if (!_Map_add_ext(dest_map, kvp->key, kvp->value,
+                      _Map_entry_hash(dest_map, map, kvp)).key) {
+      return false;
     }
   }
   return true;
@@ -675,19 +857,13 @@ bool Map_intersect_with(Map *dest_map, const Map *map) {
   ASSERT(map != NULL);
 
   KeyValuePair *kvp;
-  for (size_t i = 0; i < dest_map->capacity; i++) {
-    struct MapBucket *bucket = Vector_get(dest_map->buckets, i);
-    for (size_t j = 0;
-         j <
-         Vector_count(bucket->key_value_pairs) /* inline due to modification */;
-         j++) {
-      kvp = Vector_get(bucket->key_value_pairs, j);
-      if (!Map_contains_key(map, kvp->key)) {
-        free(kvp->key);
-        free(kvp->value);
-        Vector_remove(bucket->key_value_pairs,
-                    j-- /* j doesn't change after removal */);
-      }
+  // Vacating a slot never moves other entries, so it's safe mid-scan.
+  for (size_t i = 0; i < _Map_entry_count(dest_map); i++) {
+    if (!(kvp = _Map_entry(dest_map, i))) {
+      continue;
+    }
+    if (!_Map_find_ext(map, kvp->key, _Map_entry_hash(map, dest_map, kvp))) {
+      _Map_vacate_entry(dest_map, i);
     }
   }
   return true;
@@ -699,19 +875,12 @@ bool Map_difference_with(Map *dest_map, const Map *map) {
   ASSERT(map != NULL);
 
   KeyValuePair *kvp;
-  for (size_t i = 0; i < dest_map->capacity; i++) {
-    struct MapBucket *bucket = Vector_get(dest_map->buckets, i);
-    for (size_t j = 0;
-         j <
-         Vector_count(bucket->key_value_pairs) /* inline due to modification */;
-         j++) {
-      kvp = Vector_get(bucket->key_value_pairs, j);
-      if (Map_contains_key(map, kvp->key)) {
-        free(kvp->key);
-        free(kvp->value);
-        Vector_remove(bucket->key_value_pairs,
-                    j-- /* j doesn't change after removal */);
-      }
+  for (size_t i = 0; i < _Map_entry_count(dest_map); i++) {
+    if (!(kvp = _Map_entry(dest_map, i))) {
+      continue;
+    }
+    if (_Map_find_ext(map, kvp->key, _Map_entry_hash(map, dest_map, kvp))) {
+      _Map_vacate_entry(dest_map, i);
     }
   }
   return true;
@@ -723,17 +892,16 @@ bool Map_symmetric_difference_with(Map *dest_map, const Map *map) {
   ASSERT(map != NULL);
 
   KeyValuePair *kvp;
-  for (size_t i = 0; i < map->capacity; i++) {
-    struct MapBucket *bucket = Vector_get(map->buckets, i);
-    size_t nitems = Vector_count(bucket->key_value_pairs);
-    for (size_t j = 0; j < nitems; j++) {
-      kvp = Vector_get(bucket->key_value_pairs, j);
-      if (Map_contains_key(dest_map, kvp->key)) {
-        Map_delete(dest_map, kvp->key);
-      } else {
-        if (!Map_add(dest_map, kvp->key, kvp->value).key) {
-          return false;
-        }
+  for (size_t i = 0; i < _Map_entry_count(map); i++) {
+    if (!(kvp = _Map_entry(map, i))) {
+      continue;
+    }
+    if (_Map_find_ext(dest_map, kvp->key, _Map_entry_hash(dest_map, map, kvp))) {
+      Map_delete(dest_map, kvp->key);
+    } else {
+      if (!_Map_add_ext(dest_map, kvp->key, kvp->value,
+                        _Map_entry_hash(dest_map, map, kvp)).key) {
+        return false;
       }
     }
   }
@@ -751,47 +919,20 @@ void *Map_iter_current_(const Iterator *iter) {
   ASSERT(map != NULL);
   ASSERT(iter->version == map->version &&
          "Collection changed while iterating.");
-  if (Map_iter_eof_(iter)) {
+  if (Map_iter_eof_(iter) || iter->impl_data1 < 0) {
     return NULL;
   }
-  return ((KeyValuePair *)Vector_get(
-      ((struct MapBucket *)Vector_get(map->buckets, iter->impl_data1))
-          ->key_value_pairs,
-      iter->impl_data2));
+  return _Map_entry(map, iter->impl_data1);
 }
 
 void *Map_key_iter_current_(const Iterator *iter) {
-  ASSERT(iter != NULL);
-  ASSERT(iter->collection_type == COLLECTION_MAP);
-  Map *map = iter->collection;
-  ASSERT(map != NULL);
-  ASSERT(iter->version == map->version &&
-         "Collection changed while iterating.");
-  if (Map_iter_eof_(iter)) {
-    return NULL;
-  }
-  return ((KeyValuePair *)Vector_get(
-              ((struct MapBucket *)Vector_get(map->buckets, iter->impl_data1))
-                  ->key_value_pairs,
-              iter->impl_data2))
-      ->key;
+  KeyValuePair *kvp = Map_iter_current_(iter);
+  return kvp ? kvp->key : NULL;
 }
 
 void *Map_value_iter_current_(const Iterator *iter) {
-  ASSERT(iter != NULL);
-  ASSERT(iter->collection_type == COLLECTION_MAP);
-  Map *map = iter->collection;
-  ASSERT(map != NULL);
-  ASSERT(iter->version == map->version &&
-         "Collection changed while iterating.");
-  if (Map_iter_eof_(iter)) {
-    return NULL;
-  }
-  return ((KeyValuePair *)Vector_get(
-              ((struct MapBucket *)Vector_get(map->buckets, iter->impl_data1))
-                  ->key_value_pairs,
-              iter->impl_data2))
-      ->value;
+  KeyValuePair *kvp = Map_iter_current_(iter);
+  return kvp ? kvp->value : NULL;
 }
 
 bool Map_iter_eof_(const Iterator *iter) {
@@ -801,7 +942,7 @@ bool Map_iter_eof_(const Iterator *iter) {
   ASSERT(map != NULL);
   ASSERT(iter->version == map->version &&
          "Collection changed while iterating.");
-  return Map_empty(map) || iter->impl_data1 >= (int)map->capacity;
+  return Map_empty(map) || iter->impl_data1 >= (long long)_Map_entry_count(map);
 }
 
 bool Map_iter_move_next_(Iterator *iter) {
@@ -814,63 +955,42 @@ bool Map_iter_move_next_(Iterator *iter) {
   if (Map_iter_eof_(iter)) {
     return false;
   }
-  iter->impl_data2++;
-  while (iter->impl_data1 == -1 ||
-         iter->impl_data2 >= Vector_count(((struct MapBucket *)Vector_get(
-                                            map->buckets, iter->impl_data1))
-                                           ->key_value_pairs)) {
+  do {
     iter->impl_data1++;
-    iter->impl_data2 = 0;
-    if (Map_iter_eof_(iter))
-      break;
-  }
+  } while (iter->impl_data1 < (long long)_Map_entry_count(map) &&
+           !_Map_entry(map, iter->impl_data1));
   return !Map_iter_eof_(iter);
 }
 
-// Gets a key/value Iterator for this Map in an undefined order.
-void Map_get_iterator(const Map *map, Iterator *iter) {
+void _Map_init_iterator(const Map *map, Iterator *iter) {
   ASSERT(map != NULL);
   ASSERT(iter != NULL);
 
   iter->collection_type = COLLECTION_MAP;
   iter->collection = (void *)map;
   iter->elem_size = map->elem_size;
-  iter->current = Map_iter_current_;
   iter->move_next = Map_iter_move_next_;
   iter->eof = Map_iter_eof_;
-  iter->impl_data1 = -1;
+  iter->impl_data1 = -1; // Current slot
   iter->impl_data2 = 0;
-  iter->version = 0;
+  iter->version = map->version;
+}
+
+// Gets a key/value Iterator for this Map in an undefined order.
+void Map_get_iterator(const Map *map, Iterator *iter) {
+  _Map_init_iterator(map, iter);
+  iter->current = Map_iter_current_;
 }
 
 // Gets a key Iterator for this Map in an undefined order.
 void Map_get_key_iterator(const Map *map, Iterator *iter) {
-  ASSERT(map != NULL);
-  ASSERT(iter != NULL);
-
-  iter->collection_type = COLLECTION_MAP;
-  iter->collection = (void *)map;
-  iter->elem_size = map->elem_size;
+  _Map_init_iterator(map, iter);
+  iter->elem_size = map->key_info.key_size;
   iter->current = Map_key_iter_current_;
-  iter->move_next = Map_iter_move_next_;
-  iter->eof = Map_iter_eof_;
-  iter->impl_data1 = -1;
-  iter->impl_data2 = 0;
-  iter->version = 0;
 }
 
 // Gets a value Iterator for this Map in an undefined order.
 void Map_get_value_iterator(const Map *map, Iterator *iter) {
-  ASSERT(map != NULL);
-  ASSERT(iter != NULL);
-
-  iter->collection_type = COLLECTION_MAP;
-  iter->collection = (void *)map;
-  iter->elem_size = map->elem_size;
+  _Map_init_iterator(map, iter);
   iter->current = Map_value_iter_current_;
-  iter->move_next = Map_iter_move_next_;
-  iter->eof = Map_iter_eof_;
-  iter->impl_data1 = -1;
-  iter->impl_data2 = 0;
-  iter->version = 0;
 }
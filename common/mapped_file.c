@@ -0,0 +1,120 @@
+#define _GNU_SOURCE // mremap
+#include "protected/mapped_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../test/stubs.h"
+#include "public/assert.h"
+
+// Maps `size' bytes of the file, or nothing if it's empty.
+static bool _MappedFile_map(MappedFile *file, size_t size)
+{
+  void *data = NULL;
+  if (size > 0) {
+    data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, file->fd, 0);
+    if (data == MAP_FAILED) {
+      return false;
+    }
+  }
+  file->data = data;
+  file->size = size;
+  return true;
+}
+
+MappedFile *MappedFile_open(const char *path)
+{
+  LOG_FORMAT(TRACE, "MappedFile_open(path: %s) called", path);
+  ASSERT(path != NULL);
+  MappedFile *file = malloc(sizeof(MappedFile));
+  if (!file) {
+    return NULL;
+  }
+  struct stat st;
+  if ((file->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644)) < 0) {
+    goto out_free;
+  }
+  if (fstat(file->fd, &st) < 0 || !_MappedFile_map(file, (size_t)st.st_size)) {
+    goto out_close;
+  }
+  return file;
+
+out_close:
+  close(file->fd);
+out_free:
+  free(file);
+  return NULL;
+}
+
+void MappedFile_close(MappedFile *file)
+{
+  ASSERT(file != NULL);
+  if (file->data) {
+    munmap(file->data, file->size);
+  }
+  close(file->fd);
+  free(file);
+}
+
+void *MappedFile_data(const MappedFile *file)
+{
+  ASSERT(file != NULL);
+  return file->data;
+}
+
+size_t MappedFile_size(const MappedFile *file)
+{
+  ASSERT(file != NULL);
+  return file->size;
+}
+
+bool MappedFile_resize(MappedFile *file, size_t size)
+{
+  LOG_FORMAT(TRACE, "MappedFile_resize(*file: %p, size: %zu) called", file,
+             size);
+  ASSERT(file != NULL);
+  if (size == file->size) {
+    return true;
+  }
+  // A growing file needs its pages before they're mapped; a shrinking one
+  // loses them only once they're unmapped.
+  if (size > file->size && ftruncate(file->fd, (off_t)size) < 0) {
+    return false;
+  }
+  void *data = NULL;
+  bool moved = false;
+  if (size > 0) {
+#ifdef __linux__
+    // The pages belong to the file, so moving the mapping copies nothing.
+    if (file->data) {
+      data = mremap(file->data, file->size, size, MREMAP_MAYMOVE);
+      moved = data != MAP_FAILED;
+    } else
+#endif
+    data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, file->fd, 0);
+    if (data == MAP_FAILED) {
+      if (size > file->size) {
+        ftruncate(file->fd, (off_t)file->size);
+      }
+      return false;
+    }
+  }
+  if (file->data && !moved) {
+    munmap(file->data, file->size);
+  }
+  if (size < file->size) {
+    // If this fails the file just keeps some unused bytes at the end.
+    ftruncate(file->fd, (off_t)size);
+  }
+  file->data = data;
+  file->size = size;
+  return true;
+}
+
+bool MappedFile_sync(MappedFile *file)
+{
+  ASSERT(file != NULL);
+  return !file->data || msync(file->data, file->size, MS_SYNC) == 0;
+}
@@ -0,0 +1,404 @@
+#include "protected/mpmc_queue.h"
+
+#include <sched.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "../test/stubs.h"
+#include "public/assert.h"
+#include "public/collections.h"
+
+DEFINE_MPMC_QUEUE(Int, int)
+DEFINE_MPMC_QUEUE(Long, long)
+DEFINE_MPMC_QUEUE(Char, char)
+DEFINE_MPMC_QUEUE(Float, float)
+DEFINE_MPMC_QUEUE(Double, double)
+DEFINE_MPMC_QUEUE(UnsignedInt, unsigned int)
+DEFINE_MPMC_QUEUE(UnsignedLong, unsigned long)
+DEFINE_MPMC_QUEUE(UnsignedChar, unsigned char)
+DEFINE_MPMC_QUEUE(CString, char *)
+DEFINE_MPMC_QUEUE(Ptr, void *)
+
+// Initializes a pre-allocated MpmcQueue object
+bool MpmcQueue_init(MpmcQueue *queue, size_t elem_size, size_t capacity,
+                    WaitPolicy wait) {
+  ASSERT(queue != NULL);
+  ASSERT(elem_size > 0);
+  ASSERT(capacity > 0);
+
+  size_t rounded = 2;
+  while (rounded < capacity) {
+    rounded <<= 1;
+  }
+  size_t align = _Alignof(max_align_t);
+  queue->elem_offset = (sizeof(struct MpmcCell) + align - 1) & ~(align - 1);
+  queue->cell_size =
+      (queue->elem_offset + elem_size + align - 1) & ~(align - 1);
+  if ((queue->cells = CacheLine_alloc(rounded * queue->cell_size)) == NULL) {
+    return false;
+  }
+  for (size_t i = 0; i < rounded; i++) {
+    struct MpmcCell *cell =
+        (struct MpmcCell *)(queue->cells + i * queue->cell_size);
+    atomic_init(&cell->sequence, i);
+  }
+  atomic_init(&queue->enqueue_pos, 0);
+  atomic_init(&queue->dequeue_pos, 0);
+  queue->elem_size = elem_size;
+  queue->capacity = rounded;
+  queue->mask = rounded - 1;
+  queue->wait = wait;
+  atomic_init(&queue->closed, false);
+  atomic_init(&queue->producers_sleeping, 0);
+  atomic_init(&queue->consumers_sleeping, 0);
+  pthread_mutex_init(&queue->lock, NULL);
+  pthread_cond_init(&queue->not_empty, NULL);
+  pthread_cond_init(&queue->not_full, NULL);
+  return true;
+}
+
+void MpmcQueue_cleanup(MpmcQueue *queue) {
+  ASSERT(queue != NULL);
+  CacheLine_free(queue->cells);
+  queue->cells = NULL;
+  pthread_mutex_destroy(&queue->lock);
+  pthread_cond_destroy(&queue->not_empty);
+  pthread_cond_destroy(&queue->not_full);
+}
+
+MpmcQueue *MpmcQueue_alloc(size_t elem_size, size_t capacity) {
+  return MpmcQueue_alloc_ext(elem_size, capacity, WAIT_SPIN);
+}
+
+MpmcQueue *MpmcQueue_alloc_ext(size_t elem_size, size_t capacity,
+                               WaitPolicy wait) {
+  MpmcQueue *queue;
+  if (NULL == (queue = CacheLine_alloc(sizeof(MpmcQueue)))) {
+    return NULL;
+  }
+  if (!MpmcQueue_init(queue, elem_size, capacity, wait)) {
+    CacheLine_free(queue);
+    return NULL;
+  }
+  return queue;
+}
+
+void MpmcQueue_free(MpmcQueue *queue) {
+  ASSERT(queue != NULL);
+  MpmcQueue_cleanup(queue);
+  CacheLine_free(queue);
+}
+
+size_t MpmcQueue_element_size(const MpmcQueue *queue) {
+  ASSERT(queue != NULL);
+  return queue->elem_size;
+}
+
+size_t MpmcQueue_capacity(const MpmcQueue *queue) {
+  ASSERT(queue != NULL);
+  return queue->capacity;
+}
+
+size_t MpmcQueue_count(const MpmcQueue *queue) {
+  ASSERT(queue != NULL);
+  // Dequeue first: enqueue_pos only grows, so it can't read as behind.
+  size_t head = atomic_load_explicit(&queue->dequeue_pos, memory_order_acquire);
+  size_t tail = atomic_load_explicit(&queue->enqueue_pos, memory_order_acquire);
+  return tail - head;
+}
+
+bool MpmcQueue_empty(const MpmcQueue *queue) {
+  return MpmcQueue_count(queue) == 0;
+}
+
+static inline struct MpmcCell *_MpmcQueue_cell(const MpmcQueue *queue,
+                                               size_t pos) {
+  return (struct MpmcCell *)(queue->cells + (pos & queue->mask) *
+                                                queue->cell_size);
+}
+
+static inline void *_MpmcQueue_elem(const MpmcQueue *queue, size_t pos) {
+  return (unsigned char *)_MpmcQueue_cell(queue, pos) + queue->elem_offset;
+}
+
+// Wakes one sleeper, if there are any. The fence pairs with the increment in
+// _MpmcQueue_wait: either the sleeper sees our cell, or we see it sleeping.
+static void _MpmcQueue_wake(MpmcQueue *queue, atomic_int *sleepers,
+                            pthread_cond_t *cond) {
+  if (queue->wait != WAIT_BLOCK) {
+    return;
+  }
+  atomic_thread_fence(memory_order_seq_cst);
+  if (atomic_load_explicit(sleepers, memory_order_relaxed) > 0) {
+    pthread_mutex_lock(&queue->lock);
+    pthread_cond_signal(cond);
+    pthread_mutex_unlock(&queue->lock);
+  }
+}
+
+// Claims the next position to write. Returns NULL if the queue is full.
+static void *_MpmcQueue_claim_write(MpmcQueue *queue, size_t *pos_out) {
+  size_t pos = atomic_load_explicit(&queue->enqueue_pos, memory_order_relaxed);
+  for (;;) {
+    struct MpmcCell *cell = _MpmcQueue_cell(queue, pos);
+    size_t sequence =
+        atomic_load_explicit(&cell->sequence, memory_order_acquire);
+    intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+    if (diff == 0) {
+      if (atomic_compare_exchange_weak_explicit(&queue->enqueue_pos, &pos,
+                                                pos + 1, memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        *pos_out = pos;
+        return _MpmcQueue_elem(queue, pos);
+      }
+    } else if (diff < 0) {
+      return NULL; // The consumer from the last lap hasn't finished with it.
+    } else {
+      pos = atomic_load_explicit(&queue->enqueue_pos, memory_order_relaxed);
+    }
+  }
+}
+
+// Hands a written cell to the consumers.
+static void _MpmcQueue_publish(MpmcQueue *queue, size_t pos) {
+  atomic_store_explicit(&_MpmcQueue_cell(queue, pos)->sequence, pos + 1,
+                        memory_order_release);
+  _MpmcQueue_wake(queue, &queue->consumers_sleeping, &queue->not_empty);
+}
+
+// Claims the oldest element. Returns NULL if the queue is empty.
+static void *_MpmcQueue_claim_read(MpmcQueue *queue, size_t *pos_out) {
+  size_t pos = atomic_load_explicit(&queue->dequeue_pos, memory_order_relaxed);
+  for (;;) {
+    struct MpmcCell *cell = _MpmcQueue_cell(queue, pos);
+    size_t sequence =
+        atomic_load_explicit(&cell->sequence, memory_order_acquire);
+    intptr_t diff = (intptr_t)sequence - (intptr_t)(pos + 1);
+    if (diff == 0) {
+      if (atomic_compare_exchange_weak_explicit(&queue->dequeue_pos, &pos,
+                                                pos + 1, memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        *pos_out = pos;
+        return _MpmcQueue_elem(queue, pos);
+      }
+    } else if (diff < 0) {
+      return NULL; // Its producer hasn't published it yet.
+    } else {
+      pos = atomic_load_explicit(&queue->dequeue_pos, memory_order_relaxed);
+    }
+  }
+}
+
+// Hands a read cell to the producers of the next lap.
+static void _MpmcQueue_release(MpmcQueue *queue, size_t pos) {
+  atomic_store_explicit(&_MpmcQueue_cell(queue, pos)->sequence,
+                        pos + queue->capacity, memory_order_release);
+  _MpmcQueue_wake(queue, &queue->producers_sleeping, &queue->not_full);
+}
+
+static bool _MpmcQueue_readable(MpmcQueue *queue) {
+  size_t pos = atomic_load_explicit(&queue->dequeue_pos, memory_order_relaxed);
+  return atomic_load_explicit(&_MpmcQueue_cell(queue, pos)->sequence,
+                              memory_order_acquire) == pos + 1;
+}
+
+static bool _MpmcQueue_writable(MpmcQueue *queue) {
+  size_t pos = atomic_load_explicit(&queue->enqueue_pos, memory_order_relaxed);
+  return atomic_load_explicit(&_MpmcQueue_cell(queue, pos)->sequence,
+                              memory_order_acquire) == pos;
+}
+
+// Waits until `ready' holds. Returns false, without waiting any longer, if the
+// queue is closed.
+static bool _MpmcQueue_wait(MpmcQueue *queue, bool (*ready)(MpmcQueue *),
+                            atomic_int *sleepers, pthread_cond_t *cond) {
+  for (int spins = 0;; spins++) {
+    if (ready(queue)) {
+      return true;
+    }
+    if (atomic_load_explicit(&queue->closed, memory_order_acquire)) {
+      return false;
+    }
+    if (spins < SPIN_LIMIT) {
+      cpu_relax();
+    } else if (queue->wait == WAIT_SPIN) {
+      sched_yield();
+    } else {
+      break;
+    }
+  }
+  pthread_mutex_lock(&queue->lock);
+  atomic_fetch_add_explicit(sleepers, 1, memory_order_seq_cst);
+  bool ready_now;
+  while (!(ready_now = ready(queue)) &&
+         !atomic_load_explicit(&queue->closed, memory_order_acquire)) {
+    pthread_cond_wait(cond, &queue->lock);
+  }
+  atomic_fetch_sub_explicit(sleepers, 1, memory_order_relaxed);
+  pthread_mutex_unlock(&queue->lock);
+  return ready_now;
+}
+
+bool MpmcQueue_enqueue(MpmcQueue *queue, const void *data) {
+  ASSERT(queue != NULL);
+  ASSERT(data != NULL);
+  size_t pos;
+  void *elem = _MpmcQueue_claim_write(queue, &pos);
+  if (!elem) {
+    return false;
+  }
+  memcpy(elem, data, queue->elem_size);
+  _MpmcQueue_publish(queue, pos);
+  return true;
+}
+
+bool MpmcQueue_dequeue(MpmcQueue *queue, void *data_out) {
+  ASSERT(queue != NULL);
+  ASSERT(data_out != NULL);
+  size_t pos;
+  void *elem = _MpmcQueue_claim_read(queue, &pos);
+  if (!elem) {
+    return false;
+  }
+  memcpy(data_out, elem, queue->elem_size);
+  _MpmcQueue_release(queue, pos);
+  return true;
+}
+
+bool MpmcQueue_peek(MpmcQueue *queue, void *data_out) {
+  ASSERT(queue != NULL);
+  ASSERT(data_out != NULL);
+  for (;;) {
+    size_t pos =
+        atomic_load_explicit(&queue->dequeue_pos, memory_order_acquire);
+    atomic_size_t *sequence = &_MpmcQueue_cell(queue, pos)->sequence;
+    if (atomic_load_explicit(sequence, memory_order_acquire) != pos + 1) {
+      return false;
+    }
+    memcpy(data_out, _MpmcQueue_elem(queue, pos), queue->elem_size);
+    // If nobody took the element while we copied it, the copy is whole.
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(sequence, memory_order_relaxed) == pos + 1) {
+      return true;
+    }
+  }
+}
+
+bool MpmcQueue_enqueue_wait(MpmcQueue *queue, const void *data) {
+  while (!MpmcQueue_enqueue(queue, data)) {
+    if (!_MpmcQueue_wait(queue, _MpmcQueue_writable,
+                         &queue->producers_sleeping, &queue->not_full)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool MpmcQueue_dequeue_wait(MpmcQueue *queue, void *data_out) {
+  while (!MpmcQueue_dequeue(queue, data_out)) {
+    if (!_MpmcQueue_wait(queue, _MpmcQueue_readable,
+                         &queue->consumers_sleeping, &queue->not_empty)) {
+      // Closed. Anything added before the close is visible now.
+      return MpmcQueue_dequeue(queue, data_out);
+    }
+  }
+  return true;
+}
+
+void MpmcQueue_close(MpmcQueue *queue) {
+  ASSERT(queue != NULL);
+  atomic_store_explicit(&queue->closed, true, memory_order_release);
+  pthread_mutex_lock(&queue->lock);
+  pthread_cond_broadcast(&queue->not_empty);
+  pthread_cond_broadcast(&queue->not_full);
+  pthread_mutex_unlock(&queue->lock);
+}
+
+bool MpmcQueue_closed(const MpmcQueue *queue) {
+  ASSERT(queue != NULL);
+  return atomic_load_explicit(&queue->closed, memory_order_acquire);
+}
+
+// The iterator keeps the cell it has claimed (position + 1 in impl_data1, 0
+// for none) until the next move_next. impl_data2 is set once the queue is
+// closed and drained.
+
+void *MpmcQueue_iter_current_(const Iterator *iter);
+bool MpmcQueue_iter_eof_(const Iterator *iter);
+bool MpmcQueue_iter_move_next_(Iterator *iter);
+
+void *MpmcQueue_iter_current_(const Iterator *iter) {
+  ASSERT(iter != NULL);
+  ASSERT(iter->collection_type == COLLECTION_MPMC_QUEUE);
+  MpmcQueue *queue = iter->collection;
+  ASSERT(queue != NULL);
+  if (!iter->impl_data1) {
+    return NULL;
+  }
+  return _MpmcQueue_elem(queue, (size_t)iter->impl_data1 - 1);
+}
+
+bool MpmcQueue_iter_eof_(const Iterator *iter) {
+  ASSERT(iter != NULL);
+  ASSERT(iter->collection_type == COLLECTION_MPMC_QUEUE);
+  return iter->impl_data2 != 0;
+}
+
+bool MpmcQueue_iter_move_next_(Iterator *iter) {
+  ASSERT(iter != NULL);
+  ASSERT(iter->collection_type == COLLECTION_MPMC_QUEUE);
+  MpmcQueue *queue = iter->collection;
+  ASSERT(queue != NULL);
+  if (iter->impl_data2) {
+    return false;
+  }
+  if (iter->impl_data1) {
+    _MpmcQueue_release(queue, (size_t)iter->impl_data1 - 1);
+    iter->impl_data1 = 0;
+  }
+  size_t pos;
+  while (!_MpmcQueue_claim_read(queue, &pos)) {
+    if (!_MpmcQueue_wait(queue, _MpmcQueue_readable,
+                         &queue->consumers_sleeping, &queue->not_empty)) {
+      if (_MpmcQueue_claim_read(queue, &pos)) {
+        break;
+      }
+      iter->impl_data2 = 1;
+      return false;
+    }
+  }
+  iter->impl_data1 = (long long)pos + 1;
+  return true;
+}
+
+void MpmcQueue_get_iterator(const MpmcQueue *queue, Iterator *iter) {
+  ASSERT(queue != NULL);
+  ASSERT(iter != NULL);
+  iter->collection_type = COLLECTION_MPMC_QUEUE;
+  iter->collection = (void *)queue;
+  iter->elem_size = queue->elem_size;
+  iter->current = MpmcQueue_iter_current_;
+  iter->eof = MpmcQueue_iter_eof_;
+  iter->move_next = MpmcQueue_iter_move_next_;
+  iter->impl_data1 = 0; // The claimed position + 1, or 0
+  iter->impl_data2 = 0; // Whether the queue is closed and drained
+  iter->version = 0;
+}
+
+void *MpmcQueue_sink_add_(Sink *sink, const void *elem);
+
+void MpmcQueue_get_sink(const MpmcQueue *queue, Sink *sink) {
+  ASSERT(queue != NULL);
+  ASSERT(sink != NULL);
+  sink->collection_type = COLLECTION_MPMC_QUEUE;
+  sink->collection = (void *)queue;
+  sink->elem_size = queue->elem_size;
+  sink->add = MpmcQueue_sink_add_;
+}
+
+void *MpmcQueue_sink_add_(Sink *sink, const void *elem) {
+  ASSERT(sink != NULL);
+  MpmcQueue *queue = sink->collection;
+  ASSERT(queue != NULL);
+  return MpmcQueue_enqueue_wait(queue, elem) ? (void *)elem : NULL;
+}
@@ -0,0 +1,133 @@
+#include "protected/pool.h"
+
+#include "../test/stubs.h"
+#include "public/assert.h"
+
+// Initializes a pre-allocated Pool object
+bool Pool_init(Pool *pool, size_t object_size, Arena *arena) {
+  ASSERT(pool != NULL);
+  ASSERT(object_size > 0);
+
+  size_t align = _Alignof(max_align_t);
+  if (object_size < sizeof(struct PoolFree)) {
+    object_size = sizeof(struct PoolFree);
+  }
+  pool->arena = arena;
+  pool->object_size = (object_size + align - 1) & ~(align - 1);
+  pool->count = 0;
+  pool->free_list = NULL;
+  pool->slabs = NULL;
+  pool->cursor = NULL;
+  pool->limit = NULL;
+  pool->slab_objects = POOL_MIN_SLAB_OBJECTS;
+  return true;
+}
+
+// Creates a new Pool object.
+Pool *Pool_alloc(size_t object_size) {
+  return Pool_alloc_ext(object_size, NULL);
+}
+
+// Creates a new Pool object whose slabs come from `arena'.
+Pool *Pool_alloc_ext(size_t object_size, Arena *arena) {
+  Pool *pool;
+  if (NULL == (pool = Arena_malloc(arena, sizeof(Pool)))) {
+    return NULL;
+  }
+  if (!Pool_init(pool, object_size, arena)) {
+    Arena_release(arena, pool);
+    return NULL;
+  }
+  return pool;
+}
+
+// Frees every slab, but not the Pool object.
+void Pool_cleanup(Pool *pool) {
+  ASSERT(pool != NULL);
+
+  Pool_clear(pool);
+}
+
+// Frees up the Pool object.
+void Pool_free(Pool *pool) {
+  ASSERT(pool != NULL);
+
+  Pool_cleanup(pool);
+  Arena_release(pool->arena, pool);
+}
+
+size_t Pool_object_size(const Pool *pool) {
+  ASSERT(pool != NULL);
+
+  return pool->object_size;
+}
+
+size_t Pool_count(const Pool *pool) {
+  ASSERT(pool != NULL);
+
+  return pool->count;
+}
+
+// Starts a new slab, each one twice the size of the last up to the maximum.
+bool _Pool_grow(Pool *pool) {
+  struct PoolSlab *slab;
+  size_t size = pool->object_size * pool->slab_objects;
+  if (NULL ==
+      (slab = Arena_malloc(pool->arena, sizeof(struct PoolSlab) + size))) {
+    return false;
+  }
+  slab->next = pool->slabs;
+  pool->slabs = slab;
+  pool->cursor = slab->data;
+  pool->limit = slab->data + size;
+  if (pool->slab_objects < POOL_MAX_SLAB_OBJECTS) {
+    pool->slab_objects <<= 1;
+  }
+  return true;
+}
+
+void *Pool_acquire(Pool *pool) {
+  ASSERT(pool != NULL);
+
+  void *object;
+  if (pool->free_list) {
+    object = pool->free_list;
+    pool->free_list = pool->free_list->next;
+  } else {
+    if (pool->cursor == pool->limit && !_Pool_grow(pool)) {
+      return NULL;
+    }
+    object = pool->cursor;
+    pool->cursor += pool->object_size;
+  }
+  pool->count++;
+  return object;
+}
+
+void Pool_release(Pool *pool, void *object) {
+  ASSERT(pool != NULL);
+  ASSERT(object != NULL);
+  ASSERT(pool->count > 0);
+
+  struct PoolFree *free_object = object;
+  free_object->next = pool->free_list;
+  pool->free_list = free_object;
+  pool->count--;
+}
+
+void Pool_clear(Pool *pool) {
+  ASSERT(pool != NULL);
+
+  struct PoolSlab *slab = pool->slabs;
+  while (slab) {
+    struct PoolSlab *next = slab->next;
+    Arena_release(pool->arena, slab);
+    slab = next;
+  }
+  pool->count = 0;
+  pool->free_list = NULL;
+  pool->slabs = NULL;
+  pool->cursor = NULL;
+  pool->limit = NULL;
+  pool->slab_objects = POOL_MIN_SLAB_OBJECTS;
+}
@@ -4,9 +4,11 @@
 
 #include "../test/stubs.h"
 #include "public/assert.h"
+#include "public/concurrency.h"
 
 bool PriorityQueue_init(PriorityQueue *queue, RelationalKeyInfo *key_info,
-                                    size_t elem_size, PriorityQueueMode mode)
+                        size_t elem_size, PriorityQueueMode mode,
+                        size_t arity, bool indexed)
 {
     ASSERT(queue != NULL);
     ASSERT(key_info != NULL);
@@ -14,21 +16,43 @@ bool PriorityQueue_init(PriorityQueue *queue, RelationalKeyInfo *key_info,
     ASSERT(key_info->key_info->key_size > 0);
     ASSERT(elem_size > 0);
     ASSERT(mode == PQ_MODE_SMALLEST_FIRST || mode == PQ_MODE_LARGEST_FIRST);
-    if (NULL == (Vector_alloc(elem_size + key_info->key_info->key_size))) {
-        return false;
-    }
-    queue->key_info = key_info;
-    queue->elem_size = elem_size;
+    ASSERT(arity >= 2);
+    queue->block = NULL;
+    queue->heap = NULL;
+    queue->capacity = 0;
     queue->count = 0;
+    queue->arity = arity;
+    queue->key_size = key_info->key_info->key_size;
+    queue->elem_size = elem_size;
+    queue->entry_size = queue->key_size + elem_size +
+                        (indexed ? sizeof(PriorityQueueHandle) : 0);
     queue->mode = mode;
+    queue->key_info = key_info;
+    queue->positions = NULL;
+    queue->handle_count = 0;
+    queue->handle_capacity = 0;
+    queue->free_handle = PQ_INVALID_HANDLE;
+    queue->version = 0;
+    if (indexed) {
+        // Having a `positions' table is what makes a queue indexed.
+        queue->handle_capacity = 16;
+        if (!(queue->positions =
+                  malloc(queue->handle_capacity * sizeof(size_t)))) {
+            return false;
+        }
+    }
     return true;
 }
 
 void PriorityQueue_cleanup(PriorityQueue *queue)
 {
     ASSERT(queue != NULL);
-    Vector_free(queue->list);
-    queue->list = NULL;
+    CacheLine_free(queue->block);
+    free(queue->positions);
+    queue->block = NULL;
+    queue->heap = NULL;
+    queue->positions = NULL;
+    queue->capacity = 0;
     queue->count = 0;
     queue->key_info = NULL;
     queue->elem_size = 0;
@@ -37,16 +61,38 @@ void PriorityQueue_cleanup(PriorityQueue *queue)
 PriorityQueue *PriorityQueue_alloc(RelationalKeyInfo *key_info,
                                     size_t elem_size, PriorityQueueMode mode)
 {
-    ASSERT(key_info != NULL);
-    ASSERT(key_info->key_info != NULL);
-    ASSERT(key_info->key_info->key_size > 0);
-    ASSERT(elem_size > 0);
-    ASSERT(mode == PQ_MODE_SMALLEST_FIRST || mode == PQ_MODE_LARGEST_FIRST);
+    return PriorityQueue_alloc_ext(key_info, elem_size, mode,
+                                   PQ_DEFAULT_ARITY);
+}
+
+PriorityQueue *PriorityQueue_alloc_ext(RelationalKeyInfo *key_info,
+                                        size_t elem_size,
+                                        PriorityQueueMode mode, size_t arity)
+{
+    PriorityQueue *queue = NULL;
+    if (!(queue = malloc(sizeof(PriorityQueue)))) {
+        return NULL;
+    }
+    if (!PriorityQueue_init(queue, key_info, elem_size, mode, arity, false)) {
+        free(queue);
+        return NULL;
+    }
+    return queue;
+}
+
+PriorityQueue *PriorityQueue_alloc_indexed(RelationalKeyInfo *key_info,
+                                            size_t elem_size,
+                                            PriorityQueueMode mode,
+                                            size_t arity)
+{
     PriorityQueue *queue = NULL;
     if (!(queue = malloc(sizeof(PriorityQueue)))) {
         return NULL;
     }
-    PriorityQueue_init(queue, key_info, elem_size, mode);
+    if (!PriorityQueue_init(queue, key_info, elem_size, mode, arity, true)) {
+        free(queue);
+        return NULL;
+    }
     return queue;
 }
 
@@ -65,29 +111,41 @@ bool PriorityQueue_empty(const PriorityQueue *queue)
 size_t PriorityQueue_capacity(const PriorityQueue *queue)
 {
     ASSERT(queue);
-    return queue->list ? Vector_capacity(queue->list) : 0;
+    return queue->capacity;
+}
+
+// Moves the entries to storage for `capacity' of them (plus the spare).
+static bool _PriorityQueue_resize(PriorityQueue *queue, size_t capacity)
+{
+    size_t size = queue->entry_size;
+    // Puts entry 1, the first child of the root, at the start of a line.
+    size_t pad = (CACHE_LINE_SIZE - size % CACHE_LINE_SIZE) % CACHE_LINE_SIZE;
+    unsigned char *block = CacheLine_alloc(pad + (capacity + 1) * size);
+    if (block == NULL) return false;
+    unsigned char *heap = block + pad;
+    if (queue->count) memcpy(heap, queue->heap, queue->count * size);
+    CacheLine_free(queue->block);
+    queue->block = block;
+    queue->heap = heap;
+    queue->capacity = capacity;
+    return true;
 }
 
 bool PriorityQueue_reserve(PriorityQueue *queue, size_t num_elems) {
     ASSERT(queue);
-    if (!queue->list &&
-        NULL == (Vector_alloc(queue->elem_size +
-                            queue->key_info->key_info->key_size))) {
-        return false;
+    if (num_elems <= queue->capacity) return true;
+    size_t capacity = queue->capacity ? queue->capacity : 16;
+    while (capacity < num_elems) {
+        capacity *= 2;
     }
-    return Vector_reserve(queue->list, num_elems);
+    return _PriorityQueue_resize(queue, capacity);
 }
 
 bool PriorityQueue_trim(PriorityQueue *queue)
 {
     ASSERT(queue);
-    if (!queue->list &&
-        NULL == (Vector_alloc(queue->elem_size +
-                            queue->key_info->key_info->key_size))) {
-        return false;
-    }
-    Vector_truncate(queue->list, queue->count);
-    return Vector_trim(queue->list);
+    if (queue->count == queue->capacity) return true;
+    return _PriorityQueue_resize(queue, queue->count ? queue->count : 1);
 }
 
 void PriorityQueue_free(PriorityQueue *queue)
@@ -109,67 +167,170 @@ PriorityQueueMode PriorityQueue_mode(const PriorityQueue *queue)
     return queue->mode;
 }
 
+size_t PriorityQueue_arity(const PriorityQueue *queue)
+{
+    ASSERT(queue);
+    return queue->arity;
+}
+
 RelationalKeyInfo *PriorityQueue_key_info(const PriorityQueue *queue)
 {
     ASSERT(queue);
     return queue->key_info;
 }
 
-void trickle_down(PriorityQueue *queue, size_t index)
+static inline unsigned char *_PriorityQueue_entry(const PriorityQueue *queue,
+                                                  size_t index)
 {
-    ASSERT(queue);
-    ASSERT(index >= 0);
-    ASSERT(index < queue->count);
-    int larger_child;
-    int multiplier = queue->mode == PQ_MODE_LARGEST_FIRST ? 1 : -1;
-    size_t data_size = Vector_element_size(queue->list);
-    char top_data[data_size];
-    memcpy(top_data, Vector_get(queue->list, 0), data_size);
-    while (index < queue->count / 2)
-    {
-        size_t left_child = 2 * index + 1;
-        size_t right_child = left_child + 1;
-
-        if (right_child < queue->count) {
-          if (queue->key_info->compare_fn(Vector_get(queue->list, left_child),
-                                          Vector_get(queue->list, right_child)) *
-                  multiplier < 0)
-            larger_child = right_child;
-        }
-        else {
-            larger_child = left_child;
-        }
-        void *larger_child_data = Vector_get(queue->list, larger_child);
-        if (queue->key_info->compare_fn(top_data, larger_child_data) *
-                multiplier >= 0)
-          break;
+    return queue->heap + index * queue->entry_size;
+}
 
-        Vector_set(queue->list, index, larger_child_data);
-        index = larger_child;
+static inline PriorityQueueHandle _PriorityQueue_handle_of(
+    const PriorityQueue *queue, const unsigned char *entry)
+{
+    PriorityQueueHandle handle;
+    memcpy(&handle, entry + queue->key_size + queue->elem_size,
+           sizeof(handle));
+    return handle;
+}
+
+// Copies `entry' to `index', and in an indexed queue, tracks where it went.
+static inline void _PriorityQueue_place(PriorityQueue *queue, size_t index,
+                                        const unsigned char *entry)
+{
+    memcpy(_PriorityQueue_entry(queue, index), entry, queue->entry_size);
+    if (queue->positions) {
+        queue->positions[_PriorityQueue_handle_of(queue, entry)] = index;
     }
-    Vector_set(queue->list, index, top_data);
 }
 
-void trickle_up(PriorityQueue *queue, size_t index)
+// Returns whether entry `a' comes out before entry `b'.
+static inline bool _PriorityQueue_before(const PriorityQueue *queue,
+                                         const void *a, const void *b)
 {
-    ASSERT(queue);
-    ASSERT(index >= 0);
-    ASSERT(index < queue->count);
-    size_t parent = (index - 1) / 2;
-    int multiplier = queue->mode == PQ_MODE_LARGEST_FIRST ? 1 : -1;
-    size_t data_size = Vector_element_size(queue->list);
-    char bottom_data[data_size];
-    memcpy(bottom_data, Vector_get(queue->list, index), data_size);
-
-    while (index > 0 &&
-           multiplier * queue->key_info->compare_fn(
-                            Vector_get(queue->list, parent), bottom_data) <
-               0) {
-        Vector_set(queue->list, index, Vector_get(queue->list, parent));
+    int order = queue->key_info->compare_fn(a, b);
+    return queue->mode == PQ_MODE_LARGEST_FIRST ? order > 0 : order < 0;
+}
+
+// Moves `entry' from `index' toward the root, shifting parents down into the
+// hole rather than swapping. `entry' must not live in the heap.
+// Returns where it ended up.
+static size_t _PriorityQueue_sift_up(PriorityQueue *queue, size_t index,
+                                     const void *entry)
+{
+    while (index > 0) {
+        size_t parent = (index - 1) / queue->arity;
+        unsigned char *parent_entry = _PriorityQueue_entry(queue, parent);
+        if (!_PriorityQueue_before(queue, entry, parent_entry)) break;
+        _PriorityQueue_place(queue, index, parent_entry);
         index = parent;
-        parent = (parent - 1) / 2;
     }
-    Vector_set(queue->list, index, bottom_data);
+    _PriorityQueue_place(queue, index, entry);
+    return index;
+}
+
+// Moves `entry' from `index' toward the leaves, shifting the first of each
+// set of children up into the hole. `entry' must not live below `count'.
+static void _PriorityQueue_sift_down(PriorityQueue *queue, size_t index,
+                                     const void *entry)
+{
+    size_t count = queue->count;
+    for (;;) {
+        size_t first = queue->arity * index + 1;
+        if (first >= count) break;
+        size_t end = count - first > queue->arity ? first + queue->arity
+                                                  : count;
+        size_t best = first;
+        unsigned char *best_entry = _PriorityQueue_entry(queue, first);
+        for (size_t child = first + 1; child < end; child++) {
+            unsigned char *child_entry = _PriorityQueue_entry(queue, child);
+            if (_PriorityQueue_before(queue, child_entry, best_entry)) {
+                best = child;
+                best_entry = child_entry;
+            }
+        }
+        if (!_PriorityQueue_before(queue, best_entry, entry)) break;
+        _PriorityQueue_place(queue, index, best_entry);
+        index = best;
+    }
+    _PriorityQueue_place(queue, index, entry);
+}
+
+// Moves the entry at `index', which now holds `entry', whichever way it has
+// to go. `entry' must not live below `count'.
+static void _PriorityQueue_sift(PriorityQueue *queue, size_t index,
+                                const void *entry)
+{
+    if (index > 0 &&
+        _PriorityQueue_before(
+            queue, entry,
+            _PriorityQueue_entry(queue, (index - 1) / queue->arity))) {
+        _PriorityQueue_sift_up(queue, index, entry);
+    } else {
+        _PriorityQueue_sift_down(queue, index, entry);
+    }
+}
+
+// Restores heap order from scratch, bottom up (Floyd). Each level has
+// `arity' times fewer entries to sift than the one below, and they have that
+// much less far to go, which sums to O(n).
+static void _PriorityQueue_heapify(PriorityQueue *queue)
+{
+    if (queue->count < 2) return;
+    unsigned char *spare = _PriorityQueue_entry(queue, queue->capacity);
+    for (size_t index = (queue->count - 2) / queue->arity + 1; index-- > 0;) {
+        memcpy(spare, _PriorityQueue_entry(queue, index), queue->entry_size);
+        _PriorityQueue_sift_down(queue, index, spare);
+    }
+}
+
+// Hands out a handle for a new entry. Returns PQ_INVALID_HANDLE if out of
+// memory.
+static PriorityQueueHandle _PriorityQueue_take_handle(PriorityQueue *queue)
+{
+    PriorityQueueHandle handle = queue->free_handle;
+    if (handle != PQ_INVALID_HANDLE) {
+        queue->free_handle = ~queue->positions[handle];
+        return handle;
+    }
+    if (queue->handle_count == queue->handle_capacity) {
+        size_t capacity = queue->handle_capacity * 2;
+        size_t *positions = realloc(queue->positions,
+                                    capacity * sizeof(size_t));
+        if (!positions) return PQ_INVALID_HANDLE;
+        queue->positions = positions;
+        queue->handle_capacity = capacity;
+    }
+    return queue->handle_count++;
+}
+
+static void _PriorityQueue_release_handle(PriorityQueue *queue,
+                                          PriorityQueueHandle handle)
+{
+    queue->positions[handle] = ~queue->free_handle;
+    queue->free_handle = handle;
+}
+
+// Builds a new entry in the spare slot past the end of the heap, out of the
+// way of the sift. Returns NULL if out of memory.
+static unsigned char *_PriorityQueue_new_entry(PriorityQueue *queue,
+                                               const void *key,
+                                               const void *data)
+{
+    if (queue->count == queue->capacity &&
+        !PriorityQueue_reserve(queue, queue->count + 1)) {
+        return NULL;
+    }
+    unsigned char *spare = _PriorityQueue_entry(queue, queue->capacity);
+    memcpy(spare, key, queue->key_size);
+    memcpy(spare + queue->key_size, data, queue->elem_size);
+    if (queue->positions) {
+        PriorityQueueHandle handle = _PriorityQueue_take_handle(queue);
+        if (handle == PQ_INVALID_HANDLE) return NULL;
+        memcpy(spare + queue->key_size + queue->elem_size, &handle,
+               sizeof(handle));
+    }
+    return spare;
 }
 
 void *PriorityQueue_enqueue(PriorityQueue *queue, const void *key,
@@ -178,18 +339,129 @@ void *PriorityQueue_enqueue(PriorityQueue *queue, const void *key,
     ASSERT(queue);
     ASSERT(key);
     ASSERT(data);
-    char buffer[Vector_element_size(queue->list)];
-    memcpy(buffer, key, queue->key_info->key_info->key_size);
-    memcpy(buffer + queue->key_info->key_info->key_size, data, queue->elem_size);
-    if (queue->count >= Vector_count(queue->list)) {
-        Vector_add(queue->list, buffer);
-    } else {
-        Vector_set(queue->list, queue->count, buffer);
+    unsigned char *entry = _PriorityQueue_new_entry(queue, key, data);
+    if (!entry) return NULL;
+    size_t index = _PriorityQueue_sift_up(queue, queue->count++, entry);
+    queue->version++;
+    return _PriorityQueue_entry(queue, index) + queue->key_size;
+}
+
+PriorityQueueHandle PriorityQueue_enqueue_handle(PriorityQueue *queue,
+                                                 const void *key,
+                                                 const void *data)
+{
+    ASSERT(queue);
+    ASSERT(queue->positions && "Not an indexed priority queue.");
+    ASSERT(key);
+    ASSERT(data);
+    unsigned char *entry = _PriorityQueue_new_entry(queue, key, data);
+    if (!entry) return PQ_INVALID_HANDLE;
+    PriorityQueueHandle handle = _PriorityQueue_handle_of(queue, entry);
+    _PriorityQueue_sift_up(queue, queue->count++, entry);
+    queue->version++;
+    return handle;
+}
+
+bool PriorityQueue_from_iterator(PriorityQueue *queue, Iterator *iter)
+{
+    ASSERT(queue);
+    ASSERT(iter);
+    bool success = true;
+    while (iter->move_next(iter)) {
+        KeyValuePair *kvp = iter->current(iter);
+        unsigned char *entry =
+            _PriorityQueue_new_entry(queue, kvp->key, kvp->value);
+        if (!entry) {
+            success = false;
+            break;
+        }
+        _PriorityQueue_place(queue, queue->count++, entry);
+    }
+    // Even on failure, leave what did get added in order.
+    _PriorityQueue_heapify(queue);
+    queue->version++;
+    return success;
+}
+
+bool PriorityQueue_contains(const PriorityQueue *queue,
+                            PriorityQueueHandle handle)
+{
+    ASSERT(queue);
+    ASSERT(queue->positions && "Not an indexed priority queue.");
+    return handle < queue->handle_count &&
+           queue->positions[handle] < PQ_INVALID_HANDLE;
+}
+
+bool PriorityQueue_get(const PriorityQueue *queue, PriorityQueueHandle handle,
+                       void *key_out, void *data_out)
+{
+    ASSERT(queue);
+    if (!PriorityQueue_contains(queue, handle)) return false;
+    unsigned char *entry =
+        _PriorityQueue_entry(queue, queue->positions[handle]);
+    if (key_out) memcpy(key_out, entry, queue->key_size);
+    if (data_out) {
+        memcpy(data_out, entry + queue->key_size, queue->elem_size);
     }
+    return true;
+}
+
+bool PriorityQueue_update_key(PriorityQueue *queue, PriorityQueueHandle handle,
+                              const void *key)
+{
+    ASSERT(queue);
+    ASSERT(key);
+    if (!PriorityQueue_contains(queue, handle)) return false;
+    size_t index = queue->positions[handle];
+    unsigned char *spare = _PriorityQueue_entry(queue, queue->capacity);
+    memcpy(spare, _PriorityQueue_entry(queue, index), queue->entry_size);
+    memcpy(spare, key, queue->key_size);
+    _PriorityQueue_sift(queue, index, spare);
+    queue->version++;
+    return true;
+}
+
+bool PriorityQueue_decrease_key(PriorityQueue *queue,
+                                PriorityQueueHandle handle, const void *key)
+{
+    ASSERT(queue);
+    ASSERT(!PriorityQueue_contains(queue, handle) ||
+           queue->key_info->compare_fn(
+               key, _PriorityQueue_entry(queue, queue->positions[handle])) <=
+               0);
+    return PriorityQueue_update_key(queue, handle, key);
+}
 
-    trickle_up(queue, queue->count++);
+bool PriorityQueue_increase_key(PriorityQueue *queue,
+                                PriorityQueueHandle handle, const void *key)
+{
+    ASSERT(queue);
+    ASSERT(!PriorityQueue_contains(queue, handle) ||
+           queue->key_info->compare_fn(
+               key, _PriorityQueue_entry(queue, queue->positions[handle])) >=
+               0);
+    return PriorityQueue_update_key(queue, handle, key);
+}
 
-    return NULL; // No way to get the data
+bool PriorityQueue_remove(PriorityQueue *queue, PriorityQueueHandle handle,
+                          void *key_out, void *data_out)
+{
+    ASSERT(queue);
+    if (!PriorityQueue_contains(queue, handle)) return false;
+    size_t index = queue->positions[handle];
+    unsigned char *entry = _PriorityQueue_entry(queue, index);
+    if (key_out) memcpy(key_out, entry, queue->key_size);
+    if (data_out) {
+        memcpy(data_out, entry + queue->key_size, queue->elem_size);
+    }
+    _PriorityQueue_release_handle(queue, handle);
+    // The last entry fills the hole, from just past the shrunken heap.
+    if (index != --queue->count) {
+        _PriorityQueue_sift(queue, index,
+                            _PriorityQueue_entry(queue, queue->count));
+    }
+    queue->version++;
+    return true;
 }
 
 bool PriorityQueue_dequeue(PriorityQueue *queue, void *key_out,
@@ -199,11 +471,19 @@ bool PriorityQueue_dequeue(PriorityQueue *queue, void *key_out,
     ASSERT(key_out);
     ASSERT(data_out);
     if (!queue->count) return false;
-    void *data = Vector_get(queue->list, 0);
-    memcpy(key_out, data, queue->key_info->key_info->key_size);
-    memcpy(data_out, data + queue->key_info->key_info->key_size, queue->elem_size);
-    Vector_set(queue->list, 0, Vector_get(queue->list, --queue->count));
-    trickle_down(queue, 0);
+    unsigned char *top = _PriorityQueue_entry(queue, 0);
+    memcpy(key_out, top, queue->key_size);
+    memcpy(data_out, top + queue->key_size, queue->elem_size);
+    if (queue->positions) {
+        _PriorityQueue_release_handle(queue,
+                                      _PriorityQueue_handle_of(queue, top));
+    }
+    // The last entry sits just past the shrunken heap while it sifts down.
+    if (--queue->count) {
+        _PriorityQueue_sift_down(queue, 0,
+                                 _PriorityQueue_entry(queue, queue->count));
+    }
+    queue->version++;
     return true;
 }
 
@@ -214,17 +494,19 @@ bool PriorityQueue_peek(PriorityQueue *queue, void *key_out,
     ASSERT(key_out);
     ASSERT(data_out);
     if (!queue->count) return false;
-    void *data = Vector_get_data(queue->list);
-    memcpy(key_out, data, queue->key_info->key_info->key_size);
-    memcpy(data_out, data + queue->key_info->key_info->key_size, queue->elem_size);
+    unsigned char *top = _PriorityQueue_entry(queue, 0);
+    memcpy(key_out, top, queue->key_size);
+    memcpy(data_out, top + queue->key_size, queue->elem_size);
     return true;
 }
 
 void PriorityQueue_clear(PriorityQueue *queue)
 {
     ASSERT(queue);
-    if (queue->list) Vector_clear(queue->list);
     queue->count = 0;
+    queue->handle_count = 0;
+    queue->free_handle = PQ_INVALID_HANDLE;
+    queue->version++;
 }
 
 bool PriorityQueue_copy(PriorityQueue *dest_queue, const PriorityQueue *queue)
@@ -232,10 +514,27 @@ bool PriorityQueue_copy(PriorityQueue *dest_queue, const PriorityQueue *queue)
     ASSERT(dest_queue);
     ASSERT(queue);
     ASSERT(dest_queue->elem_size == queue->elem_size);
-    ASSERT(dest_queue->key_info->key_info->key_size == 
-                queue->key_info->key_info->key_size);
+    ASSERT(dest_queue->key_size == queue->key_size);
     PriorityQueue new_queue = *queue;
-    if (!Vector_copy(new_queue.list, queue->list)) return false;
+    new_queue.block = NULL;
+    new_queue.heap = NULL;
+    new_queue.capacity = 0;
+    new_queue.count = 0;
+    if (queue->count && !_PriorityQueue_resize(&new_queue, queue->count)) {
+        return false;
+    }
+    if (queue->positions) {
+        size_t size = queue->handle_capacity * sizeof(size_t);
+        if (!(new_queue.positions = malloc(size))) {
+            CacheLine_free(new_queue.block);
+            return false;
+        }
+        memcpy(new_queue.positions, queue->positions, size);
+    }
+    memcpy(new_queue.heap, queue->heap, queue->count * queue->entry_size);
+    new_queue.count = queue->count;
+    CacheLine_free(dest_queue->block);
+    free(dest_queue->positions);
     *dest_queue = new_queue;
     return true;
 }
@@ -256,7 +555,7 @@ void *PriorityQueue_iter_current_(const Iterator *iter)
     return NULL;
   }
   // Get the data after the key for the first item in the list.
-  return Vector_get_data(queue->list) + queue->key_info->key_info->key_size;
+  return _PriorityQueue_entry(queue, 0) + queue->key_size;
 }
 
 bool PriorityQueue_iter_eof_(const Iterator *iter) 
@@ -267,7 +566,7 @@ bool PriorityQueue_iter_eof_(const Iterator *iter)
   ASSERT(queue != NULL);
   ASSERT(iter->version == queue->version &&
          "Collection changed while iterating.");
-  return PriorityQueue_empty(queue) || iter->impl_data1 >= (int)queue->count;
+  return iter->impl_data1 < 0 || PriorityQueue_empty(queue);
 }
 
 bool PriorityQueue_iter_move_next_(Iterator *iter) 
@@ -278,14 +577,15 @@ bool PriorityQueue_iter_move_next_(Iterator *iter)
   ASSERT(queue != NULL);
   ASSERT(iter->version == queue->version &&
          "Collection changed while iterating.");
-  if (PriorityQueue_iter_eof_(iter)) {
-    return false;
+  // Dequeue the item we were on, if any, so the next one is on top.
+  if (iter->impl_data1 >= 0 && !PriorityQueue_empty(queue)) {
+    char dummy_key[queue->key_size];
+    char dummy_value[queue->elem_size];
+    PriorityQueue_dequeue(queue, dummy_key, dummy_value);
+    iter->version = queue->version;
   }
-  char dummy_key[queue->key_info->key_info->key_size];
-  char dummy_value[queue->elem_size];
-  PriorityQueue_dequeue(queue, dummy_key, dummy_value);
-  return PriorityQueue_iter_eof_(iter);
-  // TODO: Test this logic.
+  iter->impl_data1++;
+  return !PriorityQueue_empty(queue);
 }
 
 // Gets an Iterator for this PriorityQueue
@@ -299,7 +599,7 @@ void PriorityQueue_get_iterator(const PriorityQueue *queue, Iterator *iter)
   iter->current = PriorityQueue_iter_current_;
   iter->eof = PriorityQueue_iter_eof_;
   iter->move_next = PriorityQueue_iter_move_next_;
-  iter->impl_data1 = -1; // Current index
+  iter->impl_data1 = -1; // Number of items dequeued so far, -1 before start
   iter->impl_data2 = 0;
   iter->version = queue->version;
 }
@@ -0,0 +1,34 @@
+#ifndef COMMON_PROTECTED_ARENA_H__
+#define COMMON_PROTECTED_ARENA_H__
+
+#include "../public/arena.h"
+
+#include <stddef.h>
+
+// The block size used when none is given.
+#define ARENA_DEFAULT_BLOCK_SIZE (64 * 1024)
+
+// Every allocation is aligned to this.
+#define ARENA_ALIGN _Alignof(max_align_t)
+
+struct ArenaBlock {
+  struct ArenaBlock *next;
+  size_t size; // Usable bytes in `data'.
+  size_t used;
+  _Alignas(max_align_t) unsigned char data[];
+};
+
+// Blocks are kept newest-first; only `head' is allocated from. Oversized
+// allocations get a dedicated block linked in behind `head'.
+struct Arena {
+  struct ArenaBlock *head;
+  size_t block_size;
+  size_t bytes_used;
+  void *last; // The most recent allocation in `head', which can grow in place.
+};
+
+bool Arena_init(Arena *arena, size_t block_size);
+
+void Arena_cleanup(Arena *arena);
+
+#endif // COMMON_PROTECTED_ARENA_H__
@@ -6,10 +6,15 @@
 #include <stdbool.h>
 #include <stddef.h>
 
+#include "../public/mapped_file.h"
+
 struct Array
 {
     size_t count;
     size_t elem_size;
+    // The file a file-backed array lives in, or NULL. Stored in the file
+    // too, but only meaningful while it's open.
+    MappedFile *file;
     unsigned char data[];
 };
 
@@ -0,0 +1,60 @@
+#ifndef COMMON_PROTECTED_ATOMIC_STACK_H__
+#define COMMON_PROTECTED_ATOMIC_STACK_H__
+
+#include "../public/atomic_stack.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../public/concurrency.h"
+
+// Nodes are addressed by 32-bit index rather than by pointer, which leaves
+// room in a 64-bit word for a tag. A stack's top is `tag << 32 | (index + 1)'
+// (0 for empty), and the tag is bumped on every change, so a CAS that read
+// the top before another thread popped that node, recycled it and pushed it
+// again still fails. That is the ABA problem, solved with a plain 64-bit CAS.
+#define ATOMIC_STACK_EMPTY 0
+
+// Slab `k' holds ATOMIC_STACK_FIRST_SLAB << k nodes, so an index finds its slab
+// with one bit scan and the slabs never move once allocated.
+#define ATOMIC_STACK_FIRST_SLAB_LOG2 6
+#define ATOMIC_STACK_FIRST_SLAB (1u << ATOMIC_STACK_FIRST_SLAB_LOG2)
+#define ATOMIC_STACK_MAX_SLABS 26
+
+// The head of every node; the element follows it inline. `next' is atomic
+// because a popper may read it just as the node is popped by someone else and
+// reused; the tag then makes that popper's CAS fail.
+struct AtomicStackNode {
+  _Atomic uint32_t next; // index + 1 of the node below, or 0.
+};
+
+struct AtomicStack {
+  // The elements.
+  _Alignas(CACHE_LINE_SIZE) _Atomic uint64_t top;
+
+  // Nodes whose elements were popped, waiting to be reused.
+  _Alignas(CACHE_LINE_SIZE) _Atomic uint64_t free_top;
+
+  // How many nodes have ever been handed out of the slabs.
+  _Alignas(CACHE_LINE_SIZE) _Atomic uint32_t fresh;
+
+  // Slabs only ever go from NULL to allocated, and `grow_lock' is only taken
+  // to do that.
+  _Alignas(CACHE_LINE_SIZE) _Atomic(unsigned char *)
+      slabs[ATOMIC_STACK_MAX_SLABS];
+  pthread_mutex_t grow_lock;
+
+  // Fixed after init.
+  size_t elem_size;
+  size_t elem_offset;
+  size_t node_size;
+};
+
+bool AtomicStack_init(AtomicStack *stack, size_t elem_size);
+
+void AtomicStack_cleanup(AtomicStack *stack);
+
+#endif // COMMON_PROTECTED_ATOMIC_STACK_H__
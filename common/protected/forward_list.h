@@ -3,8 +3,14 @@
 
 #include "../public/forward_list.h"
 
+#include "../public/arena.h"
+#include "../public/pool.h"
+
 struct ForwardList
 {
+    Arena *arena; // NULL to use malloc.
+    Pool *pool; // If set, nodes come from here instead of the arena.
+    bool owns_pool;
     size_t elem_size;
     size_t count;
     ForwardListNode *head;
@@ -18,4 +24,6 @@ struct ForwardListNode
     unsigned char data[];
 };
 
+bool ForwardList_init_ext(ForwardList *list, size_t elem_size, Arena *arena);
+
 #endif // COMMON_PROTECTED_FORWARD_LIST_H__
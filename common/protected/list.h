@@ -3,8 +3,14 @@
 
 #include "../public/list.h"
 
+#include "../public/arena.h"
+#include "../public/pool.h"
+
 struct List
 {
+    Arena *arena; // NULL to use malloc.
+    Pool *pool; // If set, nodes come from here instead of the arena.
+    bool owns_pool;
     size_t elem_size;
     size_t count;
     ListNode *head;
@@ -19,4 +25,6 @@ struct ListNode
     unsigned char data[];
 };
 
+bool List_init_ext(List *list, size_t elem_size, Arena *arena);
+
 #endif // COMMON_PROTECTED_LIST_H__
@@ -0,0 +1,44 @@
+#ifndef COMMON_PROTECTED_LOG_H__
+#define COMMON_PROTECTED_LOG_H__
+
+#include "../public/log.h"
+
+#include <stdint.h>
+
+// What each argument of a LogSite is read as.
+enum {
+  LOG_ARG_INT,
+  LOG_ARG_LONG,
+  LOG_ARG_LONG_LONG,
+  LOG_ARG_SIZE,
+  LOG_ARG_INTMAX,
+  LOG_ARG_PTRDIFF,
+  LOG_ARG_DOUBLE,
+  LOG_ARG_LONG_DOUBLE, // Kept as a double.
+  LOG_ARG_POINTER,
+  LOG_ARG_STRING,
+};
+
+// One logged call, as it sits on a ring and in a log file.
+typedef struct LogRecord {
+  uint64_t timestamp_ns; // Since the epoch.
+  uint32_t site_id;
+  uint32_t thread_id;
+  uint8_t level;
+  uint8_t indent;
+  uint16_t payload_size;
+  // The arguments in order: 8 bytes for a number or pointer, and a 2-byte
+  // length and then the characters for a string.
+  unsigned char payload[LOG_RECORD_SIZE - 20];
+} LogRecord;
+
+// A log file starts with this, then the size of a record as 4 bytes. Each
+// entry after that is a tag byte and what it tags:
+//   'S': a site's id and line as 4 bytes each, the lengths of its file
+//        and format as 2 bytes each, then the file and format. Written before
+//        the first record from the site.
+//   'R': a LogRecord.
+//   'D': the number of records dropped so far, as 8 bytes.
+#define LOG_FILE_MAGIC "ccLOG\0\0\1"
+
+#endif // COMMON_PROTECTED_LOG_H__
@@ -5,22 +5,53 @@
 
 #include <stdlib.h>
 
-#include "../public/vector.h"
+#include "../public/arena.h"
 
+// Control byte values. A full slot stores the top 7 bits of its hash instead.
+#define MAP_CTRL_EMPTY ((unsigned char)0x80)
+#define MAP_CTRL_DELETED ((unsigned char)0xFE)
+#define MAP_CTRL_IS_FULL(c) (((c) & 0x80) == 0)
+
+// How many slots of the old table each mutating operation migrates while an
+// incremental rehash is in progress.
+#define MAP_REHASH_STEP 16
+
+// The head of every slot. The key and value follow it inline.
+struct MapSlot {
+  KeyValuePair kvp; // Points at the key and value stored in the same slot.
+  uint64_t hash; // Finalized. Cached so probes and rehashes never rehash.
+};
+
+// One slab of slots: `capacity' slots of `slot_size' bytes, followed by
+// `capacity' control bytes. Each slot is laid out as [MapSlot][key][value].
+struct MapTable {
+  unsigned char *slots;
+  unsigned char *ctrl;
+  size_t capacity; // Number of slots -- always a power of 2.
+  size_t tombstones;
+};
+
+// Open-addressing hash table. Keys and values are stored inline in the slots.
+// While an incremental rehash is in progress, entries live in either `table' or
+// `old_table', and `old_table' slots below `rehash_index' have been migrated.
 struct Map {
-  Vector *buckets;
+  Arena *arena; // NULL to use malloc.
+  struct MapTable table;
+  struct MapTable old_table; // All zero unless rehashing.
+  size_t rehash_index;
+  bool incremental;
+  size_t slot_size;
+  size_t key_offset;
+  size_t value_offset;
   KeyInfo key_info;
   size_t elem_size;
-  size_t capacity;
-  size_t count;
+  size_t count; // Live entries in both tables.
   int version;
   void (*print_key)(const Map *, char*, const void*);
   void (*print_value)(const Map *, char*, const void*);
 };
 
-struct MapBucket {
-  Map *map;
-  Vector *key_value_pairs;
-};
+bool Map_init_ext(Map *map, KeyInfo *key_info, size_t elem_size,
+                  size_t capacity, Arena *arena);
 
 #endif // #ifndef COMMON_PROTECTED_MAP_H__
@@ -0,0 +1,17 @@
+#ifndef COMMON_PROTECTED_MAPPED_FILE_H__
+#define COMMON_PROTECTED_MAPPED_FILE_H__
+
+#include "../public/mapped_file.h"
+
+#include <stddef.h>
+
+struct MappedFile {
+  int fd;
+
+  // NULL while the file is empty, since nothing can be mapped.
+  void *data;
+
+  size_t size;
+};
+
+#endif // COMMON_PROTECTED_MAPPED_FILE_H__
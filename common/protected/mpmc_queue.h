@@ -0,0 +1,52 @@
+#ifndef COMMON_PROTECTED_MPMC_QUEUE_H__
+#define COMMON_PROTECTED_MPMC_QUEUE_H__
+
+#include "../public/mpmc_queue.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "../public/concurrency.h"
+
+// The head of every cell; the element follows it inline. A cell at position
+// `pos' (mod capacity) is free for the producer of `pos' when its sequence is
+// `pos', and holds that producer's element when its sequence is `pos + 1'.
+// The consumer then hands it to the next lap by setting it to
+// `pos + capacity'.
+struct MpmcCell {
+  atomic_size_t sequence;
+};
+
+struct MpmcQueue {
+  // Claimed by producers.
+  _Alignas(CACHE_LINE_SIZE) atomic_size_t enqueue_pos;
+
+  // Claimed by consumers.
+  _Alignas(CACHE_LINE_SIZE) atomic_size_t dequeue_pos;
+
+  // Fixed after init.
+  _Alignas(CACHE_LINE_SIZE) unsigned char *cells;
+  size_t cell_size;
+  size_t elem_offset;
+  size_t elem_size;
+  size_t capacity; // Always a power of 2.
+  size_t mask;
+  WaitPolicy wait;
+  atomic_bool closed;
+
+  // Only used by WAIT_BLOCK, to sleep and wake.
+  atomic_int producers_sleeping;
+  atomic_int consumers_sleeping;
+  pthread_mutex_t lock;
+  pthread_cond_t not_empty;
+  pthread_cond_t not_full;
+};
+
+bool MpmcQueue_init(MpmcQueue *queue, size_t elem_size, size_t capacity,
+                    WaitPolicy wait);
+
+void MpmcQueue_cleanup(MpmcQueue *queue);
+
+#endif // COMMON_PROTECTED_MPMC_QUEUE_H__
@@ -0,0 +1,37 @@
+#ifndef COMMON_PROTECTED_POOL_H__
+#define COMMON_PROTECTED_POOL_H__
+
+#include "../public/pool.h"
+
+#include <stddef.h>
+
+// Slabs start with room for this many objects and double up to the maximum.
+#define POOL_MIN_SLAB_OBJECTS 32
+#define POOL_MAX_SLAB_OBJECTS 4096
+
+struct PoolSlab {
+  struct PoolSlab *next;
+  _Alignas(max_align_t) unsigned char data[];
+};
+
+// A released object holds the link to the next free one.
+struct PoolFree {
+  struct PoolFree *next;
+};
+
+struct Pool {
+  Arena *arena; // NULL to use malloc.
+  size_t object_size;
+  size_t count; // Objects acquired and not released.
+  struct PoolFree *free_list;
+  struct PoolSlab *slabs; // Newest first.
+  unsigned char *cursor; // Next never-used object in the newest slab.
+  unsigned char *limit; // End of the newest slab.
+  size_t slab_objects; // Size of the next slab.
+};
+
+bool Pool_init(Pool *pool, size_t object_size, Arena *arena);
+
+void Pool_cleanup(Pool *pool);
+
+#endif // COMMON_PROTECTED_POOL_H__
@@ -5,16 +5,38 @@
 #include <stddef.h>
 
 #include "../public/priority_queue.h"
-#include "../public/vector.h"
 
+// Each entry is the key followed by the element, and in an indexed queue, the
+// entry's handle. The children of entry `i' are entries `arity * i + 1' to
+// `arity * i + arity', and entry 1 starts a cache line, so when
+// `arity * entry_size' is a cache line, every node's children share one.
+//
+// An indexed queue maps each handle to where its entry is in the heap. A free
+// handle instead holds the complement of the next free one, which sets its
+// top bit; heap positions never do.
 struct PriorityQueue
 {
-    Vector *list;
-    PriorityQueueMode mode;
-    RelationalKeyInfo *key_info;
+    unsigned char *block; // From CacheLine_alloc.
+    unsigned char *heap;  // Entry 0, just before the first aligned line.
+    size_t capacity;      // Entries; one more is kept spare past the end.
     size_t count;
+    size_t arity;
+    size_t key_size;
     size_t elem_size;
+    size_t entry_size;
+    PriorityQueueMode mode;
+    RelationalKeyInfo *key_info;
+    size_t *positions;      // NULL unless indexed.
+    size_t handle_count;    // Handles ever handed out.
+    size_t handle_capacity;
+    size_t free_handle;     // PQ_INVALID_HANDLE if none.
     int version;
 };
 
+bool PriorityQueue_init(PriorityQueue *queue, RelationalKeyInfo *key_info,
+                        size_t elem_size, PriorityQueueMode mode,
+                        size_t arity, bool indexed);
+
+void PriorityQueue_cleanup(PriorityQueue *queue);
+
 #endif // COMMON_PROTECTED_PRIORITY_QUEUE_H__
@@ -0,0 +1,36 @@
+#ifndef COMMON_PROTECTED_ROPE_H__
+#define COMMON_PROTECTED_ROPE_H__
+
+#include "../public/rope.h"
+
+#include <stddef.h>
+
+#include "../public/arena.h"
+#include "../public/vector.h"
+
+// A run of the Rope's bytes, in a chunk or wherever it was appended from.
+// Adjacent appends to the same memory extend the last piece.
+struct RopePiece {
+  const char *data;
+  size_t start; // Where it starts in the Rope.
+  size_t length;
+};
+
+// Memory the Rope copies appended bytes into. Bytes are only ever added after
+// the last, so pieces keep pointing at them.
+struct RopeChunkBlock {
+  struct RopeChunkBlock *next;
+  size_t size;
+  size_t used;
+  char data[];
+};
+
+struct Rope {
+  Arena *arena; // NULL to use malloc.
+  Vector *pieces; // struct RopePiece, ordered by start.
+  struct RopeChunkBlock *chunks; // Newest, the one appended to, first.
+  size_t length;
+  size_t next_chunk_size;
+};
+
+#endif // COMMON_PROTECTED_ROPE_H__
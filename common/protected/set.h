@@ -5,18 +5,37 @@
 
 #include <stdlib.h>
 
+#include "../public/arena.h"
 #include "../public/vector.h"
 
+// How many buckets of the old bucket vector each mutating operation migrates
+// while an incremental rehash is in progress.
+#define SET_REHASH_STEP 4
+
+// While an incremental rehash is in progress, items live in either `buckets'
+// or `old_buckets', and `old_buckets' below `rehash_index' are empty.
 struct Set {
+  Arena *arena; // NULL to use malloc.
   Vector *buckets;
+  Vector *old_buckets; // NULL unless rehashing.
+  size_t rehash_index;
+  bool incremental;
   KeyInfo key_info;
-  size_t capacity;
-  size_t count;
+  size_t capacity; // Number of buckets in `buckets'.
+  size_t count; // Items in both bucket vectors.
   int version;
 };
 
 struct SetBucket {
-  Vector *items; // Holds void* items to allocated copies
+  Vector *items; // Holds SetItems. NULL until used.
+};
+
+struct SetItem {
+  uint64_t hash; // Finalized. Cached so lookups and rehashes never rehash.
+  void *value; // Allocated copy of the element.
 };
 
+bool Set_init_ext(Set *set, KeyInfo *key_info, size_t capacity,
+                  Arena *arena);
+
 #endif // COMMON_PROTECTED_SET_H__
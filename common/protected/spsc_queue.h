@@ -0,0 +1,47 @@
+#ifndef COMMON_PROTECTED_SPSC_QUEUE_H__
+#define COMMON_PROTECTED_SPSC_QUEUE_H__
+
+#include "../public/spsc_queue.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "../public/concurrency.h"
+
+// `head' and `tail' count every element ever removed and added; the slot for a
+// count is `count & mask'. Each side keeps a private copy of the other side's
+// counter and only reloads it when the copy says the queue is empty (or full),
+// so in steady state neither side touches the other's cache line.
+struct SpscQueue {
+  // Written by the consumer.
+  _Alignas(CACHE_LINE_SIZE) atomic_size_t head;
+  size_t tail_cache;
+  atomic_bool consumer_sleeping;
+
+  // Written by the producer.
+  _Alignas(CACHE_LINE_SIZE) atomic_size_t tail;
+  size_t head_cache;
+  atomic_bool producer_sleeping;
+
+  // Fixed after init.
+  _Alignas(CACHE_LINE_SIZE) unsigned char *data;
+  size_t elem_size;
+  size_t capacity; // Always a power of 2.
+  size_t mask;
+  WaitPolicy wait;
+  atomic_bool closed;
+
+  // Only used by WAIT_BLOCK, to sleep and wake.
+  pthread_mutex_t lock;
+  pthread_cond_t not_empty;
+  pthread_cond_t not_full;
+};
+
+bool SpscQueue_init(SpscQueue *queue, size_t elem_size, size_t capacity,
+                    WaitPolicy wait);
+
+void SpscQueue_cleanup(SpscQueue *queue);
+
+#endif // COMMON_PROTECTED_SPSC_QUEUE_H__
@@ -0,0 +1,68 @@
+#ifndef COMMON_PROTECTED_THREAD_POOL_H__
+#define COMMON_PROTECTED_THREAD_POOL_H__
+
+#include "../public/thread_pool.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "../public/atomic_stack.h"
+#include "../public/concurrency.h"
+#include "../public/mpmc_queue.h"
+#include "../public/work_deque.h"
+
+// `released' is set, under the lock, by whoever finishes the last outstanding
+// task, and that is the last time they touch the group. Waiters wait for it
+// rather than for `pending' to reach 0, so the group may be freed as soon as
+// a wait returns.
+struct WaitGroup {
+  _Alignas(CACHE_LINE_SIZE) atomic_size_t pending;
+  bool released;
+  pthread_mutex_t lock;
+  pthread_cond_t all_done;
+};
+
+struct Task {
+  TaskFn fn;
+  void *arg;
+  WaitGroup *group;
+};
+
+struct ThreadPoolWorker {
+  _Alignas(CACHE_LINE_SIZE) ThreadPool *pool;
+  WorkDeque *deque;
+  pthread_t thread;
+  int index;
+  unsigned int seed; // Picks whom to steal from.
+};
+
+// Task slots are allocated up front and recycled through `free_tasks', so
+// submitting never allocates. Tasks submitted from outside the pool go on
+// `injected'; both hold `max_tasks', so neither can overflow while there are
+// free slots.
+struct ThreadPool {
+  struct ThreadPoolWorker *workers;
+  size_t num_threads;
+  struct Task *tasks;
+  size_t max_tasks;
+  AtomicStack *free_tasks;
+  MpmcQueue *injected;
+
+  // Idle workers sleep here.
+  _Alignas(CACHE_LINE_SIZE) atomic_int sleepers;
+  atomic_bool stopping;
+  pthread_mutex_t lock;
+  pthread_cond_t has_work;
+};
+
+bool WaitGroup_init(WaitGroup *group);
+
+void WaitGroup_cleanup(WaitGroup *group);
+
+bool ThreadPool_init(ThreadPool *pool, size_t num_threads, size_t max_tasks);
+
+void ThreadPool_cleanup(ThreadPool *pool);
+
+#endif // COMMON_PROTECTED_THREAD_POOL_H__
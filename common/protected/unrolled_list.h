@@ -0,0 +1,46 @@
+#ifndef COMMON_PROTECTED_UNROLLED_LIST_H__
+#define COMMON_PROTECTED_UNROLLED_LIST_H__
+
+#include "../public/unrolled_list.h"
+
+#include <stddef.h>
+
+#include "../public/arena.h"
+#include "../public/pool.h"
+
+// Bytes per node, header included. Eight cache lines: enough that the links
+// are a small fraction of what a scan reads, small enough that shifting
+// elements to insert or remove in the middle of a node stays cheap.
+#define UNROLLED_LIST_NODE_SIZE 512
+
+// Nodes hold at least this many elements, however large they are.
+#define UNROLLED_LIST_MIN_NODE_CAPACITY 4
+
+struct UnrolledList
+{
+    Arena *arena; // NULL to use malloc.
+    Pool *pool; // If set, nodes come from here instead of the arena.
+    bool owns_pool;
+    size_t elem_size;
+    size_t node_capacity;
+    size_t count;
+    UnrolledListNode *head;
+    UnrolledListNode *tail;
+    int version;
+};
+
+// Nodes are never empty. Adjacent nodes that fall to half full between them
+// are merged, so a scan never wades through a run of nearly empty nodes.
+struct UnrolledListNode
+{
+    UnrolledListNode *prev;
+    UnrolledListNode *next;
+    size_t count;
+    _Alignas(max_align_t) unsigned char data[];
+};
+
+bool UnrolledList_init_ext(UnrolledList *list, size_t elem_size, Arena *arena);
+
+void UnrolledList_cleanup(UnrolledList *list);
+
+#endif // COMMON_PROTECTED_UNROLLED_LIST_H__
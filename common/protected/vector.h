@@ -3,8 +3,13 @@
 
 #include "../public/vector.h"
 
+#include <stdbool.h>
 #include <stdlib.h>
 
+#include "../public/arena.h"
+#include "../public/mapped_file.h"
+
+// Starts with the fields of a VectorPrefix, in the same order.
 struct Vector {
   void *data;
 
@@ -17,13 +22,31 @@ struct Vector {
   // The actual number of elements.
   size_t elem_count;
 
-  // The ideal capacity -- must be a power of 2.
-  size_t reserve_count;
-
   // Detect changes to the list while iterating
   int version;
 
+  Arena *arena; // NULL to use malloc.
+
+  // The ideal capacity; a power of 2 under VECTOR_GROW_DOUBLE.
+  size_t reserve_count;
+
+  VectorGrowth growth;
+
+  // Whether `data' is its own mapping rather than a heap block.
+  bool mapped;
+
+  // A small vector's own storage, which `data' points to until it outgrows
+  // it. NULL for other vectors.
+  void *inline_data;
+  size_t inline_size;
+
+  // The file a file-backed vector's elements live in, after its header. NULL
+  // for other vectors.
+  MappedFile *file;
+
   void (*print)(const Vector *, char*, const void*);
 };
 
+bool Vector_init_ext(Vector *vector, size_t elem_size, Arena *arena);
+
 #endif // #ifndef COMMON_PROTECTED_VECTOR_H__
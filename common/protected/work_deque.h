@@ -0,0 +1,39 @@
+#ifndef COMMON_PROTECTED_WORK_DEQUE_H__
+#define COMMON_PROTECTED_WORK_DEQUE_H__
+
+#include "../public/work_deque.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../public/concurrency.h"
+
+// The items live in a ring. When it fills up, the owner copies them to one
+// twice the size; thieves may still be reading the old ring, so it is kept
+// until the deque is freed.
+struct WorkDequeBuffer {
+  size_t capacity; // Always a power of 2.
+  size_t mask;
+  struct WorkDequeBuffer *older;
+  _Atomic(void *) items[];
+};
+
+// `top' and `bottom' count every item ever stolen and pushed; the slot for a
+// count is `count & mask'. They are signed so that the owner can briefly take
+// `bottom' below `top' while it pops.
+struct WorkDeque {
+  // Advanced by thieves, and by the owner taking the last item.
+  _Alignas(CACHE_LINE_SIZE) _Atomic int64_t top;
+
+  // Written by the owner.
+  _Alignas(CACHE_LINE_SIZE) _Atomic int64_t bottom;
+  _Atomic(struct WorkDequeBuffer *) buffer;
+};
+
+bool WorkDeque_init(WorkDeque *deque, size_t capacity);
+
+void WorkDeque_cleanup(WorkDeque *deque);
+
+#endif // COMMON_PROTECTED_WORK_DEQUE_H__
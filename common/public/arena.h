@@ -0,0 +1,45 @@
+#ifndef COMMON_PUBLIC_ARENA_H__
+#define COMMON_PUBLIC_ARENA_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// A region allocator. Allocations are carved out of large blocks and are all
+// released together when the Arena is reset or freed.
+//
+// Every function that takes an Arena also accepts NULL, in which case it uses
+// malloc/realloc/free instead. Containers created with an Arena (see the
+// *_alloc_ext functions) draw all their memory from it, so freeing the Arena
+// releases them without calling their *_free functions.
+typedef struct Arena Arena;
+
+// Creates a new Arena that allocates blocks of `block_size' bytes, or a
+// default size if 0. Larger allocations get a block of their own.
+Arena *Arena_alloc(size_t block_size);
+
+// Frees the Arena and everything allocated from it.
+void Arena_free(Arena *arena);
+
+// Releases everything allocated from the Arena at once, keeping one block for
+// reuse.
+void Arena_reset(Arena *arena);
+
+// Gets the number of bytes allocated from the Arena since it was created or
+// last reset.
+size_t Arena_bytes_used(const Arena *arena);
+
+// Allocates `size' bytes, suitably aligned for any type.
+void *Arena_malloc(Arena *arena, size_t size);
+
+// Allocates `count' zeroed objects of `size' bytes each.
+void *Arena_calloc(Arena *arena, size_t count, size_t size);
+
+// Resizes an allocation of `old_size' bytes to `size' bytes, moving it if
+// need be. The most recent allocation from the Arena grows in place.
+void *Arena_realloc(Arena *arena, void *ptr, size_t old_size, size_t size);
+
+// Frees an allocation if `arena' is NULL. Otherwise does nothing; the memory
+// is reclaimed with the Arena.
+void Arena_release(Arena *arena, void *ptr);
+
+#endif // COMMON_PUBLIC_ARENA_H__
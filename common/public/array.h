@@ -11,6 +11,17 @@ typedef struct Array Array;
 
 Array *Array_alloc(size_t count, size_t elem_size);
 
+// Opens an Array that lives in the file at `path', mapped rather than read so
+// that it opens immediately at any size. A new file is created with `count'
+// zeroed elements; an existing one keeps its elements, and is resized to
+// `count' unless that's 0. Returns NULL if the file can't be mapped or holds a
+// different size of element. Array_realloc grows the file, and Array_free
+// closes it, keeping the elements.
+Array *Array_open_file(const char *path, size_t count, size_t elem_size);
+
+// Writes a file-backed array through to the disk. Returns whether successful.
+bool Array_sync(Array *array);
+
 // Re-zeroes out the memory of the used array.
 void Array_clear(Array *array);
 
@@ -62,6 +73,7 @@ void Array_get_indexer(const Array *array, Indexer *indexer);
 #define DECLARE_ARRAY(name, T)                                                 \
   typedef struct Array name##Array;                                            \
   name##Array *name##Array_alloc(size_t count);                                \
+  name##Array *name##Array_open_file(const char *path, size_t count);          \
   T *name##Array_get_data(name##Array *array);                                 \
   T name##Array_get(name##Array *array, size_t index);                         \
   T *name##Array_get_ref(name##Array *array, size_t index);                    \
@@ -83,6 +95,9 @@ void Array_get_indexer(const Array *array, Indexer *indexer);
   name##Array *name##Array_alloc(size_t count) {                               \
     return (name##Array *)Array_alloc(count, sizeof(T));                       \
   }                                                                            \
+  name##Array *name##Array_open_file(const char *path, size_t count) {         \
+    return (name##Array *)Array_open_file(path, count, sizeof(T));             \
+  }                                                                            \
   T *name##Array_get_data(name##Array *array) {                                \
     return (T *)Array_get_data((Array *)array);                                \
   }                                                                            \
@@ -0,0 +1,43 @@
+#ifndef COMMON_PUBLIC_ATOMIC_STACK_H__
+#define COMMON_PUBLIC_ATOMIC_STACK_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// A LIFO stack that any number of threads may push to and pop from at once,
+// without locks. Elements live in nodes that are recycled through a lock-free
+// free list, so pushing only allocates when every node is in use.
+typedef struct AtomicStack AtomicStack;
+
+// Creates a new AtomicStack object.
+AtomicStack *AtomicStack_alloc(size_t elem_size);
+
+// Frees up the AtomicStack object. No thread may be using it.
+void AtomicStack_free(AtomicStack *stack);
+
+// Returns whether the stack is empty. Only a snapshot while other threads are
+// active. There is no count: keeping one would add a contended atomic to
+// every push and pop.
+bool AtomicStack_empty(const AtomicStack *stack);
+
+// Gets the size of an element in the AtomicStack
+size_t AtomicStack_element_size(const AtomicStack *stack);
+
+// Allocates nodes for a total of `num_elems' objects up front, so that pushes
+// never have to allocate while there are at most that many.
+// Returns whether the allocation was successful.
+bool AtomicStack_reserve(AtomicStack *stack, size_t num_elems);
+
+// Adds the item to the top of the stack. Returns false if a node was needed
+// and couldn't be allocated.
+bool AtomicStack_push(AtomicStack *stack, const void *data);
+
+// Removes the item on the top of the stack and stores it in the given
+// location. Returns false if the stack is empty.
+bool AtomicStack_pop(AtomicStack *stack, void *data_out);
+
+// Peeks the item on the top of the stack and stores it in the given location.
+// Another thread may have popped it by the time this returns.
+bool AtomicStack_peek(const AtomicStack *stack, void *data_out);
+
+#endif // COMMON_PUBLIC_ATOMIC_STACK_H__
@@ -8,10 +8,12 @@
 #include "iterator.h"
 #include "list.h"
 #include "map.h"
+#include "mpmc_queue.h"
 #include "priority_queue.h"
 #include "queue.h"
 #include "set.h"
 #include "stack.h"
+#include "unrolled_list.h"
 #include "vector.h"
 
 // Cartesians:
@@ -20,7 +22,7 @@
 
 #define DO_COLLECTIONS(...) \
     CARTESIAN(DOMAP, (__VA_ARGS__, (CStringCase, char *)), (__VA_ARGS__)) \
-    CARTESIAN(DOCOLLECTION, (DECLARE_VECTOR, DECLARE_LIST, DECLARE_ARRAY, DECLARE_FORWARD_LIST), (__VA_ARGS__))
+    CARTESIAN(DOCOLLECTION, (DECLARE_VECTOR, DECLARE_LIST, DECLARE_ARRAY, DECLARE_FORWARD_LIST, DECLARE_UNROLLED_LIST, DECLARE_MPMC_QUEUE), (__VA_ARGS__))
 
 DO_COLLECTIONS(
     (Char, char), 
@@ -0,0 +1,39 @@
+#ifndef COMMON_PUBLIC_CONCURRENCY_H__
+#define COMMON_PUBLIC_CONCURRENCY_H__
+
+#include <stddef.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// Data written by different threads is kept this far apart, so that a write on
+// one core doesn't steal the cache line another core is reading.
+#define CACHE_LINE_SIZE 64
+
+// How many times a waiting thread polls before it yields or sleeps.
+#define SPIN_LIMIT 256
+
+// What a thread does when it has to wait on a concurrent container.
+typedef enum {
+  WAIT_SPIN,  // Poll, yielding the CPU between rounds. Lowest latency.
+  WAIT_BLOCK, // Poll briefly, then sleep until woken. Frees the core.
+} WaitPolicy;
+
+// Tells the CPU we are in a spin loop, so it can back off the pipeline and
+// let a hyperthread sibling run.
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  _mm_pause();
+#elif defined(__aarch64__)
+  __asm__ __volatile__("yield");
+#endif
+}
+
+// Allocates `size' bytes aligned to a cache line. Free with CacheLine_free.
+void *CacheLine_alloc(size_t size);
+
+// Frees memory from CacheLine_alloc.
+void CacheLine_free(void *ptr);
+
+#endif // COMMON_PUBLIC_CONCURRENCY_H__
@@ -4,7 +4,9 @@
 #include <stdbool.h>
 #include <stddef.h>
 
+#include "arena.h"
 #include "iterator.h"
+#include "pool.h"
 
 typedef struct ForwardList ForwardList;
 
@@ -23,6 +25,18 @@ typedef struct ForwardListNode ForwardListNode;
 // Creates a new ForwardList object.
 ForwardList *ForwardList_alloc(size_t elem_size);
 
+// Creates a new ForwardList object whose memory comes from `arena'.
+ForwardList *ForwardList_alloc_ext(size_t elem_size, Arena *arena);
+
+// Creates a new ForwardList whose nodes are recycled through `pool' rather
+// than allocated one at a time. If `pool' is NULL the ForwardList gets a pool
+// of its own.
+ForwardList *ForwardList_alloc_pooled(size_t elem_size, Pool *pool);
+
+// Creates a Pool of nodes that ForwardLists of `elem_size'-byte elements can
+// share.
+Pool *ForwardList_node_pool_alloc(size_t elem_size);
+
 // Gets the number of elements in the ForwardList
 size_t ForwardList_count(const ForwardList *list);
 
@@ -114,6 +128,8 @@ void ForwardList_get_reverse_sink(const ForwardList *list, Sink *sink);
   typedef struct ForwardList name##ForwardList;                                  \
   typedef struct ForwardListNode name##ForwardListNode;                          \
   name##ForwardList *name##ForwardList_alloc(void);                                  \
+  name##ForwardList *name##ForwardList_alloc_ext(Arena *arena);                      \
+  name##ForwardList *name##ForwardList_alloc_pooled(Pool *pool);                     \
   T name##ForwardList_get_first(const name##ForwardList *list);                  \
   T name##ForwardList_get_last(const name##ForwardList *list);                   \
   T *name##ForwardList_get_first_ref(const name##ForwardList *list);             \
@@ -151,7 +167,13 @@ void ForwardList_get_reverse_sink(const ForwardList *list, Sink *sink);
 
 #define DEFINE_FORWARD_LIST(name, T)                                            \
   name##ForwardList *name##ForwardList_alloc(void) {                                 \
-    return (name##ForwardList *)ForwardList_alloc(sizeof(ForwardList));           \
+    return (name##ForwardList *)ForwardList_alloc(sizeof(T));           \
+  }                                                                            \
+  name##ForwardList *name##ForwardList_alloc_ext(Arena *arena) {                     \
+    return (name##ForwardList *)ForwardList_alloc_ext(sizeof(T), arena);             \
+  }                                                                            \
+  name##ForwardList *name##ForwardList_alloc_pooled(Pool *pool) {                    \
+    return (name##ForwardList *)ForwardList_alloc_pooled(sizeof(T), pool);           \
   }                                                                            \
   T name##ForwardList_get_first(const name##ForwardList *list) {                 \
     return *name##ForwardList_get_first_ref(list);                              \
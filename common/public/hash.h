@@ -0,0 +1,34 @@
+#ifndef COMMON_PUBLIC_HASH_H__
+#define COMMON_PUBLIC_HASH_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The seed used by the default KeyInfo hash functions.
+#define HASH_DEFAULT_SEED 0x2D358DCCAA6C78A5ull
+
+// Hashes `len' bytes into 64 well-mixed bits. Reads 8 bytes at a time and
+// needs no alignment. Equal inputs and seeds always give equal hashes.
+uint64_t Hash_bytes(const void *data, size_t len, uint64_t seed);
+
+// Like Hash_bytes, but ASCII letters hash the same regardless of case.
+uint64_t Hash_bytes_case(const void *data, size_t len, uint64_t seed);
+
+// Hashes a NUL-terminated string, not including the terminator.
+uint64_t Hash_cstring(const char *str, uint64_t seed);
+
+// Hashes a NUL-terminated string, ignoring the case of ASCII letters.
+uint64_t Hash_cstring_case(const char *str, uint64_t seed);
+
+// Mixes a 64-bit integer so that every input bit affects every output bit.
+uint64_t Hash_u64(uint64_t value, uint64_t seed);
+
+// Finalizes a hash for indexing a power-of-two table. The fibonacci multiply
+// carries every bit upward; folding the high half back down means the low bits
+// can be masked off directly. The top bits are left free for tags.
+static inline uint64_t Hash_fibonacci(uint64_t hash) {
+  hash *= 0x9E3779B97F4A7C15ull;
+  return hash ^ (hash >> 32);
+}
+
+#endif // COMMON_PUBLIC_HASH_H__
@@ -3,6 +3,7 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 #include "assert.h"
 
@@ -18,6 +19,9 @@ typedef enum {
   COLLECTION_SET = 1 << 7,
   COLLECTION_MAP = 1 << 8,
   COLLECTION_CUSTOM = 1 << 9,
+  COLLECTION_UNROLLED_LIST = 1 << 10,
+  COLLECTION_SPSC_QUEUE = 1 << 11,
+  COLLECTION_MPMC_QUEUE = 1 << 12,
 } CollectionType;
 
 typedef struct KeyInfo KeyInfo;
@@ -72,10 +76,26 @@ DECLARE_INDEXER_TYPE(, void)
 
 struct KeyInfo {
   size_t key_size;
-  int (*hash_fn)(const void *key);
+  int (*hash_fn)(const void *key); // Only used if hash64_fn is NULL.
   bool (*eq_fn)(const void *key_a, const void *key_b);
+  uint64_t (*hash64_fn)(const void *key);
 };
 
+// Hashes a key with the 64-bit hash function if there is one, falling back to
+// the 32-bit one, so KeyInfos written before hash64_fn existed still work.
+static inline uint64_t KeyInfo_hash(const KeyInfo *key_info, const void *key) {
+  if (key_info->hash64_fn) {
+    return key_info->hash64_fn(key);
+  }
+  return (unsigned int)key_info->hash_fn(key);
+}
+
+// Whether two KeyInfos hash keys the same way.
+static inline bool KeyInfo_same_hash(const KeyInfo *a, const KeyInfo *b) {
+  return a->hash64_fn == b->hash64_fn &&
+         (a->hash64_fn != NULL || a->hash_fn == b->hash_fn);
+}
+
 struct RelationalKeyInfo {
   KeyInfo *key_info;
   int (*compare_fn)(const void *a, const void *b);
@@ -120,6 +140,10 @@ int CString_hash(const void *key);
 
 int CStringCase_hash(const void *key);
 
+uint64_t CString_hash64(const void *key);
+
+uint64_t CStringCase_hash64(const void *key);
+
 #define DECLARE_CONTAINER_FN(name, T, hash_fn, eq_fn)                          \
   DECLARE_ITERATOR_TYPE(name, T)                                               \
   DECLARE_INDEXER_TYPE(name, T)                                                \
@@ -134,10 +158,14 @@ int CStringCase_hash(const void *key);
   T name##_next(name##Iterator *iter);
 
 #define DECLARE_CONTAINER(name, T)                                             \
-  DECLARE_CONTAINER_FN(name, T, name##_hash, name##_eq)
+  DECLARE_CONTAINER_FN(name, T, name##_hash, name##_eq)                        \
+  uint64_t name##_hash64(const void *k);
 
 #define DEFINE_CONTAINER_FN(name, T, hash_fn, eq_fn)                           \
-  KeyInfo name##KeyInfo = {sizeof(T), hash_fn, eq_fn};                         \
+  DEFINE_CONTAINER_FN_EXT(name, T, hash_fn, NULL, eq_fn)
+
+#define DEFINE_CONTAINER_FN_EXT(name, T, hash_fn, hash64_fn, eq_fn)            \
+  KeyInfo name##KeyInfo = {sizeof(T), hash_fn, eq_fn, hash64_fn};              \
   void name##_for_each(name##Iterator *iter, void (*action)(T * elem)) {       \
     for_each((Iterator *)iter, (void (*)(void *))action);                      \
   }                                                                            \
@@ -149,10 +177,15 @@ int CStringCase_hash(const void *key);
     return *(T *)iter->move_next(iter);                                        \
   }
 
+// `hash_expr' gives 64 bits; the 32-bit name##_hash folds them together.
 #define DEFINE_CONTAINER(name, T, hash_expr, eq_expr)                          \
-  int name##_hash(const void *k) {                                             \
+  uint64_t name##_hash64(const void *k) {                                      \
     T key = *(const T *)k;                                                     \
-    return (hash_expr);                                                        \
+    return (uint64_t)(hash_expr);                                              \
+  }                                                                            \
+  int name##_hash(const void *k) {                                             \
+    uint64_t hash = name##_hash64(k);                                          \
+    return (int)(hash ^ (hash >> 32));                                         \
   }                                                                            \
   bool name##_eq(const void *_a, const void *_b) {                             \
     T a = *(const T *)_a;                                                      \
@@ -173,7 +206,7 @@ int CStringCase_hash(const void *key);
     _##name##_current_reduce_fn = last_fn;                                     \
     return initial;                                                            \
   }                                                                            \
-  DEFINE_CONTAINER_FN(name, T, name##_hash, name##_eq)
+  DEFINE_CONTAINER_FN_EXT(name, T, name##_hash, name##_hash64, name##_eq)
 
 #define DECLARE_RELATIONAL_CONTAINER_FN(name, T, hash_fn, compare_fn)          \
   DECLARE_CONTAINER_FN(name, T, hash_fn, name##_eq)                            \
@@ -181,7 +214,8 @@ int CStringCase_hash(const void *key);
   int compare_fn(const void *a, const void *b);
 
 #define DECLARE_RELATIONAL_CONTAINER(name, T)                                  \
-  DECLARE_RELATIONAL_CONTAINER_FN(name, T, name##_hash, name##_compare)
+  DECLARE_RELATIONAL_CONTAINER_FN(name, T, name##_hash, name##_compare)        \
+  uint64_t name##_hash64(const void *k);
 
 #define DECLARE_CONTAINER_REDUCER(name, T, func_name)                          \
   T name##_##func_name(name##Iterator *iter);
@@ -194,10 +228,14 @@ int CStringCase_hash(const void *key);
   DECLARE_CONTAINER_REDUCER(name, T, max)
 
 #define DEFINE_RELATIONAL_CONTAINER_FN(name, T, hash_fn, compare_fn)           \
+  DEFINE_RELATIONAL_CONTAINER_FN_EXT(name, T, hash_fn, NULL, compare_fn)
+
+#define DEFINE_RELATIONAL_CONTAINER_FN_EXT(name, T, hash_fn, hash64_fn,        \
+                                           compare_fn)                         \
   bool name##_eq(const void *a, const void *b) {                               \
     return name##_compare(a, b) == 0;                                          \
   }                                                                            \
-  DEFINE_CONTAINER_FN(name, T, hash_fn, name##_eq)                             \
+  DEFINE_CONTAINER_FN_EXT(name, T, hash_fn, hash64_fn, name##_eq)              \
   RelationalKeyInfo name##RelationalKeyInfo = {&name##KeyInfo, compare_fn};
 
 #define DEFINE_RELATIONAL_CONTAINER(name, T, hash_expr, compare_expr)          \
@@ -215,13 +253,13 @@ int CStringCase_hash(const void *key);
     return name##_reduce((initial), iter, _##name##__##func_name);             \
   }
 
+// Integer keys hash as their value. Floating-point ones pass their own
+// `hash_expr' over `key', since converting would drop the fraction.
 #define DEFINE_RELATIONAL_CONTAINER_BASIC(name, T)                             \
-  DEFINE_RELATIONAL_CONTAINER(                                                 \
-      name, T,                                                                 \
-      (int)(unsigned int)((unsigned long long)((long double)key *              \
-                                               2654435761) %                   \
-                          0x100000000ul),                                      \
-      a - b)                                                                   \
+  DEFINE_RELATIONAL_CONTAINER_BASIC_EXT(name, T, (long long)key)
+
+#define DEFINE_RELATIONAL_CONTAINER_BASIC_EXT(name, T, hash_expr)              \
+  DEFINE_RELATIONAL_CONTAINER(name, T, hash_expr, (a > b) - (a < b))          \
   DEFINE_CONTAINER_REDUCER(name, T, sum, 0, a + b)                             \
   DEFINE_CONTAINER_REDUCER(name, T, product, 1, a *b)                          \
   DEFINE_CONTAINER_REDUCER(name, T, min, (T)0x7FFFFFFFFFFFFFFF,                \
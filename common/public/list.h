@@ -4,7 +4,9 @@
 #include <stdbool.h>
 #include <stddef.h>
 
+#include "arena.h"
 #include "iterator.h"
+#include "pool.h"
 
 typedef struct List List;
 
@@ -23,6 +25,16 @@ typedef struct ListNode ListNode;
 // Creates a new List object.
 List *List_alloc(size_t elem_size);
 
+// Creates a new List object whose memory comes from `arena'.
+List *List_alloc_ext(size_t elem_size, Arena *arena);
+
+// Creates a new List whose nodes are recycled through `pool' rather than
+// allocated one at a time. If `pool' is NULL the List gets a pool of its own.
+List *List_alloc_pooled(size_t elem_size, Pool *pool);
+
+// Creates a Pool of nodes that Lists of `elem_size'-byte elements can share.
+Pool *List_node_pool_alloc(size_t elem_size);
+
 // Gets the number of elements in the List
 size_t List_count(const List *list);
 
@@ -121,6 +133,8 @@ void List_get_reverse_sink(const List *list, Sink *sink);
   typedef struct List name##List;                                      \
   typedef struct ListNode name##ListNode;                                      \
   name##List *name##List_alloc(void);                                      \
+  name##List *name##List_alloc_ext(Arena *arena);                          \
+  name##List *name##List_alloc_pooled(Pool *pool);                         \
   T name##List_get_first(const name##List *list);                     \
   T name##List_get_last(const name##List *list);                      \
   T *name##List_get_first_ref(const name##List *list);                     \
@@ -162,7 +176,13 @@ void List_get_reverse_sink(const List *list, Sink *sink);
 
 #define DEFINE_LIST(name, T)                                              \
   name##List *name##List_alloc(void) {                                     \
-    return (name##List *)List_alloc(sizeof(List));                 \
+    return (name##List *)List_alloc(sizeof(T));                 \
+  }                                                                            \
+  name##List *name##List_alloc_ext(Arena *arena) {                         \
+    return (name##List *)List_alloc_ext(sizeof(T), arena);                 \
+  }                                                                            \
+  name##List *name##List_alloc_pooled(Pool *pool) {                        \
+    return (name##List *)List_alloc_pooled(sizeof(T), pool);               \
   }                                                                            \
   T name##List_get_first(const name##List *list) {                     \
     return *name##List_get_first_ref(list);                                \
@@ -0,0 +1,86 @@
+#ifndef COMMON_PUBLIC_LOG_H__
+#define COMMON_PUBLIC_LOG_H__
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// An asynchronous binary logger. While it runs, the LOG_* macros in
+// test/stubs.h don't format anything: they copy their arguments into a
+// fixed-size record on a lock-free ring buffer of the calling thread's own,
+// and a background thread drains the rings. It either formats the records as
+// the macros otherwise would, or writes them out raw for Log_decode to format
+// later. A crash flushes whatever is still on the rings before the process
+// dies.
+
+// Log levels, lowest first.
+enum {
+  TRACE,
+  DEBUG,
+  INFO,
+  WARN,
+  ERROR,
+  FATAL,
+};
+
+// The size of a record, timestamp and arguments included.
+#define LOG_RECORD_SIZE 128
+
+// How many records each thread's ring holds. Records logged while it's full
+// are dropped and counted, rather than waiting.
+#define LOG_RING_CAPACITY 4096
+
+// The most arguments a format can take; any more are dropped.
+#define LOG_MAX_ARGS 16
+
+// Longer strings are cut short in a record.
+#define LOG_MAX_STRING 64
+
+// A LOG_* call: where it is and its format, which is parsed once to know
+// what its arguments are.
+typedef struct LogSite {
+  const char *file;
+  int line;
+  const char *format;
+  // 0 until the site first logs, then its number in the log.
+  atomic_uint id;
+  unsigned char arg_count;
+  unsigned char arg_types[LOG_MAX_ARGS];
+} LogSite;
+
+#define LOG_SITE_INIT(fmt)                                                     \
+  {.file = __FILE__, .line = __LINE__, .format = (fmt)}
+
+// Starts the background thread. Records are formatted to stdout, or stderr
+// from WARN up, if `path' is NULL, and written raw to the file at `path' for
+// Log_decode if it isn't. Returns false if the logger is already running or
+// can't start.
+bool Log_start(const char *path);
+
+// Writes out everything logged so far and stops the background thread. No
+// other thread may be logging.
+void Log_stop(void);
+
+// Returns whether the logger is running.
+bool Log_running(void);
+
+// Waits until everything logged so far on any thread has been written out.
+void Log_flush(void);
+
+// Gets the number of records dropped because a ring was full, since the
+// logger started.
+size_t Log_dropped(void);
+
+// Logs a record at `level' for `site', whose arguments follow, with the
+// message indented by `indent' spaces. Does nothing unless the logger is
+// running.
+void Log_write(LogSite *site, int level, size_t indent, ...);
+
+// Formats the records in a file written by the logger to `out', each line
+// starting with its time and thread. Returns false if `in' isn't a log or is
+// cut short.
+bool Log_decode(FILE *in, FILE *out);
+
+#endif // COMMON_PUBLIC_LOG_H__
@@ -4,6 +4,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 
+#include "arena.h"
 #include "iterator.h"
 
 // A map data structure.
@@ -12,6 +13,9 @@ typedef struct Map Map;
 // Creates a new Map object.
 Map *Map_alloc(KeyInfo *key_info, size_t elem_size);
 
+// Creates a new Map object whose memory comes from `arena'.
+Map *Map_alloc_ext(KeyInfo *key_info, size_t elem_size, Arena *arena);
+
 // Gets the number of elements in the Map
 size_t Map_count(const Map *map);
 
@@ -27,6 +31,10 @@ size_t Map_element_size(const Map *map);
 // Gets the key info for the Map
 const KeyInfo *Map_key_info(const Map *map);
 
+// Sets whether growing the Map migrates entries a few at a time on later adds
+// and deletes, rather than all at once. Bounds the cost of any single add.
+void Map_incremental_rehash(Map *map, bool enable);
+
 // Copies the key and value to the map and returns pointer to new key/value
 // pair. Returns NULL in the key if unsuccessful.
 const KeyValuePair Map_add(Map *map, const void *key, const void *data);
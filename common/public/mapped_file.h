@@ -0,0 +1,33 @@
+#ifndef COMMON_PUBLIC_MAPPED_FILE_H__
+#define COMMON_PUBLIC_MAPPED_FILE_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// A file mapped read/write and shared with the file itself, so writes go
+// straight to the page cache and opening it again is just another mapping,
+// with nothing to read or parse. File-backed Vectors and Arrays keep their
+// elements in one.
+typedef struct MappedFile MappedFile;
+
+// Opens `path', creating it empty if it doesn't exist, and maps all of it.
+// Returns NULL if that fails.
+MappedFile *MappedFile_open(const char *path);
+
+// Unmaps and closes the file, leaving its contents on disk.
+void MappedFile_close(MappedFile *file);
+
+// Gets the mapped contents of the file, or NULL if it's empty.
+void *MappedFile_data(const MappedFile *file);
+
+// Gets the size of the file.
+size_t MappedFile_size(const MappedFile *file);
+
+// Grows the file with zeroes, or truncates it, to `size' bytes and maps it
+// again. The data may move. Returns false, leaving it alone, if that fails.
+bool MappedFile_resize(MappedFile *file, size_t size);
+
+// Writes changes through to the disk. Returns whether successful.
+bool MappedFile_sync(MappedFile *file);
+
+#endif // COMMON_PUBLIC_MAPPED_FILE_H__
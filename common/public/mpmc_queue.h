@@ -0,0 +1,127 @@
+#ifndef COMMON_PUBLIC_MPMC_QUEUE_H__
+#define COMMON_PUBLIC_MPMC_QUEUE_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "concurrency.h"
+#include "iterator.h"
+
+// A bounded FIFO queue that any number of threads may add to and remove from
+// at once, without locks. Each slot carries a sequence number that says whose
+// turn it is, so producers and consumers only contend on claiming a position.
+typedef struct MpmcQueue MpmcQueue;
+
+// Creates a new MpmcQueue holding up to `capacity' elements (rounded up to a
+// power of 2, and at least 2). Waiting threads spin.
+MpmcQueue *MpmcQueue_alloc(size_t elem_size, size_t capacity);
+
+// Creates a new MpmcQueue whose waiting threads follow `wait'.
+MpmcQueue *MpmcQueue_alloc_ext(size_t elem_size, size_t capacity,
+                               WaitPolicy wait);
+
+// Frees up the MpmcQueue object. No thread may be using it.
+void MpmcQueue_free(MpmcQueue *queue);
+
+// Gets the size of an element in the MpmcQueue
+size_t MpmcQueue_element_size(const MpmcQueue *queue);
+
+// Gets the capacity of the MpmcQueue
+size_t MpmcQueue_capacity(const MpmcQueue *queue);
+
+// Gets the number of elements in the MpmcQueue. Only a snapshot while other
+// threads are active.
+size_t MpmcQueue_count(const MpmcQueue *queue);
+
+// Returns whether the queue is empty. Only a snapshot while other threads are
+// active.
+bool MpmcQueue_empty(const MpmcQueue *queue);
+
+// Adds the item to the queue. Returns false if it is full.
+bool MpmcQueue_enqueue(MpmcQueue *queue, const void *data);
+
+// Removes the oldest item and stores it in the given location. Returns false
+// if the queue is empty.
+bool MpmcQueue_dequeue(MpmcQueue *queue, void *data_out);
+
+// Peeks the oldest item and stores it in the given location. Another thread
+// may have removed it by the time this returns.
+bool MpmcQueue_peek(MpmcQueue *queue, void *data_out);
+
+// Adds the item, waiting for room if the queue is full. Returns false if the
+// queue was closed.
+bool MpmcQueue_enqueue_wait(MpmcQueue *queue, const void *data);
+
+// Removes the oldest item, waiting for one if the queue is empty. Returns false
+// once the queue is closed and empty.
+bool MpmcQueue_dequeue_wait(MpmcQueue *queue, void *data_out);
+
+// Marks the end of the stream and wakes every waiting thread. Consumers can
+// still remove what is left.
+void MpmcQueue_close(MpmcQueue *queue);
+
+// Returns whether the queue has been closed.
+bool MpmcQueue_closed(const MpmcQueue *queue);
+
+// Gets an Iterator that removes each item as it moves onto it, waiting for more
+// until the queue is closed. Several threads may each iterate, and each item
+// is seen by exactly one of them. `current' points into the queue until the
+// next move_next.
+void MpmcQueue_get_iterator(const MpmcQueue *queue, Iterator *iter);
+
+// Gets a Sink that adds items, waiting for room. The Sink returns the item it
+// was given, or NULL if the queue was closed.
+void MpmcQueue_get_sink(const MpmcQueue *queue, Sink *sink);
+
+#define DECLARE_MPMC_QUEUE(name, T)                                            \
+  typedef struct MpmcQueue name##MpmcQueue;                                    \
+  name##MpmcQueue *name##MpmcQueue_alloc(size_t capacity);                     \
+  name##MpmcQueue *name##MpmcQueue_alloc_ext(size_t capacity,                  \
+                                             WaitPolicy wait);                 \
+  bool name##MpmcQueue_enqueue(name##MpmcQueue *queue, const T data);          \
+  bool name##MpmcQueue_enqueue_ref(name##MpmcQueue *queue, const T *data);     \
+  bool name##MpmcQueue_dequeue(name##MpmcQueue *queue, T *data_out);           \
+  bool name##MpmcQueue_peek(name##MpmcQueue *queue, T *data_out);              \
+  bool name##MpmcQueue_enqueue_wait(name##MpmcQueue *queue, const T data);     \
+  bool name##MpmcQueue_dequeue_wait(name##MpmcQueue *queue, T *data_out);      \
+  void name##MpmcQueue_get_iterator(const name##MpmcQueue *queue,              \
+                                    name##Iterator *iter);                     \
+  void name##MpmcQueue_get_sink(const name##MpmcQueue *queue,                  \
+                                name##Sink *sink);
+
+#define DEFINE_MPMC_QUEUE(name, T)                                             \
+  name##MpmcQueue *name##MpmcQueue_alloc(size_t capacity) {                    \
+    return (name##MpmcQueue *)MpmcQueue_alloc(sizeof(T), capacity);            \
+  }                                                                            \
+  name##MpmcQueue *name##MpmcQueue_alloc_ext(size_t capacity,                  \
+                                             WaitPolicy wait) {                \
+    return (name##MpmcQueue *)MpmcQueue_alloc_ext(sizeof(T), capacity, wait);  \
+  }                                                                            \
+  bool name##MpmcQueue_enqueue(name##MpmcQueue *queue, const T data) {         \
+    return MpmcQueue_enqueue((MpmcQueue *)queue, &data);                       \
+  }                                                                            \
+  bool name##MpmcQueue_enqueue_ref(name##MpmcQueue *queue, const T *data) {    \
+    return MpmcQueue_enqueue((MpmcQueue *)queue, data);                        \
+  }                                                                            \
+  bool name##MpmcQueue_dequeue(name##MpmcQueue *queue, T *data_out) {          \
+    return MpmcQueue_dequeue((MpmcQueue *)queue, data_out);                    \
+  }                                                                            \
+  bool name##MpmcQueue_peek(name##MpmcQueue *queue, T *data_out) {             \
+    return MpmcQueue_peek((MpmcQueue *)queue, data_out);                       \
+  }                                                                            \
+  bool name##MpmcQueue_enqueue_wait(name##MpmcQueue *queue, const T data) {    \
+    return MpmcQueue_enqueue_wait((MpmcQueue *)queue, &data);                  \
+  }                                                                            \
+  bool name##MpmcQueue_dequeue_wait(name##MpmcQueue *queue, T *data_out) {     \
+    return MpmcQueue_dequeue_wait((MpmcQueue *)queue, data_out);               \
+  }                                                                            \
+  void name##MpmcQueue_get_iterator(const name##MpmcQueue *queue,              \
+                                    name##Iterator *iter) {                    \
+    MpmcQueue_get_iterator((const MpmcQueue *)queue, (Iterator *)iter);        \
+  }                                                                            \
+  void name##MpmcQueue_get_sink(const name##MpmcQueue *queue,                  \
+                                name##Sink *sink) {                            \
+    MpmcQueue_get_sink((const MpmcQueue *)queue, (Sink *)sink);                \
+  }
+
+#endif // COMMON_PUBLIC_MPMC_QUEUE_H__
@@ -0,0 +1,39 @@
+#ifndef COMMON_PUBLIC_POOL_H__
+#define COMMON_PUBLIC_POOL_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "arena.h"
+
+// A pool of fixed-size objects. Objects are carved out of slabs of many
+// objects each, and released objects are recycled through a free list, so
+// acquiring one is usually a pointer pop and neighbours stay close in memory.
+typedef struct Pool Pool;
+
+// Creates a new Pool of objects of `object_size' bytes.
+Pool *Pool_alloc(size_t object_size);
+
+// Creates a new Pool whose slabs come from `arena'.
+Pool *Pool_alloc_ext(size_t object_size, Arena *arena);
+
+// Frees the Pool and every object in it.
+void Pool_free(Pool *pool);
+
+// Gets the size of the objects in the Pool, after rounding for alignment.
+size_t Pool_object_size(const Pool *pool);
+
+// Gets the number of objects acquired and not yet released.
+size_t Pool_count(const Pool *pool);
+
+// Gets an uninitialized object, suitably aligned for any type. Returns NULL
+// if a new slab was needed and couldn't be allocated.
+void *Pool_acquire(Pool *pool);
+
+// Returns an object to the Pool for reuse.
+void Pool_release(Pool *pool, void *object);
+
+// Releases every object at once and frees the slabs.
+void Pool_clear(Pool *pool);
+
+#endif // COMMON_PUBLIC_POOL_H__
@@ -3,6 +3,7 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 #include "iterator.h"
 
@@ -15,10 +16,34 @@ typedef enum {
   PQ_MODE_LARGEST_FIRST,
 } PriorityQueueMode;
 
-// Creates a new PriorityQueue object.
+// The heap arity PriorityQueue_alloc uses.
+#define PQ_DEFAULT_ARITY 2
+
+// Creates a new PriorityQueue object, backed by a binary heap.
 PriorityQueue *PriorityQueue_alloc(RelationalKeyInfo *key_info,
                                     size_t elem_size, PriorityQueueMode mode);
 
+// Creates a new PriorityQueue object backed by a heap where each node has
+// `arity' children. A 4- or 8-ary heap is shallower than a binary one, and
+// when `arity' times the key plus element size is a cache line, each node's
+// children share one.
+PriorityQueue *PriorityQueue_alloc_ext(RelationalKeyInfo *key_info,
+                                        size_t elem_size,
+                                        PriorityQueueMode mode, size_t arity);
+
+// Names an item in an indexed PriorityQueue for as long as it is queued. Once
+// the item leaves, the handle may be given to a new one.
+typedef size_t PriorityQueueHandle;
+
+#define PQ_INVALID_HANDLE ((PriorityQueueHandle)(SIZE_MAX >> 1))
+
+// Creates a new PriorityQueue object whose items have handles, so they can
+// be looked up, reprioritized or removed after they are enqueued.
+PriorityQueue *PriorityQueue_alloc_indexed(RelationalKeyInfo *key_info,
+                                            size_t elem_size,
+                                            PriorityQueueMode mode,
+                                            size_t arity);
+
 // Gets the number of elements in the PriorityQueue
 size_t PriorityQueue_count(const PriorityQueue *queue);
 
@@ -46,14 +71,58 @@ size_t PriorityQueue_element_size(const PriorityQueue *queue);
 // Gets the priority queue mode
 PriorityQueueMode PriorityQueue_mode(const PriorityQueue *queue);
 
+// Gets the number of children per node in the heap
+size_t PriorityQueue_arity(const PriorityQueue *queue);
+
 // Gets the key info for the PriorityQueue
 RelationalKeyInfo *PriorityQueue_key_info(const PriorityQueue *queue);
 
-// Adds the item to the queue and returns pointer to new data.
-// Returns NULL if unsuccessful.
+// Adds the item to the queue and returns pointer to new data, which is only
+// valid until the queue changes. Returns NULL if unsuccessful.
 void *PriorityQueue_enqueue(PriorityQueue *queue, const void *key,
                              const void *data);
 
+// Adds the item to an indexed queue and returns its handle.
+// Returns PQ_INVALID_HANDLE if unsuccessful.
+PriorityQueueHandle PriorityQueue_enqueue_handle(PriorityQueue *queue,
+                                                 const void *key,
+                                                 const void *data);
+
+// Adds every KeyValuePair from `iter', then restores heap order in a single
+// O(n) pass, rather than sifting each one in. In an indexed queue that has
+// never had items removed, they get handles in iteration order.
+// Returns whether successful.
+bool PriorityQueue_from_iterator(PriorityQueue *queue, Iterator *iter);
+
+// Returns whether `handle' names an item in the indexed queue.
+bool PriorityQueue_contains(const PriorityQueue *queue,
+                            PriorityQueueHandle handle);
+
+// Gets the item named by `handle' and stores it in the given location.
+// Returns false if it isn't in the queue.
+bool PriorityQueue_get(const PriorityQueue *queue, PriorityQueueHandle handle,
+                       void *key_out, void *data_out);
+
+// Changes the key of the item named by `handle', moving it up or down to
+// match. Returns false if it isn't in the queue.
+bool PriorityQueue_update_key(PriorityQueue *queue, PriorityQueueHandle handle,
+                              const void *key);
+
+// Changes the key of the item named by `handle' to one no larger.
+// Returns false if it isn't in the queue.
+bool PriorityQueue_decrease_key(PriorityQueue *queue,
+                                PriorityQueueHandle handle, const void *key);
+
+// Changes the key of the item named by `handle' to one no smaller.
+// Returns false if it isn't in the queue.
+bool PriorityQueue_increase_key(PriorityQueue *queue,
+                                PriorityQueueHandle handle, const void *key);
+
+// Removes the item named by `handle' and stores it in the given location,
+// either of which may be NULL. Returns false if it isn't in the queue.
+bool PriorityQueue_remove(PriorityQueue *queue, PriorityQueueHandle handle,
+                          void *key_out, void *data_out);
+
 // Removes an item from the queue and stores it in the given location.
 bool PriorityQueue_dequeue(PriorityQueue *queue, void *key_out,
                            void *data_out);
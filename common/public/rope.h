@@ -0,0 +1,111 @@
+#ifndef COMMON_PUBLIC_ROPE_H__
+#define COMMON_PUBLIC_ROPE_H__
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "arena.h"
+
+// A string built by appending, for output too big to keep reallocating and
+// copying. Appended bytes are copied into chunks that never move, or referred
+// to where they already are, so appending is O(1) and nothing is copied again
+// until the Rope is flattened or written out, a chunk at a time.
+typedef struct Rope Rope;
+
+// The bytes from `start' for `length' bytes of a Rope. Views are made and
+// narrowed without copying, and stay valid as the Rope is appended to, until
+// it is cleared or freed.
+typedef struct RopeView {
+  const Rope *rope;
+  size_t start;
+  size_t length;
+} RopeView;
+
+// A run of a Rope's bytes that is contiguous in memory.
+typedef struct RopeChunk {
+  const char *data;
+  size_t length;
+} RopeChunk;
+
+// Walks the chunks of a view, in order.
+typedef struct RopeChunkCursor {
+  const Rope *rope;
+  size_t piece;
+  size_t offset; // Into the piece.
+  size_t remaining;
+} RopeChunkCursor;
+
+// Chunks start this big, and double as the Rope grows.
+#define ROPE_MIN_CHUNK_SIZE 256
+
+// Chunks stop doubling at this size. Bigger appends get a chunk of their own.
+#define ROPE_MAX_CHUNK_SIZE 65536
+
+// Creates a new, empty Rope.
+Rope *Rope_alloc(void);
+
+// Creates a new Rope whose memory comes from `arena'.
+Rope *Rope_alloc_ext(Arena *arena);
+
+// Frees the Rope and the chunks it copied bytes into.
+void Rope_free(Rope *rope);
+
+// Gets the Rope's length in bytes.
+size_t Rope_length(const Rope *rope);
+
+// Empties the Rope, freeing its chunks. Views of it are no longer valid.
+void Rope_clear(Rope *rope);
+
+// Appends a copy of `length' bytes. Returns false if out of memory.
+bool Rope_append(Rope *rope, const char *data, size_t length);
+
+// Appends a copy of a NUL-terminated string.
+bool Rope_append_c_str(Rope *rope, const char *c_str);
+
+// Appends printf-style output, formatted straight into the Rope's chunk.
+bool Rope_append_format(Rope *rope, const char *format, ...);
+
+bool Rope_append_vformat(Rope *rope, const char *format, va_list args);
+
+// Appends `length' bytes without copying them. They must outlive the Rope
+// and not change.
+bool Rope_append_ref(Rope *rope, const char *data, size_t length);
+
+// Appends what `view' covers without copying it, even if it's of the same
+// Rope. Its Rope must outlive this one and not be cleared.
+bool Rope_append_view(Rope *rope, RopeView view);
+
+// Gets the byte at `index'.
+char Rope_char_at(const Rope *rope, size_t index);
+
+// Gets a view of `length' bytes from `start', or as many as there are.
+RopeView Rope_view(const Rope *rope, size_t start, size_t length);
+
+// Gets a view of `length' bytes from `start' within `view', or as many as it
+// has.
+RopeView RopeView_slice(RopeView view, size_t start, size_t length);
+
+// Copies the view's bytes to `out', which has room for them. Doesn't add a
+// NUL. Returns the number copied.
+size_t RopeView_copy(RopeView view, char *out);
+
+// Copies the view into a new NUL-terminated string, which the caller frees.
+// Returns NULL if out of memory.
+char *RopeView_flatten(RopeView view);
+
+// Copies the whole Rope into a new NUL-terminated string, which the caller
+// frees.
+char *Rope_flatten(const Rope *rope);
+
+// Points the cursor at the view's first chunk.
+void RopeView_get_chunks(RopeView view, RopeChunkCursor *cursor);
+
+// Gets the cursor's next chunk. Returns false once there are no more.
+bool RopeChunkCursor_next(RopeChunkCursor *cursor, RopeChunk *chunk);
+
+// Writes the view to `fd' with writev, up to IOV_MAX chunks at a time, and
+// without copying it. Returns false if a write fails, with errno set.
+bool RopeView_write(RopeView view, int fd);
+
+#endif // COMMON_PUBLIC_ROPE_H__
@@ -4,6 +4,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 
+#include "arena.h"
 #include "iterator.h"
 
 // A set data structure.
@@ -12,6 +13,9 @@ typedef struct Set Set;
 // Creates a new Set object.
 Set *Set_alloc(KeyInfo *key_info);
 
+// Creates a new Set object whose memory comes from `arena'.
+Set *Set_alloc_ext(KeyInfo *key_info, Arena *arena);
+
 // Gets the number of elements in the Set
 size_t Set_count(const Set *set);
 
@@ -27,6 +31,10 @@ size_t Set_element_size(const Set *set);
 // Gets the key info for the Set
 const KeyInfo *Set_key_info(const Set *set);
 
+// Sets whether growing the Set migrates items a few buckets at a time on later
+// adds and deletes, rather than all at once. Bounds the cost of any single add.
+void Set_incremental_rehash(Set *set, bool enable);
+
 // Copies the value to the set and returns pointer to the new value.
 // Returns NULL if unsuccessful.
 void *Set_add(Set *set, const void *data);
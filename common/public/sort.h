@@ -0,0 +1,272 @@
+#ifndef COMMON_PUBLIC_SORT_H__
+#define COMMON_PUBLIC_SORT_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "iterator.h"
+#include "thread_pool.h"
+
+// Sorts `count' elements of `data' in place.
+typedef void (*SortFn)(void *data, size_t count);
+
+// Partitions this small are finished off with insertion sort.
+#define SORT_INSERTION_THRESHOLD 16
+
+// Below this many elements a radix sort's passes cost more than comparing.
+#define SORT_RADIX_THRESHOLD 256
+
+// Integer keys spanning at most this many values are counted, not radix sorted.
+#define SORT_COUNTING_MAX_RANGE 65536
+
+// Below this many elements Indexer_parallel_sort sorts on the calling thread.
+#define SORT_PARALLEL_THRESHOLD 65536
+
+// Finds the sort kernel that orders elements of `elem_size' bytes the same way
+// as `compare_fn', or NULL if there is none and qsort has to be used.
+SortFn Sort_find_kernel(int (*compare_fn)(const void *a, const void *b),
+                        size_t elem_size);
+
+// Sorts `count' elements of `elem_size' bytes in place, with the kernel for
+// `compare_fn' if it has one and qsort if not.
+void Sort_data(void *data, size_t count, size_t elem_size,
+               int (*compare_fn)(const void *a, const void *b));
+
+// Sorts a Vector or Array on `pool', or on a pool made for the call with a
+// thread per CPU if it's NULL. Runs are sorted on each thread, then merged in
+// pairs, with every merge split across the threads too. Anything under
+// SORT_PARALLEL_THRESHOLD elements is left to Indexer_sort.
+void Indexer_parallel_sort(const Indexer *indexer,
+                           int (*compare_fn)(const void *a, const void *b),
+                           ThreadPool *pool);
+
+#define DECLARE_SORT(name, T)                                                  \
+  /* Sorts `count' elements in ascending order, without indirect calls. */    \
+  void name##_sort(T *data, size_t count);
+
+// Introsort with the comparison inlined: median-of-three quicksort that falls
+// back to heapsort when it recurses too deep, and insertion sort for small
+// partitions. `less_expr' compares the values `a' and `b'.
+#define DEFINE_INTROSORT_KERNEL(name, T, less_expr)                            \
+  static inline bool _##name##_less(const T a, const T b) {                    \
+    return (less_expr);                                                        \
+  }                                                                            \
+  static void _##name##_insertion_sort(T *data, size_t count) {                \
+    for (size_t i = 1; i < count; i++) {                                       \
+      T elem = data[i];                                                        \
+      size_t j = i;                                                            \
+      for (; j > 0 && _##name##_less(elem, data[j - 1]); j--) {                \
+        data[j] = data[j - 1];                                                 \
+      }                                                                        \
+      data[j] = elem;                                                          \
+    }                                                                          \
+  }                                                                            \
+  static void _##name##_sift_down(T *data, size_t index, size_t count) {       \
+    T elem = data[index];                                                      \
+    for (size_t child; (child = 2 * index + 1) < count; index = child) {       \
+      if (child + 1 < count && _##name##_less(data[child], data[child + 1])) { \
+        child++;                                                               \
+      }                                                                        \
+      if (!_##name##_less(elem, data[child])) {                                \
+        break;                                                                 \
+      }                                                                        \
+      data[index] = data[child];                                               \
+    }                                                                          \
+    data[index] = elem;                                                        \
+  }                                                                            \
+  static void _##name##_heap_sort(T *data, size_t count) {                     \
+    for (size_t i = count / 2; i > 0; i--) {                                   \
+      _##name##_sift_down(data, i - 1, count);                                 \
+    }                                                                          \
+    for (size_t end = count - 1; end > 0; end--) {                             \
+      T top = data[0];                                                         \
+      data[0] = data[end];                                                     \
+      data[end] = top;                                                         \
+      _##name##_sift_down(data, 0, end);                                       \
+    }                                                                          \
+  }                                                                            \
+  static void _##name##_introsort(T *data, size_t count, int depth) {          \
+    while (count > SORT_INSERTION_THRESHOLD) {                                 \
+      if (depth-- == 0) {                                                      \
+        _##name##_heap_sort(data, count);                                      \
+        return;                                                                \
+      }                                                                        \
+      /* Order the first, middle and last elements; the median is the       \
+       * pivot, and the other two stop the scans below at the ends. */         \
+      T *lo = data;                                                            \
+      T *mid = data + (count - 1) / 2;                                         \
+      T *hi = data + count - 1;                                                \
+      T tmp;                                                                   \
+      if (_##name##_less(*mid, *lo)) {                                         \
+        tmp = *mid, *mid = *lo, *lo = tmp;                                     \
+      }                                                                        \
+      if (_##name##_less(*hi, *mid)) {                                         \
+        tmp = *hi, *hi = *mid, *mid = tmp;                                     \
+        if (_##name##_less(*mid, *lo)) {                                       \
+          tmp = *mid, *mid = *lo, *lo = tmp;                                   \
+        }                                                                      \
+      }                                                                        \
+      T pivot = *mid;                                                          \
+      size_t i = 0, j = count - 1;                                             \
+      for (;;) {                                                               \
+        while (_##name##_less(data[i], pivot)) {                               \
+          i++;                                                                 \
+        }                                                                      \
+        while (_##name##_less(pivot, data[j])) {                               \
+          j--;                                                                 \
+        }                                                                      \
+        if (i >= j) {                                                          \
+          break;                                                               \
+        }                                                                      \
+        tmp = data[i], data[i] = data[j], data[j] = tmp;                       \
+        i++;                                                                   \
+        j--;                                                                   \
+      }                                                                        \
+      /* [0, j] <= pivot <= [j + 1, count). Recurse into the smaller side. */  \
+      size_t left = j + 1;                                                     \
+      if (left < count - left) {                                               \
+        _##name##_introsort(data, left, depth);                                \
+        data += left;                                                          \
+        count -= left;                                                         \
+      } else {                                                                 \
+        _##name##_introsort(data + left, count - left, depth);                 \
+        count = left;                                                          \
+      }                                                                        \
+    }                                                                          \
+    _##name##_insertion_sort(data, count);                                     \
+  }                                                                            \
+  static void _##name##_introsort_all(T *data, size_t count) {                 \
+    int depth = 0;                                                             \
+    for (size_t n = count; n > 1; n >>= 1) {                                   \
+      depth += 2;                                                              \
+    }                                                                          \
+    _##name##_introsort(data, count, depth);                                   \
+  }
+
+#define DEFINE_INTROSORT(name, T, less_expr)                                   \
+  DEFINE_INTROSORT_KERNEL(name, T, less_expr)                                  \
+  void name##_sort(T *data, size_t count) {                                    \
+    _##name##_introsort_all(data, count);                                      \
+  }
+
+// LSD radix sort, a byte at a time, on the unsigned key `key_expr' computes
+// from the element `x'. Keys must order the same way as the elements. Every
+// byte is counted in one pass up front, and bytes that are the same in every
+// key are skipped. Returns false if the scratch buffer can't be allocated.
+#define DEFINE_RADIX_SORT_KERNEL(name, T, K, key_expr)                         \
+  static inline K _##name##_key(const T x) { return (K)(key_expr); }           \
+  static bool _##name##_radix_sort(T *data, size_t count) {                    \
+    size_t counts[sizeof(K)][256];                                             \
+    memset(counts, 0, sizeof(counts));                                         \
+    for (size_t i = 0; i < count; i++) {                                       \
+      K key = _##name##_key(data[i]);                                          \
+      for (size_t b = 0; b < sizeof(K); b++) {                                 \
+        counts[b][(key >> (8 * b)) & 0xFF]++;                                  \
+      }                                                                        \
+    }                                                                          \
+    T *buffer = malloc(count * sizeof(T));                                     \
+    if (!buffer) {                                                             \
+      return false;                                                            \
+    }                                                                          \
+    T *from = data;                                                            \
+    T *to = buffer;                                                            \
+    K first = _##name##_key(data[0]);                                          \
+    for (size_t b = 0; b < sizeof(K); b++) {                                   \
+      size_t *offsets = counts[b];                                             \
+      if (offsets[(first >> (8 * b)) & 0xFF] == count) {                       \
+        continue;                                                              \
+      }                                                                        \
+      size_t sum = 0;                                                          \
+      for (size_t d = 0; d < 256; d++) {                                       \
+        size_t n = offsets[d];                                                 \
+        offsets[d] = sum;                                                      \
+        sum += n;                                                              \
+      }                                                                        \
+      for (size_t i = 0; i < count; i++) {                                     \
+        T elem = from[i];                                                      \
+        to[offsets[(_##name##_key(elem) >> (8 * b)) & 0xFF]++] = elem;         \
+      }                                                                        \
+      T *swap = from;                                                          \
+      from = to;                                                               \
+      to = swap;                                                               \
+    }                                                                          \
+    if (from != data) {                                                        \
+      memcpy(data, from, count * sizeof(T));                                   \
+    }                                                                          \
+    free(buffer);                                                              \
+    return true;                                                               \
+  }
+
+// Radix sort for floating-point types, whose bits `K' flips into an unsigned
+// key with `key_expr'.
+#define DEFINE_RADIX_SORT(name, T, K, key_expr)                                \
+  DEFINE_INTROSORT_KERNEL(name, T, a < b)                                      \
+  DEFINE_RADIX_SORT_KERNEL(name, T, K, key_expr)                               \
+  void name##_sort(T *data, size_t count) {                                    \
+    if (count < SORT_RADIX_THRESHOLD || !_##name##_radix_sort(data, count)) {  \
+      _##name##_introsort_all(data, count);                                    \
+    }                                                                          \
+  }
+
+// Sort for integer types, with `K' the unsigned type of the same width. Values
+// in a range no wider than the count are counted and written back out in
+// order; anything else is radix sorted, signed values with their sign flipped.
+#define DEFINE_INTEGER_SORT(name, T, K)                                        \
+  DEFINE_INTROSORT_KERNEL(name, T, a < b)                                      \
+  DEFINE_RADIX_SORT_KERNEL(name, T, K,                                         \
+                           (T)-1 < 0 ? (K)x ^ ((K)1 << (8 * sizeof(K) - 1))    \
+                                     : (K)x)                                   \
+  static bool _##name##_counting_sort(T *data, size_t count) {                 \
+    T min = data[0], max = data[0];                                            \
+    for (size_t i = 1; i < count; i++) {                                       \
+      T elem = data[i];                                                        \
+      min = elem < min ? elem : min;                                           \
+      max = elem > max ? elem : max;                                           \
+    }                                                                          \
+    size_t range = (size_t)(K)((K)max - (K)min);                               \
+    if (range >= count || range >= SORT_COUNTING_MAX_RANGE) {                  \
+      return false;                                                            \
+    }                                                                          \
+    size_t *counts = calloc(range + 1, sizeof(size_t));                        \
+    if (!counts) {                                                             \
+      return false;                                                            \
+    }                                                                          \
+    for (size_t i = 0; i < count; i++) {                                       \
+      counts[(K)((K)data[i] - (K)min)]++;                                      \
+    }                                                                          \
+    T *out = data;                                                             \
+    for (size_t v = 0; v <= range; v++) {                                      \
+      T elem = (T)((K)min + (K)v);                                             \
+      for (size_t n = counts[v]; n > 0; n--) {                                 \
+        *out++ = elem;                                                         \
+      }                                                                        \
+    }                                                                          \
+    free(counts);                                                              \
+    return true;                                                               \
+  }                                                                            \
+  void name##_sort(T *data, size_t count) {                                    \
+    if (count < SORT_RADIX_THRESHOLD) {                                        \
+      _##name##_introsort_all(data, count);                                    \
+    } else if (!_##name##_counting_sort(data, count) &&                        \
+               !_##name##_radix_sort(data, count)) {                           \
+      _##name##_introsort_all(data, count);                                    \
+    }                                                                          \
+  }
+
+DECLARE_SORT(Char, char)
+DECLARE_SORT(Short, short)
+DECLARE_SORT(Int, int)
+DECLARE_SORT(Long, long)
+DECLARE_SORT(Float, float)
+DECLARE_SORT(Double, double)
+DECLARE_SORT(LongDouble, long double)
+DECLARE_SORT(UnsignedChar, unsigned char)
+DECLARE_SORT(UnsignedShort, unsigned short)
+DECLARE_SORT(UnsignedInt, unsigned int)
+DECLARE_SORT(UnsignedLong, unsigned long)
+DECLARE_SORT(CString, char *)
+DECLARE_SORT(CStringCase, char *)
+
+#endif // COMMON_PUBLIC_SORT_H__
@@ -0,0 +1,93 @@
+#ifndef COMMON_PUBLIC_SPSC_QUEUE_H__
+#define COMMON_PUBLIC_SPSC_QUEUE_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "concurrency.h"
+#include "iterator.h"
+
+// A bounded FIFO queue for passing elements from one thread to another without
+// locks. Exactly one thread may add to it (the producer) and exactly one thread
+// may remove from it (the consumer); they may be different threads.
+typedef struct SpscQueue SpscQueue;
+
+// Creates a new SpscQueue holding up to `capacity' elements (rounded up to a
+// power of 2). Waiting threads spin.
+SpscQueue *SpscQueue_alloc(size_t elem_size, size_t capacity);
+
+// Creates a new SpscQueue whose waiting threads follow `wait'.
+SpscQueue *SpscQueue_alloc_ext(size_t elem_size, size_t capacity,
+                               WaitPolicy wait);
+
+// Frees up the SpscQueue object. Neither thread may be using it.
+void SpscQueue_free(SpscQueue *queue);
+
+// Gets the size of an element in the SpscQueue
+size_t SpscQueue_element_size(const SpscQueue *queue);
+
+// Gets the capacity of the SpscQueue
+size_t SpscQueue_capacity(const SpscQueue *queue);
+
+// Gets the number of elements in the SpscQueue. Only a snapshot if the other
+// thread is active.
+size_t SpscQueue_count(const SpscQueue *queue);
+
+// Returns whether the queue is empty. Only a snapshot if the producer is
+// active.
+bool SpscQueue_empty(const SpscQueue *queue);
+
+// Producer: adds the item to the queue. Returns false if it is full.
+bool SpscQueue_enqueue(SpscQueue *queue, const void *data);
+
+// Producer: adds as many of the `count' items at `data' as there is room for,
+// in one step. Returns how many were added.
+size_t SpscQueue_enqueue_n(SpscQueue *queue, const void *data, size_t count);
+
+// Producer: adds the item, waiting for room if the queue is full. Returns false
+// if the queue was closed.
+bool SpscQueue_enqueue_wait(SpscQueue *queue, const void *data);
+
+// Producer: adds all `count' items, waiting for room as needed. Returns how
+// many were added, which is less than `count' only if the queue was closed.
+size_t SpscQueue_enqueue_n_wait(SpscQueue *queue, const void *data,
+                                size_t count);
+
+// Producer: marks the end of the stream. Wakes any waiting thread; the
+// consumer can still remove what is left.
+void SpscQueue_close(SpscQueue *queue);
+
+// Returns whether the queue has been closed.
+bool SpscQueue_closed(const SpscQueue *queue);
+
+// Consumer: removes the oldest item and stores it in the given location.
+// Returns false if the queue is empty.
+bool SpscQueue_dequeue(SpscQueue *queue, void *data_out);
+
+// Consumer: removes up to `count' items in one step, storing them at
+// `data_out'. Returns how many were removed.
+size_t SpscQueue_dequeue_n(SpscQueue *queue, void *data_out, size_t count);
+
+// Consumer: removes the oldest item, waiting for one if the queue is empty.
+// Returns false once the queue is closed and empty.
+bool SpscQueue_dequeue_wait(SpscQueue *queue, void *data_out);
+
+// Consumer: removes up to `count' items, waiting until there is at least one.
+// Returns 0 once the queue is closed and empty.
+size_t SpscQueue_dequeue_n_wait(SpscQueue *queue, void *data_out,
+                                size_t count);
+
+// Consumer: peeks the oldest item and stores it in the given location.
+bool SpscQueue_peek(SpscQueue *queue, void *data_out);
+
+// Consumer: gets an Iterator that removes each item as it moves past it,
+// waiting for more until the queue is closed. Items are not copied out:
+// `current' points into the queue until the next move_next.
+void SpscQueue_get_iterator(const SpscQueue *queue, Iterator *iter);
+
+// Producer: gets a Sink that adds items, waiting for room. The Sink returns the
+// item it was given (the slot it went into belongs to the consumer), or NULL
+// if the queue was closed.
+void SpscQueue_get_sink(const SpscQueue *queue, Sink *sink);
+
+#endif // COMMON_PUBLIC_SPSC_QUEUE_H__
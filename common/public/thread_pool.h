@@ -0,0 +1,70 @@
+#ifndef COMMON_PUBLIC_THREAD_POOL_H__
+#define COMMON_PUBLIC_THREAD_POOL_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Counts outstanding tasks, so that a thread can wait for all of them.
+typedef struct WaitGroup WaitGroup;
+
+// A fixed set of worker threads, each with a WorkDeque of tasks. Tasks a
+// worker submits go on its own deque; idle workers steal from the others.
+typedef struct ThreadPool ThreadPool;
+
+// A unit of work: `fn(arg)'.
+typedef void (*TaskFn)(void *arg);
+
+// A slice of a data-parallel loop: handles the indices in [begin, end).
+typedef void (*RangeFn)(void *arg, size_t begin, size_t end);
+
+// Creates a new WaitGroup with nothing outstanding.
+WaitGroup *WaitGroup_alloc(void);
+
+// Frees up the WaitGroup object. Nothing may be outstanding.
+void WaitGroup_free(WaitGroup *group);
+
+// Adds `count' outstanding tasks.
+void WaitGroup_add(WaitGroup *group, size_t count);
+
+// Marks one outstanding task as finished.
+void WaitGroup_done(WaitGroup *group);
+
+// Gets the number of outstanding tasks. Only a snapshot.
+size_t WaitGroup_pending(const WaitGroup *group);
+
+// Blocks until nothing is outstanding. Use ThreadPool_wait_group instead from
+// a pool's own tasks, so the thread keeps working while it waits.
+void WaitGroup_wait(WaitGroup *group);
+
+// Creates a pool of `num_threads' workers, or one per online CPU if 0. At most
+// `max_tasks' tasks can be queued at once; beyond that, submit runs the task
+// in the calling thread.
+ThreadPool *ThreadPool_alloc(size_t num_threads, size_t max_tasks);
+
+// Stops the workers and frees up the ThreadPool object. Every submitted task
+// must have finished.
+void ThreadPool_free(ThreadPool *pool);
+
+// Gets the number of worker threads.
+size_t ThreadPool_thread_count(const ThreadPool *pool);
+
+// Gets the index of the calling thread among the pool's workers, or -1 if it
+// isn't one of them.
+int ThreadPool_worker_index(const ThreadPool *pool);
+
+// Queues `fn(arg)' to run on a worker and counts it in `group', which may be
+// NULL. If the queue is full, runs it right away instead.
+void ThreadPool_submit(ThreadPool *pool, WaitGroup *group, TaskFn fn,
+                       void *arg);
+
+// Runs queued tasks in the calling thread until nothing in `group' is
+// outstanding.
+void ThreadPool_wait_group(ThreadPool *pool, WaitGroup *group);
+
+// Calls `fn' on slices of [begin, end) of about `grain' indices each (0 picks
+// one), spread across the workers and the calling thread. Returns once every
+// slice is done.
+void ThreadPool_parallel_for(ThreadPool *pool, size_t begin, size_t end,
+                             size_t grain, RangeFn fn, void *arg);
+
+#endif // COMMON_PUBLIC_THREAD_POOL_H__
@@ -0,0 +1,264 @@
+#ifndef COMMON_PUBLIC_UNROLLED_LIST_H__
+#define COMMON_PUBLIC_UNROLLED_LIST_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "arena.h"
+#include "iterator.h"
+#include "pool.h"
+
+// A doubly linked list that packs many elements into each node, so scanning it
+// touches about as many cache lines as a Vector would. Elements are addressed
+// by a cursor (a node and an index into it) rather than by a node of their own.
+typedef struct UnrolledList UnrolledList;
+
+typedef struct UnrolledListNode UnrolledListNode;
+
+// The position of one element. A cursor whose node is NULL is past the end.
+// Inserting or removing through a cursor keeps that cursor valid; any other
+// cursor into the same list may be invalidated.
+typedef struct UnrolledListCursor {
+  UnrolledListNode *node;
+  size_t index;
+} UnrolledListCursor;
+
+// Creates a new UnrolledList object.
+UnrolledList *UnrolledList_alloc(size_t elem_size);
+
+// Creates a new UnrolledList object whose memory comes from `arena'.
+UnrolledList *UnrolledList_alloc_ext(size_t elem_size, Arena *arena);
+
+// Creates a new UnrolledList whose nodes are recycled through `pool'. If
+// `pool' is NULL the UnrolledList gets a pool of its own.
+UnrolledList *UnrolledList_alloc_pooled(size_t elem_size, Pool *pool);
+
+// Creates a Pool of nodes that UnrolledLists of `elem_size'-byte elements can
+// share.
+Pool *UnrolledList_node_pool_alloc(size_t elem_size);
+
+// Gets the number of elements in the UnrolledList
+size_t UnrolledList_count(const UnrolledList *list);
+
+// Returns whether the list is empty
+bool UnrolledList_empty(const UnrolledList *list);
+
+// Frees up the UnrolledList object.
+void UnrolledList_free(UnrolledList *list);
+
+// Gets the size of an element in the UnrolledList
+size_t UnrolledList_element_size(const UnrolledList *list);
+
+// Gets the most elements a single node holds
+size_t UnrolledList_node_capacity(const UnrolledList *list);
+
+// Gets the first item
+void *UnrolledList_get_first(const UnrolledList *list);
+
+// Gets the last item
+void *UnrolledList_get_last(const UnrolledList *list);
+
+// Points the cursor at the first element. Returns false if the list is empty.
+bool UnrolledList_get_first_cursor(const UnrolledList *list,
+                                   UnrolledListCursor *cursor);
+
+// Points the cursor at the last element. Returns false if the list is empty.
+bool UnrolledList_get_last_cursor(const UnrolledList *list,
+                                  UnrolledListCursor *cursor);
+
+// Points the cursor at the element at `index', walking from whichever end is
+// closer. Returns false if `index' is out of range.
+bool UnrolledList_get_cursor_at(const UnrolledList *list, size_t index,
+                                UnrolledListCursor *cursor);
+
+// Moves the cursor to the next element. Returns false once it is past the end.
+bool UnrolledList_move_next(UnrolledListCursor *cursor);
+
+// Moves the cursor to the previous element. Returns false if there is none,
+// leaving the cursor past the end.
+bool UnrolledList_move_previous(UnrolledListCursor *cursor);
+
+// Sets the element under the cursor.
+void UnrolledList_set(const UnrolledList *list,
+                      const UnrolledListCursor *cursor, const void *data);
+
+// Gets the element under the cursor.
+void *UnrolledList_get(const UnrolledList *list,
+                       const UnrolledListCursor *cursor);
+
+// Gets the elements from the cursor to the end of its node, which are
+// contiguous. Stores how many there are in `count'. Loops that scan a span at
+// a time instead of moving the cursor per element run at Vector speed.
+void *UnrolledList_get_span(const UnrolledList *list,
+                            const UnrolledListCursor *cursor, size_t *count);
+
+// Inserts the given element before the cursor, and points the cursor at it.
+// Returns the new element, or NULL if unsuccessful.
+void *UnrolledList_insert_before(UnrolledList *list, UnrolledListCursor *cursor,
+                                 const void *elem);
+
+// Inserts the given element after the cursor, and points the cursor at it.
+// Returns the new element, or NULL if unsuccessful.
+void *UnrolledList_insert_after(UnrolledList *list, UnrolledListCursor *cursor,
+                                const void *elem);
+
+// Appends the given element to the list.
+// Returns the new element, or NULL if unsuccessful.
+void *UnrolledList_append(UnrolledList *list, const void *elem);
+
+// Prepends the given element to the list.
+// Returns the new element, or NULL if unsuccessful.
+void *UnrolledList_prepend(UnrolledList *list, const void *elem);
+
+// Removes the element under the cursor, and moves the cursor to the element
+// that followed it.
+void UnrolledList_remove(UnrolledList *list, UnrolledListCursor *cursor);
+
+// Removes the first element from the list.
+void UnrolledList_remove_first(UnrolledList *list);
+
+// Removes the last element from the list.
+void UnrolledList_remove_last(UnrolledList *list);
+
+// Removes all the items from the list.
+// Remember to clean up memory first.
+void UnrolledList_clear(UnrolledList *list);
+
+// Removes a range of elements starting at the cursor, and moves the cursor to
+// the element that followed them.
+void UnrolledList_remove_range(UnrolledList *list, UnrolledListCursor *cursor,
+                               int count);
+
+// Copies a list. Returns whether successful.
+bool UnrolledList_copy(UnrolledList *dest_list, const UnrolledList *list);
+
+// Gets an Iterator for this UnrolledList
+void UnrolledList_get_iterator(const UnrolledList *list, Iterator *iter);
+
+// Gets a reverse Iterator for this UnrolledList
+void UnrolledList_get_reverse_iterator(const UnrolledList *list,
+                                       Iterator *iter);
+
+// Gets a Sink for this list
+void UnrolledList_get_sink(const UnrolledList *list, Sink *sink);
+
+#define DECLARE_UNROLLED_LIST(name, T)                                         \
+  typedef struct UnrolledList name##UnrolledList;                              \
+  name##UnrolledList *name##UnrolledList_alloc(void);                          \
+  name##UnrolledList *name##UnrolledList_alloc_ext(Arena *arena);              \
+  name##UnrolledList *name##UnrolledList_alloc_pooled(Pool *pool);             \
+  T name##UnrolledList_get_first(const name##UnrolledList *list);              \
+  T name##UnrolledList_get_last(const name##UnrolledList *list);               \
+  T *name##UnrolledList_get_first_ref(const name##UnrolledList *list);         \
+  T *name##UnrolledList_get_last_ref(const name##UnrolledList *list);          \
+  void name##UnrolledList_set(const name##UnrolledList *list,                  \
+                              const UnrolledListCursor *cursor, const T data); \
+  T name##UnrolledList_get(const name##UnrolledList *list,                     \
+                           const UnrolledListCursor *cursor);                  \
+  void name##UnrolledList_set_ref(const name##UnrolledList *list,              \
+                                  const UnrolledListCursor *cursor,            \
+                                  const T *data);                              \
+  T *name##UnrolledList_get_ref(const name##UnrolledList *list,                \
+                                const UnrolledListCursor *cursor);             \
+  T *name##UnrolledList_get_span(const name##UnrolledList *list,               \
+                                 const UnrolledListCursor *cursor,             \
+                                 size_t *count);                               \
+  T *name##UnrolledList_insert_before(name##UnrolledList *list,                \
+                                      UnrolledListCursor *cursor,              \
+                                      const T *elem);                          \
+  T *name##UnrolledList_insert_after(name##UnrolledList *list,                 \
+                                     UnrolledListCursor *cursor,               \
+                                     const T *elem);                           \
+  T *name##UnrolledList_append(name##UnrolledList *list, const T *elem);       \
+  T *name##UnrolledList_prepend(name##UnrolledList *list, const T *elem);      \
+  void name##UnrolledList_remove(name##UnrolledList *list,                     \
+                                 UnrolledListCursor *cursor);                  \
+  void name##UnrolledList_get_iterator(const name##UnrolledList *list,         \
+                                       name##Iterator *iter);                  \
+  void name##UnrolledList_get_reverse_iterator(const name##UnrolledList *list, \
+                                               name##Iterator *iter);          \
+  void name##UnrolledList_get_sink(const name##UnrolledList *list,             \
+                                   name##Sink *sink);
+
+#define DEFINE_UNROLLED_LIST(name, T)                                          \
+  name##UnrolledList *name##UnrolledList_alloc(void) {                         \
+    return (name##UnrolledList *)UnrolledList_alloc(sizeof(T));                \
+  }                                                                            \
+  name##UnrolledList *name##UnrolledList_alloc_ext(Arena *arena) {             \
+    return (name##UnrolledList *)UnrolledList_alloc_ext(sizeof(T), arena);     \
+  }                                                                            \
+  name##UnrolledList *name##UnrolledList_alloc_pooled(Pool *pool) {            \
+    return (name##UnrolledList *)UnrolledList_alloc_pooled(sizeof(T), pool);   \
+  }                                                                            \
+  T name##UnrolledList_get_first(const name##UnrolledList *list) {             \
+    return *name##UnrolledList_get_first_ref(list);                            \
+  }                                                                            \
+  T name##UnrolledList_get_last(const name##UnrolledList *list) {              \
+    return *name##UnrolledList_get_last_ref(list);                             \
+  }                                                                            \
+  T *name##UnrolledList_get_first_ref(const name##UnrolledList *list) {        \
+    return (T *)UnrolledList_get_first((const UnrolledList *)list);            \
+  }                                                                            \
+  T *name##UnrolledList_get_last_ref(const name##UnrolledList *list) {         \
+    return (T *)UnrolledList_get_last((const UnrolledList *)list);             \
+  }                                                                            \
+  void name##UnrolledList_set(const name##UnrolledList *list,                  \
+                              const UnrolledListCursor *cursor,                \
+                              const T data) {                                  \
+    name##UnrolledList_set_ref(list, cursor, &data);                           \
+  }                                                                            \
+  T name##UnrolledList_get(const name##UnrolledList *list,                     \
+                           const UnrolledListCursor *cursor) {                 \
+    return *name##UnrolledList_get_ref(list, cursor);                          \
+  }                                                                            \
+  void name##UnrolledList_set_ref(const name##UnrolledList *list,              \
+                                  const UnrolledListCursor *cursor,            \
+                                  const T *data) {                             \
+    UnrolledList_set((const UnrolledList *)list, cursor, data);                \
+  }                                                                            \
+  T *name##UnrolledList_get_ref(const name##UnrolledList *list,                \
+                                const UnrolledListCursor *cursor) {            \
+    return (T *)UnrolledList_get((const UnrolledList *)list, cursor);          \
+  }                                                                            \
+  T *name##UnrolledList_get_span(const name##UnrolledList *list,               \
+                                 const UnrolledListCursor *cursor,             \
+                                 size_t *count) {                              \
+    return (T *)UnrolledList_get_span((const UnrolledList *)list, cursor,      \
+                                      count);                                  \
+  }                                                                            \
+  T *name##UnrolledList_insert_before(name##UnrolledList *list,                \
+                                      UnrolledListCursor *cursor,              \
+                                      const T *elem) {                         \
+    return (T *)UnrolledList_insert_before((UnrolledList *)list, cursor,       \
+                                           elem);                              \
+  }                                                                            \
+  T *name##UnrolledList_insert_after(name##UnrolledList *list,                 \
+                                     UnrolledListCursor *cursor,               \
+                                     const T *elem) {                          \
+    return (T *)UnrolledList_insert_after((UnrolledList *)list, cursor, elem); \
+  }                                                                            \
+  T *name##UnrolledList_append(name##UnrolledList *list, const T *elem) {      \
+    return (T *)UnrolledList_append((UnrolledList *)list, elem);               \
+  }                                                                            \
+  T *name##UnrolledList_prepend(name##UnrolledList *list, const T *elem) {     \
+    return (T *)UnrolledList_prepend((UnrolledList *)list, elem);              \
+  }                                                                            \
+  void name##UnrolledList_remove(name##UnrolledList *list,                     \
+                                 UnrolledListCursor *cursor) {                 \
+    UnrolledList_remove((UnrolledList *)list, cursor);                         \
+  }                                                                            \
+  void name##UnrolledList_get_iterator(const name##UnrolledList *list,         \
+                                       name##Iterator *iter) {                 \
+    UnrolledList_get_iterator((const UnrolledList *)list, (Iterator *)iter);   \
+  }                                                                            \
+  void name##UnrolledList_get_reverse_iterator(const name##UnrolledList *list, \
+                                               name##Iterator *iter) {         \
+    UnrolledList_get_reverse_iterator((const UnrolledList *)list,              \
+                                      (Iterator *)iter);                       \
+  }                                                                            \
+  void name##UnrolledList_get_sink(const name##UnrolledList *list,             \
+                                   name##Sink *sink) {                         \
+    UnrolledList_get_sink((const UnrolledList *)list, (Sink *)sink);           \
+  }
+
+#endif // COMMON_PUBLIC_UNROLLED_LIST_H__
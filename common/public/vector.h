@@ -4,6 +4,8 @@
 #include <stdbool.h>
 #include <stddef.h>
 
+#include "arena.h"
+#include "assert.h"
 #include "iterator.h"
 
 // A dynamically growing vector.
@@ -12,6 +14,70 @@ typedef struct Vector Vector;
 // Creates a new Vector object.
 Vector *Vector_alloc(size_t elem_size);
 
+// Creates a new Vector object whose memory comes from `arena'.
+Vector *Vector_alloc_ext(size_t elem_size, Arena *arena);
+
+// Bytes to set aside for a Vector, so that a small vector can hold one
+// without seeing its definition.
+#define VECTOR_HEADER_SIZE (12 * sizeof(void *))
+
+// Creates a small vector: a Vector with room for `capacity' elements in the
+// same allocation, so it only allocates again once it outgrows them.
+Vector *Vector_alloc_inline(size_t elem_size, size_t capacity);
+
+// Initializes a small vector whose header is `header', VECTOR_HEADER_SIZE
+// bytes aligned for any type, and whose first `capacity' elements live in
+// `buffer'. Both are usually on the stack or inside another struct, which must
+// not move while the elements are inline. Clean it up with Vector_cleanup.
+Vector *Vector_init_inline(void *header, size_t elem_size, void *buffer,
+                           size_t capacity);
+
+// Frees up the data of a Vector that was initialized in place, leaving it
+// empty.
+void Vector_cleanup(Vector *vector);
+
+// File-backed vectors' files start with a header this big, so the elements
+// after it are page-aligned.
+#define VECTOR_FILE_HEADER_SIZE 4096
+
+// Opens a Vector whose elements live in the file at `path', creating the file
+// if it doesn't exist. The file is mapped rather than read, so a vector of any
+// size opens immediately and its pages load as they're used; growing the
+// vector grows the file. Returns NULL if the file can't be mapped or holds a
+// different size of element. Vector_free closes it, keeping the elements;
+// Vector_cleanup and Vector_clear empty the file.
+Vector *Vector_open_file(const char *path, size_t elem_size);
+
+// Writes a file-backed vector's elements and count through to the disk. The
+// count is otherwise only written when the vector is freed. Returns whether
+// successful.
+bool Vector_sync(Vector *vector);
+
+// How a Vector's capacity grows when it runs out of room.
+typedef enum VectorGrowth {
+  // Doubles the capacity. The default.
+  VECTOR_GROW_DOUBLE,
+  // Grows the capacity by half, which wastes less and lets the allocator
+  // reuse freed blocks.
+  VECTOR_GROW_BY_HALF,
+  // Grows by half, rounded up to whole pages so no part of one goes unused.
+  VECTOR_GROW_PAGES,
+  // Doubles, but buffers of VECTOR_MAP_THRESHOLD bytes or more get their own
+  // anonymous mapping, grown with mremap: the kernel moves page tables
+  // instead of copying, and pages use memory only once they are written.
+  // Behaves like VECTOR_GROW_DOUBLE off Linux and for Vectors with an Arena.
+  VECTOR_GROW_MAPPED,
+} VectorGrowth;
+
+// Buffers this big are mapped under VECTOR_GROW_MAPPED.
+#define VECTOR_MAP_THRESHOLD (1 << 20)
+
+// Sets how the vector grows from now on.
+void Vector_set_growth(Vector *vector, VectorGrowth growth);
+
+// Gets how the vector grows.
+VectorGrowth Vector_growth(const Vector *vector);
+
 // Gets the number of elements in the Vector
 size_t Vector_count(const Vector *vector);
 
@@ -22,14 +88,12 @@ bool Vector_empty(const Vector *vector);
 size_t Vector_capacity(const Vector *vector);
 
 // Reserves memory for a total of `num_elems' objects.
-// Capacity always increases by a factor of 2.
 // Returns whether the allocation was successful.
 bool Vector_reserve(Vector *vector, size_t num_elems);
 
 // Reserves memory for a total of `num_elems' objects.
 // Increases the count of elements in the vector,
 // but does not initialize the new objects.
-// Capacity always increases by a factor of 2.
 // Returns whether the allocation was successful.
 bool Vector_expand(Vector *vector, size_t num_elems);
 
@@ -90,6 +154,11 @@ void Vector_truncate(Vector *vector, size_t start_index);
 // Copies a vector. Returns whether successful.
 bool Vector_copy(Vector *dest_vector, const Vector *vector);
 
+// Sorts the vector in place. The built-in compare functions (Int_compare,
+// Double_compare, CString_compare, ...) get a specialized sort; others use
+// qsort.
+void Vector_sort(Vector *vector, int (*compare_fn)(const void *a, const void *b));
+
 // Gets an Iterator for this Vector
 void Vector_get_iterator(const Vector *vector, Iterator *iter);
 
@@ -106,23 +175,57 @@ void Vector_print_fn(Vector *vector, void (*print)(const Vector *self, char *tar
 
 void Vector_print(Vector *vector, char *buffer, size_t index);
 
+// The fields every Vector starts with, in this order, so that the accessors
+// DECLARE_VECTOR defines inline can reach the elements without a call. The
+// rest of a Vector is private.
+typedef struct VectorPrefix {
+  void *data;
+  size_t data_size;
+  size_t elem_size;
+  size_t elem_count;
+  // Bumped on every change, to catch changes while iterating.
+  int version;
+} VectorPrefix;
+
+// Declares name##Vector. Its element accessors are defined inline and index a
+// T * directly; the rest wrap the generic functions, which are still the way
+// to reach elements of a type without a name##Vector.
 #define DECLARE_VECTOR(name, T)                                                  \
   /* A dynamically growing vector. */                                            \
   typedef struct name##Vector name##Vector;                                        \
   /* Creates a new name##Vector object. */                                       \
   name##Vector *name##Vector_alloc(void);                                              \
-  /* Gets the data for the vector. */                                            \
-  T *name##Vector_get_data(const name##Vector *vector);                              \
+  name##Vector *name##Vector_alloc_ext(Arena *arena);                                  \
+  /* Opens a name##Vector whose elements live in the file at `path'. */        \
+  name##Vector *name##Vector_open_file(const char *path);                      \
+  /* Gets the data for the vector. */                                          \
+  static inline T *name##Vector_get_data(const name##Vector *self) {           \
+    return (T *)((const VectorPrefix *)self)->data;                            \
+  }                                                                            \
   /* Gets the item at `index' */                                               \
-  T name##Vector_get(const name##Vector *self, size_t index);                      \
+  static inline T *name##Vector_get_ref(const name##Vector *self,              \
+                                        size_t index) {                        \
+    ASSERT(index < ((const VectorPrefix *)self)->elem_count);                  \
+    return (T *)((const VectorPrefix *)self)->data + index;                    \
+  }                                                                            \
   /* Gets the item at `index' */                                               \
-  T *name##Vector_get_ref(const name##Vector *self, size_t index);                 \
+  static inline T name##Vector_get(const name##Vector *self, size_t index) {   \
+    return *name##Vector_get_ref(self, index);                                 \
+  }                                                                            \
   /* Sets the item at `index' to the given data. `index' must be within the    \
-   * bounds of the vector. */                                                    \
-  void name##Vector_set(name##Vector *self, size_t index, const T elem);           \
+   * bounds of the vector. */                                                  \
+  static inline void name##Vector_set_ref(name##Vector *self, size_t index,    \
+                                          const T *elem) {                     \
+    /* With T a pointer, `const T' is a pointer to const; drop that. */        \
+    *name##Vector_get_ref(self, index) = *(T *)elem;                           \
+    ((VectorPrefix *)self)->version++;                                         \
+  }                                                                            \
   /* Sets the item at `index' to the given data. `index' must be within the    \
-   * bounds of the vector. */                                                    \
-  void name##Vector_set_ref(name##Vector *self, size_t index, const T *elem);      \
+   * bounds of the vector. */                                                  \
+  static inline void name##Vector_set(name##Vector *self, size_t index,        \
+                                      const T elem) {                          \
+    name##Vector_set_ref(self, index, &elem);                                  \
+  }                                                                            \
   /* Sets the data at `index' to the given data. `index' and data must be      \
    * within the bounds of the vector. */                                         \
   void name##Vector_set_range(name##Vector *self, size_t index, const T *elem,     \
@@ -137,15 +240,30 @@ void Vector_print(Vector *vector, char *buffer, size_t index);
    * pointer to the inserted data. Returns NULL if unsuccessful. */            \
   T *name##Vector_insert_range(name##Vector *self, size_t index, const T *elems,   \
                              size_t count);                                    \
-  /* Appends the given element to the vector. Returns a pointer to the appended  \
-   * data. Returns NULL if unsuccessful. */                                    \
-  T *name##Vector_add(name##Vector *self, const T elem);                           \
-  /* Appends the given element to the vector. Returns a pointer to the appended  \
-   * data. Returns NULL if unsuccessful. */                                    \
-  T *name##Vector_add_ref(name##Vector *self, const T *elem);                      \
+  /* Appends the given element to the vector. Returns a pointer to the       \
+   * appended data. Returns NULL if unsuccessful. Only growing the vector      \
+   * takes a call. */                                                          \
+  static inline T *name##Vector_add_ref(name##Vector *self, const T *elem) {   \
+    VectorPrefix *vector = (VectorPrefix *)self;                               \
+    if ((vector->elem_count + 1) * sizeof(T) > vector->data_size) {            \
+      return (T *)Vector_add((Vector *)self, elem);                            \
+    }                                                                          \
+    T *dest = (T *)vector->data + vector->elem_count++;                        \
+    *dest = *(T *)elem;                                                        \
+    vector->version++;                                                         \
+    return dest;                                                               \
+  }                                                                            \
+  /* Appends the given element to the vector. Returns a pointer to the       \
+   * appended data. Returns NULL if unsuccessful. */                           \
+  static inline T *name##Vector_add(name##Vector *self, const T elem) {        \
+    return name##Vector_add_ref(self, &elem);                                  \
+  }                                                                            \
   /* Appends the given elements to the vector. Returns a pointer to the appended \
    * data. Returns NULL if unsuccessful. */                                    \
   T *name##Vector_add_range(name##Vector *self, const T *elems, size_t count);     \
+  /* Sorts the vector in place. */                                             \
+  void name##Vector_sort(name##Vector *self,                                   \
+                         int (*compare_fn)(const void *a, const void *b));     \
   /* Gets an Iterator for this name##Vector */                                   \
   void name##Vector_get_iterator(const name##Vector *self, name##Iterator *iter);  \
   /* Gets a reverse Iterator for this name##Vector */                            \
@@ -160,20 +278,11 @@ void Vector_print(Vector *vector, char *buffer, size_t index);
   name##Vector *name##Vector_alloc(void) {                                             \
     return (name##Vector *)Vector_alloc(sizeof(T));                                \
   }                                                                            \
-  T *name##Vector_get_data(const name##Vector *self) {                             \
-    return (T *)Vector_get_data((const Vector *)self);                             \
+  name##Vector *name##Vector_alloc_ext(Arena *arena) {                                 \
+    return (name##Vector *)Vector_alloc_ext(sizeof(T), arena);                         \
   }                                                                            \
-  T name##Vector_get(const name##Vector *self, size_t index) {                     \
-    return *(T *)Vector_get((const Vector *)self, index);                          \
-  }                                                                            \
-  T *name##Vector_get_ref(const name##Vector *self, size_t index) {                \
-    return (T *)Vector_get((const Vector *)self, index);                           \
-  }                                                                            \
-  void name##Vector_set(name##Vector *self, size_t index, const T elem) {          \
-    Vector_set((Vector *)self, index, &elem);                                      \
-  }                                                                            \
-  void name##Vector_set_ref(name##Vector *self, size_t index, const T *elem) {     \
-    Vector_set((Vector *)self, index, elem);                                       \
+  name##Vector *name##Vector_open_file(const char *path) {                     \
+    return (name##Vector *)Vector_open_file(path, sizeof(T));                  \
   }                                                                            \
   void name##Vector_set_range(name##Vector *self, size_t index, const T *elem,     \
                             int count) {                                       \
@@ -189,15 +298,13 @@ void Vector_print(Vector *vector, char *buffer, size_t index);
                              size_t count) {                                   \
     return (T *)Vector_insert_range((Vector *)self, index, elems, count);          \
   }                                                                            \
-  T *name##Vector_add(name##Vector *self, const T elem) {                          \
-    return (T *)Vector_add((Vector *)self, &elem);                                 \
-  }                                                                            \
-  T *name##Vector_add_ref(name##Vector *self, const T *elem) {                     \
-    return (T *)Vector_add((Vector *)self, elem);                                  \
-  }                                                                            \
   T *name##Vector_add_range(name##Vector *self, const T *elems, size_t count) {    \
     return (T *)Vector_add_range((Vector *)self, elems, count);                    \
   }                                                                            \
+  void name##Vector_sort(name##Vector *self,                                   \
+                         int (*compare_fn)(const void *a, const void *b)) {    \
+    Vector_sort((Vector *)self, compare_fn);                                   \
+  }                                                                            \
   void name##Vector_get_iterator(const name##Vector *self, name##Iterator *iter) { \
     Vector_get_iterator((const Vector *)self, (Iterator *)iter);                   \
   }                                                                            \
@@ -213,4 +320,38 @@ void Vector_print(Vector *vector, char *buffer, size_t index);
     Vector_get_indexer((const Vector *)self, (Indexer *)indexer);                  \
   }
 
+// A name##Vector with room for N elements inside it, usually on the stack or
+// in another struct; it only allocates once it holds more. The name##Vector
+// functions work on name##SmallVector_vector(self). Needs DECLARE_VECTOR(name,
+// T), and there can only be one N per name.
+#define DECLARE_SMALL_VECTOR(name, T, N)                                       \
+  typedef struct name##SmallVector {                                           \
+    _Alignas(max_align_t) unsigned char header[VECTOR_HEADER_SIZE];            \
+    T items[N];                                                                \
+  } name##SmallVector;                                                         \
+  /* Initializes the small vector in place and returns it as a vector. */      \
+  name##Vector *name##SmallVector_init(name##SmallVector *self);               \
+  /* Frees up anything the vector spilled to the heap. */                      \
+  void name##SmallVector_cleanup(name##SmallVector *self);                     \
+  /* Gets the small vector as a vector. */                                     \
+  name##Vector *name##SmallVector_vector(name##SmallVector *self);             \
+  /* Creates a name##Vector with room for N elements in the same allocation.   \
+   * Free it with Vector_free. */                                              \
+  name##Vector *name##SmallVector_alloc(void);
+
+#define DEFINE_SMALL_VECTOR(name, T, N)                                        \
+  name##Vector *name##SmallVector_init(name##SmallVector *self) {              \
+    return (name##Vector *)Vector_init_inline(self->header, sizeof(T),         \
+                                              self->items, N);                 \
+  }                                                                            \
+  void name##SmallVector_cleanup(name##SmallVector *self) {                    \
+    Vector_cleanup((Vector *)self->header);                                    \
+  }                                                                            \
+  name##Vector *name##SmallVector_vector(name##SmallVector *self) {            \
+    return (name##Vector *)self->header;                                       \
+  }                                                                            \
+  name##Vector *name##SmallVector_alloc(void) {                                \
+    return (name##Vector *)Vector_alloc_inline(sizeof(T), N);                  \
+  }
+
 #endif // COMMON_PUBLIC_VECTOR_H__
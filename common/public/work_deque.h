@@ -0,0 +1,39 @@
+#ifndef COMMON_PUBLIC_WORK_DEQUE_H__
+#define COMMON_PUBLIC_WORK_DEQUE_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// A Chase-Lev work-stealing deque of pointers. One thread, the owner, pushes
+// and pops at the bottom like a stack; any other thread may steal from the
+// top. The owner only contends with thieves when one item is left.
+typedef struct WorkDeque WorkDeque;
+
+// Creates a new WorkDeque with room for `capacity' items (rounded up to a power
+// of 2) before it has to grow.
+WorkDeque *WorkDeque_alloc(size_t capacity);
+
+// Frees up the WorkDeque object. No thread may be using it.
+void WorkDeque_free(WorkDeque *deque);
+
+// Gets the number of items in the WorkDeque. Only a snapshot while other
+// threads are active.
+size_t WorkDeque_count(const WorkDeque *deque);
+
+// Returns whether the deque is empty. Only a snapshot while other threads are
+// active.
+bool WorkDeque_empty(const WorkDeque *deque);
+
+// Adds a non-NULL item to the bottom. Owner only. Returns false if the deque
+// was full and couldn't grow.
+bool WorkDeque_push(WorkDeque *deque, void *item);
+
+// Removes the item at the bottom, the one pushed last. Owner only. Returns
+// NULL if the deque is empty.
+void *WorkDeque_pop(WorkDeque *deque);
+
+// Removes the item at the top, the one pushed first. Any thread. Returns NULL
+// if the deque is empty or another thread took the item first.
+void *WorkDeque_steal(WorkDeque *deque);
+
+#endif // COMMON_PUBLIC_WORK_DEQUE_H__
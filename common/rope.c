@@ -0,0 +1,355 @@
+#include "protected/rope.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "../test/stubs.h"
+#include "public/assert.h"
+
+// The most chunks RopeView_write hands writev at once.
+#ifdef IOV_MAX
+#define _ROPE_IOV_BATCH (IOV_MAX < 1024 ? IOV_MAX : 1024)
+#else
+#define _ROPE_IOV_BATCH 1024
+#endif
+
+Rope *Rope_alloc(void) { return Rope_alloc_ext(NULL); }
+
+Rope *Rope_alloc_ext(Arena *arena) {
+  Rope *rope;
+  if (NULL == (rope = Arena_malloc(arena, sizeof(Rope)))) {
+    return NULL;
+  }
+  if (NULL == (rope->pieces = Vector_alloc_ext(sizeof(struct RopePiece),
+                                               arena))) {
+    Arena_release(arena, rope);
+    return NULL;
+  }
+  rope->arena = arena;
+  rope->chunks = NULL;
+  rope->length = 0;
+  rope->next_chunk_size = ROPE_MIN_CHUNK_SIZE;
+  return rope;
+}
+
+static void _Rope_free_chunks(Rope *rope) {
+  struct RopeChunkBlock *chunk = rope->chunks;
+  while (chunk) {
+    struct RopeChunkBlock *next = chunk->next;
+    Arena_release(rope->arena, chunk);
+    chunk = next;
+  }
+  rope->chunks = NULL;
+}
+
+void Rope_free(Rope *rope) {
+  if (!rope) {
+    return;
+  }
+  _Rope_free_chunks(rope);
+  Vector_free(rope->pieces);
+  Arena_release(rope->arena, rope);
+}
+
+size_t Rope_length(const Rope *rope) {
+  ASSERT(rope != NULL);
+  return rope->length;
+}
+
+void Rope_clear(Rope *rope) {
+  ASSERT(rope != NULL);
+  _Rope_free_chunks(rope);
+  Vector_clear(rope->pieces);
+  rope->length = 0;
+  rope->next_chunk_size = ROPE_MIN_CHUNK_SIZE;
+}
+
+// Adds `length' bytes at `data' to the end, extending the last piece if they
+// follow straight on from it.
+static bool _Rope_add_piece(Rope *rope, const char *data, size_t length) {
+  size_t count = Vector_count(rope->pieces);
+  if (count > 0) {
+    struct RopePiece *last =
+        (struct RopePiece *)Vector_get_data(rope->pieces) + count - 1;
+    if (last->data + last->length == data) {
+      last->length += length;
+      rope->length += length;
+      return true;
+    }
+  }
+  struct RopePiece piece = {data, rope->length, length};
+  if (!Vector_add(rope->pieces, &piece)) {
+    return false;
+  }
+  rope->length += length;
+  return true;
+}
+
+// Gets room for at least `length' bytes at the end of the newest chunk,
+// starting a new one if it hasn't the room. Returns NULL if out of memory.
+static char *_Rope_reserve(Rope *rope, size_t length) {
+  struct RopeChunkBlock *chunk = rope->chunks;
+  if (chunk && chunk->size - chunk->used >= length) {
+    return chunk->data + chunk->used;
+  }
+  size_t size = rope->next_chunk_size;
+  if (size < length) {
+    size = length;
+  }
+  if (NULL == (chunk = Arena_malloc(rope->arena,
+                                    sizeof(struct RopeChunkBlock) + size))) {
+    return NULL;
+  }
+  chunk->next = rope->chunks;
+  chunk->size = size;
+  chunk->used = 0;
+  rope->chunks = chunk;
+  if (rope->next_chunk_size < ROPE_MAX_CHUNK_SIZE) {
+    rope->next_chunk_size *= 2;
+  }
+  return chunk->data;
+}
+
+// Appends the `length' bytes just written where _Rope_reserve said.
+static bool _Rope_commit(Rope *rope, size_t length) {
+  struct RopeChunkBlock *chunk = rope->chunks;
+  if (!_Rope_add_piece(rope, chunk->data + chunk->used, length)) {
+    return false;
+  }
+  chunk->used += length;
+  return true;
+}
+
+bool Rope_append(Rope *rope, const char *data, size_t length) {
+  ASSERT(rope != NULL);
+  ASSERT(data != NULL || length == 0);
+  if (length == 0) {
+    return true;
+  }
+  // Fill what's left of the newest chunk before starting another.
+  struct RopeChunkBlock *chunk = rope->chunks;
+  size_t room = chunk ? chunk->size - chunk->used : 0;
+  if (room > 0 && room < length) {
+    memcpy(chunk->data + chunk->used, data, room);
+    if (!_Rope_commit(rope, room)) {
+      return false;
+    }
+    data += room;
+    length -= room;
+  }
+  char *out;
+  if (NULL == (out = _Rope_reserve(rope, length))) {
+    return false;
+  }
+  memcpy(out, data, length);
+  return _Rope_commit(rope, length);
+}
+
+bool Rope_append_c_str(Rope *rope, const char *c_str) {
+  ASSERT(c_str != NULL);
+  return Rope_append(rope, c_str, strlen(c_str));
+}
+
+bool Rope_append_format(Rope *rope, const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  bool result = Rope_append_vformat(rope, format, args);
+  va_end(args);
+  return result;
+}
+
+bool Rope_append_vformat(Rope *rope, const char *format, va_list args) {
+  ASSERT(rope != NULL);
+  ASSERT(format != NULL);
+  // Try what's left of the newest chunk; if it's too small, the length that
+  // comes back says how big a chunk to format into instead.
+  struct RopeChunkBlock *chunk = rope->chunks;
+  size_t room = chunk ? chunk->size - chunk->used : 0;
+  va_list retry;
+  va_copy(retry, args);
+  int length = vsnprintf(room ? chunk->data + chunk->used : NULL, room, format,
+                         args);
+  bool result = false;
+  if (length < 0) {
+    goto out;
+  }
+  if ((size_t)length >= room) {
+    // vsnprintf needs room for the NUL, which isn't kept.
+    char *out;
+    if (NULL == (out = _Rope_reserve(rope, (size_t)length + 1))) {
+      goto out;
+    }
+    vsnprintf(out, (size_t)length + 1, format, retry);
+  }
+  result = _Rope_commit(rope, (size_t)length);
+out:
+  va_end(retry);
+  return result;
+}
+
+bool Rope_append_ref(Rope *rope, const char *data, size_t length) {
+  ASSERT(rope != NULL);
+  ASSERT(data != NULL || length == 0);
+  return length == 0 || _Rope_add_piece(rope, data, length);
+}
+
+bool Rope_append_view(Rope *rope, RopeView view) {
+  ASSERT(rope != NULL);
+  // Appending a view of the same Rope adds pieces as it goes, so the cursor
+  // works through them by index, and only as far as the view reached.
+  RopeChunkCursor cursor;
+  RopeChunk chunk;
+  RopeView_get_chunks(view, &cursor);
+  while (RopeChunkCursor_next(&cursor, &chunk)) {
+    if (!_Rope_add_piece(rope, chunk.data, chunk.length)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Gets the index of the piece holding the byte at `offset', which is in the
+// Rope.
+static size_t _Rope_find_piece(const Rope *rope, size_t offset) {
+  const struct RopePiece *pieces = Vector_get_data(rope->pieces);
+  size_t lo = 0, hi = Vector_count(rope->pieces);
+  while (hi - lo > 1) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (pieces[mid].start <= offset) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+char Rope_char_at(const Rope *rope, size_t index) {
+  ASSERT(rope != NULL);
+  ASSERT(index < rope->length);
+  const struct RopePiece *piece =
+      (const struct RopePiece *)Vector_get_data(rope->pieces) +
+      _Rope_find_piece(rope, index);
+  return piece->data[index - piece->start];
+}
+
+RopeView Rope_view(const Rope *rope, size_t start, size_t length) {
+  ASSERT(rope != NULL);
+  ASSERT(start <= rope->length);
+  if (length > rope->length - start) {
+    length = rope->length - start;
+  }
+  return (RopeView){rope, start, length};
+}
+
+RopeView RopeView_slice(RopeView view, size_t start, size_t length) {
+  ASSERT(start <= view.length);
+  if (length > view.length - start) {
+    length = view.length - start;
+  }
+  return (RopeView){view.rope, view.start + start, length};
+}
+
+void RopeView_get_chunks(RopeView view, RopeChunkCursor *cursor) {
+  ASSERT(view.rope != NULL);
+  ASSERT(cursor != NULL);
+  cursor->rope = view.rope;
+  cursor->remaining = view.length;
+  cursor->piece = 0;
+  cursor->offset = 0;
+  if (view.length > 0) {
+    cursor->piece = _Rope_find_piece(view.rope, view.start);
+    cursor->offset =
+        view.start -
+        ((const struct RopePiece *)Vector_get_data(view.rope->pieces))[cursor->piece]
+            .start;
+  }
+}
+
+bool RopeChunkCursor_next(RopeChunkCursor *cursor, RopeChunk *chunk) {
+  ASSERT(cursor != NULL);
+  ASSERT(chunk != NULL);
+  if (cursor->remaining == 0) {
+    return false;
+  }
+  const struct RopePiece *piece =
+      (const struct RopePiece *)Vector_get_data(cursor->rope->pieces) +
+      cursor->piece;
+  size_t length = piece->length - cursor->offset;
+  if (length > cursor->remaining) {
+    length = cursor->remaining;
+  }
+  chunk->data = piece->data + cursor->offset;
+  chunk->length = length;
+  cursor->remaining -= length;
+  cursor->piece++;
+  cursor->offset = 0;
+  return true;
+}
+
+size_t RopeView_copy(RopeView view, char *out) {
+  ASSERT(out != NULL || view.length == 0);
+  RopeChunkCursor cursor;
+  RopeChunk chunk;
+  size_t copied = 0;
+  RopeView_get_chunks(view, &cursor);
+  while (RopeChunkCursor_next(&cursor, &chunk)) {
+    memcpy(out + copied, chunk.data, chunk.length);
+    copied += chunk.length;
+  }
+  return copied;
+}
+
+char *RopeView_flatten(RopeView view) {
+  char *str;
+  if (NULL == (str = malloc(view.length + 1))) {
+    return NULL;
+  }
+  str[RopeView_copy(view, str)] = '\0';
+  return str;
+}
+
+char *Rope_flatten(const Rope *rope) {
+  return RopeView_flatten(Rope_view(rope, 0, Rope_length(rope)));
+}
+
+bool RopeView_write(RopeView view, int fd) {
+  struct iovec iov[_ROPE_IOV_BATCH];
+  RopeChunkCursor cursor;
+  RopeChunk chunk;
+  RopeView_get_chunks(view, &cursor);
+  bool more = RopeChunkCursor_next(&cursor, &chunk);
+  while (more) {
+    int count = 0;
+    for (; more && count < _ROPE_IOV_BATCH; count++) {
+      iov[count].iov_base = (void *)chunk.data;
+      iov[count].iov_len = chunk.length;
+      more = RopeChunkCursor_next(&cursor, &chunk);
+    }
+    // Short writes leave the rest of the batch to go again.
+    struct iovec *next = iov;
+    while (count > 0) {
+      ssize_t written = writev(fd, next, count);
+      if (written < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return false;
+      }
+      while (count > 0 && (size_t)written >= next->iov_len) {
+        written -= next->iov_len;
+        next++;
+        count--;
+      }
+      if (count > 0) {
+        next->iov_base = (char *)next->iov_base + written;
+        next->iov_len -= written;
+      }
+    }
+  }
+  return true;
+}
@@ -1,16 +1,15 @@
 #include "protected/set.h"
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "../test/stubs.h"
 #include "public/assert.h"
+#include "public/hash.h"
 #include "public/iterator.h"
 #include "public/vector.h"
 
-// TODO:
-// - Version
-
 bool Set_init(Set *set, KeyInfo *key_info);
 
 void Set_cleanup(Set *set);
@@ -22,56 +21,106 @@ void _Set_swap(Set *a, Set *b) {
   *b = tmp;
 }
 
-const void *_Set_find_ext(const Set *set, const void *key, int hash);
+const void *_Set_find_ext(const Set *set, const void *key, uint64_t hash);
 
-int _Set_hash(const Set *set, const void *key) {
+// Hashes a key and finalizes it, so the low bits pick the bucket.
+uint64_t _Set_hash(const Set *set, const void *key) {
   ASSERT(set != NULL);
   ASSERT(key != NULL);
 
-  int hash = set->key_info.hash_fn(key);
-  return hash > 0 ? hash : -hash;
+  return Hash_fibonacci(KeyInfo_hash(&set->key_info, key));
 }
 
-// Initializes a pre-allocated Set object with a custom capacity
-bool Set_init_ext(Set *set, KeyInfo *key_info, size_t capacity) {
-  struct SetBucket bucket;
-  if (!(set->buckets = Vector_alloc(sizeof(struct SetBucket)))) {
+// Frees a vector of buckets, but not the items in them.
+void _Set_free_buckets(Vector *buckets) {
+  if (buckets == NULL) {
+    return;
+  }
+  size_t nbuckets = Vector_count(buckets);
+  for (size_t i = 0; i < nbuckets; i++) {
+    struct SetBucket *bucket = Vector_get(buckets, i);
+    if (bucket->items) {
+      Vector_free(bucket->items);
+    }
+  }
+  Vector_free(buckets);
+}
+
+// Allocates a vector of `capacity' empty buckets. Each bucket's item vector is
+// only allocated once something is added to it, so this costs one allocation.
+Vector *_Set_alloc_buckets(Arena *arena, size_t capacity) {
+  Vector *buckets;
+  if (!(buckets = Vector_alloc_ext(sizeof(struct SetBucket), arena))) {
     goto error;
   }
+  if (!Vector_expand(buckets, capacity)) { // Zeroes the new buckets.
+    goto error_buckets;
+  }
+  return buckets;
+error_buckets:
+  Vector_free(buckets);
+error:
+  return NULL;
+}
+
+// Gets the number of items in a bucket.
+size_t _Set_bucket_size(const struct SetBucket *bucket) {
+  return bucket->items ? Vector_count(bucket->items) : 0;
+}
+
+// Adds an item to a bucket. Returns whether successful.
+bool _Set_bucket_add(Arena *arena, struct SetBucket *bucket,
+                     const struct SetItem *item) {
+  if (!bucket->items &&
+      !(bucket->items = Vector_alloc_ext(sizeof(struct SetItem), arena))) {
+    return false;
+  }
+  return Vector_add(bucket->items, item) != NULL;
+}
+
+// Rounds a bucket count up to a power of 2, so hashes can be masked.
+size_t _Set_round_capacity(size_t capacity) {
+  size_t nbuckets = 1;
+  while (nbuckets < capacity) {
+    nbuckets <<= 1;
+  }
+  return nbuckets;
+}
+
+// Initializes a pre-allocated Set object with a custom capacity
+bool Set_init_ext(Set *set, KeyInfo *key_info, size_t capacity,
+                  Arena *arena) {
+  capacity = _Set_round_capacity(capacity);
+  set->arena = arena;
   set->capacity = capacity;
   set->count = 0;
   set->key_info = *key_info;
   set->version = 0;
-  if (!Vector_reserve(set->buckets, capacity)) {
-      goto error_buckets;
-  }
-  for (size_t i = 0; i < capacity; i++) {
-    if (NULL == (bucket.items = Vector_alloc(sizeof(void *)))) {
-      goto error_buckets;
-    }
-    if (!Vector_add(set->buckets, &bucket)) {
-      goto error_buckets;
-    }
+  set->old_buckets = NULL;
+  set->rehash_index = 0;
+  set->incremental = false;
+  if (!(set->buckets = _Set_alloc_buckets(arena, capacity))) {
+    return false;
   }
   return true;
-error_buckets:
-  Vector_free(set->buckets);
-  set->buckets = NULL;
-error:
-  return false;
 }
 
 // Creates a new Set object.
 Set *Set_alloc(KeyInfo *key_info) {
+  return Set_alloc_ext(key_info, NULL);
+}
+
+// Creates a new Set object whose memory comes from `arena'.
+Set *Set_alloc_ext(KeyInfo *key_info, Arena *arena) {
   ASSERT(key_info != NULL);
 
-  Set *set = malloc(sizeof(Set));
+  Set *set = Arena_malloc(arena, sizeof(Set));
   if (set == NULL) {
     return NULL;
   }
   set->buckets = NULL;
-  if (!Set_init(set, key_info)) {
-    free(set);
+  if (!Set_init_ext(set, key_info, 4, arena)) {
+    Arena_release(arena, set);
     return NULL;
   }
   return set;
@@ -82,7 +131,7 @@ bool Set_init(Set *set, KeyInfo *key_info) {
   ASSERT(set != NULL);
   ASSERT(key_info != NULL);
 
-  return Set_init_ext(set, key_info, 4);
+  return Set_init_ext(set, key_info, 4, NULL);
 }
 
 // Gets the number of elements in the Set
@@ -104,7 +153,7 @@ void Set_free(Set *set) {
   ASSERT(set != NULL);
 
   Set_cleanup(set);
-  free(set);
+  Arena_release(set->arena, set);
 }
 
 // Cleans up the Set object, but does not free it.
@@ -112,10 +161,8 @@ void Set_cleanup(Set *set) {
   ASSERT(set != NULL);
 
   Set_clear(set);
-  if (set->buckets != NULL) {
-    Vector_free(set->buckets);
-    set->buckets = NULL;
-  }
+  _Set_free_buckets(set->buckets);
+  set->buckets = NULL;
   set->capacity = 0;
   set->count = 0;
 }
@@ -134,109 +181,225 @@ const KeyInfo *Set_key_info(const Set *set) {
   return &set->key_info;
 }
 
-bool Set_resize(Set *set, size_t new_capacity) {
-  bool status = false;
-  if (set->capacity >= new_capacity) {
-    status = true;
-    goto out; // Nothing to do.
-  }
-  Set *new_set;
-  if ((new_set = malloc(sizeof(Set))) == NULL) {
-    goto out;
+// Number of buckets across both bucket vectors. Together with _Set_bucket_at
+// this lets callers walk every item whether or not a rehash is in progress.
+size_t _Set_bucket_count(const Set *set) {
+  if (set->buckets == NULL) {
+    return 0;
   }
-  if (!Set_init_ext(new_set, &set->key_info, new_capacity)) {
-    goto out_new_set;
-  }
-  struct SetBucket *bucket;
-  void **ptrval;
+  return Vector_count(set->buckets) +
+         (set->old_buckets ? Vector_count(set->old_buckets) : 0);
+}
+
+// Gets bucket `index' of the combined bucket range.
+struct SetBucket *_Set_bucket_at(const Set *set, size_t index) {
   size_t nbuckets = Vector_count(set->buckets);
-  for (size_t i = 0; i < nbuckets; i++) {
-    bucket = Vector_get(set->buckets, i);
-    size_t nitems = Vector_count(bucket->items);
-    for (size_t j = 0; j < nitems; j++) {
-      ptrval = Vector_get(bucket->items, j);
-      if (Set_add(new_set, ptrval) == NULL) {
-        goto out_new_set;
+  if (index < nbuckets) {
+    return Vector_get(set->buckets, index);
+  }
+  return Vector_get(set->old_buckets, index - nbuckets);
+}
+
+// The bucket count is always a power of 2, so the hash can be masked.
+struct SetBucket *_Set_bucket(const Vector *buckets, uint64_t hash) {
+  return Vector_get(buckets, (size_t)hash & (Vector_count(buckets) - 1));
+}
+
+// Migrates up to `max_buckets' buckets of the old bucket vector into the new
+// one, and frees the old vector once it's been drained.
+// Returns whether successful.
+bool _Set_rehash_step(Set *set, size_t max_buckets) {
+  ASSERT(set != NULL);
+
+  if (set->old_buckets == NULL) {
+    return true;
+  }
+  size_t nbuckets = Vector_count(set->old_buckets);
+  for (; max_buckets > 0 && set->rehash_index < nbuckets; max_buckets--) {
+    struct SetBucket *bucket = Vector_get(set->old_buckets, set->rehash_index);
+    // Move items off the end one at a time so a failed add leaves every item
+    // in exactly one bucket.
+    while (_Set_bucket_size(bucket) > 0) {
+      size_t last = Vector_count(bucket->items) - 1;
+      struct SetItem *item = Vector_get(bucket->items, last);
+      if (!_Set_bucket_add(set->arena, _Set_bucket(set->buckets, item->hash),
+                           item)) {
+        return false;
       }
+      Vector_remove(bucket->items, last);
+    }
+    // Free drained buckets as we go, so freeing the old vector is cheap too.
+    if (bucket->items) {
+      Vector_free(bucket->items);
+      bucket->items = NULL;
     }
+    set->rehash_index++;
+  }
+  if (set->rehash_index == nbuckets) {
+    _Set_free_buckets(set->old_buckets);
+    set->old_buckets = NULL;
+    set->rehash_index = 0;
   }
-  // Put the new set in place of the old set.
-  _Set_swap(set, new_set);
-out_new_set:
-  Set_free(new_set);
-out:
-  return status;
+  set->version++;
+  return true;
 }
 
+// Moves every item into `new_capacity' fresh buckets. In incremental mode the
+// items are migrated a few buckets at a time by later operations.
+bool _Set_start_rehash(Set *set, size_t new_capacity) {
+  Vector *buckets;
+  // Only one rehash can be in flight at a time.
+  if (!_Set_rehash_step(set, SIZE_MAX)) {
+    return false;
+  }
+  new_capacity = _Set_round_capacity(new_capacity);
+  if (NULL == (buckets = _Set_alloc_buckets(set->arena, new_capacity))) {
+    return false;
+  }
+  set->old_buckets = set->buckets;
+  set->buckets = buckets;
+  set->capacity = new_capacity;
+  set->rehash_index = 0;
+  set->version++;
+  return set->incremental || _Set_rehash_step(set, SIZE_MAX);
+}
+
+bool Set_resize(Set *set, size_t new_capacity) {
+  if (set->capacity >= new_capacity) {
+    return true; // Nothing to do.
+  }
+  // An explicit resize is never deferred.
+  return _Set_start_rehash(set, new_capacity) &&
+         _Set_rehash_step(set, SIZE_MAX);
+}
+
+// Sets whether growing the set migrates its items a few buckets at a time on
+// later adds and deletes, instead of all at once.
+void Set_incremental_rehash(Set *set, bool enable) {
+  ASSERT(set != NULL);
+
+  set->incremental = enable;
+  if (!enable) {
+    _Set_rehash_step(set, SIZE_MAX);
+  }
+}
+
+// Gets the hash `set' uses for an item of `src', reusing the item's cached
+// hash when both sets hash the same way.
+uint64_t _Set_item_hash(const Set *set, const Set *src,
+                        const struct SetItem *item) {
+  if (KeyInfo_same_hash(&set->key_info, &src->key_info)) {
+    return item->hash;
+  }
+  return _Set_hash(set, item->value);
+}
+
+void *_Set_add_ext(Set *set, const void *key, uint64_t hash);
+
 // Copies the value to the set and returns pointer to the new value.
 // Returns NULL if unsuccessful.
 void *Set_add(Set *set, const void *key) {
   ASSERT(set != NULL);
   ASSERT(key != NULL);
 
+  return _Set_add_ext(set, key, _Set_hash(set, key));
+}
+
+void *_Set_add_ext(Set *set, const void *key, uint64_t hash) {
   if (!set->buckets) {
-    // Map needs to be re-initialized.
-    Set_init(set, &set->key_info);
+    // Set was cleaned up; only its buckets need to come back.
+    set->capacity = _Set_round_capacity(4);
+    if (!(set->buckets = _Set_alloc_buckets(set->arena, set->capacity))) {
+      goto error;
+    }
   }
+  _Set_rehash_step(set, SET_REHASH_STEP);
 
   void *val = NULL;
-  int hash = _Set_hash(set, key);
   if ((val = (void *)_Set_find_ext(set, key, hash)) == NULL) {
-    size_t ibucket = hash % Vector_count(set->buckets);
-    struct SetBucket *bucket = Vector_get(set->buckets, ibucket);
-    if (!(val = malloc(set->key_info.key_size))) {
+    struct SetBucket *bucket = _Set_bucket(set->buckets, hash);
+    if (!(val = Arena_malloc(set->arena, set->key_info.key_size))) {
       goto error;
     }
-    if (!Vector_add(bucket->items, &val)) {
-      val = NULL;
-      goto error_buckets;
+    struct SetItem item = {hash, val};
+    if (!_Set_bucket_add(set->arena, bucket, &item)) {
+      goto error_val;
     }
     set->count++;
+    set->version++;
   }
   // Overwrite any key for good measure.
   memcpy(val, key, set->key_info.key_size);
 
   // Have we grown too big?
   if (set->count > set->capacity) {
-    if (!Set_resize(set, set->capacity << 1)) {
+    if (!_Set_start_rehash(set, set->capacity << 1)) {
       // Print an error and ignore
       fprintf(stderr, "Unable to expand capacity of set to %016llx",
               (unsigned long long)(set->capacity << 1));
     }
   }
   return val;
-error_buckets:
-  free(val);
+error_val:
+  Arena_release(set->arena, val);
 error:
   return NULL;
 }
 
-const void *_Set_find_ext(const Set *set, const void *key, int hash) {
-  ASSERT(set != NULL);
-  ASSERT(key != NULL);
-
-  size_t ibucket = hash % set->capacity;
-  struct SetBucket *bucket = Vector_get(set->buckets, ibucket);
-  size_t nitems = Vector_count(bucket->items);
+// Finds the index of `key' in `bucket', or returns -1.
+long long _Set_bucket_find(const Set *set, const struct SetBucket *bucket,
+                           const void *key, uint64_t hash) {
+  size_t nitems = _Set_bucket_size(bucket);
   for (size_t i = 0; i < nitems; i++) {
-    void **ptrval = Vector_get(bucket->items, i);
-    int ihash = _Set_hash(set, *ptrval);
-    if (ihash == hash && set->key_info.eq_fn(*ptrval, key)) {
-      return *ptrval;
+    struct SetItem *item = Vector_get(bucket->items, i);
+    if (item->hash == hash && set->key_info.eq_fn(item->value, key)) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// Finds the bucket holding `key' in whichever bucket vector it lives in, and
+// stores its index in the bucket. Returns NULL if not found.
+struct SetBucket *_Set_lookup(const Set *set, const void *key, uint64_t hash,
+                              long long *index_out) {
+  struct SetBucket *bucket;
+  if (!set->buckets) {
+    return NULL;
+  }
+  bucket = _Set_bucket(set->buckets, hash);
+  if ((*index_out = _Set_bucket_find(set, bucket, key, hash)) != -1) {
+    return bucket;
+  }
+  if (set->old_buckets) {
+    bucket = _Set_bucket(set->old_buckets, hash);
+    if ((*index_out = _Set_bucket_find(set, bucket, key, hash)) != -1) {
+      return bucket;
     }
   }
   return NULL;
 }
 
+const void *_Set_find_ext(const Set *set, const void *key, uint64_t hash) {
+  ASSERT(set != NULL);
+  ASSERT(key != NULL);
+
+  long long index;
+  struct SetBucket *bucket;
+  if (!(bucket = _Set_lookup(set, key, hash, &index))) {
+    return NULL;
+  }
+  return ((struct SetItem *)Vector_get(bucket->items, index))->value;
+}
+
 // Looks up the value in set and stores the data in the given location.
 // Returns whether successful.
 bool Set_get(Set *set, const void *key, void *data_out) {
   ASSERT(set != NULL);
   ASSERT(key != NULL);
 
-  KeyValuePair null_kvp = {NULL, NULL};
   const void *val;
-  int hash = _Set_hash(set, key);
+  uint64_t hash = _Set_hash(set, key);
   if (!(val = _Set_find_ext(set, key, hash))) {
     return false;
   }
@@ -246,14 +409,20 @@ bool Set_get(Set *set, const void *key, void *data_out) {
 
 // Checks whether the given key exists in the set.
 bool Set_contains(const Set *set, const void *key) {
+  ASSERT(set != NULL);
+  ASSERT(key != NULL);
 
-  KeyValuePair null_kvp = {NULL, NULL};
-  const void *val;
-  int hash = _Set_hash(set, key);
-  if (!(val = _Set_find_ext(set, key, hash))) {
-    return false;
-  }
-  return true;
+  uint64_t hash = _Set_hash(set, key);
+  return _Set_find_ext(set, key, hash) != NULL;
+}
+
+// Removes item `index' from `bucket'.
+void _Set_bucket_remove(Set *set, struct SetBucket *bucket, size_t index) {
+  Arena_release(set->arena,
+                ((struct SetItem *)Vector_get(bucket->items, index))->value);
+  Vector_remove(bucket->items, index);
+  set->count--;
+  set->version++;
 }
 
 // Removes an item from the set.
@@ -261,19 +430,15 @@ void Set_delete(Set *set, const void *key) {
   ASSERT(set != NULL);
   ASSERT(key != NULL);
 
-  int hash = _Set_hash(set, key);
-  size_t ibucket = hash % set->capacity;
-  struct SetBucket *bucket = Vector_get(set->buckets, ibucket);
-  size_t nitems = Vector_count(bucket->items);
-  for (size_t i = 0; i < nitems; i++) {
-    void **ptrval = Vector_get(bucket->items, i);
-    int ihash = _Set_hash(set, *ptrval);
-    if (ihash == hash && set->key_info.eq_fn(*ptrval, key)) {
-      free(*ptrval);
-      Vector_remove(bucket->items, i);
-      set->count--;
-      return;
-    }
+  if (!set->buckets) {
+    return;
+  }
+  _Set_rehash_step(set, SET_REHASH_STEP);
+  long long index;
+  uint64_t hash = _Set_hash(set, key);
+  struct SetBucket *bucket;
+  if ((bucket = _Set_lookup(set, key, hash, &index))) {
+    _Set_bucket_remove(set, bucket, index);
   }
 }
 
@@ -283,18 +448,23 @@ void Set_clear(Set *set) {
   ASSERT(set != NULL);
 
   struct SetBucket *bucket;
-  Vector *items;
-  void **ptrval;
-  for (size_t i = 0; i < set->capacity; i++) {
-    bucket = Vector_get(set->buckets, i);
-    items = bucket->items;
-    size_t nitems = Vector_count(items);
+  struct SetItem *item;
+  for (size_t i = 0; i < _Set_bucket_count(set); i++) {
+    bucket = _Set_bucket_at(set, i);
+    size_t nitems = _Set_bucket_size(bucket);
     for (size_t j = 0; j < nitems; j++) {
-      ptrval = Vector_get(items, j);
-      free(*ptrval);
+      item = Vector_get(bucket->items, j);
+      Arena_release(set->arena, item->value);
+    }
+    if (bucket->items) {
+      Vector_clear(bucket->items);
     }
-    Vector_clear(items);
   }
+  _Set_free_buckets(set->old_buckets);
+  set->old_buckets = NULL;
+  set->rehash_index = 0;
+  set->count = 0;
+  set->version++;
 }
 
 // Copies a set. Returns whether successful.
@@ -306,18 +476,7 @@ bool Set_copy(Set *dest_set, const Set *set) {
   if (!Set_resize(dest_set, set->capacity)) {
     return false;
   }
-  void **ptrval;
-  for (size_t i = 0; i < set->capacity; i++) {
-    struct SetBucket *bucket = Vector_get(set->buckets, i);
-    size_t nitems = Vector_count(bucket->items);
-    for (size_t j = 0; j < nitems; j++) {
-      ptrval = Vector_get(bucket->items, j);
-      if (!Set_add(dest_set, *ptrval)) {
-        return false;
-      }
-    }
-  }
-  return true;
+  return Set_union_with(dest_set, set);
 }
 
 // Creates the union of two sets.
@@ -326,23 +485,25 @@ bool Set_union(Set *dest_set, const Set *a, const Set *b) {
   ASSERT(a != NULL);
   ASSERT(b != NULL);
 
-  void **ptrval;
-  for (size_t i = 0; i < a->capacity; i++) {
-    struct SetBucket *bucket = Vector_get(a->buckets, i);
-    size_t nitems = Vector_count(bucket->items);
+  struct SetItem *item;
+  for (size_t i = 0; i < _Set_bucket_count(a); i++) {
+    struct SetBucket *bucket = _Set_bucket_at(a, i);
+    size_t nitems = _Set_bucket_size(bucket);
     for (size_t j = 0; j < nitems; j++) {
-      ptrval = Vector_get(bucket->items, j);
-      if (!Set_add(dest_set, *ptrval)) {
+      item = Vector_get(bucket->items, j);
+      if (!_Set_add_ext(dest_set, item->value,
+                        _Set_item_hash(dest_set, a, item))) {
         return false;
       }
     }
   }
-  for (size_t i = 0; i < b->capacity; i++) {
-    struct SetBucket *bucket = Vector_get(b->buckets, i);
-    size_t nitems = Vector_count(bucket->items);
+  for (size_t i = 0; i < _Set_bucket_count(b); i++) {
+    struct SetBucket *bucket = _Set_bucket_at(b, i);
+    size_t nitems = _Set_bucket_size(bucket);
     for (size_t j = 0; j < nitems; j++) {
-      ptrval = Vector_get(bucket->items, j);
-      if (!Set_add(dest_set, *ptrval)) {
+      item = Vector_get(bucket->items, j);
+      if (!_Set_add_ext(dest_set, item->value,
+                        _Set_item_hash(dest_set, b, item))) {
         return false;
       }
     }
@@ -356,15 +517,16 @@ bool Set_intersection(Set *dest_set, const Set *a, const Set *b) {
   ASSERT(a != NULL);
   ASSERT(b != NULL);
 
-  void **ptrval;
-  for (size_t i = 0; i < a->capacity; i++) {
-    struct SetBucket *bucket = Vector_get(a->buckets, i);
-    size_t nitems = Vector_count(bucket->items);
+  struct SetItem *item;
+  for (size_t i = 0; i < _Set_bucket_count(a); i++) {
+    struct SetBucket *bucket = _Set_bucket_at(a, i);
+    size_t nitems = _Set_bucket_size(bucket);
     for (size_t j = 0; j < nitems; j++) {
-      ptrval = Vector_get(bucket->items, j);
-      if (!Set_contains(b, *ptrval))
+      item = Vector_get(bucket->items, j);
+      if (!_Set_find_ext(b, item->value, _Set_item_hash(b, a, item)))
         continue;
-      if (!Set_add(dest_set, *ptrval)) {
+      if (!_Set_add_ext(dest_set, item->value,
+                        _Set_item_hash(dest_set, a, item))) {
         return false;
       }
     }
@@ -378,15 +540,16 @@ bool Set_difference(Set *dest_set, const Set *a, const Set *b) {
   ASSERT(a != NULL);
   ASSERT(b != NULL);
 
-  void **ptrval;
-  for (size_t i = 0; i < a->capacity; i++) {
-    struct SetBucket *bucket = Vector_get(a->buckets, i);
-    size_t nitems = Vector_count(bucket->items);
+  struct SetItem *item;
+  for (size_t i = 0; i < _Set_bucket_count(a); i++) {
+    struct SetBucket *bucket = _Set_bucket_at(a, i);
+    size_t nitems = _Set_bucket_size(bucket);
     for (size_t j = 0; j < nitems; j++) {
-      ptrval = Vector_get(bucket->items, j);
-      if (Set_contains(b, *ptrval))
+      item = Vector_get(bucket->items, j);
+      if (_Set_find_ext(b, item->value, _Set_item_hash(b, a, item)))
         continue;
-      if (!Set_add(dest_set, *ptrval)) {
+      if (!_Set_add_ext(dest_set, item->value,
+                        _Set_item_hash(dest_set, a, item))) {
         return false;
       }
     }
@@ -400,32 +563,7 @@ bool Set_symmetric_difference(Set *dest_set, const Set *a, const Set *b) {
   ASSERT(a != NULL);
   ASSERT(b != NULL);
 
-  void **ptrval;
-  for (size_t i = 0; i < a->capacity; i++) {
-    struct SetBucket *bucket = Vector_get(a->buckets, i);
-    size_t nitems = Vector_count(bucket->items);
-    for (size_t j = 0; j < nitems; j++) {
-      ptrval = Vector_get(bucket->items, j);
-      if (Set_contains(b, *ptrval))
-        continue;
-      if (!Set_add(dest_set, *ptrval)) {
-        return false;
-      }
-    }
-  }
-  for (size_t i = 0; i < b->capacity; i++) {
-    struct SetBucket *bucket = Vector_get(b->buckets, i);
-    size_t nitems = Vector_count(bucket->items);
-    for (size_t j = 0; j < nitems; j++) {
-      ptrval = Vector_get(bucket->items, j);
-      if (Set_contains(a, *ptrval))
-        continue;
-      if (!Set_add(dest_set, *ptrval)) {
-        return false;
-      }
-    }
-  }
-  return true;
+  return Set_difference(dest_set, a, b) && Set_difference(dest_set, b, a);
 }
 
 // Stores the union of two sets into the first set.
@@ -433,13 +571,14 @@ bool Set_union_with(Set *dest_set, const Set *set) {
   ASSERT(dest_set != NULL);
   ASSERT(set != NULL);
 
-  void **ptrval;
-  for (size_t i = 0; i < set->capacity; i++) {
-    struct SetBucket *bucket = Vector_get(set->buckets, i);
-    size_t nitems = Vector_count(bucket->items);
+  struct SetItem *item;
+  for (size_t i = 0; i < _Set_bucket_count(set); i++) {
+    struct SetBucket *bucket = _Set_bucket_at(set, i);
+    size_t nitems = _Set_bucket_size(bucket);
     for (size_t j = 0; j < nitems; j++) {
-      ptrval = Vector_get(bucket->items, j);
-      if (!Set_add(dest_set, *ptrval)) {
+      item = Vector_get(bucket->items, j);
+      if (!_Set_add_ext(dest_set, item->value,
+                        _Set_item_hash(dest_set, set, item))) {
         return false;
       }
     }
@@ -452,15 +591,16 @@ bool Set_intersect_with(Set *dest_set, const Set *set) {
   ASSERT(dest_set != NULL);
   ASSERT(set != NULL);
 
-  void **ptrval;
-  for (size_t i = 0; i < dest_set->capacity; i++) {
-    struct SetBucket *bucket = Vector_get(dest_set->buckets, i);
+  struct SetItem *item;
+  for (size_t i = 0; i < _Set_bucket_count(dest_set); i++) {
+    struct SetBucket *bucket = _Set_bucket_at(dest_set, i);
     for (size_t j = 0;
-         j < Vector_count(bucket->items) /* inline due to modification */; j++) {
-      ptrval = Vector_get(bucket->items, j);
-      if (!Set_contains(set, *ptrval)) {
-        free(*ptrval);
-        Vector_remove(bucket->items, j-- /* j doesn't change after removal */);
+         j < _Set_bucket_size(bucket) /* inline due to modification */; j++) {
+      item = Vector_get(bucket->items, j);
+      if (!_Set_find_ext(set, item->value,
+                         _Set_item_hash(set, dest_set, item))) {
+        _Set_bucket_remove(dest_set, bucket,
+                           j-- /* j doesn't change after removal */);
       }
     }
   }
@@ -472,15 +612,16 @@ bool Set_difference_with(Set *dest_set, const Set *set) {
   ASSERT(dest_set != NULL);
   ASSERT(set != NULL);
 
-  void **ptrval;
-  for (size_t i = 0; i < dest_set->capacity; i++) {
-    struct SetBucket *bucket = Vector_get(dest_set->buckets, i);
+  struct SetItem *item;
+  for (size_t i = 0; i < _Set_bucket_count(dest_set); i++) {
+    struct SetBucket *bucket = _Set_bucket_at(dest_set, i);
     for (size_t j = 0;
-         j < Vector_count(bucket->items) /* inline due to modification */; j++) {
-      ptrval = Vector_get(bucket->items, j);
-      if (Set_contains(set, *ptrval)) {
-        free(*ptrval);
-        Vector_remove(bucket->items, j-- /* j doesn't change after removal */);
+         j < _Set_bucket_size(bucket) /* inline due to modification */; j++) {
+      item = Vector_get(bucket->items, j);
+      if (_Set_find_ext(set, item->value,
+                        _Set_item_hash(set, dest_set, item))) {
+        _Set_bucket_remove(dest_set, bucket,
+                           j-- /* j doesn't change after removal */);
       }
     }
   }
@@ -492,16 +633,18 @@ bool Set_symmetric_difference_with(Set *dest_set, const Set *set) {
   ASSERT(dest_set != NULL);
   ASSERT(set != NULL);
 
-  void **ptrval;
-  for (size_t i = 0; i < set->capacity; i++) {
-    struct SetBucket *bucket = Vector_get(set->buckets, i);
-    size_t nitems = Vector_count(bucket->items);
+  struct SetItem *item;
+  for (size_t i = 0; i < _Set_bucket_count(set); i++) {
+    struct SetBucket *bucket = _Set_bucket_at(set, i);
+    size_t nitems = _Set_bucket_size(bucket);
     for (size_t j = 0; j < nitems; j++) {
-      ptrval = Vector_get(bucket->items, j);
-      if (Set_contains(dest_set, *ptrval)) {
-        Set_delete(dest_set, *ptrval);
+      item = Vector_get(bucket->items, j);
+      if (_Set_find_ext(dest_set, item->value,
+                        _Set_item_hash(dest_set, set, item))) {
+        Set_delete(dest_set, item->value);
       } else {
-        if (!Set_add(dest_set, *ptrval)) {
+        if (!_Set_add_ext(dest_set, item->value,
+                          _Set_item_hash(dest_set, set, item))) {
           return false;
         }
       }
@@ -521,12 +664,12 @@ void *Set_iter_current_(const Iterator *iter) {
   ASSERT(set != NULL);
   ASSERT(iter->version == set->version &&
          "Collection changed while iterating.");
-  if (Set_iter_eof_(iter)) {
+  if (Set_iter_eof_(iter) || iter->impl_data1 < 0) {
     return NULL;
   }
-  return Vector_get(
-      ((struct SetBucket *)Vector_get(set->buckets, iter->impl_data1))->items,
-      iter->impl_data2);
+  return ((struct SetItem *)Vector_get(
+              _Set_bucket_at(set, iter->impl_data1)->items, iter->impl_data2))
+      ->value;
 }
 
 bool Set_iter_eof_(const Iterator *iter) {
@@ -536,7 +679,8 @@ bool Set_iter_eof_(const Iterator *iter) {
   ASSERT(set != NULL);
   ASSERT(iter->version == set->version &&
          "Collection changed while iterating.");
-  return Set_empty(set) || iter->impl_data1 >= (int)set->capacity;
+  return Set_empty(set) ||
+         iter->impl_data1 >= (long long)_Set_bucket_count(set);
 }
 
 bool Set_iter_move_next_(Iterator *iter) {
@@ -551,9 +695,8 @@ bool Set_iter_move_next_(Iterator *iter) {
   }
   iter->impl_data2++;
   while (iter->impl_data1 == -1 ||
-         iter->impl_data2 >= Vector_count(((struct SetBucket *)Vector_get(
-                                            set->buckets, iter->impl_data1))
-                                           ->items)) {
+         iter->impl_data2 >=
+             _Set_bucket_size(_Set_bucket_at(set, iter->impl_data1))) {
     iter->impl_data1++;
     iter->impl_data2 = 0;
     if (Set_iter_eof_(iter))
@@ -567,7 +710,7 @@ void Set_get_iterator(const Set *set, Iterator *iter) {
   ASSERT(set != NULL);
   ASSERT(iter != NULL);
 
-  iter->collection_type = COLLECTION_MAP;
+  iter->collection_type = COLLECTION_SET;
   iter->collection = (void *)set;
   iter->elem_size = set->key_info.key_size;
   iter->current = Set_iter_current_;
@@ -575,5 +718,5 @@ void Set_get_iterator(const Set *set, Iterator *iter) {
   iter->eof = Set_iter_eof_;
   iter->impl_data1 = -1;
   iter->impl_data2 = 0;
-  iter->version = 0;
+  iter->version = set->version;
 }
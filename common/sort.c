@@ -0,0 +1,234 @@
+#include "public/sort.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "public/array.h"
+#include "public/assert.h"
+#include "public/iterator.h"
+#include "public/thread_pool.h"
+#include "public/vector.h"
+
+// Flips IEEE 754 bits so they order as unsigned integers: negative numbers
+// have every bit flipped, positive numbers just the sign bit.
+static inline uint32_t _Sort_float_key(float f) {
+  uint32_t bits;
+  memcpy(&bits, &f, sizeof(bits));
+  return bits ^ (-(bits >> 31) | 0x80000000u);
+}
+
+static inline uint64_t _Sort_double_key(double d) {
+  uint64_t bits;
+  memcpy(&bits, &d, sizeof(bits));
+  return bits ^ (-(bits >> 63) | 0x8000000000000000ull);
+}
+
+DEFINE_INTEGER_SORT(Char, char, unsigned char)
+DEFINE_INTEGER_SORT(Short, short, unsigned short)
+DEFINE_INTEGER_SORT(Int, int, unsigned int)
+DEFINE_INTEGER_SORT(Long, long, unsigned long)
+DEFINE_INTEGER_SORT(UnsignedChar, unsigned char, unsigned char)
+DEFINE_INTEGER_SORT(UnsignedShort, unsigned short, unsigned short)
+DEFINE_INTEGER_SORT(UnsignedInt, unsigned int, unsigned int)
+DEFINE_INTEGER_SORT(UnsignedLong, unsigned long, unsigned long)
+DEFINE_RADIX_SORT(Float, float, uint32_t, _Sort_float_key(x))
+DEFINE_RADIX_SORT(Double, double, uint64_t, _Sort_double_key(x))
+DEFINE_INTROSORT(LongDouble, long double, a < b)
+DEFINE_INTROSORT(CString, char *, strcmp(a, b) < 0)
+DEFINE_INTROSORT(CStringCase, char *, strcasecmp(a, b) < 0)
+
+// The comparison functions each kernel stands in for.
+static const struct {
+  int (*compare_fn)(const void *a, const void *b);
+  size_t elem_size;
+  SortFn sort;
+} _Sort_kernels[] = {
+    {Char_compare, sizeof(char), (SortFn)Char_sort},
+    {Short_compare, sizeof(short), (SortFn)Short_sort},
+    {Int_compare, sizeof(int), (SortFn)Int_sort},
+    {Long_compare, sizeof(long), (SortFn)Long_sort},
+    {Float_compare, sizeof(float), (SortFn)Float_sort},
+    {Double_compare, sizeof(double), (SortFn)Double_sort},
+    {LongDouble_compare, sizeof(long double), (SortFn)LongDouble_sort},
+    {UnsignedChar_compare, sizeof(unsigned char), (SortFn)UnsignedChar_sort},
+    {UnsignedShort_compare, sizeof(unsigned short),
+     (SortFn)UnsignedShort_sort},
+    {UnsignedInt_compare, sizeof(unsigned int), (SortFn)UnsignedInt_sort},
+    {UnsignedLong_compare, sizeof(unsigned long), (SortFn)UnsignedLong_sort},
+    {CString_compare, sizeof(char *), (SortFn)CString_sort},
+    {CStringCase_compare, sizeof(char *), (SortFn)CStringCase_sort},
+};
+
+SortFn Sort_find_kernel(int (*compare_fn)(const void *a, const void *b),
+                        size_t elem_size) {
+  for (size_t i = 0; i < sizeof(_Sort_kernels) / sizeof(_Sort_kernels[0]);
+       i++) {
+    if (_Sort_kernels[i].compare_fn == compare_fn &&
+        _Sort_kernels[i].elem_size == elem_size) {
+      return _Sort_kernels[i].sort;
+    }
+  }
+  return NULL;
+}
+
+void Sort_data(void *data, size_t count, size_t elem_size,
+               int (*compare_fn)(const void *a, const void *b)) {
+  if (!data || count < 2) {
+    return;
+  }
+  SortFn sort = Sort_find_kernel(compare_fn, elem_size);
+  if (sort) {
+    sort(data, count);
+  } else {
+    qsort(data, count, elem_size, compare_fn);
+  }
+}
+
+// One pass of a parallel sort: sorting the runs of `width' elements in
+// `from', or merging pairs of them into `to'.
+struct _SortRuns {
+  unsigned char *from;
+  unsigned char *to;
+  size_t count;
+  size_t elem_size;
+  size_t width;
+  int (*compare_fn)(const void *a, const void *b);
+};
+
+static void _Sort_runs(void *arg, size_t begin, size_t end) {
+  struct _SortRuns *runs = arg;
+  for (size_t run = begin; run < end; run++) {
+    size_t start = run * runs->width;
+    if (start >= runs->count) {
+      break;
+    }
+    size_t stop = runs->count - start > runs->width ? start + runs->width
+                                                    : runs->count;
+    Sort_data(runs->from + start * runs->elem_size, stop - start,
+              runs->elem_size, runs->compare_fn);
+  }
+}
+
+// Gets how many of the first `k' elements of the merge of `a' and `b' come
+// from `a', which wins ties.
+static size_t _Sort_co_rank(const struct _SortRuns *runs, size_t k,
+                            const unsigned char *a, size_t a_count,
+                            const unsigned char *b, size_t b_count) {
+  size_t size = runs->elem_size;
+  size_t lo = k > b_count ? k - b_count : 0;
+  size_t hi = k < a_count ? k : a_count;
+  while (lo < hi) {
+    size_t i = lo + (hi - lo) / 2;
+    if (runs->compare_fn(a + i * size, b + (k - i - 1) * size) > 0) {
+      hi = i;
+    } else {
+      lo = i + 1;
+    }
+  }
+  return lo;
+}
+
+// Writes elements [begin, end) of the merged output. A slice can start or end
+// in the middle of a merge; each end is found by binary search, so the
+// threads split even a single merge evenly.
+static void _Sort_merge(void *arg, size_t begin, size_t end) {
+  struct _SortRuns *runs = arg;
+  size_t size = runs->elem_size;
+  size_t pair = 2 * runs->width;
+  while (begin < end) {
+    size_t start = begin - begin % pair;
+    size_t mid = runs->count - start > runs->width ? start + runs->width
+                                                   : runs->count;
+    size_t stop = runs->count - start > pair ? start + pair : runs->count;
+    size_t out_end = end < stop ? end : stop;
+    const unsigned char *a = runs->from + start * size;
+    const unsigned char *b = runs->from + mid * size;
+    size_t a_count = mid - start, b_count = stop - mid;
+    size_t i = _Sort_co_rank(runs, begin - start, a, a_count, b, b_count);
+    size_t j = begin - start - i;
+    size_t i_end = _Sort_co_rank(runs, out_end - start, a, a_count, b, b_count);
+    size_t j_end = out_end - start - i_end;
+    unsigned char *out = runs->to + begin * size;
+    while (i < i_end && j < j_end) {
+      if (runs->compare_fn(b + j * size, a + i * size) < 0) {
+        memcpy(out, b + j++ * size, size);
+      } else {
+        memcpy(out, a + i++ * size, size);
+      }
+      out += size;
+    }
+    memcpy(out, a + i * size, (i_end - i) * size);
+    out += (i_end - i) * size;
+    memcpy(out, b + j * size, (j_end - j) * size);
+    begin = out_end;
+  }
+}
+
+static void _Sort_copy(void *arg, size_t begin, size_t end) {
+  struct _SortRuns *runs = arg;
+  memcpy(runs->to + begin * runs->elem_size,
+         runs->from + begin * runs->elem_size,
+         (end - begin) * runs->elem_size);
+}
+
+void Indexer_parallel_sort(const Indexer *indexer,
+                           int (*compare_fn)(const void *a, const void *b),
+                           ThreadPool *pool) {
+  ASSERT(indexer != NULL);
+  ASSERT(indexer->collection_type & (COLLECTION_ARRAY | COLLECTION_VECTOR));
+  void *data = NULL;
+  switch (indexer->collection_type) {
+  case COLLECTION_VECTOR:
+    data = Vector_get_data((Vector *)indexer->collection);
+    break;
+  case COLLECTION_ARRAY:
+    data = Array_get_data((Array *)indexer->collection);
+    break;
+  default:
+    return; // not supported
+  }
+  size_t count = indexer->size(indexer);
+  size_t size = indexer->elem_size;
+  ThreadPool *own_pool = NULL;
+  unsigned char *scratch = NULL;
+  if (!data || count < SORT_PARALLEL_THRESHOLD) {
+    goto sequential;
+  }
+  if (!pool && !(pool = own_pool = ThreadPool_alloc(0, 64))) {
+    goto sequential;
+  }
+  if (!(scratch = malloc(count * size))) {
+    goto sequential;
+  }
+
+  // One run per thread, including the calling one, rounded up to a power of
+  // 2 so the merges pair off evenly.
+  size_t threads = ThreadPool_thread_count(pool) + 1;
+  size_t run_count = 2;
+  while (run_count < threads) {
+    run_count <<= 1;
+  }
+  struct _SortRuns runs = {data, scratch, count, size,
+                           (count + run_count - 1) / run_count, compare_fn};
+  ThreadPool_parallel_for(pool, 0, run_count, 1, _Sort_runs, &runs);
+  for (; runs.width < count; runs.width *= 2) {
+    ThreadPool_parallel_for(pool, 0, count, 0, _Sort_merge, &runs);
+    unsigned char *swap = runs.from;
+    runs.from = runs.to;
+    runs.to = swap;
+  }
+  if (runs.from != data) {
+    ThreadPool_parallel_for(pool, 0, count, 0, _Sort_copy, &runs);
+  }
+  goto out;
+
+sequential:
+  Sort_data(data, count, size, compare_fn);
+out:
+  free(scratch);
+  if (own_pool) {
+    ThreadPool_free(own_pool);
+  }
+}
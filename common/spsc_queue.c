@@ -0,0 +1,379 @@
+#include "protected/spsc_queue.h"
+
+#include <sched.h>
+#include <string.h>
+
+#include "../test/stubs.h"
+#include "public/assert.h"
+
+// Initializes a pre-allocated SpscQueue object
+bool SpscQueue_init(SpscQueue *queue, size_t elem_size, size_t capacity,
+                    WaitPolicy wait) {
+  ASSERT(queue != NULL);
+  ASSERT(elem_size > 0);
+  ASSERT(capacity > 0);
+
+  size_t rounded = 1;
+  while (rounded < capacity) {
+    rounded <<= 1;
+  }
+  if ((queue->data = CacheLine_alloc(rounded * elem_size)) == NULL) {
+    return false;
+  }
+  atomic_init(&queue->head, 0);
+  queue->tail_cache = 0;
+  atomic_init(&queue->consumer_sleeping, false);
+  atomic_init(&queue->tail, 0);
+  queue->head_cache = 0;
+  atomic_init(&queue->producer_sleeping, false);
+  queue->elem_size = elem_size;
+  queue->capacity = rounded;
+  queue->mask = rounded - 1;
+  queue->wait = wait;
+  atomic_init(&queue->closed, false);
+  pthread_mutex_init(&queue->lock, NULL);
+  pthread_cond_init(&queue->not_empty, NULL);
+  pthread_cond_init(&queue->not_full, NULL);
+  return true;
+}
+
+void SpscQueue_cleanup(SpscQueue *queue) {
+  ASSERT(queue != NULL);
+  CacheLine_free(queue->data);
+  queue->data = NULL;
+  pthread_mutex_destroy(&queue->lock);
+  pthread_cond_destroy(&queue->not_empty);
+  pthread_cond_destroy(&queue->not_full);
+}
+
+SpscQueue *SpscQueue_alloc(size_t elem_size, size_t capacity) {
+  return SpscQueue_alloc_ext(elem_size, capacity, WAIT_SPIN);
+}
+
+SpscQueue *SpscQueue_alloc_ext(size_t elem_size, size_t capacity,
+                               WaitPolicy wait) {
+  SpscQueue *queue;
+  if (NULL == (queue = CacheLine_alloc(sizeof(SpscQueue)))) {
+    return NULL;
+  }
+  if (!SpscQueue_init(queue, elem_size, capacity, wait)) {
+    CacheLine_free(queue);
+    return NULL;
+  }
+  return queue;
+}
+
+void SpscQueue_free(SpscQueue *queue) {
+  ASSERT(queue != NULL);
+  SpscQueue_cleanup(queue);
+  CacheLine_free(queue);
+}
+
+size_t SpscQueue_element_size(const SpscQueue *queue) {
+  ASSERT(queue != NULL);
+  return queue->elem_size;
+}
+
+size_t SpscQueue_capacity(const SpscQueue *queue) {
+  ASSERT(queue != NULL);
+  return queue->capacity;
+}
+
+size_t SpscQueue_count(const SpscQueue *queue) {
+  ASSERT(queue != NULL);
+  size_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+  size_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+  return tail - head;
+}
+
+bool SpscQueue_empty(const SpscQueue *queue) {
+  return SpscQueue_count(queue) == 0;
+}
+
+// Wakes the other side if it has gone to sleep. The fence pairs with the one
+// in _SpscQueue_wait: either the sleeper sees our counter, or we see its flag.
+static void _SpscQueue_wake(SpscQueue *queue, atomic_bool *sleeping,
+                            pthread_cond_t *cond) {
+  if (queue->wait != WAIT_BLOCK) {
+    return;
+  }
+  atomic_thread_fence(memory_order_seq_cst);
+  if (atomic_load_explicit(sleeping, memory_order_relaxed)) {
+    pthread_mutex_lock(&queue->lock);
+    pthread_cond_signal(cond);
+    pthread_mutex_unlock(&queue->lock);
+  }
+}
+
+static bool _SpscQueue_readable(SpscQueue *queue) {
+  return atomic_load_explicit(&queue->tail, memory_order_acquire) !=
+         atomic_load_explicit(&queue->head, memory_order_relaxed);
+}
+
+static bool _SpscQueue_writable(SpscQueue *queue) {
+  return atomic_load_explicit(&queue->tail, memory_order_relaxed) -
+             atomic_load_explicit(&queue->head, memory_order_acquire) <
+         queue->capacity;
+}
+
+// Waits until `ready' holds. Returns false, without waiting any longer, if the
+// queue is closed.
+static bool _SpscQueue_wait(SpscQueue *queue, bool (*ready)(SpscQueue *),
+                            atomic_bool *sleeping, pthread_cond_t *cond) {
+  for (int spins = 0;; spins++) {
+    if (ready(queue)) {
+      return true;
+    }
+    if (atomic_load_explicit(&queue->closed, memory_order_acquire)) {
+      return false;
+    }
+    if (spins < SPIN_LIMIT) {
+      cpu_relax();
+    } else if (queue->wait == WAIT_SPIN) {
+      sched_yield();
+    } else {
+      break;
+    }
+  }
+  pthread_mutex_lock(&queue->lock);
+  atomic_store_explicit(sleeping, true, memory_order_relaxed);
+  atomic_thread_fence(memory_order_seq_cst);
+  bool ready_now;
+  while (!(ready_now = ready(queue)) &&
+         !atomic_load_explicit(&queue->closed, memory_order_acquire)) {
+    pthread_cond_wait(cond, &queue->lock);
+  }
+  atomic_store_explicit(sleeping, false, memory_order_relaxed);
+  pthread_mutex_unlock(&queue->lock);
+  return ready_now;
+}
+
+// Copies `count' elements between `buffer' and the ring starting at slot
+// `position', wrapping around the end of the ring if need be.
+static void _SpscQueue_copy(SpscQueue *queue, size_t position, void *buffer,
+                            size_t count, bool into_ring) {
+  size_t index = position & queue->mask;
+  size_t first = queue->capacity - index;
+  if (first > count) {
+    first = count;
+  }
+  unsigned char *ring = queue->data + index * queue->elem_size;
+  unsigned char *rest = (unsigned char *)buffer + first * queue->elem_size;
+  if (into_ring) {
+    memcpy(ring, buffer, first * queue->elem_size);
+    memcpy(queue->data, rest, (count - first) * queue->elem_size);
+  } else {
+    memcpy(buffer, ring, first * queue->elem_size);
+    memcpy(rest, queue->data, (count - first) * queue->elem_size);
+  }
+}
+
+size_t SpscQueue_enqueue_n(SpscQueue *queue, const void *data, size_t count) {
+  ASSERT(queue != NULL);
+  ASSERT(data != NULL || count == 0);
+
+  size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+  size_t room = queue->capacity - (tail - queue->head_cache);
+  if (room < count) {
+    queue->head_cache = atomic_load_explicit(&queue->head, memory_order_acquire);
+    room = queue->capacity - (tail - queue->head_cache);
+  }
+  if (count > room) {
+    count = room;
+  }
+  if (count == 0) {
+    return 0;
+  }
+  _SpscQueue_copy(queue, tail, (void *)data, count, true);
+  atomic_store_explicit(&queue->tail, tail + count, memory_order_release);
+  _SpscQueue_wake(queue, &queue->consumer_sleeping, &queue->not_empty);
+  return count;
+}
+
+bool SpscQueue_enqueue(SpscQueue *queue, const void *data) {
+  ASSERT(data != NULL);
+  return SpscQueue_enqueue_n(queue, data, 1) == 1;
+}
+
+size_t SpscQueue_enqueue_n_wait(SpscQueue *queue, const void *data,
+                                size_t count) {
+  ASSERT(queue != NULL);
+  size_t added = 0;
+  while (added < count) {
+    added += SpscQueue_enqueue_n(
+        queue, (const unsigned char *)data + added * queue->elem_size,
+        count - added);
+    if (added < count &&
+        !_SpscQueue_wait(queue, _SpscQueue_writable, &queue->producer_sleeping,
+                         &queue->not_full)) {
+      break;
+    }
+  }
+  return added;
+}
+
+bool SpscQueue_enqueue_wait(SpscQueue *queue, const void *data) {
+  ASSERT(data != NULL);
+  return SpscQueue_enqueue_n_wait(queue, data, 1) == 1;
+}
+
+void SpscQueue_close(SpscQueue *queue) {
+  ASSERT(queue != NULL);
+  atomic_store_explicit(&queue->closed, true, memory_order_release);
+  pthread_mutex_lock(&queue->lock);
+  pthread_cond_broadcast(&queue->not_empty);
+  pthread_cond_broadcast(&queue->not_full);
+  pthread_mutex_unlock(&queue->lock);
+}
+
+bool SpscQueue_closed(const SpscQueue *queue) {
+  ASSERT(queue != NULL);
+  return atomic_load_explicit(&queue->closed, memory_order_acquire);
+}
+
+// Makes up to `count' elements readable, reloading the producer's counter only
+// if the cached one says there are too few. Returns how many are readable.
+static size_t _SpscQueue_readable_count(SpscQueue *queue, size_t head,
+                                        size_t count) {
+  size_t available = queue->tail_cache - head;
+  if (available < count) {
+    queue->tail_cache = atomic_load_explicit(&queue->tail, memory_order_acquire);
+    available = queue->tail_cache - head;
+  }
+  return available < count ? available : count;
+}
+
+size_t SpscQueue_dequeue_n(SpscQueue *queue, void *data_out, size_t count) {
+  ASSERT(queue != NULL);
+  ASSERT(data_out != NULL || count == 0);
+
+  size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+  if ((count = _SpscQueue_readable_count(queue, head, count)) == 0) {
+    return 0;
+  }
+  _SpscQueue_copy(queue, head, data_out, count, false);
+  atomic_store_explicit(&queue->head, head + count, memory_order_release);
+  _SpscQueue_wake(queue, &queue->producer_sleeping, &queue->not_full);
+  return count;
+}
+
+bool SpscQueue_dequeue(SpscQueue *queue, void *data_out) {
+  ASSERT(data_out != NULL);
+  return SpscQueue_dequeue_n(queue, data_out, 1) == 1;
+}
+
+size_t SpscQueue_dequeue_n_wait(SpscQueue *queue, void *data_out,
+                                size_t count) {
+  ASSERT(queue != NULL);
+  size_t removed;
+  while ((removed = SpscQueue_dequeue_n(queue, data_out, count)) == 0 &&
+         count > 0) {
+    if (!_SpscQueue_wait(queue, _SpscQueue_readable,
+                         &queue->consumer_sleeping, &queue->not_empty)) {
+      // Closed. Anything added before the close is visible now.
+      return SpscQueue_dequeue_n(queue, data_out, count);
+    }
+  }
+  return removed;
+}
+
+bool SpscQueue_dequeue_wait(SpscQueue *queue, void *data_out) {
+  ASSERT(data_out != NULL);
+  return SpscQueue_dequeue_n_wait(queue, data_out, 1) == 1;
+}
+
+bool SpscQueue_peek(SpscQueue *queue, void *data_out) {
+  ASSERT(queue != NULL);
+  ASSERT(data_out != NULL);
+
+  size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+  if (_SpscQueue_readable_count(queue, head, 1) == 0) {
+    return false;
+  }
+  _SpscQueue_copy(queue, head, data_out, 1, false);
+  return true;
+}
+
+// The iterator holds on to the slot at `head' while it is current
+// (impl_data1 == 1), and only releases it to the producer on the next
+// move_next. impl_data2 is set once the queue is closed and drained.
+
+void *SpscQueue_iter_current_(const Iterator *iter);
+bool SpscQueue_iter_eof_(const Iterator *iter);
+bool SpscQueue_iter_move_next_(Iterator *iter);
+
+void *SpscQueue_iter_current_(const Iterator *iter) {
+  ASSERT(iter != NULL);
+  ASSERT(iter->collection_type == COLLECTION_SPSC_QUEUE);
+  SpscQueue *queue = iter->collection;
+  ASSERT(queue != NULL);
+  if (!iter->impl_data1) {
+    return NULL;
+  }
+  size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+  return queue->data + (head & queue->mask) * queue->elem_size;
+}
+
+bool SpscQueue_iter_eof_(const Iterator *iter) {
+  ASSERT(iter != NULL);
+  ASSERT(iter->collection_type == COLLECTION_SPSC_QUEUE);
+  return iter->impl_data2 != 0;
+}
+
+bool SpscQueue_iter_move_next_(Iterator *iter) {
+  ASSERT(iter != NULL);
+  ASSERT(iter->collection_type == COLLECTION_SPSC_QUEUE);
+  SpscQueue *queue = iter->collection;
+  ASSERT(queue != NULL);
+  if (iter->impl_data2) {
+    return false;
+  }
+  size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+  if (iter->impl_data1) {
+    atomic_store_explicit(&queue->head, ++head, memory_order_release);
+    _SpscQueue_wake(queue, &queue->producer_sleeping, &queue->not_full);
+  }
+  while (_SpscQueue_readable_count(queue, head, 1) == 0) {
+    if (!_SpscQueue_wait(queue, _SpscQueue_readable,
+                         &queue->consumer_sleeping, &queue->not_empty) &&
+        _SpscQueue_readable_count(queue, head, 1) == 0) {
+      iter->impl_data1 = 0;
+      iter->impl_data2 = 1;
+      return false;
+    }
+  }
+  iter->impl_data1 = 1;
+  return true;
+}
+
+void SpscQueue_get_iterator(const SpscQueue *queue, Iterator *iter) {
+  ASSERT(queue != NULL);
+  ASSERT(iter != NULL);
+  iter->collection_type = COLLECTION_SPSC_QUEUE;
+  iter->collection = (void *)queue;
+  iter->elem_size = queue->elem_size;
+  iter->current = SpscQueue_iter_current_;
+  iter->eof = SpscQueue_iter_eof_;
+  iter->move_next = SpscQueue_iter_move_next_;
+  iter->impl_data1 = 0; // Whether the slot at head is current
+  iter->impl_data2 = 0; // Whether the queue is closed and drained
+  iter->version = 0;
+}
+
+void *SpscQueue_sink_add_(Sink *sink, const void *elem);
+
+void SpscQueue_get_sink(const SpscQueue *queue, Sink *sink) {
+  ASSERT(queue != NULL);
+  ASSERT(sink != NULL);
+  sink->collection_type = COLLECTION_SPSC_QUEUE;
+  sink->collection = (void *)queue;
+  sink->elem_size = queue->elem_size;
+  sink->add = SpscQueue_sink_add_;
+}
+
+void *SpscQueue_sink_add_(Sink *sink, const void *elem) {
+  ASSERT(sink != NULL);
+  SpscQueue *queue = sink->collection;
+  ASSERT(queue != NULL);
+  return SpscQueue_enqueue_wait(queue, elem) ? (void *)elem : NULL;
+}
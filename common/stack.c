@@ -112,7 +112,7 @@ bool Stack_pop(Stack *stack, void *data_out)
 {
     ASSERT(stack);
     ASSERT(data_out);
-    if (!stack->list || stack->current < 0) return false;
+    if (!stack->list || Stack_empty(stack)) return false;
     memcpy(data_out, (void*)Vector_get(stack->list, stack->current--), stack->elem_size);
     return true;
 }
@@ -121,7 +121,7 @@ bool Stack_peek(const Stack *stack, void *data_out)
 {
     ASSERT(stack);
     ASSERT(data_out);
-    if (!stack->list || stack->current < 0) return false;
+    if (!stack->list || Stack_empty(stack)) return false;
     memcpy(data_out, (void*)Vector_get(stack->list, stack->current), stack->elem_size);
     return true;
 }
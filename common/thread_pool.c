@@ -0,0 +1,414 @@
+#include "protected/thread_pool.h"
+
+#include <sched.h>
+#include <unistd.h>
+
+#include "../test/stubs.h"
+#include "public/assert.h"
+
+// The worker the calling thread is, if any; tasks it submits go on its deque.
+static _Thread_local struct ThreadPoolWorker *_ThreadPool_self = NULL;
+
+// Initializes a pre-allocated WaitGroup object
+bool WaitGroup_init(WaitGroup *group) {
+  ASSERT(group != NULL);
+  atomic_init(&group->pending, 0);
+  group->released = true;
+  pthread_mutex_init(&group->lock, NULL);
+  pthread_cond_init(&group->all_done, NULL);
+  return true;
+}
+
+void WaitGroup_cleanup(WaitGroup *group) {
+  ASSERT(group != NULL);
+  pthread_mutex_destroy(&group->lock);
+  pthread_cond_destroy(&group->all_done);
+}
+
+WaitGroup *WaitGroup_alloc(void) {
+  WaitGroup *group;
+  if (NULL == (group = CacheLine_alloc(sizeof(WaitGroup)))) {
+    return NULL;
+  }
+  if (!WaitGroup_init(group)) {
+    CacheLine_free(group);
+    return NULL;
+  }
+  return group;
+}
+
+void WaitGroup_free(WaitGroup *group) {
+  ASSERT(group != NULL);
+  ASSERT(WaitGroup_pending(group) == 0);
+  WaitGroup_cleanup(group);
+  CacheLine_free(group);
+}
+
+size_t WaitGroup_pending(const WaitGroup *group) {
+  ASSERT(group != NULL);
+  return atomic_load_explicit(&group->pending, memory_order_acquire);
+}
+
+// Only going up from 0 takes the lock; otherwise a waiter could see
+// `released' from the previous round.
+void WaitGroup_add(WaitGroup *group, size_t count) {
+  ASSERT(group != NULL);
+  size_t pending = atomic_load_explicit(&group->pending, memory_order_relaxed);
+  while (pending > 0) {
+    if (atomic_compare_exchange_weak_explicit(&group->pending, &pending,
+                                              pending + count,
+                                              memory_order_relaxed,
+                                              memory_order_relaxed)) {
+      return;
+    }
+  }
+  pthread_mutex_lock(&group->lock);
+  atomic_fetch_add_explicit(&group->pending, count, memory_order_relaxed);
+  group->released = false;
+  pthread_mutex_unlock(&group->lock);
+}
+
+void WaitGroup_done(WaitGroup *group) {
+  ASSERT(group != NULL);
+  if (atomic_fetch_sub_explicit(&group->pending, 1, memory_order_acq_rel) !=
+      1) {
+    return;
+  }
+  pthread_mutex_lock(&group->lock);
+  // Someone may have added more since we reached 0.
+  if (atomic_load_explicit(&group->pending, memory_order_relaxed) == 0) {
+    group->released = true;
+    pthread_cond_broadcast(&group->all_done);
+  }
+  pthread_mutex_unlock(&group->lock);
+}
+
+void WaitGroup_wait(WaitGroup *group) {
+  ASSERT(group != NULL);
+  for (int i = 0; i < SPIN_LIMIT && WaitGroup_pending(group) > 0; i++) {
+    cpu_relax();
+  }
+  pthread_mutex_lock(&group->lock);
+  while (!group->released) {
+    pthread_cond_wait(&group->all_done, &group->lock);
+  }
+  pthread_mutex_unlock(&group->lock);
+}
+
+// Runs a task, after handing its slot back for reuse.
+static void _ThreadPool_run(ThreadPool *pool, struct Task *slot) {
+  struct Task task = *slot;
+  AtomicStack_push(pool->free_tasks, &slot);
+  task.fn(task.arg);
+  if (task.group) {
+    WaitGroup_done(task.group);
+  }
+}
+
+// Finds a task to run: first our own newest, then the oldest submitted from
+// outside, then the oldest of another worker's, starting at a random one.
+static struct Task *_ThreadPool_find_task(ThreadPool *pool,
+                                          struct ThreadPoolWorker *self) {
+  struct Task *task;
+  if (self && (task = WorkDeque_pop(self->deque))) {
+    return task;
+  }
+  if (MpmcQueue_dequeue(pool->injected, &task)) {
+    return task;
+  }
+  size_t start = 0;
+  if (self) {
+    self->seed = self->seed * 1103515245 + 12345;
+    start = (self->seed >> 16) % pool->num_threads;
+  }
+  for (size_t i = 0; i < pool->num_threads; i++) {
+    struct ThreadPoolWorker *victim =
+        &pool->workers[(start + i) % pool->num_threads];
+    if (victim != self && (task = WorkDeque_steal(victim->deque))) {
+      return task;
+    }
+  }
+  return NULL;
+}
+
+static bool _ThreadPool_has_work(const ThreadPool *pool) {
+  if (!MpmcQueue_empty(pool->injected)) {
+    return true;
+  }
+  for (size_t i = 0; i < pool->num_threads; i++) {
+    if (!WorkDeque_empty(pool->workers[i].deque)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Wakes one sleeping worker, if there are any. The fence pairs with the one in
+// _ThreadPool_sleep: either the sleeper sees our task, or we see it sleeping.
+static void _ThreadPool_wake(ThreadPool *pool) {
+  atomic_thread_fence(memory_order_seq_cst);
+  if (atomic_load_explicit(&pool->sleepers, memory_order_relaxed) > 0) {
+    pthread_mutex_lock(&pool->lock);
+    pthread_cond_signal(&pool->has_work);
+    pthread_mutex_unlock(&pool->lock);
+  }
+}
+
+static void _ThreadPool_sleep(ThreadPool *pool) {
+  pthread_mutex_lock(&pool->lock);
+  atomic_fetch_add_explicit(&pool->sleepers, 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_seq_cst);
+  if (!atomic_load_explicit(&pool->stopping, memory_order_relaxed) &&
+      !_ThreadPool_has_work(pool)) {
+    pthread_cond_wait(&pool->has_work, &pool->lock);
+  }
+  atomic_fetch_sub_explicit(&pool->sleepers, 1, memory_order_relaxed);
+  pthread_mutex_unlock(&pool->lock);
+}
+
+static void *_ThreadPool_worker_main(void *arg) {
+  struct ThreadPoolWorker *self = arg;
+  ThreadPool *pool = self->pool;
+  _ThreadPool_self = self;
+  int idle = 0;
+  while (!atomic_load_explicit(&pool->stopping, memory_order_acquire)) {
+    struct Task *task = _ThreadPool_find_task(pool, self);
+    if (task) {
+      _ThreadPool_run(pool, task);
+      idle = 0;
+    } else if (++idle < SPIN_LIMIT) {
+      cpu_relax();
+    } else {
+      _ThreadPool_sleep(pool);
+      idle = 0;
+    }
+  }
+  _ThreadPool_self = NULL;
+  return NULL;
+}
+
+// Initializes a pre-allocated ThreadPool object
+bool ThreadPool_init(ThreadPool *pool, size_t num_threads, size_t max_tasks) {
+  ASSERT(pool != NULL);
+  ASSERT(max_tasks > 0);
+
+  if (num_threads == 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    num_threads = cpus > 0 ? (size_t)cpus : 1;
+  }
+  pool->num_threads = num_threads;
+  pool->max_tasks = max_tasks;
+  atomic_init(&pool->sleepers, 0);
+  atomic_init(&pool->stopping, false);
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->has_work, NULL);
+
+  size_t started = 0, deques = 0;
+  pool->tasks = NULL;
+  pool->free_tasks = NULL;
+  pool->injected = NULL;
+  if ((pool->workers = CacheLine_alloc(
+           num_threads * sizeof(struct ThreadPoolWorker))) == NULL) {
+    goto error;
+  }
+  if ((pool->tasks = malloc(max_tasks * sizeof(struct Task))) == NULL) {
+    goto error;
+  }
+  // Room for the slots, plus the nodes threads hold between pop and push.
+  if ((pool->free_tasks = AtomicStack_alloc(sizeof(struct Task *))) == NULL ||
+      !AtomicStack_reserve(pool->free_tasks, 2 * max_tasks)) {
+    goto error;
+  }
+  for (size_t i = 0; i < max_tasks; i++) {
+    struct Task *slot = &pool->tasks[i];
+    AtomicStack_push(pool->free_tasks, &slot);
+  }
+  if ((pool->injected = MpmcQueue_alloc(sizeof(struct Task *), max_tasks)) ==
+      NULL) {
+    goto error;
+  }
+  for (; deques < num_threads; deques++) {
+    struct ThreadPoolWorker *worker = &pool->workers[deques];
+    worker->pool = pool;
+    worker->index = (int)deques;
+    worker->seed = (unsigned int)deques * 2654435761u + 1;
+    if ((worker->deque = WorkDeque_alloc(max_tasks)) == NULL) {
+      goto error;
+    }
+  }
+  for (; started < num_threads; started++) {
+    struct ThreadPoolWorker *worker = &pool->workers[started];
+    if (pthread_create(&worker->thread, NULL, _ThreadPool_worker_main,
+                       worker) != 0) {
+      goto error;
+    }
+  }
+  return true;
+error:
+  atomic_store(&pool->stopping, true);
+  pthread_mutex_lock(&pool->lock);
+  pthread_cond_broadcast(&pool->has_work);
+  pthread_mutex_unlock(&pool->lock);
+  for (size_t i = 0; i < started; i++) {
+    pthread_join(pool->workers[i].thread, NULL);
+  }
+  for (size_t i = 0; i < deques; i++) {
+    WorkDeque_free(pool->workers[i].deque);
+  }
+  if (pool->injected) MpmcQueue_free(pool->injected);
+  if (pool->free_tasks) AtomicStack_free(pool->free_tasks);
+  free(pool->tasks);
+  CacheLine_free(pool->workers);
+  pthread_mutex_destroy(&pool->lock);
+  pthread_cond_destroy(&pool->has_work);
+  return false;
+}
+
+void ThreadPool_cleanup(ThreadPool *pool) {
+  ASSERT(pool != NULL);
+  atomic_store(&pool->stopping, true);
+  pthread_mutex_lock(&pool->lock);
+  pthread_cond_broadcast(&pool->has_work);
+  pthread_mutex_unlock(&pool->lock);
+  for (size_t i = 0; i < pool->num_threads; i++) {
+    pthread_join(pool->workers[i].thread, NULL);
+    WorkDeque_free(pool->workers[i].deque);
+  }
+  MpmcQueue_free(pool->injected);
+  AtomicStack_free(pool->free_tasks);
+  free(pool->tasks);
+  CacheLine_free(pool->workers);
+  pthread_mutex_destroy(&pool->lock);
+  pthread_cond_destroy(&pool->has_work);
+}
+
+ThreadPool *ThreadPool_alloc(size_t num_threads, size_t max_tasks) {
+  ThreadPool *pool;
+  if (NULL == (pool = CacheLine_alloc(sizeof(ThreadPool)))) {
+    return NULL;
+  }
+  if (!ThreadPool_init(pool, num_threads, max_tasks)) {
+    CacheLine_free(pool);
+    return NULL;
+  }
+  return pool;
+}
+
+void ThreadPool_free(ThreadPool *pool) {
+  ASSERT(pool != NULL);
+  ThreadPool_cleanup(pool);
+  CacheLine_free(pool);
+}
+
+size_t ThreadPool_thread_count(const ThreadPool *pool) {
+  ASSERT(pool != NULL);
+  return pool->num_threads;
+}
+
+int ThreadPool_worker_index(const ThreadPool *pool) {
+  ASSERT(pool != NULL);
+  return _ThreadPool_self && _ThreadPool_self->pool == pool
+             ? _ThreadPool_self->index
+             : -1;
+}
+
+void ThreadPool_submit(ThreadPool *pool, WaitGroup *group, TaskFn fn,
+                       void *arg) {
+  ASSERT(pool != NULL);
+  ASSERT(fn != NULL);
+  struct Task *slot;
+  if (!AtomicStack_pop(pool->free_tasks, &slot)) {
+    fn(arg);
+    return;
+  }
+  *slot = (struct Task){fn, arg, group};
+  if (group) {
+    WaitGroup_add(group, 1);
+  }
+  struct ThreadPoolWorker *self = _ThreadPool_self;
+  if (!(self && self->pool == pool && WorkDeque_push(self->deque, slot)) &&
+      !MpmcQueue_enqueue(pool->injected, &slot)) {
+    // Can't happen while the queue holds every slot, but don't lose the task.
+    _ThreadPool_run(pool, slot);
+    return;
+  }
+  _ThreadPool_wake(pool);
+}
+
+void ThreadPool_wait_group(ThreadPool *pool, WaitGroup *group) {
+  ASSERT(pool != NULL);
+  ASSERT(group != NULL);
+  struct ThreadPoolWorker *self =
+      _ThreadPool_self && _ThreadPool_self->pool == pool ? _ThreadPool_self
+                                                         : NULL;
+  int idle = 0;
+  while (WaitGroup_pending(group) > 0) {
+    struct Task *task = _ThreadPool_find_task(pool, self);
+    if (task) {
+      _ThreadPool_run(pool, task);
+      idle = 0;
+    } else if (++idle < SPIN_LIMIT) {
+      cpu_relax();
+    } else if (self) {
+      // The rest is running on other workers, and may still submit more.
+      sched_yield();
+    } else {
+      break;
+    }
+  }
+  WaitGroup_wait(group);
+}
+
+struct _ParallelFor {
+  RangeFn fn;
+  void *arg;
+  size_t end;
+  size_t grain;
+  atomic_size_t next;
+};
+
+// Keeps taking the next slice until there are none left. Slices are handed
+// out from a shared counter, so a slow thread just ends up doing fewer.
+static void _ThreadPool_parallel_for_task(void *arg) {
+  struct _ParallelFor *loop = arg;
+  size_t begin;
+  while ((begin = atomic_fetch_add_explicit(&loop->next, loop->grain,
+                                            memory_order_relaxed)) <
+         loop->end) {
+    size_t end = loop->end - begin > loop->grain ? begin + loop->grain
+                                                 : loop->end;
+    loop->fn(loop->arg, begin, end);
+  }
+}
+
+void ThreadPool_parallel_for(ThreadPool *pool, size_t begin, size_t end,
+                             size_t grain, RangeFn fn, void *arg) {
+  ASSERT(pool != NULL);
+  ASSERT(fn != NULL);
+  if (begin >= end) {
+    return;
+  }
+  size_t count = end - begin;
+  if (grain == 0) {
+    // A few slices per thread evens out threads that start late.
+    grain = count / (pool->num_threads * 8);
+    grain = grain ? grain : 1;
+  }
+  size_t slices = (count + grain - 1) / grain;
+  if (slices == 1) {
+    fn(arg, begin, end);
+    return;
+  }
+  struct _ParallelFor loop = {fn, arg, end, grain};
+  atomic_init(&loop.next, begin);
+  WaitGroup group;
+  WaitGroup_init(&group);
+  size_t helpers = slices - 1 < pool->num_threads ? slices - 1
+                                                  : pool->num_threads;
+  for (size_t i = 0; i < helpers; i++) {
+    ThreadPool_submit(pool, &group, _ThreadPool_parallel_for_task, &loop);
+  }
+  _ThreadPool_parallel_for_task(&loop);
+  ThreadPool_wait_group(pool, &group);
+  WaitGroup_cleanup(&group);
+}
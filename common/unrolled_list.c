@@ -0,0 +1,640 @@
+#include "protected/unrolled_list.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "../test/stubs.h"
+#include "public/collections.h"
+#include "public/assert.h"
+
+DEFINE_UNROLLED_LIST(Int, int)
+DEFINE_UNROLLED_LIST(Long, long)
+DEFINE_UNROLLED_LIST(Char, char)
+DEFINE_UNROLLED_LIST(Float, float)
+DEFINE_UNROLLED_LIST(Double, double)
+DEFINE_UNROLLED_LIST(UnsignedInt, unsigned int)
+DEFINE_UNROLLED_LIST(UnsignedLong, unsigned long)
+DEFINE_UNROLLED_LIST(UnsignedChar, unsigned char)
+DEFINE_UNROLLED_LIST(CString, char *)
+
+static size_t _UnrolledList_capacity_for(size_t elem_size)
+{
+    size_t capacity =
+        (UNROLLED_LIST_NODE_SIZE - sizeof(UnrolledListNode)) / elem_size;
+    return capacity < UNROLLED_LIST_MIN_NODE_CAPACITY
+        ? UNROLLED_LIST_MIN_NODE_CAPACITY
+        : capacity;
+}
+
+static size_t _UnrolledList_node_size(size_t elem_size)
+{
+    return sizeof(UnrolledListNode) +
+           _UnrolledList_capacity_for(elem_size) * elem_size;
+}
+
+static inline unsigned char *_UnrolledList_elem(const UnrolledList *list,
+                                                UnrolledListNode *node,
+                                                size_t index)
+{
+    return node->data + index * list->elem_size;
+}
+
+bool UnrolledList_init(UnrolledList *list, size_t elem_size)
+{
+    return UnrolledList_init_ext(list, elem_size, NULL);
+}
+
+bool UnrolledList_init_ext(UnrolledList *list, size_t elem_size, Arena *arena)
+{
+    ASSERT(list);
+    ASSERT(elem_size);
+    list->arena = arena;
+    list->pool = NULL;
+    list->owns_pool = false;
+    list->elem_size = elem_size;
+    list->node_capacity = _UnrolledList_capacity_for(elem_size);
+    list->count = 0;
+    list->head = NULL;
+    list->tail = NULL;
+    list->version = 1;
+    return true;
+}
+
+// Gets an empty node and links it in between `prev' and `next'.
+static UnrolledListNode *_UnrolledList_alloc_node(UnrolledList *list,
+                                                  UnrolledListNode *prev,
+                                                  UnrolledListNode *next)
+{
+    UnrolledListNode *node = list->pool
+        ? Pool_acquire(list->pool)
+        : Arena_malloc(list->arena, _UnrolledList_node_size(list->elem_size));
+    if (!node) return NULL;
+    node->count = 0;
+    node->prev = prev;
+    node->next = next;
+    if (prev) {
+        prev->next = node;
+    } else {
+        list->head = node;
+    }
+    if (next) {
+        next->prev = node;
+    } else {
+        list->tail = node;
+    }
+    return node;
+}
+
+// Unlinks a node and gives its memory back.
+static void _UnrolledList_free_node(UnrolledList *list, UnrolledListNode *node)
+{
+    if (node->prev) {
+        node->prev->next = node->next;
+    } else {
+        list->head = node->next;
+    }
+    if (node->next) {
+        node->next->prev = node->prev;
+    } else {
+        list->tail = node->prev;
+    }
+    if (list->pool) {
+        Pool_release(list->pool, node);
+    } else {
+        Arena_release(list->arena, node);
+    }
+}
+
+void UnrolledList_cleanup(UnrolledList *list)
+{
+    if (list->owns_pool) {
+        // Nobody else has nodes in it, so drop them all at once.
+        Pool_clear(list->pool);
+    } else {
+        UnrolledListNode *current = list->head;
+        while (current) {
+            UnrolledListNode *next = current->next;
+            if (list->pool) {
+                Pool_release(list->pool, current);
+            } else {
+                Arena_release(list->arena, current);
+            }
+            current = next;
+        }
+    }
+    list->head = NULL;
+    list->tail = NULL;
+    list->count = 0;
+    list->version++;
+}
+
+UnrolledList *UnrolledList_alloc(size_t elem_size)
+{
+    return UnrolledList_alloc_ext(elem_size, NULL);
+}
+
+UnrolledList *UnrolledList_alloc_ext(size_t elem_size, Arena *arena)
+{
+    ASSERT(elem_size);
+    UnrolledList *list = NULL;
+    if ((list = Arena_malloc(arena, sizeof(UnrolledList))) == NULL) {
+        return NULL;
+    }
+    if (!UnrolledList_init_ext(list, elem_size, arena)) {
+        Arena_release(arena, list);
+        return NULL;
+    }
+    return list;
+}
+
+UnrolledList *UnrolledList_alloc_pooled(size_t elem_size, Pool *pool)
+{
+    ASSERT(elem_size);
+    ASSERT(!pool ||
+           Pool_object_size(pool) >= _UnrolledList_node_size(elem_size));
+    UnrolledList *list = NULL;
+    if ((list = UnrolledList_alloc(elem_size)) == NULL) {
+        return NULL;
+    }
+    if (!pool) {
+        if ((pool = UnrolledList_node_pool_alloc(elem_size)) == NULL) {
+            UnrolledList_free(list);
+            return NULL;
+        }
+        list->owns_pool = true;
+    }
+    list->pool = pool;
+    return list;
+}
+
+Pool *UnrolledList_node_pool_alloc(size_t elem_size)
+{
+    ASSERT(elem_size);
+    return Pool_alloc(_UnrolledList_node_size(elem_size));
+}
+
+size_t UnrolledList_count(const UnrolledList *list)
+{
+    ASSERT(list);
+    return list->count;
+}
+
+bool UnrolledList_empty(const UnrolledList *list)
+{
+    ASSERT(list);
+    return list->count == 0;
+}
+
+void UnrolledList_free(UnrolledList *list)
+{
+    ASSERT(list);
+    UnrolledList_cleanup(list);
+    if (list->owns_pool) {
+        Pool_free(list->pool);
+    }
+    Arena_release(list->arena, list);
+}
+
+size_t UnrolledList_element_size(const UnrolledList *list)
+{
+    ASSERT(list);
+    return list->elem_size;
+}
+
+size_t UnrolledList_node_capacity(const UnrolledList *list)
+{
+    ASSERT(list);
+    return list->node_capacity;
+}
+
+void *UnrolledList_get_first(const UnrolledList *list)
+{
+    ASSERT(list);
+    ASSERT(list->head);
+    return list->head->data;
+}
+
+void *UnrolledList_get_last(const UnrolledList *list)
+{
+    ASSERT(list);
+    ASSERT(list->tail);
+    return _UnrolledList_elem(list, list->tail, list->tail->count - 1);
+}
+
+bool UnrolledList_get_first_cursor(const UnrolledList *list,
+                                   UnrolledListCursor *cursor)
+{
+    ASSERT(list);
+    ASSERT(cursor);
+    cursor->node = list->head;
+    cursor->index = 0;
+    return cursor->node != NULL;
+}
+
+bool UnrolledList_get_last_cursor(const UnrolledList *list,
+                                  UnrolledListCursor *cursor)
+{
+    ASSERT(list);
+    ASSERT(cursor);
+    cursor->node = list->tail;
+    cursor->index = list->tail ? list->tail->count - 1 : 0;
+    return cursor->node != NULL;
+}
+
+bool UnrolledList_get_cursor_at(const UnrolledList *list, size_t index,
+                                UnrolledListCursor *cursor)
+{
+    ASSERT(list);
+    ASSERT(cursor);
+    cursor->node = NULL;
+    cursor->index = 0;
+    if (index >= list->count) {
+        return false;
+    }
+    UnrolledListNode *node;
+    if (index < list->count / 2) {
+        for (node = list->head; index >= node->count; node = node->next) {
+            index -= node->count;
+        }
+    } else {
+        // Count back from the end instead.
+        size_t from_end = list->count - 1 - index;
+        for (node = list->tail; from_end >= node->count; node = node->prev) {
+            from_end -= node->count;
+        }
+        index = node->count - 1 - from_end;
+    }
+    cursor->node = node;
+    cursor->index = index;
+    return true;
+}
+
+bool UnrolledList_move_next(UnrolledListCursor *cursor)
+{
+    ASSERT(cursor);
+    if (!cursor->node) {
+        return false;
+    }
+    if (++cursor->index >= cursor->node->count) {
+        cursor->node = cursor->node->next;
+        cursor->index = 0;
+    }
+    return cursor->node != NULL;
+}
+
+bool UnrolledList_move_previous(UnrolledListCursor *cursor)
+{
+    ASSERT(cursor);
+    if (!cursor->node) {
+        return false;
+    }
+    if (cursor->index == 0) {
+        cursor->node = cursor->node->prev;
+        cursor->index = cursor->node ? cursor->node->count - 1 : 0;
+    } else {
+        cursor->index--;
+    }
+    return cursor->node != NULL;
+}
+
+void UnrolledList_set(const UnrolledList *list,
+                      const UnrolledListCursor *cursor, const void *data)
+{
+    ASSERT(list);
+    ASSERT(cursor && cursor->node);
+    ASSERT(cursor->index < cursor->node->count);
+    ASSERT(data);
+    memcpy(_UnrolledList_elem(list, cursor->node, cursor->index), data,
+           list->elem_size);
+}
+
+void *UnrolledList_get(const UnrolledList *list,
+                       const UnrolledListCursor *cursor)
+{
+    ASSERT(list);
+    ASSERT(cursor && cursor->node);
+    ASSERT(cursor->index < cursor->node->count);
+    return _UnrolledList_elem(list, cursor->node, cursor->index);
+}
+
+void *UnrolledList_get_span(const UnrolledList *list,
+                            const UnrolledListCursor *cursor, size_t *count)
+{
+    ASSERT(list);
+    ASSERT(cursor);
+    ASSERT(count);
+    if (!cursor->node) {
+        *count = 0;
+        return NULL;
+    }
+    ASSERT(cursor->index < cursor->node->count);
+    *count = cursor->node->count - cursor->index;
+    return _UnrolledList_elem(list, cursor->node, cursor->index);
+}
+
+// Inserts `elem' at `index' in `node' (or into a new node if `node' is NULL,
+// which only happens when the list is empty), and points the cursor at it.
+static void *_UnrolledList_insert_at(UnrolledList *list,
+                                     UnrolledListNode *node, size_t index,
+                                     const void *elem,
+                                     UnrolledListCursor *cursor)
+{
+    if (!node) {
+        if ((node = _UnrolledList_alloc_node(list, NULL, NULL)) == NULL) {
+            return NULL;
+        }
+    } else if (node->count == list->node_capacity) {
+        // Full. At either end, start a new node rather than splitting, so a
+        // list built by appending or prepending keeps its nodes full.
+        if (index == node->count) {
+            node = _UnrolledList_alloc_node(list, node, node->next);
+            if (!node) return NULL;
+            index = 0;
+        } else if (index == 0) {
+            node = _UnrolledList_alloc_node(list, node->prev, node);
+            if (!node) return NULL;
+        } else {
+            UnrolledListNode *upper =
+                _UnrolledList_alloc_node(list, node, node->next);
+            if (!upper) return NULL;
+            size_t keep = node->count / 2;
+            upper->count = node->count - keep;
+            memcpy(upper->data, _UnrolledList_elem(list, node, keep),
+                   upper->count * list->elem_size);
+            node->count = keep;
+            if (index > keep) {
+                node = upper;
+                index -= keep;
+            }
+        }
+    }
+    unsigned char *slot = _UnrolledList_elem(list, node, index);
+    memmove(slot + list->elem_size, slot,
+            (node->count - index) * list->elem_size);
+    memcpy(slot, elem, list->elem_size);
+    node->count++;
+    list->count++;
+    list->version++;
+    if (cursor) {
+        cursor->node = node;
+        cursor->index = index;
+    }
+    return slot;
+}
+
+// Merges `node->next' into `node' if the two are at most half full between
+// them, keeping the cursor on the same element. Returns whether it merged.
+static bool _UnrolledList_try_merge(UnrolledList *list, UnrolledListNode *node,
+                                    UnrolledListCursor *cursor)
+{
+    UnrolledListNode *next = node ? node->next : NULL;
+    if (!next || node->count + next->count > list->node_capacity / 2) {
+        return false;
+    }
+    memcpy(_UnrolledList_elem(list, node, node->count), next->data,
+           next->count * list->elem_size);
+    if (cursor->node == next) {
+        cursor->node = node;
+        cursor->index += node->count;
+    }
+    node->count += next->count;
+    _UnrolledList_free_node(list, next);
+    return true;
+}
+
+void *UnrolledList_insert_before(UnrolledList *list, UnrolledListCursor *cursor,
+                                 const void *elem)
+{
+    ASSERT(list);
+    ASSERT(cursor && cursor->node);
+    ASSERT(cursor->index < cursor->node->count);
+    ASSERT(elem);
+    return _UnrolledList_insert_at(list, cursor->node, cursor->index, elem,
+                                   cursor);
+}
+
+void *UnrolledList_insert_after(UnrolledList *list, UnrolledListCursor *cursor,
+                                const void *elem)
+{
+    ASSERT(list);
+    ASSERT(cursor && cursor->node);
+    ASSERT(cursor->index < cursor->node->count);
+    ASSERT(elem);
+    return _UnrolledList_insert_at(list, cursor->node, cursor->index + 1, elem,
+                                   cursor);
+}
+
+void *UnrolledList_append(UnrolledList *list, const void *elem)
+{
+    ASSERT(list);
+    ASSERT(elem);
+    return _UnrolledList_insert_at(list, list->tail,
+                                   list->tail ? list->tail->count : 0, elem,
+                                   NULL);
+}
+
+void *UnrolledList_prepend(UnrolledList *list, const void *elem)
+{
+    ASSERT(list);
+    ASSERT(elem);
+    return _UnrolledList_insert_at(list, list->head, 0, elem, NULL);
+}
+
+void UnrolledList_remove(UnrolledList *list, UnrolledListCursor *cursor)
+{
+    ASSERT(list);
+    ASSERT(cursor && cursor->node);
+    ASSERT(cursor->index < cursor->node->count);
+    UnrolledListNode *node = cursor->node;
+    unsigned char *slot = _UnrolledList_elem(list, node, cursor->index);
+    node->count--;
+    memmove(slot, slot + list->elem_size,
+            (node->count - cursor->index) * list->elem_size);
+    list->count--;
+    list->version++;
+    if (cursor->index == node->count) {
+        cursor->node = node->next;
+        cursor->index = 0;
+    }
+    if (node->count == 0) {
+        _UnrolledList_free_node(list, node);
+        return;
+    }
+    // Merge with whichever neighbours are now sparse enough.
+    UnrolledListNode *prev = node->prev;
+    if (_UnrolledList_try_merge(list, prev, cursor)) {
+        node = prev;
+    }
+    _UnrolledList_try_merge(list, node, cursor);
+}
+
+void UnrolledList_remove_first(UnrolledList *list)
+{
+    ASSERT(list);
+    UnrolledListCursor cursor;
+    if (UnrolledList_get_first_cursor(list, &cursor)) {
+        UnrolledList_remove(list, &cursor);
+    }
+}
+
+void UnrolledList_remove_last(UnrolledList *list)
+{
+    ASSERT(list);
+    UnrolledListCursor cursor;
+    if (UnrolledList_get_last_cursor(list, &cursor)) {
+        UnrolledList_remove(list, &cursor);
+    }
+}
+
+void UnrolledList_clear(UnrolledList *list)
+{
+    UnrolledList_cleanup(list);
+}
+
+void UnrolledList_remove_range(UnrolledList *list, UnrolledListCursor *cursor,
+                               int count)
+{
+    ASSERT(list);
+    ASSERT(cursor);
+    ASSERT(count >= 0);
+
+    while (count > 0 && cursor->node) {
+        UnrolledList_remove(list, cursor);
+        count--;
+    }
+    ASSERT(count == 0 && "Tried to remove too many elements");
+}
+
+bool UnrolledList_copy(UnrolledList *dest_list, const UnrolledList *list)
+{
+    ASSERT(list);
+    ASSERT(dest_list);
+    ASSERT(list->elem_size == dest_list->elem_size);
+
+    for (UnrolledListNode *node = list->head; node; node = node->next) {
+        for (size_t i = 0; i < node->count; i++) {
+            if (!UnrolledList_append(dest_list,
+                                     _UnrolledList_elem(list, node, i))) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// The iterator keeps its node in impl_data1 and the index in impl_data2. Before
+// the first move_next the node is NULL and the index is -1; past the end the
+// node is NULL and the index is 0.
+
+void *UnrolledList_iter_current_(const Iterator *iter);
+bool UnrolledList_iter_eof_(const Iterator *iter);
+bool UnrolledList_iter_move_next_(Iterator *iter);
+bool UnrolledList_iter_move_next_reverse_(Iterator *iter);
+
+void *UnrolledList_iter_current_(const Iterator *iter)
+{
+    ASSERT(iter != NULL);
+    ASSERT(iter->collection_type == COLLECTION_UNROLLED_LIST);
+    UnrolledList *list = iter->collection;
+    ASSERT(list != NULL);
+    ASSERT(iter->version == list->version &&
+           "Collection changed while iterating.");
+    UnrolledListNode *node = (UnrolledListNode *)(intptr_t)iter->impl_data1;
+    if (!node) {
+        return NULL;
+    }
+    return _UnrolledList_elem(list, node, iter->impl_data2);
+}
+
+bool UnrolledList_iter_eof_(const Iterator *iter)
+{
+    ASSERT(iter != NULL);
+    ASSERT(iter->collection_type == COLLECTION_UNROLLED_LIST);
+    UnrolledList *list = iter->collection;
+    ASSERT(list != NULL);
+    ASSERT(iter->version == list->version &&
+           "Collection changed while iterating.");
+    return list->count == 0 || (iter->impl_data1 == 0 && iter->impl_data2 >= 0);
+}
+
+bool UnrolledList_iter_move_next_(Iterator *iter)
+{
+    if (UnrolledList_iter_eof_(iter)) {
+        return false;
+    }
+    UnrolledList *list = iter->collection;
+    UnrolledListCursor cursor = {
+        (UnrolledListNode *)(intptr_t)iter->impl_data1,
+        (size_t)iter->impl_data2};
+    if (iter->impl_data2 < 0) {
+        UnrolledList_get_first_cursor(list, &cursor);
+    } else {
+        UnrolledList_move_next(&cursor);
+    }
+    iter->impl_data1 = (intptr_t)cursor.node;
+    iter->impl_data2 = cursor.index;
+    return cursor.node != NULL;
+}
+
+bool UnrolledList_iter_move_next_reverse_(Iterator *iter)
+{
+    if (UnrolledList_iter_eof_(iter)) {
+        return false;
+    }
+    UnrolledList *list = iter->collection;
+    UnrolledListCursor cursor = {
+        (UnrolledListNode *)(intptr_t)iter->impl_data1,
+        (size_t)iter->impl_data2};
+    if (iter->impl_data2 < 0) {
+        UnrolledList_get_last_cursor(list, &cursor);
+    } else {
+        UnrolledList_move_previous(&cursor);
+    }
+    iter->impl_data1 = (intptr_t)cursor.node;
+    iter->impl_data2 = cursor.index;
+    return cursor.node != NULL;
+}
+
+void UnrolledList_get_iterator(const UnrolledList *list, Iterator *iter)
+{
+    ASSERT(list != NULL);
+    ASSERT(iter != NULL);
+    iter->collection_type = COLLECTION_UNROLLED_LIST;
+    iter->collection = (void *)list;
+    iter->elem_size = list->elem_size;
+    iter->current = UnrolledList_iter_current_;
+    iter->eof = UnrolledList_iter_eof_;
+    iter->move_next = UnrolledList_iter_move_next_;
+    iter->impl_data1 = 0; // Current node
+    iter->impl_data2 = -1; // Index in the node
+    iter->version = list->version;
+}
+
+void UnrolledList_get_reverse_iterator(const UnrolledList *list,
+                                       Iterator *iter)
+{
+    UnrolledList_get_iterator(list, iter);
+    iter->move_next = UnrolledList_iter_move_next_reverse_;
+}
+
+void *UnrolledList_sink_add_(Sink *sink, const void *elem);
+
+void UnrolledList_get_sink(const UnrolledList *list, Sink *sink)
+{
+    ASSERT(list != NULL);
+    ASSERT(sink != NULL);
+    sink->collection_type = COLLECTION_UNROLLED_LIST;
+    sink->collection = (void *)list;
+    sink->elem_size = list->elem_size;
+    sink->add = UnrolledList_sink_add_;
+}
+
+void *UnrolledList_sink_add_(Sink *sink, const void *elem)
+{
+    ASSERT(sink != NULL);
+    UnrolledList *list = sink->collection;
+    ASSERT(list != NULL);
+    return UnrolledList_append(list, elem);
+}
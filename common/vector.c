@@ -1,7 +1,14 @@
+#define _GNU_SOURCE // mremap
 #include "protected/vector.h"
 
 #include <math.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <string.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 #include "../test/stubs.h"
 #include "public/collections.h"
@@ -9,8 +16,6 @@
 
 bool Vector_init(Vector *vector, size_t elem_size);
 
-void Vector_cleanup(Vector *vector);
-
 DEFINE_VECTOR(Int, int);
 DEFINE_VECTOR(Long, long);
 DEFINE_VECTOR(Char, char);
@@ -23,6 +28,9 @@ DEFINE_VECTOR(CString, char *);
 
 void _Vector_log(Vector *vector)
 {
+  if (!LOG_ENABLED(TRACE)) {
+    return; // Don't format every element just to throw it away.
+  }
   char print_buffer[1000];
   LOG_FORMAT(TRACE, "_Vector_log(*vector: %p):", vector);
   ASSERT(vector);
@@ -43,22 +51,31 @@ void _Vector_log(Vector *vector)
 
 void _Vector_log_element(int level, Vector *vector, char *message, const void *element)
 {
+  if (!LOG_ENABLED(level)) {
+    return;
+  }
   char print_buffer[1000];
   vector->print(vector, print_buffer, element);
-  LOG_FORMAT(TRACE, "%s: %s", message, print_buffer);
+  LOG_FORMAT(level, "%s: %s", message, print_buffer);
 }
 
 Vector *Vector_alloc(size_t elem_size) 
 {
-  LOG_FORMAT(TRACE, "Vector_alloc(elem_size: %zu) called", elem_size);
+  return Vector_alloc_ext(elem_size, NULL);
+}
+
+Vector *Vector_alloc_ext(size_t elem_size, Arena *arena)
+{
+  LOG_FORMAT(TRACE, "Vector_alloc_ext(elem_size: %zu, *arena: %p) called",
+             elem_size, arena);
   ASSERT(elem_size > 0);
 
-  Vector *vector = malloc(sizeof(Vector));
+  Vector *vector = Arena_malloc(arena, sizeof(Vector));
   LOG_FORMAT_INDENT(TRACE, "Vector allocated -> %p", vector);
 
   LOG_INDENT();
-  if (vector && !Vector_init(vector, elem_size)) {
-    free(vector);
+  if (vector && !Vector_init_ext(vector, elem_size, arena)) {
+    Arena_release(arena, vector);
     LOG_DEINDENT();
     return NULL;
   }
@@ -66,6 +83,128 @@ Vector *Vector_alloc(size_t elem_size)
   return vector;
 }
 
+_Static_assert(sizeof(Vector) <= VECTOR_HEADER_SIZE,
+               "VECTOR_HEADER_SIZE is too small for a Vector");
+_Static_assert(offsetof(Vector, data) == offsetof(VectorPrefix, data) &&
+                   offsetof(Vector, data_size) ==
+                       offsetof(VectorPrefix, data_size) &&
+                   offsetof(Vector, elem_size) ==
+                       offsetof(VectorPrefix, elem_size) &&
+                   offsetof(Vector, elem_count) ==
+                       offsetof(VectorPrefix, elem_count) &&
+                   offsetof(Vector, version) == offsetof(VectorPrefix, version),
+               "A Vector must start with a VectorPrefix");
+
+// Where a small vector's inline storage starts, after its header.
+#define _VECTOR_INLINE_OFFSET                                                  \
+  ((sizeof(Vector) + _Alignof(max_align_t) - 1) / _Alignof(max_align_t) *     \
+   _Alignof(max_align_t))
+
+Vector *Vector_alloc_inline(size_t elem_size, size_t capacity)
+{
+  LOG_FORMAT(TRACE, "Vector_alloc_inline(elem_size: %zu, capacity: %zu) called",
+             elem_size, capacity);
+  ASSERT(elem_size > 0);
+
+  unsigned char *block =
+      Arena_malloc(NULL, _VECTOR_INLINE_OFFSET + elem_size * capacity);
+  if (!block) {
+    return NULL;
+  }
+  return Vector_init_inline(block, elem_size, block + _VECTOR_INLINE_OFFSET,
+                            capacity);
+}
+
+Vector *Vector_init_inline(void *header, size_t elem_size, void *buffer,
+                           size_t capacity)
+{
+  ASSERT(header != NULL);
+  ASSERT(buffer != NULL || capacity == 0);
+  Vector *vector = header;
+  Vector_init_ext(vector, elem_size, NULL);
+  vector->inline_data = capacity ? buffer : NULL;
+  vector->inline_size = elem_size * capacity;
+  vector->data = vector->inline_data;
+  vector->data_size = vector->inline_size;
+  vector->reserve_count = capacity;
+  return vector;
+}
+
+// The start of a file-backed vector's file. The elements follow at
+// VECTOR_FILE_HEADER_SIZE.
+struct _VectorFileHeader {
+  char magic[8];
+  uint64_t elem_size;
+  uint64_t elem_count;
+};
+
+static const char _VECTOR_FILE_MAGIC[8] = "ccVECTR1";
+
+static struct _VectorFileHeader *_Vector_file_header(const Vector *vector)
+{
+  return MappedFile_data(vector->file);
+}
+
+Vector *Vector_open_file(const char *path, size_t elem_size)
+{
+  LOG_FORMAT(TRACE, "Vector_open_file(path: %s, elem_size: %zu) called", path,
+             elem_size);
+  ASSERT(path != NULL);
+  ASSERT(elem_size > 0);
+
+  Vector *vector = Vector_alloc(elem_size);
+  if (!vector) {
+    return NULL;
+  }
+  if ((vector->file = MappedFile_open(path)) == NULL) {
+    goto out_free;
+  }
+  size_t size = MappedFile_size(vector->file);
+  struct _VectorFileHeader *header;
+  if (size == 0) {
+    // A new file; just the header until something is added.
+    if (!MappedFile_resize(vector->file, VECTOR_FILE_HEADER_SIZE)) {
+      goto out_close;
+    }
+    header = _Vector_file_header(vector);
+    memcpy(header->magic, _VECTOR_FILE_MAGIC, sizeof(header->magic));
+    header->elem_size = elem_size;
+    header->elem_count = 0;
+    return vector;
+  }
+  header = _Vector_file_header(vector);
+  if (size < VECTOR_FILE_HEADER_SIZE ||
+      memcmp(header->magic, _VECTOR_FILE_MAGIC, sizeof(header->magic)) != 0 ||
+      header->elem_size != elem_size ||
+      header->elem_count > (size - VECTOR_FILE_HEADER_SIZE) / elem_size) {
+    LOG_FORMAT(TRACE, "%s is not a vector of %zu-byte elements.", path,
+               elem_size);
+    goto out_close;
+  }
+  if (size > VECTOR_FILE_HEADER_SIZE) {
+    vector->data = (unsigned char *)header + VECTOR_FILE_HEADER_SIZE;
+  }
+  vector->data_size = size - VECTOR_FILE_HEADER_SIZE;
+  vector->reserve_count = vector->data_size / elem_size;
+  vector->elem_count = header->elem_count;
+  return vector;
+
+out_close:
+  MappedFile_close(vector->file);
+  vector->file = NULL;
+out_free:
+  Vector_free(vector);
+  return NULL;
+}
+
+bool Vector_sync(Vector *vector)
+{
+  ASSERT(vector != NULL);
+  ASSERT(vector->file != NULL);
+  _Vector_file_header(vector)->elem_count = vector->elem_count;
+  return MappedFile_sync(vector->file);
+}
+
 void _Vector_default_print_fn(const Vector *self, char *str, const unsigned char *elem) {
   char byte[4];
   str[0] = '\0';
@@ -82,15 +221,28 @@ void Vector_print(Vector *vector, char *buffer, size_t index)
 
 bool Vector_init(Vector *vector, size_t elem_size) 
 {
-  LOG_FORMAT(TRACE, "Vector_init(*vector: %p, elem_size: %zu) called", vector, elem_size);
+  return Vector_init_ext(vector, elem_size, NULL);
+}
+
+// Initializes a pre-allocated Vector object that allocates from `arena'.
+bool Vector_init_ext(Vector *vector, size_t elem_size, Arena *arena)
+{
+  LOG_FORMAT(TRACE, "Vector_init_ext(*vector: %p, elem_size: %zu, *arena: %p) called",
+             vector, elem_size, arena);
   ASSERT(vector != NULL);
   ASSERT(elem_size > 0);
 
+  vector->arena = arena;
   vector->data = NULL;
   vector->data_size = 0;
   vector->elem_size = elem_size;
   vector->elem_count = 0;
   vector->reserve_count = 0;
+  vector->growth = VECTOR_GROW_DOUBLE;
+  vector->mapped = false;
+  vector->inline_data = NULL;
+  vector->inline_size = 0;
+  vector->file = NULL;
   vector->version = 0;
   vector->print = (void(*)(const Vector*, char *, const void *))_Vector_default_print_fn;
   return true;
@@ -116,6 +268,122 @@ size_t Vector_capacity(const Vector *vector)
   return vector->data_size / vector->elem_size;
 }
 
+void Vector_set_growth(Vector *vector, VectorGrowth growth)
+{
+  ASSERT(vector != NULL);
+  vector->growth = growth;
+}
+
+VectorGrowth Vector_growth(const Vector *vector)
+{
+  ASSERT(vector != NULL);
+  return vector->growth;
+}
+
+static size_t _Vector_page_size(void)
+{
+#ifdef __linux__
+  static size_t page_size = 0;
+  if (!page_size) {
+    page_size = (size_t)sysconf(_SC_PAGESIZE);
+  }
+  return page_size;
+#else
+  return 4096;
+#endif
+}
+
+static size_t _Vector_round_to_pages(size_t size)
+{
+  size_t page_size = _Vector_page_size();
+  return (size + page_size - 1) / page_size * page_size;
+}
+
+// Whether a buffer of `size' bytes should be a mapping of its own.
+static bool _Vector_should_map(const Vector *vector, size_t size)
+{
+#ifdef __linux__
+  return vector->growth == VECTOR_GROW_MAPPED && vector->arena == NULL &&
+         size >= VECTOR_MAP_THRESHOLD;
+#else
+  return false;
+#endif
+}
+
+// Moves the data into a buffer of `size' bytes, keeping what fits, and
+// returns it. Returns NULL, leaving the data alone, if that fails.
+static void *_Vector_resize_data(Vector *vector, size_t size)
+{
+  if (vector->file) {
+    if (!MappedFile_resize(vector->file, VECTOR_FILE_HEADER_SIZE + size)) {
+      return NULL;
+    }
+    return (unsigned char *)MappedFile_data(vector->file) +
+           VECTOR_FILE_HEADER_SIZE;
+  }
+  bool is_inline = vector->data != NULL && vector->data == vector->inline_data;
+  bool fits_inline = vector->inline_data != NULL && size <= vector->inline_size;
+  bool map = _Vector_should_map(vector, size);
+  if (!is_inline && !fits_inline && !vector->mapped && !map) {
+    return Arena_realloc(vector->arena, vector->data, vector->data_size, size);
+  }
+  void *data;
+#ifdef __linux__
+  if (vector->mapped && map) {
+    data = mremap(vector->data, vector->data_size, size, MREMAP_MAYMOVE);
+    return data == MAP_FAILED ? NULL : data;
+  }
+  if (map) {
+    data = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data == MAP_FAILED) {
+      return NULL;
+    }
+  } else
+#endif
+  if (fits_inline) {
+    data = vector->inline_data;
+  } else if ((data = Arena_malloc(vector->arena, size)) == NULL) {
+    return NULL;
+  }
+  if (vector->data && data != vector->data) {
+    memcpy(data, vector->data,
+           vector->data_size < size ? vector->data_size : size);
+#ifdef __linux__
+    if (vector->mapped) {
+      munmap(vector->data, vector->data_size);
+    } else
+#endif
+    if (!is_inline) {
+      Arena_release(vector->arena, vector->data);
+    }
+  }
+  vector->mapped = map;
+  return data;
+}
+
+// Frees the data, leaving an empty vector: one with its inline storage, if it
+// has any.
+static void _Vector_release_data(Vector *vector)
+{
+  if (vector->file) {
+    // Down to the header; if the file can't shrink, it's still empty.
+    MappedFile_resize(vector->file, VECTOR_FILE_HEADER_SIZE);
+  } else
+#ifdef __linux__
+  if (vector->mapped) {
+    munmap(vector->data, vector->data_size);
+    vector->mapped = false;
+  } else
+#endif
+  if (vector->data && vector->data != vector->inline_data) {
+    Arena_release(vector->arena, vector->data);
+  }
+  vector->data = vector->inline_data;
+  vector->data_size = vector->inline_size;
+  vector->reserve_count = vector->inline_size / vector->elem_size;
+}
+
 bool _Vector_reserve_ext(Vector *vector, size_t num_elems, bool slim) {
   LOG_FORMAT(
       TRACE,
@@ -131,15 +399,30 @@ bool _Vector_reserve_ext(Vector *vector, size_t num_elems, bool slim) {
     LOG_DEINDENT();
     return true; // No-op case
   }
-  // Increase capacity by factor of 2
+  // Increase capacity by the growth policy
   size_t reserve_count = vector->reserve_count == 0 ? 1 : vector->reserve_count;
-  while (reserve_count < num_elems) {
-    reserve_count <<= 1;
+  if (vector->growth == VECTOR_GROW_BY_HALF ||
+      vector->growth == VECTOR_GROW_PAGES) {
+    while (reserve_count < num_elems) {
+      reserve_count += reserve_count / 2 + 1;
+    }
+  } else {
+    while (reserve_count < num_elems) {
+      reserve_count <<= 1;
+    }
   }
   size_t new_data_size = vector->elem_size * (slim ? num_elems : reserve_count);
+  if (vector->growth == VECTOR_GROW_PAGES || vector->file ||
+      _Vector_should_map(vector, new_data_size)) {
+    // Whatever rounding adds is usable capacity too.
+    new_data_size = _Vector_round_to_pages(new_data_size);
+    if (reserve_count < new_data_size / vector->elem_size) {
+      reserve_count = new_data_size / vector->elem_size;
+    }
+  }
   void *data = NULL;
   LOG_FORMAT(TRACE, "New capacity %zu bytes.", new_data_size);
-  if ((data = realloc(vector->data, new_data_size)) == NULL) {
+  if ((data = _Vector_resize_data(vector, new_data_size)) == NULL) {
     LOG(TRACE, "Unable to realloc.");
     LOG_DEINDENT();
     return false;
@@ -176,22 +459,24 @@ bool Vector_trim(Vector *vector)
 
   if (vector->elem_count == 0) {
     LOG_FORMAT_INDENT(TRACE, "%s", "Nothing in vector, freeing data and re-initializing.");
-    if (vector->data) {
-      free(vector->data);
-      vector->data = NULL;
-    }
-    vector->data_size = 0;
-    vector->reserve_count = 0;
+    _Vector_release_data(vector);
     return true;
   }
-  if (vector->elem_count < vector->reserve_count) {
-    // Allocate and copy the data
-    void *data = realloc(vector->data, vector->elem_size * vector->elem_count);
+  if (vector->elem_count < vector->reserve_count &&
+      vector->data != vector->inline_data) {
+    // Allocate and copy the data, back into the inline storage if it fits.
+    size_t data_size = vector->elem_size * vector->elem_count;
+    if (data_size <= vector->inline_size) {
+      data_size = vector->inline_size;
+    } else if (_Vector_should_map(vector, data_size)) {
+      data_size = _Vector_round_to_pages(data_size);
+    }
+    void *data = _Vector_resize_data(vector, data_size);
     if (!data) {
       LOG_FORMAT_INDENT(TRACE, "%s", "Failed to reallocate smaller vector.");
       return false;
     }
-    vector->data_size = vector->elem_size * vector->elem_count;
+    vector->data_size = data_size;
     vector->data = data;
     // Lower the potential capacity.
     while ((vector->reserve_count >> 1) >= vector->elem_count) {
@@ -214,8 +499,14 @@ void Vector_free(Vector *vector)
   LOG_INDENT();
   // _Vector_log(vector); // Don't do this, the items are freed and can't be printed.
   ASSERT(vector != NULL);
-  Vector_cleanup(vector);
-  free(vector);
+  if (vector->file) {
+    // Only the mapping goes; the elements stay in the file.
+    _Vector_file_header(vector)->elem_count = vector->elem_count;
+    MappedFile_close(vector->file);
+  } else {
+    Vector_cleanup(vector);
+  }
+  Arena_release(vector->arena, vector);
   LOG_DEINDENT();
 }
 
@@ -225,13 +516,8 @@ void Vector_cleanup(Vector *vector)
   LOG_INDENT();
   ASSERT(vector != NULL);
 
-  if (vector->data) {
-    free(vector->data);
-  }
-  vector->data = NULL;
-  vector->data_size = 0;
+  _Vector_release_data(vector);
   vector->elem_count = 0;
-  vector->reserve_count = 0;
   vector->version++;
   LOG_DEINDENT();
 } // Vector_cleanup
@@ -386,8 +672,10 @@ void Vector_remove_range(Vector *vector, size_t start_index, size_t count)
   }
   vector->version++;
   void *new_data = vector->data;
-  // Can we reduce the size of the vector by at least half?
-  if (vector->reserve_count >> 1 >= vector->elem_count - count) {
+  // Can we reduce the size of the vector by at least half? Mappings, files
+  // and inline storage keep their size until Vector_trim.
+  if (!vector->mapped && !vector->file && vector->data != vector->inline_data &&
+      vector->reserve_count >> 1 >= vector->elem_count - count) {
     size_t old_capacity = vector->reserve_count;
     do {
       vector->reserve_count >>= 1;
@@ -395,7 +683,7 @@ void Vector_remove_range(Vector *vector, size_t start_index, size_t count)
     LOG_FORMAT(TRACE, "Reducing the capacity of the vector from %zu to %zu...",
                old_capacity, vector->reserve_count);
     // Use malloc for less copying.
-    new_data = malloc(vector->reserve_count * vector->elem_size);
+    new_data = Arena_malloc(vector->arena, vector->reserve_count * vector->elem_size);
     if (new_data == NULL) {
       new_data = vector->data;
       LOG(TRACE, "Size reduction was unsuccessful.");
@@ -404,6 +692,7 @@ void Vector_remove_range(Vector *vector, size_t start_index, size_t count)
         // Copy the first part of the old data.
         memcpy(new_data, vector->data, start_index * vector->elem_size);
       }
+      vector->data_size = vector->reserve_count * vector->elem_size;
     }
   }
   if (count > 0 && start_index + count < vector->elem_count) {
@@ -413,7 +702,7 @@ void Vector_remove_range(Vector *vector, size_t start_index, size_t count)
            vector->elem_size * (vector->elem_count - (start_index + count)));
   }
   if (new_data && new_data != vector->data) {
-    free(vector->data);
+    Arena_release(vector->arena, vector->data);
     LOG_FORMAT(TRACE, "Old, freed data: %p; new data: %p", vector->data, new_data);
   }
   vector->elem_count -= count;
@@ -445,6 +734,16 @@ bool Vector_copy(Vector *dest_vector, const Vector *vector)
   return true;
 } // Vector_copy
 
+// Sorts the vector in place.
+void Vector_sort(Vector *vector, int (*compare_fn)(const void *a, const void *b))
+{
+  ASSERT(vector != NULL);
+  Indexer indexer;
+  Vector_get_indexer(vector, &indexer);
+  Indexer_sort(&indexer, compare_fn);
+  vector->version++;
+}
+
 void *Vector_iter_current_(const Iterator *iter);
 void *Vector_iter_current_reverse_(const Iterator *iter);
 bool Vector_iter_eof_(const Iterator *iter);
@@ -0,0 +1,168 @@
+#include "protected/work_deque.h"
+
+#include "../test/stubs.h"
+#include "public/assert.h"
+
+// The memory orderings follow Le, Pop, Cohen and Zappa Nardelli, "Correct and
+// Efficient Work-Stealing for Weak Memory Models" (PPoPP 2013).
+
+static struct WorkDequeBuffer *_WorkDeque_buffer_alloc(size_t capacity) {
+  struct WorkDequeBuffer *buffer =
+      malloc(sizeof(struct WorkDequeBuffer) + capacity * sizeof(void *));
+  if (buffer == NULL) {
+    return NULL;
+  }
+  buffer->capacity = capacity;
+  buffer->mask = capacity - 1;
+  buffer->older = NULL;
+  for (size_t i = 0; i < capacity; i++) {
+    atomic_init(&buffer->items[i], NULL);
+  }
+  return buffer;
+}
+
+// Initializes a pre-allocated WorkDeque object
+bool WorkDeque_init(WorkDeque *deque, size_t capacity) {
+  ASSERT(deque != NULL);
+  ASSERT(capacity > 0);
+
+  size_t rounded = 2;
+  while (rounded < capacity) {
+    rounded <<= 1;
+  }
+  struct WorkDequeBuffer *buffer;
+  if ((buffer = _WorkDeque_buffer_alloc(rounded)) == NULL) {
+    return false;
+  }
+  atomic_init(&deque->top, 0);
+  atomic_init(&deque->bottom, 0);
+  atomic_init(&deque->buffer, buffer);
+  return true;
+}
+
+void WorkDeque_cleanup(WorkDeque *deque) {
+  ASSERT(deque != NULL);
+  struct WorkDequeBuffer *buffer =
+      atomic_load_explicit(&deque->buffer, memory_order_relaxed);
+  while (buffer) {
+    struct WorkDequeBuffer *older = buffer->older;
+    free(buffer);
+    buffer = older;
+  }
+  atomic_store_explicit(&deque->buffer, NULL, memory_order_relaxed);
+}
+
+WorkDeque *WorkDeque_alloc(size_t capacity) {
+  WorkDeque *deque;
+  if (NULL == (deque = CacheLine_alloc(sizeof(WorkDeque)))) {
+    return NULL;
+  }
+  if (!WorkDeque_init(deque, capacity)) {
+    CacheLine_free(deque);
+    return NULL;
+  }
+  return deque;
+}
+
+void WorkDeque_free(WorkDeque *deque) {
+  ASSERT(deque != NULL);
+  WorkDeque_cleanup(deque);
+  CacheLine_free(deque);
+}
+
+size_t WorkDeque_count(const WorkDeque *deque) {
+  ASSERT(deque != NULL);
+  int64_t top = atomic_load_explicit(&deque->top, memory_order_acquire);
+  int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+  return bottom > top ? (size_t)(bottom - top) : 0;
+}
+
+bool WorkDeque_empty(const WorkDeque *deque) {
+  return WorkDeque_count(deque) == 0;
+}
+
+// Moves the items in [top, bottom) to a ring twice the size. Owner only.
+static struct WorkDequeBuffer *_WorkDeque_grow(WorkDeque *deque,
+                                               struct WorkDequeBuffer *buffer,
+                                               int64_t top, int64_t bottom) {
+  struct WorkDequeBuffer *bigger;
+  if ((bigger = _WorkDeque_buffer_alloc(buffer->capacity * 2)) == NULL) {
+    return NULL;
+  }
+  for (int64_t i = top; i < bottom; i++) {
+    void *item = atomic_load_explicit(&buffer->items[i & buffer->mask],
+                                      memory_order_relaxed);
+    atomic_store_explicit(&bigger->items[i & bigger->mask], item,
+                          memory_order_relaxed);
+  }
+  bigger->older = buffer;
+  atomic_store_explicit(&deque->buffer, bigger, memory_order_release);
+  return bigger;
+}
+
+bool WorkDeque_push(WorkDeque *deque, void *item) {
+  ASSERT(deque != NULL);
+  ASSERT(item != NULL);
+  int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+  int64_t top = atomic_load_explicit(&deque->top, memory_order_acquire);
+  struct WorkDequeBuffer *buffer =
+      atomic_load_explicit(&deque->buffer, memory_order_relaxed);
+  if (bottom - top >= (int64_t)buffer->capacity &&
+      (buffer = _WorkDeque_grow(deque, buffer, top, bottom)) == NULL) {
+    return false;
+  }
+  atomic_store_explicit(&buffer->items[bottom & buffer->mask], item,
+                        memory_order_relaxed);
+  // The paper has a release fence and a relaxed store; a release store is the
+  // same instruction on x86 and ARMv8, and ThreadSanitizer understands it.
+  atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_release);
+  return true;
+}
+
+void *WorkDeque_pop(WorkDeque *deque) {
+  ASSERT(deque != NULL);
+  // Claim the bottom item first, then see whether a thief got there too.
+  int64_t bottom =
+      atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+  struct WorkDequeBuffer *buffer =
+      atomic_load_explicit(&deque->buffer, memory_order_relaxed);
+  atomic_store_explicit(&deque->bottom, bottom, memory_order_relaxed);
+  atomic_thread_fence(memory_order_seq_cst);
+  int64_t top = atomic_load_explicit(&deque->top, memory_order_relaxed);
+  if (top > bottom) {
+    atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+    return NULL;
+  }
+  void *item = atomic_load_explicit(&buffer->items[bottom & buffer->mask],
+                                    memory_order_relaxed);
+  if (top == bottom) {
+    // The last item: race the thieves for it by taking it from the top.
+    if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1,
+                                                 memory_order_seq_cst,
+                                                 memory_order_relaxed)) {
+      item = NULL;
+    }
+    atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+  }
+  return item;
+}
+
+void *WorkDeque_steal(WorkDeque *deque) {
+  ASSERT(deque != NULL);
+  int64_t top = atomic_load_explicit(&deque->top, memory_order_acquire);
+  atomic_thread_fence(memory_order_seq_cst);
+  int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+  if (top >= bottom) {
+    return NULL;
+  }
+  struct WorkDequeBuffer *buffer =
+      atomic_load_explicit(&deque->buffer, memory_order_acquire);
+  void *item = atomic_load_explicit(&buffer->items[top & buffer->mask],
+                                    memory_order_relaxed);
+  if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1,
+                                               memory_order_seq_cst,
+                                               memory_order_relaxed)) {
+    return NULL;
+  }
+  return item;
+}
@@ -0,0 +1,93 @@
+#include "arena_tests.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "../../common/public/forward_list.h"
+#include "../../common/public/list.h"
+#include "../../common/public/map.h"
+#include "../../common/public/set.h"
+#include "../../common/public/vector.h"
+
+TEST(arena_basics) {
+  Arena *arena = Arena_alloc(1024);
+
+  // Small allocations are aligned and don't overlap.
+  char *prev = NULL;
+  for (int i = 1; i < 200; i++) {
+    char *p = Arena_malloc(arena, i % 37 + 1);
+    assert(p != NULL);
+    assert((uintptr_t)p % _Alignof(max_align_t) == 0);
+    memset(p, i, i % 37 + 1);
+    if (prev) {
+      assert(prev[0] == (char)(i - 1));
+    }
+    prev = p;
+  }
+
+  // The most recent allocation grows in place; anything else moves.
+  char *a = Arena_malloc(arena, 16);
+  strcpy(a, "grow me");
+  assert(Arena_realloc(arena, a, 16, 64) == a);
+  char *b = Arena_malloc(arena, 16);
+  char *moved = Arena_realloc(arena, a, 64, 128);
+  assert(moved != a && moved != b);
+  assert(strcmp(moved, "grow me") == 0);
+
+  // Oversized allocations get their own block.
+  char *big = Arena_calloc(arena, 10, 1000);
+  for (int i = 0; i < 10000; i++) {
+    assert(big[i] == 0);
+  }
+  assert(Arena_bytes_used(arena) >= 10000);
+
+  Arena_reset(arena);
+  assert(Arena_bytes_used(arena) == 0);
+  assert(Arena_malloc(arena, 8) != NULL);
+
+  Arena_free(arena);
+}
+
+// Builds every kind of arena-aware container and then frees only the arena;
+// test_find_leaks checks that nothing was left behind.
+TEST(arena_containers) {
+  Arena *arena = Arena_alloc(0);
+
+  List *list = List_alloc_ext(sizeof(int), arena);
+  ForwardList *flist = ForwardList_alloc_ext(sizeof(int), arena);
+  Vector *vector = Vector_alloc_ext(sizeof(int), arena);
+  Map *map = Map_alloc_ext(&IntKeyInfo, sizeof(int), arena);
+  Set *set = Set_alloc_ext(&IntKeyInfo, arena);
+  for (int i = 0; i < 1000; i++) {
+    List_append(list, &i);
+    ForwardList_append(flist, &i);
+    Vector_add(vector, &i);
+    int square = i * i;
+    Map_add(map, &i, &square);
+    Set_add(set, &i);
+  }
+  for (int i = 0; i < 1000; i += 2) {
+    Map_delete(map, &i);
+    Set_delete(set, &i);
+  }
+
+  assert(List_count(list) == 1000);
+  assert(*(int *)List_get_last(list) == 999);
+  assert(ForwardList_count(flist) == 1000);
+  assert(*(int *)ForwardList_get_last(flist) == 999);
+  assert(Vector_count(vector) == 1000);
+  assert(*(int *)Vector_get(vector, 500) == 500);
+  assert(Map_count(map) == 500 && Set_count(set) == 500);
+  for (int i = 0; i < 1000; i++) {
+    int square;
+    assert(Map_get(map, &i, &square) == (i % 2 == 1));
+    assert(i % 2 == 0 || square == i * i);
+    assert(Set_contains(set, &i) == (i % 2 == 1));
+  }
+
+  Arena_free(arena);
+}
+
+int arena_tests(void) {
+  return test_arena_basics() || test_arena_containers();
+}
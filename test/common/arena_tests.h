@@ -0,0 +1,9 @@
+#ifndef TEST_COMMON_ARENA_TESTS_H__
+#define TEST_COMMON_ARENA_TESTS_H__
+
+#include "../../common/public/arena.h"
+#include "../macros.h"
+
+int arena_tests(void);
+
+#endif // TEST_COMMON_ARENA_TESTS_H__
@@ -2,4 +2,8 @@
 
 #include "../macros.h"
 
-int common_tests(void) { return vector_tests() || map_tests(); }
+int common_tests(void) {
+  return vector_tests() || map_tests() || set_tests() || hash_tests() ||
+         arena_tests() || list_tests() || concurrency_tests() ||
+         priority_queue_tests() || log_tests() || rope_tests();
+}
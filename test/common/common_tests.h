@@ -3,6 +3,14 @@
 
 #include "vector_tests.h"
 #include "map_tests.h"
+#include "set_tests.h"
+#include "hash_tests.h"
+#include "arena_tests.h"
+#include "list_tests.h"
+#include "concurrency_tests.h"
+#include "priority_queue_tests.h"
+#include "log_tests.h"
+#include "rope_tests.h"
 
 int common_tests(void);
 
@@ -0,0 +1,486 @@
+#include "concurrency_tests.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+
+// Worker threads must not allocate: the TESTING malloc tracker is not
+// thread-safe.
+
+#define SPSC_ITEMS 100000
+
+TEST(spsc_queue_basics) {
+  SpscQueue *queue = SpscQueue_alloc(sizeof(int), 6);
+  assert(SpscQueue_capacity(queue) == 8);
+  int values[10] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+  assert(SpscQueue_enqueue_n(queue, values, 5) == 5);
+  int out[10];
+  assert(SpscQueue_dequeue_n(queue, out, 3) == 3);
+  assert(out[0] == 0 && out[2] == 2);
+  // Wraps around the end of the ring, and only fills what is free.
+  assert(SpscQueue_enqueue_n(queue, &values[5], 5) == 5);
+  assert(SpscQueue_count(queue) == 7);
+  assert(SpscQueue_enqueue(queue, &values[0]));
+  assert(!SpscQueue_enqueue(queue, &values[0]));
+  int first;
+  assert(SpscQueue_peek(queue, &first) && first == 3);
+  assert(SpscQueue_dequeue_n(queue, out, 10) == 8);
+  assert(out[0] == 3 && out[6] == 9 && out[7] == 0);
+  assert(SpscQueue_empty(queue));
+  assert(!SpscQueue_dequeue(queue, &first));
+
+  // Once closed, waiting calls drain what is left and then give up.
+  SpscQueue_enqueue(queue, &values[4]);
+  SpscQueue_close(queue);
+  assert(SpscQueue_dequeue_wait(queue, &first) && first == 4);
+  assert(!SpscQueue_dequeue_wait(queue, &first));
+  SpscQueue_free(queue);
+}
+
+// Produces 0..SPSC_ITEMS-1 in batches of varying size, then closes the queue.
+static void *_spsc_producer(void *arg) {
+  SpscQueue *queue = arg;
+  int batch[17];
+  int next = 0;
+  while (next < SPSC_ITEMS) {
+    int count = 1 + next % 17;
+    if (count > SPSC_ITEMS - next) {
+      count = SPSC_ITEMS - next;
+    }
+    for (int i = 0; i < count; i++) {
+      batch[i] = next + i;
+    }
+    assert(SpscQueue_enqueue_n_wait(queue, batch, count) == (size_t)count);
+    next += count;
+  }
+  SpscQueue_close(queue);
+  return NULL;
+}
+
+static void _spsc_threads(WaitPolicy wait) {
+  // A small ring, so both sides keep having to wait on each other.
+  SpscQueue *queue = SpscQueue_alloc_ext(sizeof(int), 64, wait);
+  pthread_t producer;
+  assert(pthread_create(&producer, NULL, _spsc_producer, queue) == 0);
+  int expected = 0;
+  Iterator iter;
+  SpscQueue_get_iterator(queue, &iter);
+  while (iter.move_next(&iter)) {
+    assert(*(int *)iter.current(&iter) == expected++);
+  }
+  assert(iter.eof(&iter));
+  assert(expected == SPSC_ITEMS);
+  pthread_join(producer, NULL);
+  SpscQueue_free(queue);
+}
+
+TEST(spsc_queue_threads) {
+  _spsc_threads(WAIT_SPIN);
+  _spsc_threads(WAIT_BLOCK);
+}
+
+static void *_spsc_sink_producer(void *arg) {
+  SpscQueue *queue = arg;
+  Sink sink;
+  SpscQueue_get_sink(queue, &sink);
+  for (long i = 0; i < SPSC_ITEMS; i++) {
+    assert(sink.add(&sink, &i) == &i);
+  }
+  SpscQueue_close(queue);
+  return NULL;
+}
+
+TEST(spsc_queue_sink) {
+  SpscQueue *queue = SpscQueue_alloc_ext(sizeof(long), 128, WAIT_BLOCK);
+  pthread_t producer;
+  assert(pthread_create(&producer, NULL, _spsc_sink_producer, queue) == 0);
+  long batch[100];
+  long expected = 0;
+  size_t count;
+  while ((count = SpscQueue_dequeue_n_wait(queue, batch, 100)) > 0) {
+    for (size_t i = 0; i < count; i++) {
+      assert(batch[i] == expected++);
+    }
+  }
+  assert(expected == SPSC_ITEMS);
+  pthread_join(producer, NULL);
+  SpscQueue_free(queue);
+}
+
+#define MPMC_THREADS 4
+#define MPMC_ITEMS_PER_PRODUCER 25000
+
+TEST(mpmc_queue_basics) {
+  IntMpmcQueue *queue = IntMpmcQueue_alloc(3);
+  assert(MpmcQueue_capacity(queue) == 4);
+  for (int i = 0; i < 4; i++) {
+    assert(IntMpmcQueue_enqueue(queue, i));
+  }
+  assert(!IntMpmcQueue_enqueue(queue, 4));
+  assert(MpmcQueue_count(queue) == 4);
+  int value;
+  assert(IntMpmcQueue_peek(queue, &value) && value == 0);
+  // Go around the ring a few times.
+  for (int i = 4; i < 20; i++) {
+    assert(IntMpmcQueue_dequeue(queue, &value) && value == i - 4);
+    assert(IntMpmcQueue_enqueue(queue, i));
+  }
+  for (int i = 16; i < 20; i++) {
+    assert(IntMpmcQueue_dequeue(queue, &value) && value == i);
+  }
+  assert(MpmcQueue_empty(queue));
+  assert(!IntMpmcQueue_dequeue(queue, &value));
+  assert(!IntMpmcQueue_peek(queue, &value));
+
+  IntMpmcQueue_enqueue(queue, 7);
+  MpmcQueue_close(queue);
+  assert(IntMpmcQueue_dequeue_wait(queue, &value) && value == 7);
+  assert(!IntMpmcQueue_dequeue_wait(queue, &value));
+  MpmcQueue_free(queue);
+}
+
+typedef struct {
+  MpmcQueue *queue;
+  int id;
+  long count;        // Consumers: how many items they got.
+  long sum;          // Consumers: the sum of the items they got.
+  long last[MPMC_THREADS]; // Consumers: the last item from each producer.
+} _MpmcWorker;
+
+// Items are producer * MPMC_ITEMS_PER_PRODUCER + sequence number.
+static void *_mpmc_producer(void *arg) {
+  _MpmcWorker *worker = arg;
+  for (long i = 0; i < MPMC_ITEMS_PER_PRODUCER; i++) {
+    long item = worker->id * MPMC_ITEMS_PER_PRODUCER + i;
+    assert(MpmcQueue_enqueue_wait(worker->queue, &item));
+  }
+  return NULL;
+}
+
+static void *_mpmc_consumer(void *arg) {
+  _MpmcWorker *worker = arg;
+  Iterator iter;
+  MpmcQueue_get_iterator(worker->queue, &iter);
+  while (iter.move_next(&iter)) {
+    long item = *(long *)iter.current(&iter);
+    int producer = item / MPMC_ITEMS_PER_PRODUCER;
+    // Each producer's items come out in the order they went in.
+    assert(item > worker->last[producer]);
+    worker->last[producer] = item;
+    worker->count++;
+    worker->sum += item;
+  }
+  return NULL;
+}
+
+static void _mpmc_threads(WaitPolicy wait) {
+  MpmcQueue *queue = MpmcQueue_alloc_ext(sizeof(long), 32, wait);
+  _MpmcWorker producers[MPMC_THREADS], consumers[MPMC_THREADS];
+  pthread_t producer_threads[MPMC_THREADS], consumer_threads[MPMC_THREADS];
+  for (int i = 0; i < MPMC_THREADS; i++) {
+    producers[i] = (_MpmcWorker){queue, i};
+    consumers[i] = (_MpmcWorker){queue, i};
+    for (int j = 0; j < MPMC_THREADS; j++) {
+      consumers[i].last[j] = -1;
+    }
+    assert(pthread_create(&consumer_threads[i], NULL, _mpmc_consumer,
+                          &consumers[i]) == 0);
+    assert(pthread_create(&producer_threads[i], NULL, _mpmc_producer,
+                          &producers[i]) == 0);
+  }
+  for (int i = 0; i < MPMC_THREADS; i++) {
+    pthread_join(producer_threads[i], NULL);
+  }
+  MpmcQueue_close(queue);
+  long count = 0, sum = 0;
+  for (int i = 0; i < MPMC_THREADS; i++) {
+    pthread_join(consumer_threads[i], NULL);
+    count += consumers[i].count;
+    sum += consumers[i].sum;
+  }
+  long total = MPMC_THREADS * MPMC_ITEMS_PER_PRODUCER;
+  assert(count == total);
+  assert(sum == total * (total - 1) / 2);
+  assert(MpmcQueue_empty(queue));
+  MpmcQueue_free(queue);
+}
+
+TEST(mpmc_queue_threads) {
+  _mpmc_threads(WAIT_SPIN);
+  _mpmc_threads(WAIT_BLOCK);
+}
+
+#define ATOMIC_STACK_THREADS 8
+#define ATOMIC_STACK_ITEMS_PER_THREAD 20000
+
+TEST(atomic_stack_basics) {
+  AtomicStack *stack = AtomicStack_alloc(sizeof(int));
+  int value;
+  assert(AtomicStack_empty(stack));
+  assert(!AtomicStack_pop(stack, &value));
+  assert(!AtomicStack_peek(stack, &value));
+  // Enough to need a few slabs.
+  for (int i = 0; i < 1000; i++) {
+    assert(AtomicStack_push(stack, &i));
+  }
+  assert(AtomicStack_peek(stack, &value) && value == 999);
+  for (int i = 999; i >= 500; i--) {
+    assert(AtomicStack_pop(stack, &value) && value == i);
+  }
+  // Recycled nodes come back in LIFO order too.
+  for (int i = 500; i < 600; i++) {
+    assert(AtomicStack_push(stack, &i));
+  }
+  for (int i = 599; i >= 0; i--) {
+    assert(AtomicStack_pop(stack, &value) && value == i);
+  }
+  assert(AtomicStack_empty(stack));
+  AtomicStack_free(stack);
+}
+
+typedef struct {
+  AtomicStack *stack;
+  atomic_uchar *seen;
+  int id;
+} _AtomicStackWorker;
+
+// Pushes a burst of unique items, then pops a burst of whatever is on top, so
+// nodes keep getting recycled between threads.
+static void *_atomic_stack_worker(void *arg) {
+  _AtomicStackWorker *worker = arg;
+  int next = 0;
+  while (next < ATOMIC_STACK_ITEMS_PER_THREAD) {
+    int burst = 1 + (next + worker->id) % 16;
+    for (int i = 0; i < burst && next < ATOMIC_STACK_ITEMS_PER_THREAD; i++) {
+      int item = worker->id * ATOMIC_STACK_ITEMS_PER_THREAD + next++;
+      assert(AtomicStack_push(worker->stack, &item));
+    }
+    int item;
+    for (int i = 0; i < burst && AtomicStack_pop(worker->stack, &item); i++) {
+      // Popping an item twice would mean the ABA problem bit us.
+      assert(atomic_fetch_add(&worker->seen[item], 1) == 0);
+    }
+  }
+  return NULL;
+}
+
+TEST(atomic_stack_threads) {
+  int total = ATOMIC_STACK_THREADS * ATOMIC_STACK_ITEMS_PER_THREAD;
+  AtomicStack *stack = AtomicStack_alloc(sizeof(int));
+  assert(AtomicStack_reserve(stack, total + ATOMIC_STACK_THREADS));
+  atomic_uchar *seen = calloc(total, sizeof(atomic_uchar));
+  _AtomicStackWorker workers[ATOMIC_STACK_THREADS];
+  pthread_t threads[ATOMIC_STACK_THREADS];
+  for (int i = 0; i < ATOMIC_STACK_THREADS; i++) {
+    workers[i] = (_AtomicStackWorker){stack, seen, i};
+    assert(pthread_create(&threads[i], NULL, _atomic_stack_worker,
+                          &workers[i]) == 0);
+  }
+  for (int i = 0; i < ATOMIC_STACK_THREADS; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  int item;
+  while (AtomicStack_pop(stack, &item)) {
+    assert(atomic_fetch_add(&seen[item], 1) == 0);
+  }
+  for (int i = 0; i < total; i++) {
+    assert(seen[i] == 1);
+  }
+  assert(AtomicStack_empty(stack));
+  free(seen);
+  AtomicStack_free(stack);
+}
+
+#define WORK_DEQUE_THIEVES 3
+#define WORK_DEQUE_ITEMS 100000
+
+TEST(work_deque_basics) {
+  WorkDeque *deque = WorkDeque_alloc(2);
+  int items[100];
+  assert(WorkDeque_empty(deque));
+  assert(WorkDeque_pop(deque) == NULL);
+  assert(WorkDeque_steal(deque) == NULL);
+  // Grows well past its first ring.
+  for (int i = 0; i < 100; i++) {
+    assert(WorkDeque_push(deque, &items[i]));
+  }
+  assert(WorkDeque_count(deque) == 100);
+  // The owner takes the newest, thieves the oldest.
+  assert(WorkDeque_pop(deque) == &items[99]);
+  assert(WorkDeque_steal(deque) == &items[0]);
+  assert(WorkDeque_steal(deque) == &items[1]);
+  for (int i = 98; i >= 2; i--) {
+    assert(WorkDeque_pop(deque) == &items[i]);
+  }
+  assert(WorkDeque_pop(deque) == NULL);
+  assert(WorkDeque_empty(deque));
+  WorkDeque_free(deque);
+}
+
+typedef struct {
+  WorkDeque *deque;
+  atomic_bool *stop;
+  long taken;
+} _WorkDequeThief;
+
+static void *_work_deque_thief(void *arg) {
+  _WorkDequeThief *thief = arg;
+  while (!atomic_load(thief->stop)) {
+    atomic_uchar *item = WorkDeque_steal(thief->deque);
+    if (item) {
+      assert(atomic_fetch_add(item, 1) == 0);
+      thief->taken++;
+    }
+  }
+  return NULL;
+}
+
+TEST(work_deque_steal) {
+  WorkDeque *deque = WorkDeque_alloc(16);
+  atomic_uchar *seen = calloc(WORK_DEQUE_ITEMS, sizeof(atomic_uchar));
+  atomic_bool stop = false;
+  _WorkDequeThief thieves[WORK_DEQUE_THIEVES];
+  pthread_t threads[WORK_DEQUE_THIEVES];
+  for (int i = 0; i < WORK_DEQUE_THIEVES; i++) {
+    thieves[i] = (_WorkDequeThief){deque, &stop, 0};
+    assert(pthread_create(&threads[i], NULL, _work_deque_thief,
+                          &thieves[i]) == 0);
+  }
+  // The owner pushes in bursts and pops some back, racing the thieves for the
+  // last item every time the deque runs low.
+  long taken = 0;
+  for (int next = 0; next < WORK_DEQUE_ITEMS;) {
+    int burst = 1 + next % 7;
+    for (int i = 0; i < burst && next < WORK_DEQUE_ITEMS; i++) {
+      assert(WorkDeque_push(deque, &seen[next++]));
+    }
+    atomic_uchar *item;
+    for (int i = 0; i < burst && (item = WorkDeque_pop(deque)); i++) {
+      assert(atomic_fetch_add(item, 1) == 0);
+      taken++;
+    }
+  }
+  atomic_uchar *item;
+  while ((item = WorkDeque_pop(deque))) {
+    assert(atomic_fetch_add(item, 1) == 0);
+    taken++;
+  }
+  atomic_store(&stop, true);
+  for (int i = 0; i < WORK_DEQUE_THIEVES; i++) {
+    pthread_join(threads[i], NULL);
+    taken += thieves[i].taken;
+  }
+  assert(taken == WORK_DEQUE_ITEMS);
+  for (int i = 0; i < WORK_DEQUE_ITEMS; i++) {
+    assert(seen[i] == 1);
+  }
+  free(seen);
+  WorkDeque_free(deque);
+}
+
+typedef struct {
+  ThreadPool *pool;
+  WaitGroup *group;
+  atomic_long *count;
+  int depth;
+} _TreeTask;
+
+// Counts itself, and submits two children to the same group until depth 0.
+// The tasks are laid out in a preallocated array in depth-first order.
+static void _tree_task(void *arg) {
+  _TreeTask *task = arg;
+  atomic_fetch_add(task->count, 1);
+  if (task->depth > 0) {
+    // The left subtree follows us; the right one follows that.
+    _TreeTask *children[2] = {task + 1, task + (1 << task->depth)};
+    for (int i = 0; i < 2; i++) {
+      _TreeTask *child = children[i];
+      *child = (_TreeTask){task->pool, task->group, task->count,
+                           task->depth - 1};
+      ThreadPool_submit(task->pool, task->group, _tree_task, child);
+    }
+  }
+}
+
+static void _count_task(void *arg) { atomic_fetch_add((atomic_long *)arg, 1); }
+
+TEST(thread_pool_submit) {
+  ThreadPool *pool = ThreadPool_alloc(4, 256);
+  assert(ThreadPool_thread_count(pool) == 4);
+  assert(ThreadPool_worker_index(pool) == -1);
+  WaitGroup *group = WaitGroup_alloc();
+  atomic_long count = 0;
+  // More than fit in the queue at once, so some run right here.
+  for (int i = 0; i < 10000; i++) {
+    ThreadPool_submit(pool, group, _count_task, &count);
+  }
+  ThreadPool_wait_group(pool, group);
+  assert(count == 10000);
+  assert(WaitGroup_pending(group) == 0);
+
+  // Tasks submitted from tasks go on the workers' own deques.
+  int depth = 12;
+  _TreeTask *tree = calloc(1 << (depth + 1), sizeof(_TreeTask));
+  count = 0;
+  tree[0] = (_TreeTask){pool, group, &count, depth};
+  ThreadPool_submit(pool, group, _tree_task, &tree[0]);
+  WaitGroup_wait(group);
+  assert(count == (1 << (depth + 1)) - 1);
+  free(tree);
+  WaitGroup_free(group);
+  ThreadPool_free(pool);
+}
+
+#define PARALLEL_FOR_COUNT 100000
+
+typedef struct {
+  ThreadPool *pool;
+  atomic_uchar *seen;
+  atomic_long sum;
+} _ParallelForTest;
+
+static void _parallel_for_inner(void *arg, size_t begin, size_t end) {
+  _ParallelForTest *test = arg;
+  long sum = 0;
+  for (size_t i = begin; i < end; i++) {
+    assert(atomic_fetch_add(&test->seen[i], 1) == 0);
+    sum += i;
+  }
+  atomic_fetch_add(&test->sum, sum);
+}
+
+// Each outer slice runs a nested loop over its own range.
+static void _parallel_for_outer(void *arg, size_t begin, size_t end) {
+  _ParallelForTest *test = arg;
+  ThreadPool_parallel_for(test->pool, begin, end, 100, _parallel_for_inner,
+                          test);
+}
+
+TEST(thread_pool_parallel_for) {
+  ThreadPool *pool = ThreadPool_alloc(4, 64);
+  _ParallelForTest test = {pool,
+                           calloc(PARALLEL_FOR_COUNT, sizeof(atomic_uchar))};
+  ThreadPool_parallel_for(pool, 0, PARALLEL_FOR_COUNT, 0, _parallel_for_inner,
+                          &test);
+  long expected = (long)PARALLEL_FOR_COUNT * (PARALLEL_FOR_COUNT - 1) / 2;
+  assert(test.sum == expected);
+  memset(test.seen, 0, PARALLEL_FOR_COUNT);
+  test.sum = 0;
+  ThreadPool_parallel_for(pool, 0, PARALLEL_FOR_COUNT, 10000,
+                          _parallel_for_outer, &test);
+  assert(test.sum == expected);
+  for (int i = 0; i < PARALLEL_FOR_COUNT; i++) {
+    assert(test.seen[i] == 1);
+  }
+  free(test.seen);
+  ThreadPool_free(pool);
+}
+
+int concurrency_tests(void) {
+  return test_spsc_queue_basics() || test_spsc_queue_threads() ||
+         test_spsc_queue_sink() || test_mpmc_queue_basics() ||
+         test_mpmc_queue_threads() || test_atomic_stack_basics() ||
+         test_atomic_stack_threads() || test_work_deque_basics() ||
+         test_work_deque_steal() || test_thread_pool_submit() ||
+         test_thread_pool_parallel_for();
+}
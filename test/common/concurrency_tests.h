@@ -0,0 +1,13 @@
+#ifndef TEST_COMMON_CONCURRENCY_TESTS_H__
+#define TEST_COMMON_CONCURRENCY_TESTS_H__
+
+#include "../../common/public/atomic_stack.h"
+#include "../../common/public/collections.h"
+#include "../../common/public/spsc_queue.h"
+#include "../../common/public/thread_pool.h"
+#include "../../common/public/work_deque.h"
+#include "../macros.h"
+
+int concurrency_tests(void);
+
+#endif // TEST_COMMON_CONCURRENCY_TESTS_H__
@@ -0,0 +1,65 @@
+#include "hash_tests.h"
+
+#include <string.h>
+
+#include "../../common/public/map.h"
+
+TEST(hash_bytes) {
+  char buffer[200];
+  for (int i = 0; i < (int)sizeof(buffer); i++) {
+    buffer[i] = (char)(i * 31 + 7);
+  }
+
+  // Every length takes a different path through the short/medium/bulk cases;
+  // the hash must not depend on alignment, and must see every byte.
+  for (size_t len = 0; len < 150; len++) {
+    uint64_t h = Hash_bytes(buffer, len, HASH_DEFAULT_SEED);
+    assert(len == 0 || Hash_bytes(buffer + 1, len, HASH_DEFAULT_SEED) != h);
+    char copy[160];
+    memcpy(copy + 3, buffer, len);
+    assert(Hash_bytes(copy + 3, len, HASH_DEFAULT_SEED) == h);
+    assert(Hash_bytes(buffer, len, HASH_DEFAULT_SEED + 1) != h);
+    if (len > 0) {
+      assert(Hash_bytes(buffer, len - 1, HASH_DEFAULT_SEED) != h);
+      copy[3 + len - 1] ^= 1;
+      assert(Hash_bytes(copy + 3, len, HASH_DEFAULT_SEED) != h);
+    }
+  }
+}
+
+TEST(hash_case) {
+  const char *upper = "THE QUICK BROWN FOX JUMPS OVER THE LAZY DOG @[`{ 0123 "
+                      "\xc3\xa9\xc3\x89";
+  const char *lower = "the quick brown fox jumps over the lazy dog @[`{ 0123 "
+                      "\xc3\xa9\xc3\x89";
+  size_t len = strlen(upper);
+  for (size_t i = 0; i <= len; i++) {
+    assert(Hash_bytes_case(upper, i, 0) == Hash_bytes_case(lower, i, 0));
+    assert(Hash_bytes_case(upper, i, 0) == Hash_bytes(upper, i, 0));
+  }
+  assert(Hash_cstring_case(lower, 0) == Hash_cstring(upper, 0));
+  assert(Hash_cstring(lower, 0) != Hash_cstring(upper, 0));
+
+  // Only letters fold: '@' and '`' sit next to the letter ranges.
+  assert(Hash_cstring_case("@", 0) != Hash_cstring_case("`", 0));
+  assert(Hash_cstring_case("[", 0) != Hash_cstring_case("{", 0));
+}
+
+TEST(hash_cstring_keys) {
+  Map *m = Map_alloc(&CStringCaseKeyInfo, sizeof(int));
+  char *keys[] = {"Alpha", "beta", "GAMMA"};
+  char *lookups[] = {"alpha", "BETA", "gamma"};
+  for (int i = 0; i < 3; i++) {
+    Map_add(m, &keys[i], &i);
+  }
+  for (int i = 0; i < 3; i++) {
+    int value;
+    assert(Map_get(m, &lookups[i], &value));
+    assert(value == i);
+  }
+  Map_free(m);
+}
+
+int hash_tests(void) {
+  return test_hash_bytes() || test_hash_case() || test_hash_cstring_keys();
+}
@@ -0,0 +1,9 @@
+#ifndef TEST_COMMON_HASH_TESTS_H__
+#define TEST_COMMON_HASH_TESTS_H__
+
+#include "../../common/public/hash.h"
+#include "../macros.h"
+
+int hash_tests(void);
+
+#endif // TEST_COMMON_HASH_TESTS_H__
@@ -0,0 +1,188 @@
+#include "list_tests.h"
+
+TEST(list_links) {
+  List *list = List_alloc(sizeof(int));
+  int values[] = {2, 4, 1, 3, 0};
+  ListNode *two = List_append(list, &values[0]);
+  ListNode *four = List_append(list, &values[1]);
+  List_insert_before(list, two, &values[2]);
+  List_insert_after(list, two, &values[3]);
+  List_prepend(list, &values[4]);
+
+  int expected = 0;
+  for (ListNode *node = List_get_first_node(list); node;
+       node = List_get_next_node(node)) {
+    assert(*(const int *)List_get(node) == expected++);
+  }
+  expected = 4;
+  for (ListNode *node = List_get_last_node(list); node;
+       node = List_get_previous_node(node)) {
+    assert(*(const int *)List_get(node) == expected--);
+  }
+  List_remove_range(list, List_get_next_node(List_get_first_node(list)), 3);
+  assert(List_count(list) == 2);
+  assert(List_get_last_node(list) == four);
+  assert(*(int *)List_get_first(list) == 0);
+
+  List_free(list);
+}
+
+TEST(forward_list_remove) {
+  ForwardList *list = ForwardList_alloc(sizeof(int));
+  for (int i = 0; i < 5; i++) {
+    ForwardList_append(list, &i);
+  }
+  // Removing a middle node pulls the next element into it.
+  ForwardListNode *node =
+      ForwardList_get_next_node(ForwardList_get_first_node(list));
+  ForwardList_remove(list, node);
+  assert(*(const int *)ForwardList_get(node) == 2);
+  ForwardList_remove_last(list);
+  assert(*(int *)ForwardList_get_last(list) == 3);
+  ForwardList_remove_first(list);
+  assert(*(int *)ForwardList_get_first(list) == 2);
+  assert(ForwardList_count(list) == 2);
+  ForwardList_remove_range(list, ForwardList_get_first_node(list), 2);
+  assert(ForwardList_empty(list));
+
+  ForwardList_free(list);
+}
+
+TEST(list_pooled) {
+  // A list with a pool of its own recycles removed nodes.
+  List *list = List_alloc_pooled(sizeof(int), NULL);
+  for (int i = 0; i < 100; i++) {
+    List_append(list, &i);
+  }
+  ListNode *last = List_get_last_node(list);
+  List_remove_last(list);
+  int value = 1000;
+  assert(List_append(list, &value) == last);
+  assert(*(int *)List_get_last(list) == 1000);
+  List_free(list);
+
+  // Lists sharing a pool reuse each other's nodes, and the pool outlives them.
+  Pool *nodes = ForwardList_node_pool_alloc(sizeof(long));
+  ForwardList *a = ForwardList_alloc_pooled(sizeof(long), nodes);
+  ForwardList *b = ForwardList_alloc_pooled(sizeof(long), nodes);
+  for (long i = 0; i < 1000; i++) {
+    ForwardList_append(i % 2 ? a : b, &i);
+  }
+  assert(Pool_count(nodes) == 1000);
+  ForwardList_free(a);
+  assert(Pool_count(nodes) == 500);
+  for (long i = 0; i < 500; i++) {
+    ForwardList_prepend(b, &i);
+  }
+  assert(Pool_count(nodes) == 1000);
+  assert(ForwardList_count(b) == 1000);
+  assert(*(long *)ForwardList_get_first(b) == 499);
+  assert(*(long *)ForwardList_get_last(b) == 998);
+  ForwardList_free(b);
+  assert(Pool_count(nodes) == 0);
+  Pool_free(nodes);
+}
+
+TEST(unrolled_list_cursor) {
+  // Int nodes hold dozens of elements, so these span several nodes.
+  IntUnrolledList *list = IntUnrolledList_alloc();
+  for (int i = 0; i < 1000; i += 2) {
+    IntUnrolledList_append(list, &i);
+  }
+  // Fill in the odd numbers through a cursor, splitting full nodes as we go.
+  UnrolledListCursor cursor;
+  UnrolledList_get_first_cursor(list, &cursor);
+  for (int i = 1; i < 1000; i += 2) {
+    IntUnrolledList_insert_after(list, &cursor, &i);
+    UnrolledList_move_next(&cursor);
+  }
+  assert(UnrolledList_count(list) == 1000);
+  assert(IntUnrolledList_get_last(list) == 999);
+
+  int expected = 0;
+  for (UnrolledList_get_first_cursor(list, &cursor); cursor.node;) {
+    size_t count;
+    int *span = IntUnrolledList_get_span(list, &cursor, &count);
+    for (size_t i = 0; i < count; i++) {
+      assert(span[i] == expected++);
+    }
+    cursor.index += count - 1;
+    UnrolledList_move_next(&cursor);
+  }
+  assert(expected == 1000);
+
+  // Removing every element but the multiples of 10 merges the nodes back up.
+  UnrolledList_get_first_cursor(list, &cursor);
+  while (cursor.node) {
+    if (IntUnrolledList_get(list, &cursor) % 10) {
+      IntUnrolledList_remove(list, &cursor);
+    } else {
+      UnrolledList_move_next(&cursor);
+    }
+  }
+  assert(UnrolledList_count(list) == 100);
+  for (int i = 0; i < 100; i++) {
+    assert(UnrolledList_get_cursor_at(list, i, &cursor));
+    assert(IntUnrolledList_get(list, &cursor) == i * 10);
+  }
+  assert(!UnrolledList_get_cursor_at(list, 100, &cursor));
+
+  UnrolledList_get_last_cursor(list, &cursor);
+  expected = 990;
+  do {
+    assert(IntUnrolledList_get(list, &cursor) == expected);
+    expected -= 10;
+  } while (UnrolledList_move_previous(&cursor));
+  assert(expected == -10);
+
+  UnrolledList_get_cursor_at(list, 10, &cursor);
+  UnrolledList_remove_range(list, &cursor, 80);
+  assert(IntUnrolledList_get(list, &cursor) == 900);
+  assert(UnrolledList_count(list) == 20);
+  UnrolledList_free(list);
+}
+
+TEST(unrolled_list_iterator) {
+  UnrolledList *list = UnrolledList_alloc_pooled(sizeof(long), NULL);
+  for (long i = 0; i < 300; i++) {
+    UnrolledList_prepend(list, &i);
+  }
+  Iterator iter;
+  UnrolledList_get_iterator(list, &iter);
+  long expected = 299;
+  while (iter.move_next(&iter)) {
+    assert(*(long *)iter.current(&iter) == expected--);
+  }
+  assert(expected == -1);
+  assert(iter.eof(&iter));
+
+  UnrolledList_get_reverse_iterator(list, &iter);
+  while (iter.move_next(&iter)) {
+    assert(*(long *)iter.current(&iter) == ++expected);
+  }
+  assert(expected == 299);
+
+  // Copying goes through the sink's element order.
+  UnrolledList *copy = UnrolledList_alloc(sizeof(long));
+  Sink sink;
+  UnrolledList_get_sink(copy, &sink);
+  UnrolledList_get_reverse_iterator(list, &iter);
+  assert(Iterator_copy(&sink, &iter));
+  assert(UnrolledList_count(copy) == 300);
+  assert(*(long *)UnrolledList_get_first(copy) == 0);
+  UnrolledList_remove_first(copy);
+  UnrolledList_remove_last(copy);
+  assert(*(long *)UnrolledList_get_last(copy) == 298);
+  UnrolledList_clear(copy);
+  assert(UnrolledList_empty(copy));
+  assert(UnrolledList_copy(copy, list));
+  assert(UnrolledList_count(copy) == 300);
+  UnrolledList_free(copy);
+  UnrolledList_free(list);
+}
+
+int list_tests(void) {
+  return test_list_links() || test_forward_list_remove() ||
+         test_list_pooled() || test_unrolled_list_cursor() ||
+         test_unrolled_list_iterator();
+}
@@ -0,0 +1,9 @@
+#ifndef TEST_COMMON_LIST_TESTS_H__
+#define TEST_COMMON_LIST_TESTS_H__
+
+#include "../../common/public/collections.h"
+#include "../macros.h"
+
+int list_tests(void);
+
+#endif // TEST_COMMON_LIST_TESTS_H__
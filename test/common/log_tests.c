@@ -0,0 +1,237 @@
+#include "log_tests.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../stubs.h"
+
+#define LOG_THREADS 4
+#define LOG_THREAD_RECORDS 1000
+
+static void _make_temp_file(char *path) {
+  strcpy(path, "/tmp/log_tests_XXXXXX");
+  int fd = mkstemp(path);
+  assert(fd >= 0);
+  close(fd);
+}
+
+// Decodes the log at `path' into a string, which the caller frees.
+static char *_decode(const char *path) {
+  FILE *in = fopen(path, "rb");
+  assert(in != NULL);
+  FILE *out = tmpfile();
+  assert(out != NULL);
+  assert(Log_decode(in, out));
+  fclose(in);
+  long size = ftell(out);
+  char *text = malloc(size + 1);
+  rewind(out);
+  assert(fread(text, 1, size, out) == (size_t)size);
+  text[size] = '\0';
+  fclose(out);
+  return text;
+}
+
+static size_t _count_lines(const char *text, const char *needle) {
+  size_t count = 0;
+  for (const char *p = text; (p = strstr(p, needle)); p++) {
+    count++;
+  }
+  return count;
+}
+
+// Calls Log_write itself, since LOG_FORMAT reads the indent the tracker
+// writes while another thread allocates its ring. The thread's ring is freed
+// once it exits and the logger has emptied it.
+static void *_log_thread(void *arg) {
+  static LogSite site = LOG_SITE_INIT("thread %d record %d");
+  int thread = *(int *)arg;
+  for (int i = 0; i < LOG_THREAD_RECORDS; i++) {
+    Log_write(&site, INFO, 0, thread, i);
+  }
+  return NULL;
+}
+
+TEST(log_binary) {
+  char path[32];
+  _make_temp_file(path);
+  assert(Log_start(path));
+  assert(Log_running());
+  assert(!Log_start(path));
+
+  char *pointer = (char *)0x1234;
+  LOG_FORMAT(INFO, "int %d long %ld size %zu str %s dbl %.2f ptr %p pct %% "
+                   "width [%*d] char %c",
+             42, -7L, (size_t)123, "hello", 3.14159, (void *)pointer, 5, 9,
+             'x');
+  char expected[128];
+  snprintf(expected, sizeof(expected),
+           "int %d long %ld size %zu str %s dbl %.2f ptr %p pct %% "
+           "width [%*d] char %c",
+           42, -7L, (size_t)123, "hello", 3.14159, (void *)pointer, 5, 9, 'x');
+
+  // Strings are cut short rather than spilling out of the record.
+  char long_string[200];
+  memset(long_string, 'a', sizeof(long_string) - 1);
+  long_string[sizeof(long_string) - 1] = '\0';
+  LOG_FORMAT(WARN, "long <%s>", long_string);
+
+  pthread_t threads[LOG_THREADS];
+  int ids[LOG_THREADS];
+  for (int i = 0; i < LOG_THREADS; i++) {
+    ids[i] = i;
+    assert(pthread_create(&threads[i], NULL, _log_thread, &ids[i]) == 0);
+  }
+  for (int i = 0; i < LOG_THREADS; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  Log_flush();
+  assert(Log_dropped() == 0);
+  Log_stop();
+  assert(!Log_running());
+
+  char *text = _decode(path);
+  assert(strstr(text, expected) != NULL);
+  assert(strstr(text, "INFO ") != NULL && strstr(text, "WARN ") != NULL);
+  char truncated[LOG_MAX_STRING + 16];
+  snprintf(truncated, sizeof(truncated), "long <%.*s>", LOG_MAX_STRING,
+           long_string);
+  assert(strstr(text, truncated) != NULL);
+  assert(_count_lines(text, "record ") == LOG_THREADS * LOG_THREAD_RECORDS);
+  assert(strstr(text, "thread 3 record 999") != NULL);
+  free(text);
+
+  // Stopped, the macros go back to printing.
+  LOG_FORMAT(DEBUG, "logger stopped %d", 1);
+  unlink(path);
+}
+
+// A key made after the logger's, whose destructor runs after the logger has
+// retired the thread's ring.
+static pthread_key_t _late_key;
+
+static void _log_late(void *arg) {
+  static LogSite site = LOG_SITE_INIT("logged while exiting %d");
+  // Lets the logger thread free the retired ring first.
+  Log_flush();
+  Log_write(&site, INFO, 0, *(int *)arg);
+}
+
+static void *_log_exiting_thread(void *arg) {
+  static LogSite site = LOG_SITE_INIT("exiting thread %d");
+  Log_write(&site, INFO, 0, *(int *)arg);
+  pthread_setspecific(_late_key, arg);
+  return NULL;
+}
+
+TEST(log_thread_exit) {
+  char path[32];
+  _make_temp_file(path);
+  assert(Log_start(path));
+  assert(pthread_key_create(&_late_key, _log_late) == 0);
+  int ids[LOG_THREADS];
+  for (int i = 0; i < LOG_THREADS; i++) {
+    pthread_t thread;
+    ids[i] = i;
+    assert(pthread_create(&thread, NULL, _log_exiting_thread, &ids[i]) == 0);
+    pthread_join(thread, NULL);
+  }
+  Log_stop();
+  pthread_key_delete(_late_key);
+
+  char *text = _decode(path);
+  assert(_count_lines(text, "exiting thread ") == LOG_THREADS);
+  assert(_count_lines(text, "logged while exiting ") == LOG_THREADS);
+  free(text);
+  unlink(path);
+}
+
+TEST(log_restart) {
+  char path[32];
+  _make_temp_file(path);
+  // The thread's ring from the last run is gone; this one gets a new one.
+  assert(Log_start(path));
+  LOG(INFO, "second run");
+  Log_stop();
+  char *text = _decode(path);
+  assert(strstr(text, "second run") != NULL);
+  assert(_count_lines(text, "record ") == 0);
+  free(text);
+
+  // Anything but a log is turned away.
+  FILE *file = fopen(path, "wb");
+  fputs("not a log", file);
+  fclose(file);
+  file = fopen(path, "rb");
+  FILE *out = fopen("/dev/null", "w");
+  assert(!Log_decode(file, out));
+  fclose(out);
+  fclose(file);
+  unlink(path);
+}
+
+TEST(log_text) {
+  // Catch what the logger thread prints.
+  FILE *capture = tmpfile();
+  assert(capture != NULL);
+  fflush(stdout);
+  int saved_stdout = dup(STDOUT_FILENO);
+  assert(saved_stdout >= 0);
+  assert(dup2(fileno(capture), STDOUT_FILENO) >= 0);
+
+  assert(Log_start(NULL));
+  LOG_FORMAT(DEBUG, "formatted by the logger thread: %d", 7);
+  Log_flush();
+  Log_stop();
+
+  fflush(stdout);
+  assert(dup2(saved_stdout, STDOUT_FILENO) >= 0);
+  close(saved_stdout);
+  char text[4096];
+  rewind(capture);
+  size_t size = fread(text, 1, sizeof(text) - 1, capture);
+  text[size] = '\0';
+  fclose(capture);
+
+  const char *message = strstr(text, "formatted by the logger thread: 7\n");
+  assert(message != NULL);
+  const char *line = message;
+  while (line > text && line[-1] != '\n') {
+    line--;
+  }
+  assert(strncmp(line, "DEBUG ", 6) == 0);
+  const char *file = strstr(line, "log_tests.c:");
+  assert(file != NULL && file < message);
+}
+
+TEST(log_crash) {
+  char path[32];
+  _make_temp_file(path);
+  fflush(stdout);
+  fflush(stderr);
+  pid_t child = fork();
+  assert(child >= 0);
+  if (child == 0) {
+    Log_start(path);
+    LOG_FORMAT(ERROR, "about to crash: %d", 99);
+    abort();
+  }
+  int status;
+  assert(waitpid(child, &status, 0) == child);
+  assert(WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT);
+
+  // What was still on the ring made it out before the process died.
+  char *text = _decode(path);
+  assert(strstr(text, "about to crash: 99") != NULL);
+  free(text);
+  unlink(path);
+}
+
+int log_tests(void) {
+  return test_log_binary() || test_log_thread_exit() || test_log_restart() ||
+         test_log_text() || test_log_crash();
+}
@@ -0,0 +1,9 @@
+#ifndef TEST_COMMON_LOG_TESTS_H__
+#define TEST_COMMON_LOG_TESTS_H__
+
+#include "../../common/public/log.h"
+#include "../macros.h"
+
+int log_tests(void);
+
+#endif // TEST_COMMON_LOG_TESTS_H__
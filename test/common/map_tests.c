@@ -25,4 +25,162 @@ TEST(map_basics) {
   Map_free(m);
 }
 
-int map_tests(void) { return test_map_basics(); }
+TEST(map_growth) {
+  Map *m = Map_alloc(&IntKeyInfo, sizeof(long));
+
+  for (int i = 0; i < 1000; i++) {
+    long value = i * 10L;
+    assert(Map_add(m, &i, &value).key != NULL);
+  }
+  assert(Map_count(m) == 1000);
+
+  // Overwriting an existing key doesn't add a new entry.
+  int key = 500;
+  long value = -1;
+  KeyValuePair kvp = Map_add(m, &key, &value);
+  assert(*(int *)kvp.key == 500);
+  assert(*(long *)kvp.value == -1);
+  assert(Map_count(m) == 1000);
+
+  for (int i = 0; i < 1000; i += 2) {
+    Map_delete(m, &i);
+  }
+  assert(Map_count(m) == 500);
+  for (int i = 0; i < 1000; i++) {
+    assert(Map_contains_key(m, &i) == (i % 2 == 1));
+  }
+
+  // Re-adding over the deleted slots.
+  for (int i = 0; i < 1000; i += 2) {
+    value = i * 10L;
+    Map_add(m, &i, &value);
+  }
+  assert(Map_count(m) == 1000);
+  for (int i = 0; i < 1000; i++) {
+    assert(Map_get(m, &i, &value));
+    assert(value == i * 10L);
+  }
+
+  // Every entry is visited exactly once.
+  Iterator iter;
+  long long key_sum = 0;
+  size_t visited = 0;
+  Map_get_iterator(m, &iter);
+  while (iter.move_next(&iter)) {
+    kvp = *(KeyValuePair *)iter.current(&iter);
+    key_sum += *(int *)kvp.key;
+    visited++;
+  }
+  assert(visited == 1000);
+  assert(key_sum == 999 * 1000 / 2);
+
+  Map_free(m);
+}
+
+TEST(map_incremental_rehash) {
+  Map *m = Map_alloc(&IntKeyInfo, sizeof(long));
+  Map_incremental_rehash(m, true);
+
+  // Lookups, overwrites and deletes all have to see entries in both tables
+  // while a migration is in flight.
+  for (int i = 0; i < 5000; i++) {
+    long value = i * 10L;
+    assert(Map_add(m, &i, &value).key != NULL);
+    assert(Map_get(m, &i, &value) && value == i * 10L);
+    int half = i / 2;
+    assert(Map_get(m, &half, &value) && value == half * 10L);
+    if (i % 3 == 0) {
+      value = -half;
+      Map_add(m, &half, &value);
+      value = half * 10L;
+      Map_add(m, &half, &value);
+    }
+  }
+  assert(Map_count(m) == 5000);
+  for (int i = 0; i < 5000; i += 2) {
+    Map_delete(m, &i);
+  }
+  assert(Map_count(m) == 2500);
+
+  long long key_sum = 0;
+  size_t visited = 0;
+  Iterator iter;
+  Map_get_key_iterator(m, &iter);
+  while (iter.move_next(&iter)) {
+    int key = *(int *)iter.current(&iter);
+    assert(key % 2 == 1);
+    key_sum += key;
+    visited++;
+  }
+  assert(visited == 2500);
+  assert(key_sum == 2500LL * 2500);
+
+  // Switching back finishes any migration in one go.
+  Map_incremental_rehash(m, false);
+  for (int i = 0; i < 5000; i++) {
+    assert(Map_contains_key(m, &i) == (i % 2 == 1));
+  }
+
+  Map_free(m);
+}
+
+// A KeyInfo written before hash64_fn existed: only the 32-bit hash is set.
+int _legacy_int_hash(const void *key) { return *(const int *)key * 31; }
+
+// Hashes that differ only in their high bits, which a table indexing with the
+// raw low bits would pile into one slot.
+uint64_t _high_bits_hash64(const void *key) {
+  return (uint64_t)*(const int *)key << 40;
+}
+
+TEST(map_hash_widths) {
+  KeyInfo legacy = {sizeof(int), _legacy_int_hash, Int_eq};
+  KeyInfo high_bits = {sizeof(int), NULL, Int_eq, _high_bits_hash64};
+  KeyInfo *key_infos[] = {&legacy, &high_bits};
+
+  for (int k = 0; k < 2; k++) {
+    Map *m = Map_alloc(key_infos[k], sizeof(long));
+    Map *copy = Map_alloc(&IntKeyInfo, sizeof(long));
+    for (int i = 0; i < 3000; i++) {
+      long value = i;
+      Map_add(m, &i, &value);
+    }
+    // Copying into a map that hashes differently has to rehash every key.
+    assert(Map_copy(copy, m));
+    for (int i = 0; i < 3000; i++) {
+      long value;
+      assert(Map_get(m, &i, &value) && value == i);
+      assert(Map_get(copy, &i, &value) && value == i);
+    }
+    Map_free(copy);
+    Map_free(m);
+  }
+}
+
+// Fractional keys must stay distinct rather than collapsing onto their integer
+// parts, and -0.0 has to find the entry stored under 0.0.
+TEST(map_float_keys) {
+  Map *m = Map_alloc(&DoubleKeyInfo, sizeof(int));
+  const int n = 16384;
+  for (int i = 0; i < n; i++) {
+    double key = i / (double)n;
+    Map_add(m, &key, &i);
+  }
+  assert(Map_count(m) == (size_t)n);
+  for (int i = 0; i < n; i++) {
+    double key = i / (double)n;
+    int value;
+    assert(Map_get(m, &key, &value) && value == i);
+  }
+  double negative_zero = -0.0;
+  int value;
+  assert(Map_get(m, &negative_zero, &value) && value == 0);
+
+  Map_free(m);
+}
+
+int map_tests(void) {
+  return test_map_basics() || test_map_growth() ||
+         test_map_incremental_rehash() || test_map_hash_widths() ||
+         test_map_float_keys();
+}
@@ -0,0 +1,235 @@
+#include "priority_queue_tests.h"
+
+#define PQ_TEST_COUNT 5000
+
+// Fills a queue with pseudo-random keys, some repeated, and checks they come
+// back out in order.
+static void _pq_order(size_t arity, PriorityQueueMode mode) {
+  PriorityQueue *queue =
+      PriorityQueue_alloc_ext(&IntRelationalKeyInfo, sizeof(int), mode, arity);
+  assert(PriorityQueue_arity(queue) == arity);
+  unsigned int seed = 1;
+  for (int i = 0; i < PQ_TEST_COUNT; i++) {
+    seed = seed * 1103515245 + 12345;
+    int key = (seed >> 16) % 1000;
+    PriorityQueue_enqueue(queue, &key, &i);
+  }
+  assert(PriorityQueue_count(queue) == PQ_TEST_COUNT);
+  int key, value, peek_key, peek_value;
+  int previous = mode == PQ_MODE_SMALLEST_FIRST ? -1 : 1000;
+  for (int i = 0; i < PQ_TEST_COUNT; i++) {
+    assert(PriorityQueue_peek(queue, &peek_key, &peek_value));
+    assert(PriorityQueue_dequeue(queue, &key, &value));
+    assert(key == peek_key && value == peek_value);
+    assert(mode == PQ_MODE_SMALLEST_FIRST ? key >= previous : key <= previous);
+    previous = key;
+  }
+  assert(PriorityQueue_empty(queue));
+  assert(!PriorityQueue_dequeue(queue, &key, &value));
+  PriorityQueue_free(queue);
+}
+
+TEST(priority_queue_order) {
+  size_t arities[] = {2, 3, 4, 8};
+  for (int i = 0; i < 4; i++) {
+    _pq_order(arities[i], PQ_MODE_SMALLEST_FIRST);
+    _pq_order(arities[i], PQ_MODE_LARGEST_FIRST);
+  }
+}
+
+TEST(priority_queue_interleaved) {
+  // Dequeues between enqueues move entries from the middle of the heap.
+  PriorityQueue *queue = PriorityQueue_alloc_ext(
+      &IntRelationalKeyInfo, sizeof(int), PQ_MODE_SMALLEST_FIRST, 4);
+  int key, value;
+  for (int i = 0; i < 100; i++) {
+    int k = (i * 37) % 101;
+    PriorityQueue_enqueue(queue, &k, &i);
+    if (i % 3 == 2) {
+      int top;
+      assert(PriorityQueue_peek(queue, &top, &value));
+      assert(PriorityQueue_dequeue(queue, &key, &value) && key == top);
+    }
+  }
+  int previous = -1;
+  while (PriorityQueue_dequeue(queue, &key, &value)) {
+    assert(key >= previous);
+    assert((value * 37) % 101 == key);
+    previous = key;
+  }
+  PriorityQueue_free(queue);
+}
+
+TEST(priority_queue_copy_iterator) {
+  PriorityQueue *queue = PriorityQueue_alloc(&IntRelationalKeyInfo,
+                                             sizeof(int), PQ_MODE_LARGEST_FIRST);
+  for (int i = 0; i < 10; i++) {
+    int k = (i * 7) % 10;
+    PriorityQueue_enqueue(queue, &k, &k);
+  }
+  PriorityQueue *copy = PriorityQueue_alloc(
+      &IntRelationalKeyInfo, sizeof(int), PQ_MODE_LARGEST_FIRST);
+  assert(PriorityQueue_copy(copy, queue));
+  assert(PriorityQueue_trim(copy));
+  assert(PriorityQueue_capacity(copy) == 10);
+
+  // Iterating drains the queue, largest first.
+  Iterator iter;
+  PriorityQueue_get_iterator(copy, &iter);
+  int expected = 9;
+  while (iter.move_next(&iter)) {
+    assert(*(int *)iter.current(&iter) == expected--);
+  }
+  assert(expected == -1);
+  assert(iter.eof(&iter));
+  assert(PriorityQueue_empty(copy));
+  assert(PriorityQueue_count(queue) == 10);
+  PriorityQueue_free(copy);
+  PriorityQueue_free(queue);
+}
+
+TEST(priority_queue_handles) {
+  PriorityQueue *queue = PriorityQueue_alloc_indexed(
+      &IntRelationalKeyInfo, sizeof(int), PQ_MODE_SMALLEST_FIRST, 4);
+  PriorityQueueHandle handles[100];
+  for (int i = 0; i < 100; i++) {
+    int key = 1000 + (i * 37) % 100;
+    handles[i] = PriorityQueue_enqueue_handle(queue, &key, &i);
+    assert(handles[i] != PQ_INVALID_HANDLE);
+  }
+  int key, value;
+  assert(PriorityQueue_get(queue, handles[10], &key, &value));
+  assert(key == 1000 + 370 % 100 && value == 10);
+  // Items 0..9 jump to the front in reverse, 90..99 drop to the back, and
+  // the odd ones in between leave.
+  for (int i = 0; i < 10; i++) {
+    int smaller = -1 - i;
+    assert(PriorityQueue_decrease_key(queue, handles[i], &smaller));
+    int larger = 3000 - i;
+    assert(PriorityQueue_increase_key(queue, handles[99 - i], &larger));
+  }
+  for (int i = 11; i < 90; i += 2) {
+    assert(PriorityQueue_remove(queue, handles[i], &key, &value));
+    assert(value == i);
+    assert(!PriorityQueue_contains(queue, handles[i]));
+    assert(!PriorityQueue_remove(queue, handles[i], NULL, NULL));
+  }
+  assert(PriorityQueue_count(queue) == 60);
+  for (int i = 9; i >= 0; i--) {
+    assert(PriorityQueue_dequeue(queue, &key, &value) && value == i);
+    assert(!PriorityQueue_contains(queue, handles[i]));
+  }
+  int previous = 0;
+  for (int i = 0; i < 40; i++) {
+    assert(PriorityQueue_dequeue(queue, &key, &value));
+    assert(value >= 10 && value < 90 && value % 2 == 0);
+    assert(key >= previous);
+    previous = key;
+  }
+  for (int i = 90; i < 100; i++) {
+    assert(PriorityQueue_dequeue(queue, &key, &value) && value == i);
+  }
+  assert(PriorityQueue_empty(queue));
+  // Handles get reused once their items are gone.
+  assert(PriorityQueue_enqueue_handle(queue, &key, &value) < 100);
+  PriorityQueue_free(queue);
+}
+
+#define DIJKSTRA_SIDE 20
+#define DIJKSTRA_NODES (DIJKSTRA_SIDE * DIJKSTRA_SIDE)
+
+static int _dijkstra_weight(int from, int to) { return (from * 7 + to) % 9 + 1; }
+
+// Shortest paths on a grid, with one queue entry per node whose key drops as
+// shorter paths turn up, checked against plain relaxation to a fixed point.
+TEST(priority_queue_dijkstra) {
+  int distance[DIJKSTRA_NODES], expected[DIJKSTRA_NODES];
+  for (int i = 0; i < DIJKSTRA_NODES; i++) {
+    expected[i] = i ? 1 << 30 : 0;
+  }
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (int from = 0; from < DIJKSTRA_NODES; from++) {
+      int neighbours[4] = {from - DIJKSTRA_SIDE, from + DIJKSTRA_SIDE,
+                           from % DIJKSTRA_SIDE ? from - 1 : -1,
+                           (from + 1) % DIJKSTRA_SIDE ? from + 1 : -1};
+      for (int n = 0; n < 4; n++) {
+        int to = neighbours[n];
+        if (to < 0 || to >= DIJKSTRA_NODES) continue;
+        int through = expected[from] + _dijkstra_weight(from, to);
+        if (through < expected[to]) {
+          expected[to] = through;
+          changed = true;
+        }
+      }
+    }
+  }
+
+  // Loading every node in order makes each node's handle its index.
+  Vector *nodes = Vector_alloc(sizeof(KeyValuePair));
+  int ids[DIJKSTRA_NODES];
+  for (int i = 0; i < DIJKSTRA_NODES; i++) {
+    ids[i] = i;
+    distance[i] = i ? 1 << 30 : 0;
+    KeyValuePair kvp = {&distance[i], &ids[i]};
+    Vector_add(nodes, &kvp);
+  }
+  PriorityQueue *queue = PriorityQueue_alloc_indexed(
+      &IntRelationalKeyInfo, sizeof(int), PQ_MODE_SMALLEST_FIRST, 4);
+  Iterator iter;
+  Vector_get_iterator(nodes, &iter);
+  assert(PriorityQueue_from_iterator(queue, &iter));
+  assert(PriorityQueue_count(queue) == DIJKSTRA_NODES);
+  int from, from_distance;
+  while (PriorityQueue_dequeue(queue, &from_distance, &from)) {
+    assert(from_distance == expected[from]);
+    int neighbours[4] = {from - DIJKSTRA_SIDE, from + DIJKSTRA_SIDE,
+                         from % DIJKSTRA_SIDE ? from - 1 : -1,
+                         (from + 1) % DIJKSTRA_SIDE ? from + 1 : -1};
+    for (int n = 0; n < 4; n++) {
+      int to = neighbours[n];
+      if (to < 0 || to >= DIJKSTRA_NODES) continue;
+      int through = from_distance + _dijkstra_weight(from, to);
+      if (PriorityQueue_get(queue, to, &distance[to], NULL) &&
+          through < distance[to]) {
+        assert(PriorityQueue_decrease_key(queue, to, &through));
+      }
+    }
+  }
+  PriorityQueue_free(queue);
+  Vector_free(nodes);
+}
+
+TEST(priority_queue_from_iterator) {
+  // Bulk loading on top of items already queued keeps them all in order.
+  PriorityQueue *queue = PriorityQueue_alloc_ext(
+      &IntRelationalKeyInfo, sizeof(int), PQ_MODE_LARGEST_FIRST, 3);
+  int keys[PQ_TEST_COUNT];
+  Vector *items = Vector_alloc(sizeof(KeyValuePair));
+  for (int i = 0; i < PQ_TEST_COUNT; i++) {
+    keys[i] = (i * 7919) % PQ_TEST_COUNT;
+    if (i < 10) {
+      PriorityQueue_enqueue(queue, &keys[i], &keys[i]);
+    } else {
+      KeyValuePair kvp = {&keys[i], &keys[i]};
+      Vector_add(items, &kvp);
+    }
+  }
+  Iterator iter;
+  Vector_get_iterator(items, &iter);
+  assert(PriorityQueue_from_iterator(queue, &iter));
+  for (int expected = PQ_TEST_COUNT - 1; expected >= 0; expected--) {
+    int key, value;
+    assert(PriorityQueue_dequeue(queue, &key, &value));
+    assert(key == expected && value == expected);
+  }
+  assert(PriorityQueue_empty(queue));
+  PriorityQueue_free(queue);
+  Vector_free(items);
+}
+
+int priority_queue_tests(void) {
+  return test_priority_queue_order() || test_priority_queue_interleaved() ||
+         test_priority_queue_copy_iterator() || test_priority_queue_handles() ||
+         test_priority_queue_dijkstra() || test_priority_queue_from_iterator();
+}
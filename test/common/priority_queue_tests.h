@@ -0,0 +1,10 @@
+#ifndef TEST_COMMON_PRIORITY_QUEUE_TESTS_H__
+#define TEST_COMMON_PRIORITY_QUEUE_TESTS_H__
+
+#include "../../common/public/priority_queue.h"
+#include "../../common/public/vector.h"
+#include "../macros.h"
+
+int priority_queue_tests(void);
+
+#endif // TEST_COMMON_PRIORITY_QUEUE_TESTS_H__
@@ -0,0 +1,154 @@
+#include "rope_tests.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../stubs.h"
+
+#define ROPE_LINES 10000
+
+// Checks the view against `expected' through every way of reading it.
+static void _check_view(RopeView view, const char *expected) {
+  size_t length = strlen(expected);
+  assert(view.length == length);
+  char *flat = RopeView_flatten(view);
+  assert(strcmp(flat, expected) == 0);
+  free(flat);
+  RopeChunkCursor cursor;
+  RopeChunk chunk;
+  size_t offset = 0;
+  RopeView_get_chunks(view, &cursor);
+  while (RopeChunkCursor_next(&cursor, &chunk)) {
+    assert(chunk.length > 0);
+    assert(memcmp(chunk.data, expected + offset, chunk.length) == 0);
+    offset += chunk.length;
+  }
+  assert(offset == length);
+  for (size_t i = 0; i < length; i++) {
+    assert(Rope_char_at(view.rope, view.start + i) == expected[i]);
+  }
+}
+
+TEST(rope_append) {
+  Rope *rope = Rope_alloc();
+  assert(Rope_length(rope) == 0);
+  char *flat = Rope_flatten(rope);
+  assert(strcmp(flat, "") == 0);
+  free(flat);
+
+  assert(Rope_append_c_str(rope, "Hello"));
+  assert(Rope_append(rope, ", world", 7));
+  assert(Rope_append_format(rope, "! %d + %d = %s", 2, 2, "4"));
+  _check_view(Rope_view(rope, 0, Rope_length(rope)),
+              "Hello, world! 2 + 2 = 4");
+  // Copies into the same chunk run together.
+  RopeChunkCursor cursor;
+  RopeChunk chunk;
+  RopeView_get_chunks(Rope_view(rope, 0, Rope_length(rope)), &cursor);
+  assert(RopeChunkCursor_next(&cursor, &chunk) && chunk.length == 23);
+  assert(!RopeChunkCursor_next(&cursor, &chunk));
+
+  // Spans chunks, and formats past the end of one.
+  Rope_clear(rope);
+  assert(Rope_length(rope) == 0);
+  char *expected = malloc(ROPE_LINES * 32);
+  size_t length = 0;
+  for (int i = 0; i < ROPE_LINES; i++) {
+    if (i % 2) {
+      assert(Rope_append_format(rope, "\tmovq %%rax, %d(%%rbp)\n", i));
+    } else {
+      assert(Rope_append_c_str(rope, "\tret\n"));
+    }
+    length += sprintf(expected + length,
+                      i % 2 ? "\tmovq %%rax, %d(%%rbp)\n" : "\tret\n", i);
+  }
+  // Bigger than any chunk.
+  char big[ROPE_MAX_CHUNK_SIZE * 2 + 1];
+  memset(big, 'x', sizeof(big) - 1);
+  big[sizeof(big) - 1] = '\0';
+  assert(Rope_append_c_str(rope, big));
+  expected = realloc(expected, length + sizeof(big));
+  strcpy(expected + length, big);
+  _check_view(Rope_view(rope, 0, Rope_length(rope)), expected);
+  free(expected);
+  Rope_free(rope);
+}
+
+TEST(rope_views) {
+  Rope *rope = Rope_alloc();
+  static const char constant[] = "constant";
+  Rope_append_c_str(rope, "0123456789");
+  assert(Rope_append_ref(rope, constant, 4));
+  assert(Rope_append_ref(rope, constant + 4, 4)); // Extends the last piece.
+  Rope_append_c_str(rope, "abc");
+  _check_view(Rope_view(rope, 0, 100), "0123456789constantabc");
+  RopeView view = Rope_view(rope, 8, 6);
+  _check_view(view, "89cons");
+  _check_view(RopeView_slice(view, 1, 3), "9co");
+  _check_view(RopeView_slice(view, 6, 3), "");
+  _check_view(Rope_view(rope, Rope_length(rope), 1), "");
+
+  // Views stay good as the Rope grows, and can be appended, even to itself.
+  for (int i = 0; i < 1000; i++) {
+    Rope_append_format(rope, "%03d", i);
+  }
+  _check_view(view, "89cons");
+  assert(Rope_append_view(rope, view));
+  assert(Rope_append_view(rope, Rope_view(rope, 0, 10)));
+  size_t length = Rope_length(rope);
+  _check_view(Rope_view(rope, length - 16, 16), "89cons0123456789");
+
+  Rope *other = Rope_alloc();
+  assert(Rope_append_view(other, Rope_view(rope, 12, 9)));
+  Rope_append_c_str(other, "!");
+  _check_view(Rope_view(other, 0, 10), "nstantabc!");
+  Rope_free(other);
+  Rope_free(rope);
+}
+
+TEST(rope_arena) {
+  Arena *arena = Arena_alloc(0);
+  Rope *rope = Rope_alloc_ext(arena);
+  for (int i = 0; i < 1000; i++) {
+    Rope_append_format(rope, "%d,", i % 10);
+  }
+  assert(Rope_length(rope) == 2000);
+  assert(Rope_char_at(rope, 1998) == '9');
+  // Everything goes with the arena.
+  Arena_free(arena);
+}
+
+TEST(rope_write) {
+  Rope *rope = Rope_alloc();
+  char *expected = malloc(ROPE_LINES * 16);
+  size_t length = 0;
+  static const char ref[] = "ref\n";
+  for (int i = 0; i < ROPE_LINES; i++) {
+    // Alternating copies and references keeps every piece separate, so it
+    // takes several writev calls.
+    Rope_append_format(rope, "line %d\n", i);
+    Rope_append_ref(rope, ref, 4);
+    length += sprintf(expected + length, "line %d\nref\n", i);
+  }
+  char path[] = "/tmp/rope_tests_XXXXXX";
+  int fd = mkstemp(path);
+  assert(fd >= 0);
+  assert(RopeView_write(Rope_view(rope, 0, Rope_length(rope)), fd));
+  assert(RopeView_write(Rope_view(rope, 3, 10), fd));
+  assert(lseek(fd, 0, SEEK_END) == (off_t)(length + 10));
+  char *actual = malloc(length + 10);
+  assert(pread(fd, actual, length + 10, 0) == (ssize_t)(length + 10));
+  assert(memcmp(actual, expected, length) == 0);
+  assert(memcmp(actual + length, expected + 3, 10) == 0);
+  close(fd);
+  unlink(path);
+  free(actual);
+  free(expected);
+  Rope_free(rope);
+}
+
+int rope_tests(void) {
+  return test_rope_append() || test_rope_views() || test_rope_arena() ||
+         test_rope_write();
+}
@@ -0,0 +1,10 @@
+#ifndef TEST_COMMON_ROPE_TESTS_H__
+#define TEST_COMMON_ROPE_TESTS_H__
+
+#include "../../common/public/arena.h"
+#include "../../common/public/rope.h"
+#include "../macros.h"
+
+int rope_tests(void);
+
+#endif // TEST_COMMON_ROPE_TESTS_H__
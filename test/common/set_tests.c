@@ -0,0 +1,72 @@
+#include "set_tests.h"
+
+TEST(set_basics) {
+  Set *s = Set_alloc(&IntKeyInfo);
+  int one = 1, two = 2, three = 3, four = 4;
+
+  Set_add(s, &one);
+  Set_add(s, &two);
+  Set_add(s, &three);
+  Set_add(s, &two);
+
+  assert(Set_count(s) == 3);
+  assert(Set_contains(s, &one));
+  assert(Set_contains(s, &two));
+  assert(Set_contains(s, &three));
+  assert(!Set_contains(s, &four));
+
+  Set_delete(s, &two);
+  assert(Set_count(s) == 2);
+  assert(!Set_contains(s, &two));
+
+  Set_free(s);
+}
+
+TEST(set_incremental_rehash) {
+  Set *s = Set_alloc(&IntKeyInfo);
+  Set_incremental_rehash(s, true);
+
+  // Lookups and deletes have to see items in both bucket vectors while a
+  // migration is in flight.
+  for (int i = 0; i < 5000; i++) {
+    assert(Set_add(s, &i) != NULL);
+    assert(Set_contains(s, &i));
+    int half = i / 2;
+    assert(Set_contains(s, &half));
+    if (i % 3 == 0) {
+      Set_delete(s, &half);
+      assert(!Set_contains(s, &half));
+      Set_add(s, &half);
+    }
+  }
+  assert(Set_count(s) == 5000);
+  for (int i = 0; i < 5000; i += 2) {
+    Set_delete(s, &i);
+  }
+  assert(Set_count(s) == 2500);
+
+  long long sum = 0;
+  size_t visited = 0;
+  Iterator iter;
+  Set_get_iterator(s, &iter);
+  while (iter.move_next(&iter)) {
+    int value = *(int *)iter.current(&iter);
+    assert(value % 2 == 1);
+    sum += value;
+    visited++;
+  }
+  assert(visited == 2500);
+  assert(sum == 2500LL * 2500);
+
+  // Switching back finishes any migration in one go.
+  Set_incremental_rehash(s, false);
+  for (int i = 0; i < 5000; i++) {
+    assert(Set_contains(s, &i) == (i % 2 == 1));
+  }
+
+  Set_free(s);
+}
+
+int set_tests(void) {
+  return test_set_basics() || test_set_incremental_rehash();
+}
@@ -0,0 +1,9 @@
+#ifndef TEST_COMMON_SET_TESTS_H__
+#define TEST_COMMON_SET_TESTS_H__
+
+#include "../../common/public/set.h"
+#include "../macros.h"
+
+int set_tests(void);
+
+#endif // TEST_COMMON_SET_TESTS_H__
@@ -1,6 +1,8 @@
 #include "vector_tests.h"
 
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 void test_string_foreach(char **item);
 
@@ -211,9 +213,438 @@ TEST(vector_copy) {
   Vector_free((Vector*)vector);
 }
 
+// Checks each kernel against qsort, across the sizes where the kernels switch
+// between insertion sort, introsort, counting and radix sort.
+#define CHECK_SORT_KERNEL(name, T, make_expr)                                  \
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {             \
+    size_t n = sizes[s];                                                       \
+    T *data = malloc((n + 1) * sizeof(T));                                     \
+    T *expected = malloc((n + 1) * sizeof(T));                                 \
+    for (size_t i = 0; i < n; i++) {                                           \
+      unsigned r = (unsigned)rand();                                           \
+      data[i] = expected[i] = (T)(make_expr);                                  \
+    }                                                                          \
+    qsort(expected, n, sizeof(T), name##_compare);                             \
+    name##_sort(data, n);                                                      \
+    for (size_t i = 0; i < n; i++) {                                           \
+      assert(data[i] == expected[i]);                                          \
+    }                                                                          \
+    free(expected);                                                            \
+    free(data);                                                                \
+  }
+
+TEST(vector_sort_kernels) {
+  size_t sizes[] = {0, 1, 2, 16, 17, 255, 256, 1000, 5000};
+  srand(15);
+  CHECK_SORT_KERNEL(Int, int, (int)r - RAND_MAX / 2)
+  CHECK_SORT_KERNEL(Int, int, (int)(r % 100) - 50) // counted
+  CHECK_SORT_KERNEL(Int, int, (int)(r % 3))        // mostly duplicates
+  CHECK_SORT_KERNEL(Long, long, ((long)r << 20) - ((long)RAND_MAX << 19))
+  CHECK_SORT_KERNEL(Short, short, r)
+  CHECK_SORT_KERNEL(Char, char, r)
+  CHECK_SORT_KERNEL(UnsignedChar, unsigned char, r)
+  CHECK_SORT_KERNEL(UnsignedShort, unsigned short, r)
+  CHECK_SORT_KERNEL(UnsignedInt, unsigned int, r * 2654435761u)
+  CHECK_SORT_KERNEL(UnsignedLong, unsigned long, (unsigned long)r << 33 | r)
+  CHECK_SORT_KERNEL(Float, float, ((int)r - RAND_MAX / 2) / 1000.0f)
+  CHECK_SORT_KERNEL(Double, double, ((int)r - RAND_MAX / 2) * 1e-3)
+  CHECK_SORT_KERNEL(LongDouble, long double, ((int)r - RAND_MAX / 2) * 1e-3L)
+
+  // Already sorted and reversed input must not go quadratic or deep.
+  int *ints = malloc(100000 * sizeof(int));
+  for (int i = 0; i < 100000; i++) {
+    ints[i] = 100000 - i;
+  }
+  Int_sort(ints, 100000);
+  for (int i = 0; i < 100000; i++) {
+    assert(ints[i] == i + 1);
+  }
+  free(ints);
+}
+
+int Int_compare_descending(const void *a, const void *b) {
+  return Int_compare(b, a);
+}
+
+TEST(vector_sort) {
+  assert(Sort_find_kernel(Int_compare, sizeof(int)) == (SortFn)Int_sort);
+  assert(Sort_find_kernel(Int_compare, sizeof(long)) == NULL);
+  assert(Sort_find_kernel(Int_compare_descending, sizeof(int)) == NULL);
+
+  int values[] = {5, -3, 9, 0, 7, 7, -12, 4, 1000, 2};
+  int sorted[] = {-12, -3, 0, 2, 4, 5, 7, 7, 9, 1000};
+  int reversed[] = {1000, 9, 7, 7, 5, 4, 2, 0, -3, -12};
+  size_t count = sizeof(values) / sizeof(values[0]);
+
+  IntVector *vector = IntVector_alloc();
+  IntVector_add_range(vector, values, count);
+  IntVector_sort(vector, Int_compare);
+  assert(memcmp(IntVector_get_data(vector), sorted, sizeof(sorted)) == 0);
+  // Unknown compare functions still work, through qsort.
+  IntVector_sort(vector, Int_compare_descending);
+  assert(memcmp(IntVector_get_data(vector), reversed, sizeof(reversed)) == 0);
+
+  CStringVector *strings = CStringVector_alloc();
+  const char *words[] = {"pear", "Apple", "fig", "banana"};
+  CStringVector_add_range(strings, words, 4);
+  CStringVector_sort(strings, CString_compare);
+  assert(strcmp(CStringVector_get(strings, 0), "Apple") == 0);
+  assert(strcmp(CStringVector_get(strings, 3), "pear") == 0);
+  CStringVector_sort(strings, CStringCase_compare);
+  assert(strcmp(CStringVector_get(strings, 0), "Apple") == 0);
+  assert(strcmp(CStringVector_get(strings, 1), "banana") == 0);
+  Vector_free((Vector *)strings);
+
+  // Iterator_sort into a Vector, an Array and a collection without an Indexer.
+  Iterator iter;
+  Sink sink;
+  IntVector_get_iterator(vector, (IntIterator *)&iter);
+  IntVector *dest = IntVector_alloc();
+  IntVector_add(dest, 42);
+  IntVector_get_sink(dest, (IntSink *)&sink);
+  assert(Iterator_sort(&sink, &iter, Int_compare));
+  assert(Vector_count((Vector *)dest) == count);
+  assert(memcmp(IntVector_get_data(dest), sorted, sizeof(sorted)) == 0);
+
+  IntArray *array = IntArray_alloc(count + 2);
+  IntArray_get_data(array)[count] = -1;
+  IntArray_get_data(array)[count + 1] = -1;
+  IntVector_get_iterator(vector, (IntIterator *)&iter);
+  IntArray_get_sink(array, (IntSink *)&sink);
+  assert(Iterator_sort(&sink, &iter, Int_compare));
+  assert(memcmp(IntArray_get_data(array), sorted, sizeof(sorted)) == 0);
+  assert(IntArray_get_data(array)[count] == -1);
+
+  IntMpmcQueue *queue = IntMpmcQueue_alloc(count);
+  IntVector_get_iterator(vector, (IntIterator *)&iter);
+  IntMpmcQueue_get_sink(queue, (IntSink *)&sink);
+  assert(Iterator_sort(&sink, &iter, Int_compare));
+  for (size_t i = 0; i < count; i++) {
+    int value;
+    assert(IntMpmcQueue_dequeue(queue, &value));
+    assert(value == sorted[i]);
+  }
+  assert(MpmcQueue_empty((MpmcQueue *)queue));
+
+  MpmcQueue_free((MpmcQueue *)queue);
+  Array_free((Array *)array);
+  Vector_free((Vector *)dest);
+  Vector_free((Vector *)vector);
+}
+
+// Appends `count' ints one at a time, checking that every earlier one is
+// still there whenever the buffer moves.
+static void _vector_append(Vector *vector, int count) {
+  for (int i = 0; i < count; i++) {
+    void *data = Vector_get_data(vector);
+    int value = Vector_count(vector);
+    Vector_add(vector, &value);
+    assert(Vector_capacity(vector) >= Vector_count(vector));
+    if (data != Vector_get_data(vector)) {
+      int *values = Vector_get_data(vector);
+      for (int j = 0; j <= value; j++) {
+        assert(values[j] == j);
+      }
+    }
+  }
+}
+
+TEST(vector_growth) {
+  VectorGrowth policies[] = {VECTOR_GROW_DOUBLE, VECTOR_GROW_BY_HALF,
+                             VECTOR_GROW_PAGES, VECTOR_GROW_MAPPED};
+  for (size_t p = 0; p < 4; p++) {
+    Vector *vector = Vector_alloc(sizeof(int));
+    assert(Vector_growth(vector) == VECTOR_GROW_DOUBLE);
+    Vector_set_growth(vector, policies[p]);
+    assert(Vector_growth(vector) == policies[p]);
+    _vector_append(vector, 1000);
+    size_t capacity = Vector_capacity(vector);
+    switch (policies[p]) {
+    case VECTOR_GROW_DOUBLE:
+      assert(capacity == 1024);
+      break;
+    case VECTOR_GROW_BY_HALF:
+      assert(capacity >= 1000 && capacity < 1500);
+      break;
+    default:
+      assert(capacity * sizeof(int) % 4096 == 0);
+      break;
+    }
+    Vector_free(vector);
+  }
+
+  // Past VECTOR_MAP_THRESHOLD, the mapped vector's contents survive growing
+  // by mremap, shrinking back to the heap and growing again.
+  size_t big = 3 * VECTOR_MAP_THRESHOLD / sizeof(int);
+  Vector *vector = Vector_alloc(sizeof(int));
+  Vector_set_growth(vector, VECTOR_GROW_MAPPED);
+  assert(Vector_expand(vector, big));
+  int *values = Vector_get_data(vector);
+  for (size_t i = 0; i < big; i++) {
+    values[i] = (int)i;
+  }
+  _vector_append(vector, 10);
+  assert(Vector_count(vector) == big + 10);
+  assert(Vector_capacity(vector) > big + 10);
+  Vector_remove_range(vector, 1000, Vector_count(vector) - 1000);
+  assert(Vector_count(vector) == 1000);
+  assert(Vector_trim(vector));
+  assert(Vector_capacity(vector) == 1000);
+  _vector_append(vector, 1000);
+  assert(Vector_expand(vector, big));
+  values = Vector_get_data(vector);
+  for (size_t i = 0; i < 2000; i++) {
+    assert(values[i] == (int)i);
+  }
+  Vector_clear(vector);
+  assert(Vector_get_data(vector) == NULL);
+  Vector_free(vector);
+}
+
+DECLARE_SMALL_VECTOR(Int, int, 4)
+DEFINE_SMALL_VECTOR(Int, int, 4)
+
+TEST(vector_small) {
+  IntSmallVector small;
+  IntVector *vector = IntSmallVector_init(&small);
+  assert(vector == IntSmallVector_vector(&small));
+  assert((void *)IntVector_get_data(vector) == (void *)small.items);
+  assert(Vector_count((Vector *)vector) == 0);
+  assert(Vector_capacity((Vector *)vector) == 4);
+
+  // Stays inline up to 4, then spills to the heap with everything kept.
+  for (int i = 0; i < 4; i++) {
+    IntVector_add(vector, i);
+  }
+  assert((void *)IntVector_get_data(vector) == (void *)small.items);
+  IntVector_add(vector, 4);
+  assert((void *)IntVector_get_data(vector) != (void *)small.items);
+  for (int i = 0; i < 5; i++) {
+    assert(IntVector_get(vector, i) == i);
+  }
+
+  // Trimming moves it back inline once it fits again.
+  Vector_remove_range((Vector *)vector, 0, 2);
+  assert(Vector_trim((Vector *)vector));
+  assert((void *)IntVector_get_data(vector) == (void *)small.items);
+  assert(IntVector_get(vector, 0) == 2 && IntVector_get(vector, 2) == 4);
+  assert(Vector_capacity((Vector *)vector) == 4);
+
+  // Clearing a spilled vector goes back to the inline storage too.
+  for (int i = 0; i < 20; i++) {
+    IntVector_add(vector, i);
+  }
+  Vector_clear((Vector *)vector);
+  assert((void *)IntVector_get_data(vector) == (void *)small.items);
+  assert(Vector_capacity((Vector *)vector) == 4);
+  IntVector_add(vector, 7);
+  assert(IntVector_get(vector, 0) == 7);
+  IntSmallVector_cleanup(&small);
+
+  // One allocation for the header and the first elements.
+  IntVector *allocated = IntSmallVector_alloc();
+  IntVector_add(allocated, 1);
+  IntVector_add(allocated, 2);
+  Vector *copy = Vector_alloc(sizeof(int));
+  assert(Vector_copy(copy, (Vector *)allocated));
+  assert(Vector_count(copy) == 2);
+  for (int i = 3; i <= 10; i++) {
+    IntVector_add(allocated, i);
+  }
+  assert(IntVector_get(allocated, 9) == 10);
+  Vector_free(copy);
+  Vector_free((Vector *)allocated);
+}
+
+struct _Symbol {
+  unsigned long address;
+  int index;
+};
+
+static int _Symbol_compare(const void *a, const void *b) {
+  unsigned long x = ((const struct _Symbol *)a)->address;
+  unsigned long y = ((const struct _Symbol *)b)->address;
+  return (x > y) - (x < y);
+}
+
+TEST(vector_parallel_sort) {
+  ThreadPool *pool = ThreadPool_alloc(3, 64);
+  srand(16);
+
+  // Sizes that split unevenly into runs, and one under the threshold.
+  size_t sizes[] = {SORT_PARALLEL_THRESHOLD - 1, 300001};
+  for (size_t s = 0; s < 2; s++) {
+    size_t n = sizes[s];
+    IntArray *array = IntArray_alloc(n);
+    int *expected = malloc(n * sizeof(int));
+    for (size_t i = 0; i < n; i++) {
+      expected[i] = IntArray_get_data(array)[i] = rand() - RAND_MAX / 2;
+    }
+    qsort(expected, n, sizeof(int), Int_compare);
+    Indexer indexer;
+    IntArray_get_indexer(array, (IntIndexer *)&indexer);
+    Indexer_parallel_sort(&indexer, Int_compare, pool);
+    assert(memcmp(IntArray_get_data(array), expected, n * sizeof(int)) == 0);
+    free(expected);
+    Array_free((Array *)array);
+  }
+
+  // Records with an unknown compare function, many of them tied, in a Vector
+  // sorted on a pool made for the call.
+  size_t n = 200003;
+  struct _Symbol *symbols = malloc(n * sizeof(struct _Symbol));
+  for (size_t i = 0; i < n; i++) {
+    symbols[i].address = (unsigned long)(rand() % 5000) << 12;
+    symbols[i].index = (int)i;
+  }
+  Vector *vector = Vector_alloc(sizeof(struct _Symbol));
+  Vector_add_range(vector, symbols, n);
+  Indexer indexer;
+  Vector_get_indexer(vector, &indexer);
+  Indexer_parallel_sort(&indexer, _Symbol_compare, NULL);
+  struct _Symbol *sorted = Vector_get_data(vector);
+  char *seen = calloc(n, 1);
+  for (size_t i = 0; i < n; i++) {
+    assert(i == 0 || sorted[i - 1].address <= sorted[i].address);
+    assert(sorted[i].address == symbols[sorted[i].index].address);
+    assert(!seen[sorted[i].index]);
+    seen[sorted[i].index] = 1;
+  }
+  free(seen);
+  Vector_free(vector);
+  free(symbols);
+  ThreadPool_free(pool);
+}
+
+TEST(vector_typed) {
+  // The inline accessors and the generic functions share one vector.
+  IntVector *vector = IntVector_alloc();
+  for (int i = 0; i < 1000; i++) {
+    assert(*IntVector_add(vector, i) == i);
+    if (i % 2) {
+      Vector_add((Vector *)vector, &i);
+    }
+  }
+  assert(Vector_count((Vector *)vector) == 1500);
+  assert(IntVector_get(vector, 1) == 1 && IntVector_get(vector, 2) == 1);
+  assert(*(int *)Vector_get((Vector *)vector, 1499) == 999);
+  IntVector_set(vector, 0, 42);
+  assert(*(int *)Vector_get((Vector *)vector, 0) == 42);
+  assert(IntVector_get_ref(vector, 5) == IntVector_get_data(vector) + 5);
+
+  // Setting through the inline path is a change iterators see.
+  IntIterator iter;
+  IntVector_get_iterator(vector, &iter);
+  assert(iter.version == ((VectorPrefix *)vector)->version);
+  IntVector_set(vector, 1, 7);
+  assert(iter.version != ((VectorPrefix *)vector)->version);
+  Vector_free((Vector *)vector);
+
+  // Pointer elements, where `const T' is a pointer to const.
+  CStringVector *strings = CStringVector_alloc();
+  const char *words[] = {"a", "b"};
+  CStringVector_add_ref(strings, &words[0]);
+  CStringVector_set_ref(strings, 0, &words[1]);
+  assert(CStringVector_get(strings, 0) == words[1]);
+  Vector_free((Vector *)strings);
+}
+
+// Makes an empty file to open, since a new file-backed collection is made
+// from an empty one.
+static void _make_temp_file(char *path) {
+  strcpy(path, "/tmp/vector_tests_XXXXXX");
+  int fd = mkstemp(path);
+  assert(fd >= 0);
+  close(fd);
+}
+
+TEST(vector_file) {
+  char path[32];
+  _make_temp_file(path);
+
+  IntVector *vector = IntVector_open_file(path);
+  assert(vector != NULL);
+  assert(Vector_count((Vector *)vector) == 0);
+  for (int i = 0; i < 100000; i++) {
+    IntVector_add(vector, i * 3);
+  }
+  assert(Vector_sync((Vector *)vector));
+  Vector_free((Vector *)vector);
+
+  // Reopening maps the same elements back, with nothing to read.
+  vector = IntVector_open_file(path);
+  assert(vector != NULL);
+  assert(Vector_count((Vector *)vector) == 100000);
+  assert(IntVector_get(vector, 99999) == 99999 * 3);
+  IntIterator iter;
+  IntVector_get_iterator(vector, &iter);
+  int expected = 0;
+  while (iter.move_next(&iter)) {
+    assert(*iter.current(&iter) == expected);
+    expected += 3;
+  }
+  assert(expected == 100000 * 3);
+  Indexer indexer;
+  IntVector_get_indexer(vector, (IntIndexer *)&indexer);
+  assert(indexer.size(&indexer) == 100000);
+  assert(*(int *)indexer.get(&indexer, 500) == 1500);
+
+  // Removing and trimming shrinks the file; it has to hold the wrong size of
+  // element to be refused.
+  Vector_truncate((Vector *)vector, 10);
+  assert(Vector_trim((Vector *)vector));
+  Vector_free((Vector *)vector);
+  assert(Vector_open_file(path, sizeof(long)) == NULL);
+  vector = IntVector_open_file(path);
+  assert(Vector_count((Vector *)vector) == 10);
+  assert(IntVector_get(vector, 9) == 27);
+  Vector_clear((Vector *)vector);
+  Vector_free((Vector *)vector);
+  vector = IntVector_open_file(path);
+  assert(Vector_count((Vector *)vector) == 0);
+  IntVector_add(vector, 5);
+  assert(IntVector_get(vector, 0) == 5);
+  Vector_free((Vector *)vector);
+
+  // Arrays are the same, with their size given up front.
+  unlink(path);
+  _make_temp_file(path);
+  IntArray *array = IntArray_open_file(path, 1000);
+  assert(array != NULL);
+  assert(Array_count((Array *)array) == 1000);
+  assert(IntArray_get(array, 999) == 0);
+  for (int i = 0; i < 1000; i++) {
+    IntArray_set(array, i, -i);
+  }
+  assert(Array_sync((Array *)array));
+  Array_free((Array *)array);
+  assert(Array_open_file(path, 0, sizeof(char)) == NULL);
+  array = IntArray_open_file(path, 0);
+  assert(Array_count((Array *)array) == 1000);
+  assert(IntArray_get(array, 123) == -123);
+  array = (IntArray *)Array_realloc((Array *)array, 5000);
+  assert(array != NULL);
+  assert(IntArray_get(array, 999) == -999 && IntArray_get(array, 4999) == 0);
+  IntArray_get_indexer(array, (IntIndexer *)&indexer);
+  assert(indexer.size(&indexer) == 5000);
+  Array_free((Array *)array);
+  array = IntArray_open_file(path, 500);
+  assert(Array_count((Array *)array) == 500);
+  assert(IntArray_get(array, 499) == -499);
+  Array_free((Array *)array);
+  unlink(path);
+  // Without a count, a missing file isn't created.
+  assert(IntArray_open_file(path, 0) == NULL);
+  assert(access(path, F_OK) != 0);
+}
+
 int vector_tests(void) {
   return test_vector_basics() || test_vector_delete() || test_vector_insert() ||
-         test_vector_update() || test_vector_copy();
+         test_vector_update() || test_vector_copy() ||
+         test_vector_sort_kernels() || test_vector_sort() ||
+         test_vector_parallel_sort() || test_vector_growth() ||
+         test_vector_small() || test_vector_file() ||
+         test_vector_typed();
 }
 
 void test_string_foreach(char **item) { /*...*/ }
@@ -3,6 +3,7 @@
 
 #include "../../common/public/vector.h"
 #include "../../common/public/collections.h"
+#include "../../common/public/sort.h"
 #include "../macros.h"
 
 int vector_tests(void);
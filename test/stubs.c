@@ -1,18 +1,10 @@
 #include <assert.h>
+#include <pthread.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
-#include "../common/public/iterator.h"
-#include "../common/public/map.h"
-
-#ifndef TESTING
-#else
-Map *_malloc_log;
-bool _malloc_logging = false;
-char _malloc_reference[1000] = "";
-#endif
-
 char _log_indent[1000] = "";
 
 #include "macros.h"
@@ -25,232 +17,578 @@ char _log_indent[1000] = "";
 #undef realloc
 #undef free
 
-#ifdef TESTING
+#if defined(TESTING) || defined(HEAP_PROFILE)
+// The tracker keeps its own tables, allocated with the real malloc, so
+// nothing it does comes back into it. Worker threads allocate too, so the
+// tables are only touched under _malloc_log_lock.
+//
+// TESTING builds log every allocation, to find leaks; HEAP_PROFILE builds
+// only log the ones they sample, and pass the rest straight through.
+
+// A line that allocates, and what it has allocated. Sites are interned by
+// their __FILE__ pointer and line, so a call only hashes two words instead of
+// formatting a string. Byte counts and counts are estimates when sampling.
+struct AllocSite {
+  const char *file;
+  int line;
+  const char *func;
+  size_t live_bytes;
+  size_t live_count;
+  size_t peak_bytes; // The most this site has had live at once.
+  size_t total_bytes;
+  size_t total_count;
+  size_t at_peak_bytes; // What it had live at the heap's peak.
+};
+
+// A live allocation. `ptr' is NULL in an empty slot.
 struct MemoryLog {
-  char *file_info;
+  void *ptr;
   size_t num_bytes;
+  size_t weight;  // The bytes it stands for in the profile, or 0 if unsampled.
+  uint32_t site; // Index into _alloc_sites.
 };
 
-void *malloc_ext(size_t size) {
-  LOG_FORMAT(TRACE, "malloc(%zu) called (re-entry = %s)", size,
-             _malloc_logging ? "true" : "false");
-  if (_malloc_logging) return malloc(size);
-  _malloc_logging = true;
-  struct MemoryLog log;
+// Live allocations, open-addressed by pointer with linear probing and no
+// tombstones: deleting shifts the rest of the run back.
+static pthread_mutex_t _malloc_log_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct MemoryLog *_malloc_log;
+static size_t _malloc_log_capacity; // A power of 2.
+static size_t _malloc_log_count;
+
+static struct AllocSite *_alloc_sites;
+static uint32_t _alloc_site_count;
+static uint32_t _alloc_site_capacity;
+// Site indexes + 1, open-addressed by file and line; 0 is empty.
+static uint32_t *_alloc_site_table;
+static size_t _alloc_site_table_capacity; // A power of 2.
+
+// 0 to profile every allocation.
+static size_t _heap_sample_bytes;
+// Counts down by the bytes allocated; the allocation that takes it to 0 is
+// sampled.
+static long long _heap_until_sample;
+static uint64_t _heap_random = 0x9e3779b97f4a7c15ull;
+static size_t _heap_live_bytes;
+static size_t _heap_peak_bytes;
+// The live bytes when the sites' at_peak_bytes were last taken. They're taken
+// again once the peak passes this by 1/64th, so they're at most that far off.
+static size_t _heap_snapshot_bytes;
+static const char *_heap_profile_path;
+// The caller a wrapper like Arena_malloc is allocating for, if any.
+static _Thread_local struct {
+  int depth;
+  const char *file;
+  int line;
+  const char *func;
+} _heap_caller;
+
+#define _MALLOC_LOG_INITIAL_CAPACITY 4096
+#define _ALLOC_SITE_INITIAL_CAPACITY 256
+
+static inline size_t _malloc_log_hash(const void *ptr) {
+  uint64_t key = (uint64_t)(uintptr_t)ptr;
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdull;
+  key ^= key >> 33;
+  return (size_t)key;
+}
+
+static inline size_t _alloc_site_hash(const char *file, int line) {
+  return _malloc_log_hash(file) ^ ((size_t)line * 0x9e3779b97f4a7c15ull);
+}
+
+// Gets the slot `ptr' is in, or the empty slot ending its run if it isn't.
+static struct MemoryLog *_malloc_log_slot(const void *ptr) {
+  size_t mask = _malloc_log_capacity - 1;
+  size_t i = _malloc_log_hash(ptr) & mask;
+  while (_malloc_log[i].ptr && _malloc_log[i].ptr != ptr) {
+    i = (i + 1) & mask;
+  }
+  return &_malloc_log[i];
+}
+
+static void _malloc_log_grow(void) {
+  struct MemoryLog *old = _malloc_log;
+  size_t old_capacity = _malloc_log_capacity;
+  _malloc_log_capacity *= 2;
+  _malloc_log = calloc(_malloc_log_capacity, sizeof(struct MemoryLog));
+  assert(_malloc_log && "Unable to grow the malloc log.");
+  for (size_t i = 0; i < old_capacity; i++) {
+    if (old[i].ptr) {
+      *_malloc_log_slot(old[i].ptr) = old[i];
+    }
+  }
+  free(old);
+}
+
+static void _malloc_log_add(void *ptr, size_t num_bytes, size_t weight,
+                            uint32_t site) {
+  if (2 * (_malloc_log_count + 1) > _malloc_log_capacity) {
+    _malloc_log_grow();
+  }
+  struct MemoryLog *slot = _malloc_log_slot(ptr);
+  assert(!slot->ptr && "Allocated memory is already in the malloc log.");
+  slot->ptr = ptr;
+  slot->num_bytes = num_bytes;
+  slot->weight = weight;
+  slot->site = site;
+  _malloc_log_count++;
+}
+
+// Empties `slot', moving back any entry later in the run that
+// would otherwise no longer be found.
+static void _malloc_log_delete(struct MemoryLog *slot) {
+  size_t mask = _malloc_log_capacity - 1;
+  size_t hole = slot - _malloc_log;
+  for (size_t i = (hole + 1) & mask; _malloc_log[i].ptr; i = (i + 1) & mask) {
+    size_t home = _malloc_log_hash(_malloc_log[i].ptr) & mask;
+    // Move it back if its home isn't cyclically in (hole, i].
+    if (((i - home) & mask) >= ((i - hole) & mask)) {
+      _malloc_log[hole] = _malloc_log[i];
+      hole = i;
+    }
+  }
+  _malloc_log[hole].ptr = NULL;
+  _malloc_log_count--;
+}
+
+// Gets the index of the site for `file' and `line', adding it if it's new.
+static uint32_t _alloc_site(const char *file, int line, const char *func) {
+  size_t mask = _alloc_site_table_capacity - 1;
+  size_t i = _alloc_site_hash(file, line) & mask;
+  for (uint32_t entry; (entry = _alloc_site_table[i]); i = (i + 1) & mask) {
+    struct AllocSite *site = &_alloc_sites[entry - 1];
+    if (site->file == file && site->line == line) {
+      return entry - 1;
+    }
+  }
+  if (_alloc_site_count == _alloc_site_capacity) {
+    _alloc_site_capacity *= 2;
+    _alloc_sites =
+        realloc(_alloc_sites, _alloc_site_capacity * sizeof(struct AllocSite));
+    assert(_alloc_sites && "Unable to grow the allocation sites.");
+  }
+  uint32_t index = _alloc_site_count++;
+  _alloc_sites[index] = (struct AllocSite){file, line, func};
+  if (2 * _alloc_site_count > _alloc_site_table_capacity) {
+    free(_alloc_site_table);
+    _alloc_site_table_capacity *= 2;
+    mask = _alloc_site_table_capacity - 1;
+    _alloc_site_table = calloc(_alloc_site_table_capacity, sizeof(uint32_t));
+    assert(_alloc_site_table && "Unable to grow the allocation sites.");
+    for (uint32_t s = 0; s < _alloc_site_count; s++) {
+      i = _alloc_site_hash(_alloc_sites[s].file, _alloc_sites[s].line) & mask;
+      while (_alloc_site_table[i]) {
+        i = (i + 1) & mask;
+      }
+      _alloc_site_table[i] = s + 1;
+    }
+  } else {
+    _alloc_site_table[i] = index + 1;
+  }
+  return index;
+}
+
+// Gets how many allocations a sample of `weight' bytes stands for.
+static inline size_t _heap_count(size_t num_bytes, size_t weight) {
+  return num_bytes > 0 && weight > num_bytes ? weight / num_bytes : 1;
+}
+
+static void _heap_snapshot(void) {
+  for (uint32_t s = 0; s < _alloc_site_count; s++) {
+    _alloc_sites[s].at_peak_bytes = _alloc_sites[s].live_bytes;
+  }
+  _heap_snapshot_bytes = _heap_live_bytes;
+}
+
+// Decides whether to sample an allocation of `num_bytes'. Returns the bytes
+// it stands for if so, and 0 if not. Allocations at least as big as the
+// interval are always sampled; smaller ones about once per interval, which
+// they then stand for.
+static size_t _heap_weight(size_t num_bytes) {
+  if (_heap_sample_bytes == 0 || num_bytes >= _heap_sample_bytes) {
+    return num_bytes;
+  }
+  if ((_heap_until_sample -= num_bytes) > 0) {
+    return 0;
+  }
+  // The next interval is uniform in [1, 2 * _heap_sample_bytes], so samples
+  // don't fall in step with allocations that repeat.
+  _heap_random ^= _heap_random << 13;
+  _heap_random ^= _heap_random >> 7;
+  _heap_random ^= _heap_random << 17;
+  _heap_until_sample = 1 + _heap_random % (2 * _heap_sample_bytes);
+  return _heap_sample_bytes;
+}
+
+static void _heap_allocated(uint32_t index, size_t num_bytes, size_t weight) {
+  struct AllocSite *site = &_alloc_sites[index];
+  size_t count = _heap_count(num_bytes, weight);
+  site->live_bytes += weight;
+  site->live_count += count;
+  site->total_bytes += weight;
+  site->total_count += count;
+  if (site->live_bytes > site->peak_bytes) {
+    site->peak_bytes = site->live_bytes;
+  }
+  _heap_live_bytes += weight;
+  if (_heap_live_bytes > _heap_peak_bytes) {
+    _heap_peak_bytes = _heap_live_bytes;
+    if (_heap_peak_bytes - _heap_snapshot_bytes >= _heap_snapshot_bytes / 64) {
+      _heap_snapshot();
+    }
+  }
+}
+
+static void _heap_freed(const struct MemoryLog *log) {
+  struct AllocSite *site = &_alloc_sites[log->site];
+  site->live_bytes -= log->weight;
+  site->live_count -= _heap_count(log->num_bytes, log->weight);
+  _heap_live_bytes -= log->weight;
+}
+
+// Logs an allocation, if it's sampled or has to be checked for leaks.
+static void _malloc_log_allocated(void *data, size_t num_bytes,
+                                  const char *file, int line,
+                                  const char *func) {
+  size_t weight = _heap_weight(num_bytes);
+#ifndef TESTING
+  if (weight == 0) {
+    return;
+  }
+#endif
+  if (_heap_caller.depth > 0) {
+    file = _heap_caller.file;
+    line = _heap_caller.line;
+    func = _heap_caller.func;
+  }
+  uint32_t site = _alloc_site(file, line, func);
+  _malloc_log_add(data, num_bytes, weight, site);
+  if (weight > 0) {
+    _heap_allocated(site, num_bytes, weight);
+  }
+}
+
+static void _heap_profile_dump_at_exit(void) {
+  if (!heap_profile_dump(_heap_profile_path)) {
+    fprintf(stderr, "Unable to write the heap profile to %s\n",
+            _heap_profile_path);
+  }
+}
+
+static void _malloc_log_init(void) {
+  _malloc_log_capacity = _MALLOC_LOG_INITIAL_CAPACITY;
+  _malloc_log = calloc(_malloc_log_capacity, sizeof(struct MemoryLog));
+  _alloc_site_capacity = _ALLOC_SITE_INITIAL_CAPACITY;
+  _alloc_sites = malloc(_alloc_site_capacity * sizeof(struct AllocSite));
+  _alloc_site_table_capacity = 2 * _ALLOC_SITE_INITIAL_CAPACITY;
+  _alloc_site_table = calloc(_alloc_site_table_capacity, sizeof(uint32_t));
+  assert(_malloc_log && _alloc_sites && _alloc_site_table &&
+         "Unable to initialize malloc logging.");
+  const char *sample = getenv("HEAPPROFILE_SAMPLE");
+  if (sample) {
+    _heap_sample_bytes = _heap_until_sample = strtoull(sample, NULL, 10);
+  }
+  if ((_heap_profile_path = getenv("HEAPPROFILE"))) {
+    atexit(_heap_profile_dump_at_exit);
+  }
+}
+
+#ifdef TESTING
+// Fills `num_bytes' from `offset' on with a pattern that stands out, to
+// detect uninitialized and already-freed memory.
+static void _malloc_poison(void *data, size_t offset, size_t num_bytes) {
+  for (size_t i = offset >> 2; i < num_bytes >> 2; i++) {
+    ((unsigned int *)data)[i] = 0xDEADBEEF;
+  }
+}
+
+void *malloc_ext(size_t size, const char *file, int line, const char *func) {
+  LOG_FORMAT(TRACE, "malloc(%zu) called from %s:%d", size, file, line);
   void *data;
   size += (4 - (size & 3)) & 3; // align to 4 bytes
-  LOG_FORMAT(TRACE, "Aligned to %zu bytes", size);
   if ((data = malloc(size)) == NULL) goto error;
-  LOG_FORMAT(TRACE, "NEW allocated address: %p", data);
-  LOG(TRACE, "Overwriting memory...");
-  for (int i = 0; i < size >> 2; i++) {
-    ((unsigned int*)data)[i] = 0xDEADBEEF; // to detect uninitialized memory
-  }
-  LOG(TRACE, "Allocating new file_info string...");
-  if ((log.file_info = calloc(strlen(_malloc_reference) + 1, 1)) == NULL) {
-    goto error_data;
-  }
-  strcpy(log.file_info, _malloc_reference);
-  log.num_bytes = size;
-  LOG_FORMAT(TRACE, "Adding new memory log (num_bytes=%zu, file_info=%s)...",
-             log.num_bytes, log.file_info);
-  if (!Map_add(_malloc_log, &data, &log).key) {
-    goto error_file_info;
-  }
-  _malloc_logging = false;
+  _malloc_poison(data, 0, size);
+  pthread_mutex_lock(&_malloc_log_lock);
+  if (!_malloc_log) _malloc_log_init();
+  _malloc_log_allocated(data, size, file, line, func);
+  pthread_mutex_unlock(&_malloc_log_lock);
   return data;
-// error_map:
-//   Map_delete(_malloc_log, &data);
-error_file_info:
-  free(log.file_info);
-error_data:
-  free(data);
 error:
-  _malloc_logging = false;
   assert(0 && "malloc failed.");
   return NULL;
 }
 
-void *calloc_ext(size_t num, size_t size) {
-  LOG_FORMAT(TRACE, "calloc(%zu, %zu) called (e-entry = %s)", num, size,
-             _malloc_logging ? "true" : "false");
-  if (_malloc_logging) return calloc(num, size);
-  LOG_INDENT();
-  _malloc_logging = true;
-  struct MemoryLog log;
+void *calloc_ext(size_t num, size_t size, const char *file, int line,
+                 const char *func) {
+  LOG_FORMAT(TRACE, "calloc(%zu, %zu) called from %s:%d", num, size, file,
+             line);
   void *data;
   size += (4 - (size & 3)) & 3; // align to 4 bytes
-  LOG_FORMAT(TRACE, "Aligned to %zu bytes", size);
   if (NULL == (data = calloc(num, size))) { // automatically initializes memory to 0
     goto error;
   }
-  LOG_FORMAT(TRACE, "NEW allocated address: %p", data);
-  LOG(TRACE, "Allocating new file_info string...");
-  if (NULL == (log.file_info = calloc(strlen(_malloc_reference) + 1, 1))) {
-    goto error_data;
-  }
-  strcpy(log.file_info, _malloc_reference);
-  log.num_bytes = num * size;
-  LOG_FORMAT(TRACE, "Adding new memory log (num_bytes=%zu, file_info=%s)...",
-             log.num_bytes, log.file_info);
-  if (!Map_add(_malloc_log, &data, &log).key) {
-    goto error_file_info;
-  }
-  _malloc_logging = false;
-  LOG_DEINDENT();
+  pthread_mutex_lock(&_malloc_log_lock);
+  if (!_malloc_log) _malloc_log_init();
+  _malloc_log_allocated(data, num * size, file, line, func);
+  pthread_mutex_unlock(&_malloc_log_lock);
   return data;
-// error_map:
-//   Map_delete(_malloc_log, &data);
-error_file_info:
-  free(log.file_info);
-error_data:
-  free(data);
 error:
-  _malloc_logging = false;
-  LOG_DEINDENT();
   assert(0 && "calloc failed.");
   return NULL;
 }
 
-void *realloc_ext(void *ptr, size_t size) {
-  LOG_FORMAT(TRACE, "realloc(%p, %zu) called (e-entry = %s)", ptr, size,
-             _malloc_logging ? "true" : "false");
-  if (_malloc_logging) return realloc(ptr, size);
-  LOG_INDENT();
-  _malloc_logging = true;
-  struct MemoryLog log;
-  log.file_info = NULL;
+void *realloc_ext(void *ptr, size_t size, const char *file, int line,
+                  const char *func) {
+  LOG_FORMAT(TRACE, "realloc(%p, %zu) called from %s:%d", ptr, size, file,
+             line);
+  size_t old_bytes = 0;
   void *data;
+  pthread_mutex_lock(&_malloc_log_lock);
+  if (!_malloc_log) _malloc_log_init();
   size += (4 - (size & 3)) & 3; // align to 4 bytes
-  LOG_FORMAT(TRACE, "Aligned to %zu bytes", size);
   if (ptr != NULL) {
-    assert(Map_contains_key(_malloc_log, &ptr) && "Tried to realloc already-freed memory.");
-    Map_get(_malloc_log, &ptr, &log);
-    LOG_FORMAT(TRACE, "Existing element being reallocated (%p): (num_bytes=%zu, file_info=%s)",
-              ptr, log.num_bytes, log.file_info);
-    if (log.num_bytes > size) {
-      LOG(TRACE, "Overwriting shrunken memory tail...");
-      // Overwrite trailing memory before shrinking to detect already-freed memory:
-      for (int i = log.num_bytes >> 2; i < size >> 2; i++) {
-        ((unsigned int*)data)[i] = 0xDEADBEEF; // to detect uninitialized memory
-      }
-    }
+    struct MemoryLog *slot = _malloc_log_slot(ptr);
+    assert(slot->ptr && "Tried to realloc already-freed memory.");
+    old_bytes = slot->num_bytes;
   }
   if (NULL == (data = malloc(size))) goto error; // don't use realloc, to simulate semantics on error
   if (ptr != NULL) {
-    memcpy(data, ptr, log.num_bytes);
-  }
-  LOG_FORMAT(TRACE, "NEW reallocated address: %p", data);
-  LOG(TRACE, "Reallocating file info...");
-  if (NULL == (log.file_info = realloc(log.file_info, strlen(_malloc_reference) + 1))) {
-    goto error_data;
-  }
-  strcpy(log.file_info, _malloc_reference);
-  log.num_bytes = size;
-  LOG_FORMAT(TRACE, "Adding new log element (num_bytes=%zu, file_info=%s)...", log.num_bytes, log.file_info);
-  if (!Map_add(_malloc_log, &data, &log).key) {
-    goto error_file_info;
+    memcpy(data, ptr, old_bytes < size ? old_bytes : size);
   }
+  _malloc_poison(data, old_bytes, size);
   if (ptr != NULL) {
-    LOG_FORMAT(TRACE, "Removing old map element and deleting old block (%p)", ptr);
-    Map_delete(_malloc_log, &ptr); // Remove the old entry.
-    free(ptr); // freeing old memory instead.
+    // Remove the old entry, freeing the old memory instead.
+    struct MemoryLog *slot = _malloc_log_slot(ptr);
+    _heap_freed(slot);
+    _malloc_log_delete(slot);
+    _malloc_poison(ptr, 0, old_bytes);
+    free(ptr);
   }
-  _malloc_logging = false;
-  LOG_DEINDENT();
+  _malloc_log_allocated(data, size, file, line, func);
+  pthread_mutex_unlock(&_malloc_log_lock);
   return data;
-// error_map:
-//   Map_delete(_malloc_log, &data);
-error_file_info:
-  free(log.file_info);
-error_data:
-  free(data);
 error:
-  _malloc_logging = false;
-  LOG_DEINDENT();
+  pthread_mutex_unlock(&_malloc_log_lock);
   assert(0 && "realloc failed.");
   return NULL;
 }
 
-void free_ext(void *ptr) {
-  LOG_FORMAT(TRACE, "free(%p) called (e-entry = %s)", ptr,
-             _malloc_logging ? "true" : "false");
-  if (_malloc_logging) {
-    free(ptr);
-    return;
-  }
-  LOG_INDENT();
+void free_ext(void *ptr, const char *file, int line, const char *func) {
+  LOG_FORMAT(TRACE, "free(%p) called from %s:%d", ptr, file, line);
   if (!ptr) return;
-  _malloc_logging = true;
-  struct MemoryLog log;
-  // TODO: Un-comment
-  assert(Map_contains_key(_malloc_log, &ptr) && "Tried to free already-freed memory.");
-  Map_get(_malloc_log, &ptr, &log);
-  LOG_FORMAT(TRACE, "Element being freed (%p): (num_bytes=%zu, file_info=%s)",
-             ptr, log.num_bytes, log.file_info);
+  pthread_mutex_lock(&_malloc_log_lock);
+  struct MemoryLog *slot = _malloc_log_slot(ptr);
+  assert(slot->ptr && "Tried to free already-freed memory.");
   // Overwrite memory before releasing to detect already-freed memory:
-  for (int i = 0; i < log.num_bytes >> 2; i++) {
-    ((unsigned int*)ptr)[i] = 0xDEADBEEF; // to detect uninitialized memory
-  }
-  Map_delete(_malloc_log, &ptr);
-  free(log.file_info);
+  _malloc_poison(ptr, 0, slot->num_bytes);
+  _heap_freed(slot);
+  _malloc_log_delete(slot);
+  pthread_mutex_unlock(&_malloc_log_lock);
   free(ptr);
-  _malloc_logging = false;
-  LOG_DEINDENT();
 }
 
-void _Map_malloc_log_key_print(const Map *self, char *str, const void **elem) {
-  struct MemoryLog log;
-  unsigned char byte[4];
-  unsigned char *buffer = (unsigned char*)*elem;
-  str[0] = '\0';
-  sprintf(str, "Entry for allocated memory location (void*)%p -> ", *elem);
-  Map_get(self, elem, &log);
-  size_t i;
-  for (i = 0; i < log.num_bytes; i++) {
-    sprintf((char *)byte, " %02x", ((unsigned char*)buffer)[i]);
-    if (i % 32 == 0) strcat(str, "\n");
-    strcat(str, (char*)byte);
-    if (i % 8 == 7) strcat(str, "  ");
-    if (i % 4 == 3) strcat(str, " ");
+void init_malloc_logging(void) {
+  LOG(TRACE, "init_malloc_logging()");
+  pthread_mutex_lock(&_malloc_log_lock);
+  if (!_malloc_log) _malloc_log_init();
+  pthread_mutex_unlock(&_malloc_log_lock);
+}
+
+size_t find_leaks(void) {
+  pthread_mutex_lock(&_malloc_log_lock);
+  for (size_t i = 0; i < _malloc_log_capacity; i++) {
+    const struct MemoryLog *log = &_malloc_log[i];
+    if (log->ptr) {
+      const struct AllocSite *site = &_alloc_sites[log->site];
+      printf("***** Memory leak detected, %zu bytes:\n      In malloc called "
+             "from %s:%d\n",
+             log->num_bytes, site->file, site->line);
+    }
   }
-  strcat(str, " \n(");
-  str += strlen(str);
-  for (i = 0; i < log.num_bytes; i++) {
-    str[i] = buffer[i] >= ' ' && buffer[i] <= '~' ? buffer[i] : '.';
+  size_t count = _malloc_log_count;
+  pthread_mutex_unlock(&_malloc_log_lock);
+  return count;
+}
+
+TEST(find_leaks) {
+  assert(find_leaks() == 0);
+}
+#else
+// Only sampled allocations are logged; anything not found was passed
+// through.
+
+void *malloc_ext(size_t size, const char *file, int line, const char *func) {
+  void *data = malloc(size);
+  if (data) {
+    pthread_mutex_lock(&_malloc_log_lock);
+    if (!_malloc_log) _malloc_log_init();
+    _malloc_log_allocated(data, size, file, line, func);
+    pthread_mutex_unlock(&_malloc_log_lock);
   }
-  str[i] = 0;
-  strcat(str, ")\n");
+  return data;
 }
 
-void _Map_malloc_log_value_print(const Map *self, char *str, const struct MemoryLog *elem) {
-  sprintf(str, "MemoryLog { num_bytes: %zu file_info: \"%s\" }", elem->num_bytes, elem->file_info);
+void *calloc_ext(size_t num, size_t size, const char *file, int line,
+                 const char *func) {
+  void *data = calloc(num, size);
+  if (data) {
+    pthread_mutex_lock(&_malloc_log_lock);
+    if (!_malloc_log) _malloc_log_init();
+    _malloc_log_allocated(data, num * size, file, line, func);
+    pthread_mutex_unlock(&_malloc_log_lock);
+  }
+  return data;
 }
 
-void init_malloc_logging(void) {
-  LOG(TRACE, "init_malloc_logging()");
-  LOG_INDENT();
-  _malloc_logging = true;
-  _malloc_log = Map_alloc(&UnsignedLongKeyInfo, sizeof(struct MemoryLog));
-  Map_print_key_fn(_malloc_log, (void(*)(const Map*,char*,const void*))_Map_malloc_log_key_print);
-  Map_print_value_fn(_malloc_log, (void(*)(const Map*,char*,const void*))_Map_malloc_log_value_print);
-  assert(_malloc_log && "Unable to initialize malloc logging.");
-  _malloc_logging = false;
-  LOG_DEINDENT();
+void *realloc_ext(void *ptr, size_t size, const char *file, int line,
+                  const char *func) {
+  // Held across the realloc, so no other thread can be handed `ptr''s
+  // address and log it before its old entry is gone.
+  pthread_mutex_lock(&_malloc_log_lock);
+  if (!_malloc_log) _malloc_log_init();
+  struct MemoryLog *slot = ptr ? _malloc_log_slot(ptr) : NULL;
+  void *data = realloc(ptr, size);
+  if (data) {
+    if (slot && slot->ptr) {
+      _heap_freed(slot);
+      _malloc_log_delete(slot);
+    }
+    _malloc_log_allocated(data, size, file, line, func);
+  }
+  pthread_mutex_unlock(&_malloc_log_lock);
+  return data;
 }
 
-void find_leaks_for_each(void *elem) {
-  struct MemoryLog log = *(struct MemoryLog *)elem;
-  printf("***** Memory leak detected, %zu bytes:\n      In malloc called from "
-         "%s\n",
-         log.num_bytes, log.file_info);
+void free_ext(void *ptr, const char *file, int line, const char *func) {
+  if (ptr) {
+    pthread_mutex_lock(&_malloc_log_lock);
+    if (_malloc_log) {
+      struct MemoryLog *slot = _malloc_log_slot(ptr);
+      if (slot->ptr) {
+        _heap_freed(slot);
+        _malloc_log_delete(slot);
+      }
+    }
+    pthread_mutex_unlock(&_malloc_log_lock);
+  }
+  free(ptr);
 }
+#endif // TESTING
 
-TEST(find_leaks) {
-  Iterator iter;
-  Map_get_value_iterator(_malloc_log, &iter);
-  for_each(&iter, find_leaks_for_each);
+void heap_profile_caller(const char *file, int line, const char *func) {
+  if (_heap_caller.depth++ == 0) {
+    _heap_caller.file = file;
+    _heap_caller.line = line;
+    _heap_caller.func = func;
+  }
+}
 
-  assert(Map_count(_malloc_log) == 0);
+void *heap_profile_caller_end(void *ptr) {
+  _heap_caller.depth--;
+  return ptr;
 }
-#endif
+
+void heap_profile_sample(size_t sample_bytes) {
+  pthread_mutex_lock(&_malloc_log_lock);
+  _heap_sample_bytes = sample_bytes;
+  _heap_until_sample = sample_bytes;
+  pthread_mutex_unlock(&_malloc_log_lock);
+}
+
+// Orders sites by bytes live at the peak, then by total bytes.
+static int _heap_site_compare(const void *a, const void *b) {
+  const struct AllocSite *x = &_alloc_sites[*(const uint32_t *)a];
+  const struct AllocSite *y = &_alloc_sites[*(const uint32_t *)b];
+  if (x->at_peak_bytes != y->at_peak_bytes) {
+    return x->at_peak_bytes < y->at_peak_bytes ? 1 : -1;
+  }
+  if (x->total_bytes != y->total_bytes) {
+    return x->total_bytes < y->total_bytes ? 1 : -1;
+  }
+  return 0;
+}
+
+static void _heap_profile_report(FILE *out, size_t max_sites) {
+  size_t total_bytes = 0, total_count = 0;
+  for (uint32_t s = 0; s < _alloc_site_count; s++) {
+    total_bytes += _alloc_sites[s].total_bytes;
+    total_count += _alloc_sites[s].total_count;
+  }
+  fprintf(out,
+          "Heap profile: %zu bytes live at the peak, %zu now; %zu bytes in "
+          "%zu allocations in all",
+          _heap_peak_bytes, _heap_live_bytes, total_bytes, total_count);
+  if (_heap_sample_bytes) {
+    fprintf(out, " (estimated, sampled every %zu bytes)", _heap_sample_bytes);
+  }
+  fprintf(out, "\n%12s %12s %12s %14s %10s  %s\n", "at peak", "site peak",
+          "live", "total", "count", "site");
+  uint32_t *order = malloc((_alloc_site_count + 1) * sizeof(uint32_t));
+  if (!order) {
+    return;
+  }
+  for (uint32_t s = 0; s < _alloc_site_count; s++) {
+    order[s] = s;
+  }
+  qsort(order, _alloc_site_count, sizeof(uint32_t), _heap_site_compare);
+  size_t count = max_sites && max_sites < _alloc_site_count
+                     ? max_sites
+                     : _alloc_site_count;
+  for (size_t i = 0; i < count; i++) {
+    const struct AllocSite *site = &_alloc_sites[order[i]];
+    if (site->total_bytes == 0) {
+      break;
+    }
+    fprintf(out, "%12zu %12zu %12zu %14zu %10zu  %s:%d (%s)\n",
+            site->at_peak_bytes, site->peak_bytes, site->live_bytes,
+            site->total_bytes, site->total_count, site->file, site->line,
+            site->func);
+  }
+  free(order);
+}
+
+void heap_profile_report(FILE *out, size_t max_sites) {
+  pthread_mutex_lock(&_malloc_log_lock);
+  _heap_profile_report(out, max_sites);
+  pthread_mutex_unlock(&_malloc_log_lock);
+}
+
+void heap_profile_write_folded(FILE *out) {
+  pthread_mutex_lock(&_malloc_log_lock);
+  for (uint32_t s = 0; s < _alloc_site_count; s++) {
+    const struct AllocSite *site = &_alloc_sites[s];
+    if (site->at_peak_bytes > 0) {
+      fprintf(out, "%s;%s;%s:%d %zu\n", site->file, site->func, site->file,
+              site->line, site->at_peak_bytes);
+    }
+  }
+  pthread_mutex_unlock(&_malloc_log_lock);
+}
+
+bool heap_profile_dump(const char *path) {
+  size_t length = strlen(path);
+  char *folded_path = malloc(length + sizeof(".folded"));
+  if (!folded_path) {
+    return false;
+  }
+  memcpy(folded_path, path, length);
+  memcpy(folded_path + length, ".folded", sizeof(".folded"));
+  FILE *report = fopen(path, "w");
+  FILE *folded = fopen(folded_path, "w");
+  free(folded_path);
+  bool ok = report && folded;
+  if (ok) {
+    heap_profile_report(report, 0);
+    heap_profile_write_folded(folded);
+    ok = !ferror(report) && !ferror(folded);
+  }
+  if (report) {
+    ok = fclose(report) == 0 && ok;
+  }
+  if (folded) {
+    ok = fclose(folded) == 0 && ok;
+  }
+  return ok;
+}
+#endif // TESTING || HEAP_PROFILE
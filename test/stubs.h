@@ -6,23 +6,28 @@
 #include <stdio.h>
 #include <string.h>
 
-enum {
-    TRACE,
-    DEBUG,
-    INFO,
-    WARN,
-    ERROR,
-    FATAL,
-};
+#include "../common/public/arena.h"
+#include "../common/public/concurrency.h"
+#include "../common/public/log.h"
 
 extern char _log_indent[];
 
+// Whether messages at `level' are compiled in. LOGLEVEL is a constant, so for
+// levels below it every LOG_* call, and its arguments, compile to nothing.
+#define LOG_ENABLED(level) ((level) >= LOGLEVEL)
+
 #define LOGARGS(level, format)                                                 \
 "%-5s %40s:%-5d: %s" format "\n", #level, __FILE__, __LINE__, _log_indent
+// Goes to the asynchronous logger while it runs (see common/public/log.h), and
+// straight to stdout, or stderr from WARN up, while it doesn't.
 #define LOG_FORMAT(level, format, ...)                                         \
   do {                                                                         \
-    if ((level) >= LOGLEVEL) {                                                 \
-      if ((level) < WARN) {                                                    \
+    if (LOG_ENABLED(level)) {                                                  \
+      static LogSite _log_site = LOG_SITE_INIT(format);                        \
+      if (Log_running()) {                                                     \
+        Log_write(&_log_site, (level),                                         \
+                  LOG_ENABLED(DEBUG) ? strlen(_log_indent) : 0, __VA_ARGS__);  \
+      } else if ((level) < WARN) {                                             \
         printf(LOGARGS(level, format), __VA_ARGS__);                           \
       } else {                                                                 \
         fprintf(stderr, LOGARGS(level, format), __VA_ARGS__);                  \
@@ -31,43 +36,92 @@ extern char _log_indent[];
   } while (0)
 #define LOG_FORMAT_INDENT(level, format, ...)                                  \
   do {                                                                         \
-    if ((level) >= LOGLEVEL) {                                                 \
+    if (LOG_ENABLED(level)) {                                                  \
       LOG_INDENT();                                                            \
       LOG_FORMAT(level, format, __VA_ARGS__);                                  \
       LOG_DEINDENT();                                                          \
     }                                                                          \
   } while (0)
 #define LOG(level, message) LOG_FORMAT(level, "%s", message)
+// Indentation nests the TRACE and DEBUG messages of calls within calls, so
+// it's only kept when those are compiled in.
 #define LOG_INDENT()                                                           \
   do {                                                                         \
-    strcat(_log_indent, "  ");                                                 \
+    if (LOG_ENABLED(DEBUG)) {                                                  \
+      strcat(_log_indent, "  ");                                               \
+    }                                                                          \
   } while (0)
 #define LOG_DEINDENT()                                                         \
   do {                                                                         \
-    _log_indent[strlen(_log_indent) - 2] = '\0';                               \
+    if (LOG_ENABLED(DEBUG)) {                                                  \
+      _log_indent[strlen(_log_indent) - 2] = '\0';                             \
+    }                                                                          \
   } while (0)
 
+// Release builds (-D RELEASE) keep only warnings and errors.
 #ifndef TESTING
 #ifndef LOGLEVEL
+#ifdef RELEASE
+#define LOGLEVEL WARN
+#else
 #define LOGLEVEL INFO
 #endif
+#endif
 #else
 #ifndef LOGLEVEL
 #define LOGLEVEL DEBUG
 #endif
-void *malloc_ext(size_t size);
-void *calloc_ext(size_t num, size_t size);
-void *realloc_ext(void * ptr, size_t size);
-void free_ext(void *ptr);
 void init_malloc_logging(void);
+// Prints every allocation not yet freed, with where it was made. Returns how
+// many there are.
+size_t find_leaks(void);
 int test_find_leaks(void);
-extern char _malloc_reference[1000];
-#define ALLOC_REF sprintf(_malloc_reference, "%s:%d", __FILE__, __LINE__)
-// These macros hide the stdlib.h versions:
-#define malloc(size) (ALLOC_REF, malloc_ext(size))
-#define calloc(num, size) (ALLOC_REF, calloc_ext(num, size))
-#define realloc(ptr, size) (ALLOC_REF, realloc_ext(ptr, size))
-#define free(ptr) (ALLOC_REF, free_ext(ptr))
 #endif // TESTING
 
+// TESTING builds track every allocation for leaks. They, and -D HEAP_PROFILE
+// builds, also profile the heap by call site. Set HEAPPROFILE to a path to
+// have the report written there at exit, and HEAPPROFILE_SAMPLE to sample
+// about once every that many bytes instead of every allocation. Threads can
+// allocate and free concurrently; the tracker takes a lock for each call.
+#if defined(TESTING) || defined(HEAP_PROFILE)
+void *malloc_ext(size_t size, const char *file, int line, const char *func);
+void *calloc_ext(size_t num, size_t size, const char *file, int line,
+                 const char *func);
+void *realloc_ext(void *ptr, size_t size, const char *file, int line,
+                  const char *func);
+void free_ext(void *ptr, const char *file, int line, const char *func);
+// Samples about once every `sample_bytes' allocated, or every allocation if
+// it's 0. Sampled allocations stand in for the bytes between samples.
+void heap_profile_sample(size_t sample_bytes);
+// Prints the `max_sites' call sites with the most bytes live at the peak, or
+// all of them if it's 0, with their live, peak and total bytes and counts.
+void heap_profile_report(FILE *out, size_t max_sites);
+// Writes the bytes each site had live at the peak as folded stacks of file,
+// function and line, which flamegraph.pl takes as is.
+void heap_profile_write_folded(FILE *out);
+// Writes the report to `path', and the folded stacks to `path'.folded.
+// Returns false if either can't be written.
+bool heap_profile_dump(const char *path);
+// These macros hide the stdlib.h versions:
+#define malloc(size) malloc_ext(size, __FILE__, __LINE__, __func__)
+#define calloc(num, size) calloc_ext(num, size, __FILE__, __LINE__, __func__)
+#define realloc(ptr, size) realloc_ext(ptr, size, __FILE__, __LINE__, __func__)
+#define free(ptr) free_ext(ptr, __FILE__, __LINE__, __func__)
+// Marks the allocations until heap_profile_caller_end as made for the caller
+// at `file' and `line', unless an outer call already has.
+void heap_profile_caller(const char *file, int line, const char *func);
+void *heap_profile_caller_end(void *ptr);
+// The allocators that wrap malloc charge it to their callers, so the profile
+// shows which container the memory was for. Their definitions put their names
+// in parentheses to keep these from expanding.
+#define HEAP_PROFILE_CALLER(fn, first, ...)                                    \
+  heap_profile_caller_end(                                                     \
+      fn((heap_profile_caller(__FILE__, __LINE__, __func__), (first)),         \
+         ##__VA_ARGS__))
+#define Arena_malloc(...) HEAP_PROFILE_CALLER(Arena_malloc, __VA_ARGS__)
+#define Arena_calloc(...) HEAP_PROFILE_CALLER(Arena_calloc, __VA_ARGS__)
+#define Arena_realloc(...) HEAP_PROFILE_CALLER(Arena_realloc, __VA_ARGS__)
+#define CacheLine_alloc(...) HEAP_PROFILE_CALLER(CacheLine_alloc, __VA_ARGS__)
+#endif // TESTING || HEAP_PROFILE
+
 #endif // TEST_STUBS_H__
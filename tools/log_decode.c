@@ -0,0 +1,23 @@
+#include <stdio.h>
+
+#include "../common/public/log.h"
+
+// Formats a log written by the asynchronous logger to stdout.
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    fprintf(stderr, "usage: %s <log file>\n", argv[0]);
+    return 2;
+  }
+  FILE *in = fopen(argv[1], "rb");
+  if (!in) {
+    perror(argv[1]);
+    return 1;
+  }
+  bool ok = Log_decode(in, stdout);
+  fclose(in);
+  if (!ok) {
+    fprintf(stderr, "%s: not a log, or cut short\n", argv[1]);
+    return 1;
+  }
+  return 0;
+}